@@ -0,0 +1,539 @@
+/**
+ * Data cache hierarchy for simulator.c.
+ *
+ * Up to three set-associative levels with LRU sets, write-back and
+ * write-allocate, sharing one line size. lookup() calls cache_access()
+ * with the virtual address and the physical address it translated to.
+ *
+ * - inclusive: a miss fills every level, evicting a line from an outer
+ *   level drops it from the inner ones (back-invalidation)
+ * - exclusive: a miss fills L1 only, a hit in an outer level moves the line
+ *   to L1 and every victim moves one level out
+ * - nine: a miss fills every level, the levels evict independently
+ *
+ * With a VIPT L1 the set comes from the virtual address. Once a way is
+ * larger than a page, the index bits above the page offset are virtual and
+ * a physical line can land in one of several sets (page colors).
+ * Hardware finds the copy in the other sets on a fill (a synonym) and
+ * drops it; page coloring keeps the virtual and physical colors equal.
+ *
+ * Every level has a fully associative LRU shadow of the same capacity, a
+ * miss the shadow hits is a conflict miss: the line was lost to the set
+ * mapping, which is what the frame placement (frames.c) changes.
+ *
+ * A page fault rewrites a whole frame, so the frame's lines are flushed
+ * from every level first (coherent DMA).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include "simulator.h"
+#include "cache.h"
+#include "checkpoint.h"
+
+struct cache_hierarchy caches = {
+    .line_size = 16,
+    .inclusion = CACHE_INCLUSIVE,
+    .vipt = false,
+    .mem_latency = 200,
+    .walk_latency = 30,
+    .levels = {
+        { .name = "L1", .size = 1024, .ways = 2, .latency = 4 },
+        { .name = "L2", .size = 4096, .ways = 4, .latency = 12 },
+        { .name = "LLC", .size = 16384, .ways = 8, .latency = 40 },
+    },
+};
+
+static const char *inclusion_names[] = { "inclusive", "exclusive", "nine" };
+static long use_clock = 0;     // Timestamps for LRU
+
+
+
+static bool is_power_of_two(int x) {
+    return x > 0 && (x & (x - 1)) == 0;
+}
+
+
+
+static bool present(int k) {
+    return caches.levels[k].size > 0;
+}
+
+
+
+/**
+ * The first level after k.
+ *
+ * @return int: The level, -1 if k is the last one.
+ */
+static int next_level(int k) {
+    for (int j = k + 1; j < CACHE_LEVELS; j++) {
+        if (present(j)) return j;
+    }
+    return -1;
+}
+
+
+
+/**
+ * Number of sets a physical line can be in, more than one only for a
+ * VIPT L1 with ways larger than a page.
+ */
+static int page_colors(int k) {
+    int lines_per_page = PAGE_SIZE / caches.line_size;
+    if (k > 0 || !caches.vipt || caches.levels[0].sets <= lines_per_page) return 1;
+    return caches.levels[0].sets / lines_per_page;
+}
+
+
+
+static int set_index(int k, int virtual_address, long line) {
+    if (k == 0 && caches.vipt) return virtual_address / caches.line_size % caches.levels[0].sets;
+    return line % caches.levels[k].sets;
+}
+
+
+
+/**
+ * Find a line in a level.
+ *
+ * @param k: The level.
+ * @param set: The set to look in, -1 for every set the line can be in.
+ * @param line: The physical line.
+ * @return The line, NULL if the level does not hold it.
+ */
+static struct cache_line *find_line(int k, int set, long line) {
+    struct cache_level *lv = &caches.levels[k];
+    int count = 1;
+    int step = 0;
+    if (set == -1) {
+        // Candidate sets share the index bits inside the page offset
+        count = page_colors(k);
+        step = lv->sets / count;
+        set = line % step;
+    }
+    for (int j = 0; j < count; j++) {
+        struct cache_line *ways = &lv->lines[(set + j * step) * lv->ways];
+        for (int w = 0; w < lv->ways; w++) {
+            if (ways[w].valid && ways[w].line == line) return &ways[w];
+        }
+    }
+    return NULL;
+}
+
+
+
+/**
+ * Access the fully associative shadow of a level.
+ *
+ * @return bool: Whether the shadow held the line.
+ */
+static bool shadow_access(int k, long line) {
+    struct cache_level *lv = &caches.levels[k];
+    struct cache_line *slot = &lv->shadow[0];
+    for (int w = 0; w < lv->sets * lv->ways; w++) {
+        struct cache_line *l = &lv->shadow[w];
+        if (l->valid && l->line == line) {
+            l->last_use = ++use_clock;
+            return true;
+        }
+        if (!l->valid || l->last_use < slot->last_use) slot = l;
+    }
+    *slot = (struct cache_line){ .line = line, .valid = true, .last_use = ++use_clock };
+    return false;
+}
+
+
+
+static void shadow_drop(int k, long line) {
+    struct cache_level *lv = &caches.levels[k];
+    for (int w = 0; w < lv->sets * lv->ways; w++) {
+        if (lv->shadow[w].line == line) lv->shadow[w].valid = false;
+    }
+}
+
+
+
+/**
+ * A dirty line leaves level k: the first outer level holding it takes the
+ * data, otherwise it goes to memory.
+ */
+static void write_back(int k, long line) {
+    for (int j = next_level(k); j != -1; j = next_level(j)) {
+        struct cache_line *l = find_line(j, -1, line);
+        if (l) {
+            l->dirty = true;
+            return;
+        }
+    }
+    caches.mem_writes++;
+}
+
+
+
+static struct cache_line *install(int k, int set, long line, bool dirty);
+
+/**
+ * Handle a line evicted from level k, as the inclusion policy requires.
+ */
+static void evicted(int k, struct cache_line victim) {
+    if (caches.inclusion == CACHE_EXCLUSIVE) {
+        int next = next_level(k);
+        if (next != -1) install(next, victim.line % caches.levels[next].sets, victim.line, victim.dirty);
+        else if (victim.dirty) caches.mem_writes++;
+        return;
+    }
+    if (caches.inclusion == CACHE_INCLUSIVE) {
+        for (int j = 0; j < k; j++) {
+            struct cache_line *l = present(j) ? find_line(j, -1, victim.line) : NULL;
+            if (l) {
+                victim.dirty |= l->dirty;
+                l->valid = false;
+                caches.back_invalidations++;
+            }
+        }
+    }
+    if (victim.dirty) write_back(k, victim.line);
+}
+
+
+
+/**
+ * Put a line into a set, evicting the least recently used way if the set
+ * is full.
+ *
+ * @return The new line.
+ */
+static struct cache_line *install(int k, int set, long line, bool dirty) {
+    struct cache_level *lv = &caches.levels[k];
+    struct cache_line *ways = &lv->lines[set * lv->ways];
+    struct cache_line *slot = &ways[0];
+    for (int w = 0; w < lv->ways; w++) {
+        if (!ways[w].valid) {
+            slot = &ways[w];
+            break;
+        }
+        if (ways[w].last_use < slot->last_use) slot = &ways[w];
+    }
+    struct cache_line victim = *slot;
+    *slot = (struct cache_line){ .line = line, .valid = true, .dirty = dirty, .last_use = ++use_clock };
+    if (victim.valid) evicted(k, victim);
+    return slot;
+}
+
+
+
+/**
+ * Fill L1, dropping a synonym of the line from another set first.
+ */
+static void fill_l1(int virtual_address, long line, bool dirty) {
+    int set = set_index(0, virtual_address, line);
+    if (page_colors(0) > 1) {
+        if (set != line % caches.levels[0].sets) caches.color_mismatches++;
+        struct cache_line *other = find_line(0, -1, line);
+        if (other) {
+            caches.synonyms++;
+            dirty |= other->dirty;
+            other->valid = false;
+        }
+    }
+    install(0, set, line, dirty);
+}
+
+
+
+/**
+ * Access a byte through the hierarchy and account its latency.
+ *
+ * @param virtual_address: The virtual address, indexes a VIPT L1.
+ * @param physical_address: The physical address it translated to.
+ * @param write: Whether the access is a write.
+ * @return void
+ */
+void cache_access(int virtual_address, int physical_address, bool write) {
+    long line = physical_address / caches.line_size;
+    struct cache_line *l = NULL;
+    int hit = -1;
+
+    caches.accesses++;
+    for (int k = 0; k < CACHE_LEVELS && hit == -1; k++) {
+        if (!present(k)) continue;
+        struct cache_level *lv = &caches.levels[k];
+        caches.cycles += lv->latency;
+        lv->accesses++;
+        l = find_line(k, set_index(k, virtual_address, line), line);
+        bool shadow_hit = shadow_access(k, line);
+        if (l) {
+            lv->hits++;
+            hit = k;
+        } else if (shadow_hit) {
+            lv->conflicts++;
+        }
+    }
+    if (hit == -1) {
+        caches.cycles += caches.mem_latency;
+        caches.mem_reads++;
+    }
+
+    if (hit == 0) {
+        l->last_use = ++use_clock;
+        l->dirty |= write;
+        return;
+    }
+    bool dirty = write;
+    if (caches.inclusion == CACHE_EXCLUSIVE) {
+        if (hit != -1) {
+            dirty |= l->dirty;
+            l->valid = false;
+        }
+    } else {
+        if (hit != -1) l->last_use = ++use_clock;
+        // Outer levels first, so that a back-invalidation cannot drop the new line
+        for (int k = (hit == -1 ? CACHE_LEVELS : hit) - 1; k > 0; k--) {
+            if (present(k)) install(k, line % caches.levels[k].sets, line, false);
+        }
+    }
+    fill_l1(virtual_address, line, dirty);
+}
+
+
+
+/**
+ * Drop the lines of a frame from every level, writing dirty ones back.
+ *
+ * @param frame_num: The frame number.
+ * @return void
+ */
+void cache_flush_frame(int frame_num) {
+    long lines_per_frame = FRAME_SIZE / caches.line_size;
+    for (long line = frame_num * lines_per_frame; line < (frame_num + 1) * lines_per_frame; line++) {
+        bool cached = false;
+        bool dirty = false;
+        for (int k = 0; k < CACHE_LEVELS; k++) {
+            struct cache_line *l;
+            if (!present(k)) continue;
+            shadow_drop(k, line);
+            while ((l = find_line(k, -1, line)) != NULL) {
+                cached = true;
+                dirty |= l->dirty;
+                l->valid = false;
+            }
+        }
+        caches.flushed += cached;
+        caches.mem_writes += dirty;
+    }
+}
+
+
+
+/**
+ * Empty every level and clear the statistics.
+ *
+ * @return void
+ */
+void cache_reset(void) {
+    for (int k = 0; k < CACHE_LEVELS; k++) {
+        struct cache_level *lv = &caches.levels[k];
+        if (present(k)) {
+            memset(lv->lines, 0, (size_t)lv->sets * lv->ways * sizeof(*lv->lines));
+            memset(lv->shadow, 0, (size_t)lv->sets * lv->ways * sizeof(*lv->shadow));
+        }
+        lv->accesses = lv->hits = lv->conflicts = 0;
+    }
+    caches.accesses = caches.cycles = 0;
+    caches.mem_reads = caches.mem_writes = 0;
+    caches.back_invalidations = caches.flushed = 0;
+    caches.color_mismatches = caches.synonyms = 0;
+    use_clock = 0;
+}
+
+
+
+/**
+ * Parse a level as size[k][:ways[:latency]].
+ *
+ * @return int: 0 on success, -1 on failure.
+ */
+static int parse_level(struct cache_level *lv, const char *value) {
+    char *end;
+    long size = strtol(value, &end, 10);
+    if (*end == 'k' || *end == 'K') {
+        size *= 1024;
+        end++;
+    }
+    if (*end == ':') lv->ways = strtol(end + 1, &end, 10);
+    if (*end == ':') lv->latency = strtol(end + 1, &end, 10);
+    if (*end != 0 || size < 0) return -1;
+    lv->size = size;
+    return 0;
+}
+
+
+
+/**
+ * Configure the hierarchy and allocate its levels.
+ *
+ * The spec is a comma separated list of
+ *   l1=, l2=, llc=size[k][:ways[:latency]]   (size 0 drops L2 or LLC)
+ *   line=bytes, mem=cycles, walk=cycles
+ *   inclusive, exclusive, nine, pipt, vipt, default
+ * e.g. "l1=2k:2:4,llc=0,vipt,exclusive".
+ *
+ * @param spec: The configuration.
+ * @return int: 0 on success, -1 on failure.
+ */
+int cache_configure(const char *spec) {
+    char buf[256];
+    snprintf(buf, sizeof(buf), "%s", spec);
+    for (char *token = strtok(buf, ","); token != NULL; token = strtok(NULL, ",")) {
+        char *value = strchr(token, '=');
+        if (value) *value++ = 0;
+        int res = 0;
+        if (value && strcmp(token, "l1") == 0) res = parse_level(&caches.levels[0], value);
+        else if (value && strcmp(token, "l2") == 0) res = parse_level(&caches.levels[1], value);
+        else if (value && strcmp(token, "llc") == 0) res = parse_level(&caches.levels[2], value);
+        else if (value && strcmp(token, "line") == 0) caches.line_size = atoi(value);
+        else if (value && strcmp(token, "mem") == 0) caches.mem_latency = atoi(value);
+        else if (value && strcmp(token, "walk") == 0) caches.walk_latency = atoi(value);
+        else if (strcmp(token, "inclusive") == 0) caches.inclusion = CACHE_INCLUSIVE;
+        else if (strcmp(token, "exclusive") == 0) caches.inclusion = CACHE_EXCLUSIVE;
+        else if (strcmp(token, "nine") == 0) caches.inclusion = CACHE_NINE;
+        else if (strcmp(token, "pipt") == 0) caches.vipt = false;
+        else if (strcmp(token, "vipt") == 0) caches.vipt = true;
+        else if (strcmp(token, "default") != 0) res = -1;
+        if (res != 0) {
+            fprintf(stderr, "cache_configure: Error: Bad option %s\n", token);
+            return -1;
+        }
+    }
+
+    if (!is_power_of_two(caches.line_size) || caches.line_size > PAGE_SIZE || !present(0)) {
+        fprintf(stderr, "cache_configure: Error: Need a power of two line size up to %d and an L1\n", PAGE_SIZE);
+        return -1;
+    }
+    for (int k = 0; k < CACHE_LEVELS; k++) {
+        struct cache_level *lv = &caches.levels[k];
+        free(lv->lines);
+        free(lv->shadow);
+        lv->lines = lv->shadow = NULL;
+        if (!present(k)) continue;
+        if (!is_power_of_two(lv->size) || !is_power_of_two(lv->ways)
+            || lv->size < lv->ways * caches.line_size || lv->latency < 0) {
+            fprintf(stderr, "cache_configure: Error: Bad %s, size and ways must be powers of two\n", lv->name);
+            return -1;
+        }
+        lv->sets = lv->size / (lv->ways * caches.line_size);
+        lv->lines = calloc((size_t)lv->sets * lv->ways, sizeof(*lv->lines));
+        lv->shadow = calloc((size_t)lv->sets * lv->ways, sizeof(*lv->shadow));
+        if (lv->lines == NULL || lv->shadow == NULL) {
+            perror("cache_configure: calloc");
+            return -1;
+        }
+    }
+    cache_reset();
+    return 0;
+}
+
+
+
+/**
+ * The last level.
+ *
+ * @return int: Its index in caches.levels.
+ */
+int cache_llc(void) {
+    int k = 0;
+    for (int j = next_level(0); j != -1; j = next_level(j)) k = j;
+    return k;
+}
+
+
+
+/**
+ * Page colors of the last level: frames whose lines map to the same sets
+ * have the same color, frame % colors.
+ *
+ * @return int: The number of colors, 1 if a way fits in a page.
+ */
+int cache_llc_colors(void) {
+    struct cache_level *lv = &caches.levels[cache_llc()];
+    int way_size = lv->size / lv->ways;
+    return way_size > PAGE_SIZE ? way_size / PAGE_SIZE : 1;
+}
+
+
+
+/**
+ * Average memory access time.
+ *
+ * @return double: Cycles per access, translation not included.
+ */
+double cache_amat(void) {
+    return caches.accesses ? (double)caches.cycles / caches.accesses : 0.0;
+}
+
+
+
+/**
+ * Print the hit rate of every level and the AMAT, with and without the
+ * page walks of the TLB misses.
+ *
+ * @param tlb_misses: TLB misses of the run.
+ * @return void
+ */
+void cache_report(int tlb_misses) {
+    printf("\n=========== CACHES ===========\n");
+    printf("Lines: %d B, %s, %s L1\n", caches.line_size, inclusion_names[caches.inclusion],
+           caches.vipt ? "VIPT" : "PIPT");
+    for (int k = 0; k < CACHE_LEVELS; k++) {
+        struct cache_level *lv = &caches.levels[k];
+        if (!present(k)) continue;
+        printf("%-3s %6d B, %2d-way, %4d sets, %3d cycles: %6ld accesses, hit rate %6.2f%%, %5ld conflict misses\n",
+               lv->name, lv->size, lv->ways, lv->sets, lv->latency, lv->accesses,
+               lv->accesses ? 100.0 * lv->hits / lv->accesses : 0.0, lv->conflicts);
+    }
+    printf("Memory reads: %ld, writebacks: %ld (%d cycles)\n", caches.mem_reads, caches.mem_writes, caches.mem_latency);
+    if (caches.inclusion == CACHE_INCLUSIVE) printf("Back-invalidations: %ld\n", caches.back_invalidations);
+    if (caches.flushed) printf("Lines flushed for reused frames: %ld\n", caches.flushed);
+    if (page_colors(0) > 1) {
+        printf("VIPT L1: %d page colors, %ld fills with virtual color != physical color, %ld synonyms\n",
+               page_colors(0), caches.color_mismatches, caches.synonyms);
+    }
+    double walk = caches.accesses ? (double)tlb_misses * caches.walk_latency / caches.accesses : 0.0;
+    printf("AMAT: %.2f cycles\n", cache_amat());
+    printf("Translation: %.2f cycles per access (%d cycle page walks)\n", walk, caches.walk_latency);
+    printf("AMAT with translation: %.2f cycles\n", cache_amat() + walk);
+}
+
+
+
+/**
+ * Register the lines and statistics of the caches for a checkpoint. The
+ * geometry is configuration, the latencies may change between runs from
+ * the same checkpoint.
+ *
+ * @return void
+ */
+void cache_checkpoint(void) {
+    static const char *names[CACHE_LEVELS][4] = {
+        { "cache.l1.geometry", "cache.l1.lines", "cache.l1.shadow", "cache.l1.stats" },
+        { "cache.l2.geometry", "cache.l2.lines", "cache.l2.shadow", "cache.l2.stats" },
+        { "cache.llc.geometry", "cache.llc.lines", "cache.llc.shadow", "cache.llc.stats" },
+    };
+    checkpoint_add("cache.hierarchy", &caches.line_size,
+                   offsetof(struct cache_hierarchy, vipt) + sizeof(caches.vipt), CHECKPOINT_CONFIG);
+    for (int k = 0; k < CACHE_LEVELS; k++) {
+        struct cache_level *lv = &caches.levels[k];
+        size_t lines = (size_t)lv->sets * lv->ways * sizeof(*lv->lines);
+        checkpoint_add(names[k][0], &lv->size, 2 * sizeof(int), CHECKPOINT_CONFIG);
+        if (lv->size == 0) continue;
+        checkpoint_add(names[k][1], lv->lines, lines, CHECKPOINT_STATE);
+        checkpoint_add(names[k][2], lv->shadow, lines, CHECKPOINT_STATE);
+        checkpoint_add(names[k][3], &lv->accesses, sizeof(*lv) - offsetof(struct cache_level, accesses), CHECKPOINT_STATS);
+    }
+    checkpoint_add("cache.use_clock", &use_clock, sizeof(use_clock), CHECKPOINT_STATE);
+    checkpoint_add("cache.stats", &caches.accesses,
+                   sizeof(caches) - offsetof(struct cache_hierarchy, accesses), CHECKPOINT_STATS);
+}
@@ -0,0 +1,77 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+/**
+ * Set-associative data cache hierarchy (L1, L2, LLC) fed with the physical
+ * addresses lookup() in simulator.c translates to.
+ *
+ * Only the timing is modelled, the values still come from physical_memory.
+ */
+
+#include <stdbool.h>
+
+#define CACHE_LEVELS 3
+
+// How the levels share lines.
+enum cache_inclusion
+{
+    CACHE_INCLUSIVE,    // Outer levels hold every inner line, evicting one back-invalidates it
+    CACHE_EXCLUSIVE,    // A line is in one level, victims move one level out
+    CACHE_NINE          // Non-inclusive non-exclusive, fills go everywhere, no back-invalidation
+};
+
+struct cache_line
+{
+    long line;          // Physical address / line size
+    bool valid;
+    bool dirty;
+    long last_use;      // For LRU within the set
+};
+
+struct cache_level
+{
+    const char *name;
+    int size;           // Bytes, 0 if the level is absent
+    int ways;
+    int latency;        // Cycles
+    int sets;
+    struct cache_line *lines;   // sets * ways, set by set
+    struct cache_line *shadow;  // Fully associative LRU of the same capacity
+    long accesses;
+    long hits;
+    long conflicts;     // Misses the fully associative shadow hit
+};
+
+struct cache_hierarchy
+{
+    int line_size;
+    enum cache_inclusion inclusion;
+    bool vipt;          // L1 indexed with the virtual address
+    int mem_latency;    // Cycles
+    int walk_latency;   // Cycles of a page walk after a TLB miss
+    struct cache_level levels[CACHE_LEVELS];
+
+    // Statistics
+    long accesses;
+    long cycles;
+    long mem_reads;
+    long mem_writes;            // Dirty lines written back to memory
+    long back_invalidations;    // Inner lines dropped for inclusion
+    long flushed;               // Lines dropped because their frame was reused
+    long color_mismatches;      // VIPT L1 fills into a set a PIPT L1 would not use
+    long synonyms;              // VIPT L1 fills that found the line in another set
+};
+
+extern struct cache_hierarchy caches;
+
+int cache_configure(const char *spec);
+void cache_reset(void);
+void cache_access(int virtual_address, int physical_address, bool write);
+void cache_flush_frame(int frame_num);
+double cache_amat(void);
+int cache_llc(void);
+int cache_llc_colors(void);
+void cache_report(int tlb_misses);
+void cache_checkpoint(void);
+
+#endif
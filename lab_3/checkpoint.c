@@ -0,0 +1,206 @@
+/**
+ * Checkpoint and restore of the simulator state.
+ *
+ * The file is a header, a table of the sections and the sections, each
+ * aligned to a page:
+ *
+ *   [header][entry 0][entry 1]...[pad][section 0][pad][section 1]...
+ *
+ * Saving maps the file and copies the sections in, restoring maps it
+ * read-only and copies them back, so a restore costs one copy of the
+ * state whatever the number of references that built it.
+ *
+ * A checkpoint only restores into a run registering the same sections
+ * with the same sizes, and the same CHECKPOINT_CONFIG contents, so every
+ * section is checked before the first one is copied.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "checkpoint.h"
+
+struct section
+{
+    const char *name;
+    void *data;
+    size_t size;
+    enum checkpoint_kind kind;
+};
+
+static struct section sections[MAX_CHECKPOINT_SECTIONS];
+static int num_sections = 0;
+
+
+
+/**
+ * Register a section.
+ *
+ * @param name: Unique name, shorter than CHECKPOINT_NAME_SIZE.
+ * @param data: Where the state lives.
+ * @param size: Its size in bytes.
+ * @param kind: How a restore and a fast-forward treat it.
+ * @return void
+ */
+void checkpoint_add(const char *name, void *data, size_t size, enum checkpoint_kind kind) {
+    if (num_sections == MAX_CHECKPOINT_SECTIONS || strlen(name) >= CHECKPOINT_NAME_SIZE) {
+        fprintf(stderr, "checkpoint_add: Error: Cannot add section %s\n", name);
+        exit(1);
+    }
+    sections[num_sections++] = (struct section){ name, data, size, kind };
+}
+
+
+
+/**
+ * Zero the statistics, keeping the state, after a fast-forward.
+ *
+ * @return void
+ */
+void checkpoint_clear_stats(void) {
+    for (int k = 0; k < num_sections; k++) {
+        if (sections[k].kind == CHECKPOINT_STATS) memset(sections[k].data, 0, sections[k].size);
+    }
+}
+
+
+
+static unsigned long long align(unsigned long long offset) {
+    return (offset + CHECKPOINT_ALIGN - 1) / CHECKPOINT_ALIGN * CHECKPOINT_ALIGN;
+}
+
+
+
+/**
+ * Save the sections.
+ *
+ * The checkpoint is written next to path and renamed over it, a failed
+ * save leaves an older checkpoint intact.
+ *
+ * @param path: The checkpoint file.
+ * @return int: 0 on success, -1 on failure.
+ */
+int checkpoint_save(const char *path) {
+    unsigned long long offset = align(sizeof(struct checkpoint_header) + num_sections * sizeof(struct checkpoint_entry));
+    unsigned long long offsets[MAX_CHECKPOINT_SECTIONS];
+    for (int k = 0; k < num_sections; k++) {
+        offsets[k] = offset;
+        offset = align(offset + sections[k].size);
+    }
+
+    char tmp[4096];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    int fd = open(tmp, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0 || ftruncate(fd, offset) != 0) {
+        perror("checkpoint_save: open");
+        if (fd >= 0) close(fd);
+        return -1;
+    }
+    char *file = mmap(NULL, offset, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (file == MAP_FAILED) {
+        perror("checkpoint_save: mmap");
+        unlink(tmp);
+        return -1;
+    }
+
+    struct checkpoint_header *header = (struct checkpoint_header *)file;
+    memcpy(header->magic, CHECKPOINT_MAGIC, sizeof(header->magic));
+    header->num_sections = num_sections;
+    header->file_size = offset;
+    struct checkpoint_entry *entries = (struct checkpoint_entry *)(header + 1);
+    for (int k = 0; k < num_sections; k++) {
+        snprintf(entries[k].name, sizeof(entries[k].name), "%s", sections[k].name);
+        entries[k].kind = sections[k].kind;
+        entries[k].offset = offsets[k];
+        entries[k].size = sections[k].size;
+        memcpy(file + offsets[k], sections[k].data, sections[k].size);
+    }
+
+    int status = msync(file, offset, MS_SYNC);
+    munmap(file, offset);
+    if (status != 0 || rename(tmp, path) != 0) {
+        perror("checkpoint_save: msync");
+        unlink(tmp);
+        return -1;
+    }
+    return 0;
+}
+
+
+
+/**
+ * Find the entry of a section and check it against the registered one.
+ *
+ * @return const struct checkpoint_entry *: The entry, NULL if it does not fit.
+ */
+static const struct checkpoint_entry *find_entry(const char *file, const struct section *s) {
+    const struct checkpoint_header *header = (const struct checkpoint_header *)file;
+    const struct checkpoint_entry *entries = (const struct checkpoint_entry *)(header + 1);
+    for (unsigned int k = 0; k < header->num_sections; k++) {
+        if (strncmp(entries[k].name, s->name, CHECKPOINT_NAME_SIZE) != 0) continue;
+        if (entries[k].size != s->size || entries[k].kind != s->kind
+            || entries[k].offset + entries[k].size > header->file_size) return NULL;
+        if (s->kind == CHECKPOINT_CONFIG && memcmp(file + entries[k].offset, s->data, s->size) != 0) return NULL;
+        return &entries[k];
+    }
+    return NULL;
+}
+
+
+
+/**
+ * Restore the sections.
+ *
+ * @param path: The checkpoint file.
+ * @return int: 0 on success, -1 on failure, with the state unchanged.
+ */
+int checkpoint_restore(const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        perror("checkpoint_restore: open");
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(struct checkpoint_header)) {
+        fprintf(stderr, "checkpoint_restore: Error: %s is not a checkpoint\n", path);
+        close(fd);
+        return -1;
+    }
+    char *file = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (file == MAP_FAILED) {
+        perror("checkpoint_restore: mmap");
+        return -1;
+    }
+
+    const struct checkpoint_header *header = (const struct checkpoint_header *)file;
+    const struct checkpoint_entry *found[MAX_CHECKPOINT_SECTIONS];
+    int status = 0;
+    if (memcmp(header->magic, CHECKPOINT_MAGIC, sizeof(header->magic)) != 0
+        || header->file_size != (unsigned long long)st.st_size
+        || header->num_sections != (unsigned int)num_sections
+        || sizeof(*header) + num_sections * sizeof(struct checkpoint_entry) > (size_t)st.st_size) {
+        fprintf(stderr, "checkpoint_restore: Error: %s is not a checkpoint of this configuration\n", path);
+        status = -1;
+    }
+    for (int k = 0; status == 0 && k < num_sections; k++) {
+        found[k] = find_entry(file, &sections[k]);
+        if (found[k] == NULL) {
+            fprintf(stderr, "checkpoint_restore: Error: Section %s of %s does not match the configuration\n",
+                    sections[k].name, path);
+            status = -1;
+        }
+    }
+    for (int k = 0; status == 0 && k < num_sections; k++) {
+        if (sections[k].kind != CHECKPOINT_CONFIG) {
+            memcpy(sections[k].data, file + found[k]->offset, sections[k].size);
+        }
+    }
+    munmap(file, st.st_size);
+    return status;
+}
@@ -0,0 +1,48 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+/**
+ * Checkpoint and restore of the simulator state (see checkpoint.c).
+ *
+ * Every module registers the memory its state lives in as named sections,
+ * a checkpoint is those sections in one file.
+ */
+
+#include <stddef.h>
+
+#define CHECKPOINT_MAGIC "VMSIMCK1"
+#define CHECKPOINT_ALIGN 4096   // Sections start on a page, so each can be mapped alone
+#define CHECKPOINT_NAME_SIZE 24
+#define MAX_CHECKPOINT_SECTIONS 64
+
+enum checkpoint_kind
+{
+    CHECKPOINT_STATE,   // Saved and restored
+    CHECKPOINT_STATS,   // Saved and restored, cleared after a fast-forward
+    CHECKPOINT_CONFIG   // Saved, must match on restore
+};
+
+struct checkpoint_header
+{
+    char magic[8];
+    unsigned int num_sections;
+    unsigned int reserved;
+    unsigned long long file_size;
+};
+
+// Follows the header, one per section.
+struct checkpoint_entry
+{
+    char name[CHECKPOINT_NAME_SIZE];
+    unsigned int kind;
+    unsigned int reserved;
+    unsigned long long offset;
+    unsigned long long size;
+};
+
+void checkpoint_add(const char *name, void *data, size_t size, enum checkpoint_kind kind);
+void checkpoint_clear_stats(void);
+int checkpoint_save(const char *path);
+int checkpoint_restore(const char *path);
+
+#endif
@@ -0,0 +1,227 @@
+/**
+ * Daemon mode of simulator.c (see daemon.h for the protocol).
+ *
+ * The state stays resident between batches and between connections, so a
+ * capture agent can stream references for as long as it runs and ask for
+ * the statistics at any point. Connections are served one at a time, in
+ * the order they arrive, which keeps the references of one client in
+ * order without locking the simulator.
+ *
+ * With the path "-" requests come on stdin and replies go to stdout, the
+ * simulator's own output is moved to stderr so it cannot corrupt them.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "simulator.h"
+#include "daemon.h"
+
+static uint32_t addresses[DAEMON_MAX_BATCH];
+static int32_t values[DAEMON_MAX_BATCH];
+
+
+
+/**
+ * Read exactly len bytes.
+ *
+ * @return int: 1 on success, 0 at end of file before the first byte, -1 on
+ *         failure or end of file within the message.
+ */
+static int read_full(int fd, void *buf, size_t len) {
+    size_t done = 0;
+    while (done < len) {
+        ssize_t n = read(fd, (char *)buf + done, len - done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) {
+            perror("daemon: read");
+            return -1;
+        }
+        if (n == 0) return done == 0 ? 0 : -1;
+        done += n;
+    }
+    return 1;
+}
+
+
+
+/**
+ * Write exactly len bytes.
+ *
+ * @return int: 0 on success, -1 on failure.
+ */
+static int write_full(int fd, const void *buf, size_t len) {
+    size_t done = 0;
+    while (done < len) {
+        ssize_t n = write(fd, (const char *)buf + done, len - done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) {
+            perror("daemon: write");
+            return -1;
+        }
+        done += n;
+    }
+    return 0;
+}
+
+
+
+static int reply(int fd, uint32_t type, const void *body, uint32_t len) {
+    struct daemon_header header = { type, len };
+    if (write_full(fd, &header, sizeof(header)) != 0) return -1;
+    return len ? write_full(fd, body, len) : 0;
+}
+
+
+
+/**
+ * Translate a batch, all addresses are checked before the first lookup so
+ * a bad batch leaves the state as it was.
+ *
+ * @return int: 0 on success, -1 on a bad batch.
+ */
+static int translate(int count) {
+    for (int k = 0; k < count; k++) {
+        if ((addresses[k] & ~DAEMON_WRITE) >= MAX_NUM_OF_PAGES * PAGE_SIZE) {
+            fprintf(stderr, "daemon: Error: Address %u out of range\n", addresses[k] & ~DAEMON_WRITE);
+            return -1;
+        }
+    }
+    for (int k = 0; k < count; k++) {
+        values[k] = lookup(addresses[k] & ~DAEMON_WRITE, addresses[k] & DAEMON_WRITE);
+    }
+    return 0;
+}
+
+
+
+/**
+ * Serve the requests of one connection.
+ *
+ * @return int: 1 if the client asked the daemon to quit, 0 when the
+ *         connection ends, -1 on failure.
+ */
+static int serve_connection(int in, int out) {
+    struct daemon_header header;
+    int status;
+    while ((status = read_full(in, &header, sizeof(header))) == 1) {
+        // The other requests have no body, one that is sent anyway would be
+        // read as the next header
+        if (header.type != 'T' && header.count != 0) {
+            fprintf(stderr, "daemon: Error: Request %u with a body of %u bytes\n", header.type, header.count);
+            reply(out, 'E', NULL, 0);
+            return -1;
+        }
+        switch (header.type) {
+        case 'T': {
+            if (header.count > DAEMON_MAX_BATCH) {
+                fprintf(stderr, "daemon: Error: Batch of %u addresses, at most %d\n", header.count, DAEMON_MAX_BATCH);
+                reply(out, 'E', NULL, 0);
+                return -1;
+            }
+            // End of file before the body is a truncated message too, not an empty one
+            if (header.count > 0 && read_full(in, addresses, header.count * sizeof(*addresses)) != 1) {
+                fprintf(stderr, "daemon: Error: Batch of %u addresses cut short\n", header.count);
+                return -1;
+            }
+            if (translate(header.count) != 0) {
+                reply(out, 'E', NULL, 0);
+                return -1;
+            }
+            // The reply of a 'T' counts values, like the request
+            struct daemon_header done = { 'T', header.count };
+            if (write_full(out, &done, sizeof(done)) != 0
+                || write_full(out, values, header.count * sizeof(*values)) != 0) return -1;
+            break;
+        }
+        case 'S': {
+            struct daemon_stats stats = {
+                num_refs, page_faults, tlb_hits, tlb_misses, evictions, writebacks, tlb_invalidations
+            };
+            if (reply(out, 'S', &stats, sizeof(stats)) != 0) return -1;
+            break;
+        }
+        case 'R':
+            reset_simulation();
+            if (!demand_paging) {
+                num_addresses = 0;
+                populate("correct.txt");
+            }
+            if (reply(out, 'R', NULL, 0) != 0) return -1;
+            break;
+        case 'Q':
+            reply(out, 'Q', NULL, 0);
+            return 1;
+        default:
+            fprintf(stderr, "daemon: Error: Bad request %u\n", header.type);
+            reply(out, 'E', NULL, 0);
+            return -1;
+        }
+    }
+    return status;
+}
+
+
+
+/**
+ * Serve requests until a client sends 'Q', or stdin ends.
+ *
+ * @param path: The Unix domain socket to listen on, "-" for stdin/stdout.
+ * @return int: 0 on success, -1 on failure.
+ */
+int daemon_serve(const char *path) {
+    // A client that goes away must not kill the daemon
+    signal(SIGPIPE, SIG_IGN);
+
+    if (strcmp(path, "-") == 0) {
+        fflush(stdout);
+        int out = dup(STDOUT_FILENO);
+        if (out < 0 || dup2(STDERR_FILENO, STDOUT_FILENO) < 0) {
+            perror("daemon_serve: dup");
+            return -1;
+        }
+        int status = serve_connection(STDIN_FILENO, out);
+        close(out);
+        return status < 0 ? -1 : 0;
+    }
+
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "daemon_serve: Error: Socket path %s too long\n", path);
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0) {
+        perror("daemon_serve: socket");
+        return -1;
+    }
+    unlink(path);
+    if (bind(listener, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(listener, 8) != 0) {
+        perror("daemon_serve: bind");
+        close(listener);
+        return -1;
+    }
+    fprintf(stderr, "daemon_serve: Listening on %s\n", path);
+
+    int status = 0;
+    while (status != 1) {
+        int client = accept(listener, NULL, NULL);
+        if (client < 0) {
+            if (errno == EINTR) continue;
+            perror("daemon_serve: accept");
+            break;
+        }
+        // A failed connection only loses that client
+        status = serve_connection(client, client);
+        close(client);
+    }
+    close(listener);
+    unlink(path);
+    return status == 1 ? 0 : -1;
+}
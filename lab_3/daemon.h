@@ -0,0 +1,43 @@
+#ifndef DAEMON_H
+#define DAEMON_H
+
+/**
+ * Daemon mode of simulator.c: the simulator stays resident and translates
+ * batches of addresses sent over a Unix domain socket or a pipe.
+ *
+ * Every message, both ways, starts with a header in host byte order:
+ *   'T' translate: count addresses (uint32, bit 31 set for a write) follow,
+ *                  the reply has count values (int32, -1 for a page fault
+ *                  without demand paging)
+ *   'S' stats:     no body, the reply has a struct daemon_stats
+ *   'R' reset:     no body, empty reply, the simulation starts over
+ *   'Q' quit:      no body, empty reply, the daemon exits
+ *   'E' error:     reply to a bad request (also an 'S', 'R' or 'Q' with a
+ *                  non-zero count), the connection is closed
+ */
+
+#include <stdint.h>
+
+#define DAEMON_MAX_BATCH 4096
+#define DAEMON_WRITE (1u << 31)
+
+struct daemon_header
+{
+    uint32_t type;
+    uint32_t count;     // Addresses of a 'T' message, bytes of the body otherwise
+};
+
+struct daemon_stats
+{
+    int64_t references;
+    int64_t page_faults;
+    int64_t tlb_hits;
+    int64_t tlb_misses;
+    int64_t evictions;
+    int64_t writebacks;
+    int64_t tlb_invalidations;
+};
+
+int daemon_serve(const char *path);
+
+#endif
@@ -0,0 +1,344 @@
+/**
+ * Physical frame allocators for simulator.c.
+ *
+ * - sequential: lowest free frame, what the simulator always did
+ * - random:     any free frame, seeded with -s
+ * - buddy:      binary buddy allocator, free blocks of 2^order frames on
+ *               LIFO lists, split on allocation and merged with their
+ *               buddy on free
+ * - colored:    page coloring, a page gets a frame of its own color (the
+ *               frame bits that index the LLC, see cache_llc_colors()),
+ *               so virtually contiguous pages spread evenly over the sets
+ *
+ * All of them keep a map of the free frames, used for the fragmentation
+ * statistics: the unusable free space index of an order is the share of
+ * free frames that are not in a free aligned block of 2^order frames.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "simulator.h"
+#include "checkpoint.h"
+
+#define MAX_ORDER 9             // Orders 0..8, up to all 256 frames
+#define FRAG_ORDER 3            // Order the fragmentation is sampled at
+
+int num_colors = 1;
+unsigned int alloc_seed = 1;
+
+static bool is_free[NUM_OF_FRAMES];
+static int nr_free;
+
+// Statistics
+static long allocations;
+static long color_fallbacks;    // Colored allocations that had to take another color
+static double unusable_sum;     // Unusable free space index before each allocation
+
+
+
+// ============================ FREE MAP ============================
+
+/**
+ * Count the free naturally aligned blocks of 2^order frames.
+ */
+static int free_blocks(int order) {
+    int size = 1 << order;
+    int count = 0;
+    for (int f = 0; f + size <= num_frames; f += size) {
+        int k = 0;
+        while (k < size && is_free[f + k]) k++;
+        count += k == size;
+    }
+    return count;
+}
+
+
+
+/**
+ * Unusable free space index.
+ *
+ * @param order: The allocation order.
+ * @return double: Share of the free frames an allocation of 2^order frames
+ *         could not use, 0 with no free frames.
+ */
+double unusable_free_index(int order) {
+    if (nr_free == 0) return 0.0;
+    return (double)(nr_free - (free_blocks(order) << order)) / nr_free;
+}
+
+
+
+/**
+ * Largest free naturally aligned block.
+ *
+ * @return int: Its size in frames.
+ */
+int largest_free_block(void) {
+    for (int order = MAX_ORDER - 1; order >= 0; order--) {
+        if (free_blocks(order) > 0) return 1 << order;
+    }
+    return 0;
+}
+
+
+
+int free_frames(void) {
+    return nr_free;
+}
+
+
+
+static void map_reset(void) {
+    for (int f = 0; f < NUM_OF_FRAMES; f++) {
+        is_free[f] = f < num_frames;
+    }
+    nr_free = num_frames;
+    allocations = color_fallbacks = 0;
+    unusable_sum = 0.0;
+}
+
+
+
+/**
+ * Take a free frame out of the map, sampling the fragmentation first.
+ */
+static int take(int frame) {
+    unusable_sum += unusable_free_index(FRAG_ORDER);
+    allocations++;
+    is_free[frame] = false;
+    nr_free--;
+    return frame;
+}
+
+
+
+static void give_back(int frame) {
+    is_free[frame] = true;
+    nr_free++;
+}
+
+
+
+// ============================ SEQUENTIAL ============================
+
+static int sequential_alloc(int page) {
+    (void)page;
+    for (int f = 0; f < num_frames; f++) {
+        if (is_free[f]) return take(f);
+    }
+    return -1;
+}
+
+
+
+// ============================ RANDOM ============================
+
+static unsigned int rand_state;
+
+static void random_reset(void) {
+    map_reset();
+    rand_state = alloc_seed ? alloc_seed : 1;
+}
+
+
+
+static int random_alloc(int page) {
+    (void)page;
+    if (nr_free == 0) return -1;
+    // xorshift32
+    rand_state ^= rand_state << 13;
+    rand_state ^= rand_state >> 17;
+    rand_state ^= rand_state << 5;
+    int k = rand_state % nr_free;
+    for (int f = 0; f < num_frames; f++) {
+        if (is_free[f] && k-- == 0) return take(f);
+    }
+    return -1;
+}
+
+
+
+// ============================ BUDDY ============================
+
+static int free_list[MAX_ORDER][NUM_OF_FRAMES];
+static int free_count[MAX_ORDER];
+static signed char block_order[NUM_OF_FRAMES];  // Order of the free block starting here, -1 if none
+
+
+
+static void buddy_push(int order, int frame) {
+    free_list[order][free_count[order]++] = frame;
+    block_order[frame] = order;
+}
+
+
+
+static void buddy_remove(int order, int frame) {
+    for (int k = 0; k < free_count[order]; k++) {
+        if (free_list[order][k] == frame) {
+            free_list[order][k] = free_list[order][--free_count[order]];
+            break;
+        }
+    }
+    block_order[frame] = -1;
+}
+
+
+
+/**
+ * Cut the frames into the largest aligned blocks that fit.
+ */
+static void buddy_reset(void) {
+    map_reset();
+    memset(free_count, 0, sizeof(free_count));
+    memset(block_order, -1, sizeof(block_order));
+    for (int f = 0; f < num_frames; ) {
+        int order = MAX_ORDER - 1;
+        while (f % (1 << order) != 0 || f + (1 << order) > num_frames) order--;
+        buddy_push(order, f);
+        f += 1 << order;
+    }
+}
+
+
+
+/**
+ * Take a block of the smallest order that has one, keep its lower frame
+ * and put the upper halves back on the lower orders.
+ */
+static int buddy_alloc(int page) {
+    (void)page;
+    int order = 0;
+    while (order < MAX_ORDER && free_count[order] == 0) order++;
+    if (order == MAX_ORDER) return -1;
+    int frame = free_list[order][--free_count[order]];
+    block_order[frame] = -1;
+    while (order > 0) {
+        order--;
+        buddy_push(order, frame + (1 << order));
+    }
+    return take(frame);
+}
+
+
+
+/**
+ * Merge the frame with its buddy for as long as the buddy is a free block
+ * of the same order.
+ */
+static void buddy_free(int frame) {
+    give_back(frame);
+    int order = 0;
+    while (order < MAX_ORDER - 1) {
+        int buddy = frame ^ (1 << order);
+        if (buddy >= num_frames || block_order[buddy] != order) break;
+        buddy_remove(order, buddy);
+        if (buddy < frame) frame = buddy;
+        order++;
+    }
+    buddy_push(order, frame);
+}
+
+
+
+// ============================ COLORED ============================
+
+/**
+ * A free frame of the page's color, else any free frame.
+ */
+static int colored_alloc(int page) {
+    for (int f = page % num_colors; f < num_frames; f += num_colors) {
+        if (is_free[f]) return take(f);
+    }
+    int frame = sequential_alloc(page);
+    if (frame != -1) color_fallbacks++;
+    return frame;
+}
+
+
+
+/**
+ * Print the fragmentation and how the resident pages spread over the
+ * colors.
+ *
+ * @return void
+ */
+void frames_report(const struct alloc_ops *allocator) {
+    int per_color[NUM_OF_FRAMES] = { 0 };
+    int mismatches = 0;
+    int resident = 0;
+    for (int f = 0; f < num_frames; f++) {
+        int page = frame_table[f].page;
+        if (page == -1) continue;
+        per_color[f % num_colors]++;
+        mismatches += page % num_colors != f % num_colors;
+        resident++;
+    }
+    int min = per_color[0], max = per_color[0];
+    for (int c = 1; c < num_colors; c++) {
+        if (per_color[c] < min) min = per_color[c];
+        if (per_color[c] > max) max = per_color[c];
+    }
+
+    printf("\n=========== FRAMES ===========\n");
+    printf("Allocator: %s (%d frames, %d colors)\n", allocator->name, num_frames, num_colors);
+    printf("Allocations: %ld\n", allocations);
+    printf("Free frames: %d, largest free block: %d\n", nr_free, largest_free_block());
+    printf("Unusable free space (order %d): %.3f now, %.3f on average\n", FRAG_ORDER,
+           unusable_free_index(FRAG_ORDER), allocations ? unusable_sum / allocations : 0.0);
+    printf("Resident pages per color: min %d, max %d, average %.2f\n", min, max, (double)resident / num_colors);
+    printf("Pages in a frame of another color: %d\n", mismatches);
+    if (allocator->alloc == colored_alloc) printf("Color fallbacks: %ld\n", color_fallbacks);
+}
+
+
+
+/**
+ * Average unusable free space index, sampled before every allocation.
+ */
+double average_unusable_free_index(void) {
+    return allocations ? unusable_sum / allocations : 0.0;
+}
+
+
+
+const struct alloc_ops alloc_policies[] = {
+    { "sequential", map_reset, sequential_alloc, give_back },
+    { "random", random_reset, random_alloc, give_back },
+    { "buddy", buddy_reset, buddy_alloc, buddy_free },
+    { "colored", map_reset, colored_alloc, give_back },
+};
+const int num_of_alloc_policies = sizeof(alloc_policies) / sizeof(alloc_policies[0]);
+
+
+
+/**
+ * Find an allocator by name.
+ *
+ * @return The allocator, NULL if there is none with that name.
+ */
+const struct alloc_ops *find_allocator(const char *name) {
+    for (int k = 0; k < num_of_alloc_policies; k++) {
+        if (strcmp(alloc_policies[k].name, name) == 0) return &alloc_policies[k];
+    }
+    return NULL;
+}
+
+
+
+/**
+ * Register the state of the allocators for a checkpoint.
+ *
+ * @return void
+ */
+void frames_checkpoint(void) {
+    checkpoint_add("frames.is_free", is_free, sizeof(is_free), CHECKPOINT_STATE);
+    checkpoint_add("frames.nr_free", &nr_free, sizeof(nr_free), CHECKPOINT_STATE);
+    checkpoint_add("frames.rand_state", &rand_state, sizeof(rand_state), CHECKPOINT_STATE);
+    checkpoint_add("frames.free_list", free_list, sizeof(free_list), CHECKPOINT_STATE);
+    checkpoint_add("frames.free_count", free_count, sizeof(free_count), CHECKPOINT_STATE);
+    checkpoint_add("frames.block_order", block_order, sizeof(block_order), CHECKPOINT_STATE);
+    checkpoint_add("frames.allocations", &allocations, sizeof(allocations), CHECKPOINT_STATS);
+    checkpoint_add("frames.color_fallbacks", &color_fallbacks, sizeof(color_fallbacks), CHECKPOINT_STATS);
+    checkpoint_add("frames.unusable_sum", &unusable_sum, sizeof(unusable_sum), CHECKPOINT_STATS);
+}
@@ -0,0 +1,356 @@
+/**
+ * Miss ratio curves of the page stream, with bounded memory.
+ *
+ * SHARDS spatial sampling: a page is sampled if the hash of its number is
+ * below a threshold, so either every reference to a page is sampled or
+ * none is. The sampled stream behaves like the whole stream scaled down
+ * by the rate: a sampled LRU stack distance d stands for d / rate pages.
+ *
+ * - LRU: stack distances of the sampled pages, histogram by cache size
+ * - FIFO: no stack property, so one miniature FIFO cache per point, of the
+ *   point's size times the rate, is run on the sampled stream
+ *
+ * Memory is fixed: at most budget sampled pages are tracked. When a new
+ * page would exceed it, the page with the largest hash is dropped and the
+ * threshold lowered to its hash (fixed-size SHARDS), which lowers the rate.
+ * Pages that are not sampled cost a hash and a compare.
+ *
+ * The error bound is the 95% binomial interval of a miss ratio estimated
+ * from the sampled references. It does not cover the spatial error of
+ * sampling few pages, the exact curves ("exact") show that one.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "simulator.h"
+#include "mrc.h"
+
+struct mrc_config mrc_config = {
+    .rate = 0.1,
+    .budget = 64,
+    .points = 16,
+    .max_size = NUM_OF_FRAMES,
+    .every = 0,
+    .exact = false,
+};
+
+
+
+static unsigned int hash_page(long page) {
+    unsigned long long x = (unsigned long long)page + 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x & (MRC_MODULUS - 1);
+}
+
+
+
+double mrc_rate(const struct mrc *m) {
+    return (double)m->threshold / MRC_MODULUS;
+}
+
+
+
+/**
+ * Size of a point's cache, in pages.
+ */
+static double point_size(const struct mrc *m, int point) {
+    return (double)point * m->max_size / m->points;
+}
+
+
+
+/**
+ * Create a sampler.
+ *
+ * @param rate: Initial sampling rate, 1 for exact curves.
+ * @param budget: Sampled pages tracked at most.
+ * @param points: Cache sizes on the curve, evenly spaced up to max_size.
+ * @param max_size: Largest cache size, in pages.
+ * @return The sampler, NULL on failure.
+ */
+struct mrc *mrc_create(double rate, int budget, int points, int max_size) {
+    struct mrc *m = calloc(1, sizeof(*m));
+    if (m == NULL) {
+        perror("mrc_create: calloc");
+        return NULL;
+    }
+    m->threshold = rate >= 1.0 ? MRC_MODULUS : (unsigned int)(rate * MRC_MODULUS);
+    m->budget = budget;
+    m->points = points;
+    m->max_size = max_size;
+    m->stack = calloc(budget, sizeof(*m->stack));
+    m->hashes = calloc(budget, sizeof(*m->hashes));
+    m->hist = calloc(points + 2, sizeof(*m->hist));
+    m->fifo = calloc(points, sizeof(*m->fifo));
+    bool ok = m->stack && m->hashes && m->hist && m->fifo;
+    for (int k = 0; ok && k < points; k++) {
+        m->fifo[k].keys = calloc(budget, sizeof(*m->fifo[k].keys));
+        ok = m->fifo[k].keys != NULL;
+    }
+    if (!ok) {
+        perror("mrc_create: calloc");
+        mrc_destroy(m);
+        return NULL;
+    }
+    return m;
+}
+
+
+
+void mrc_destroy(struct mrc *m) {
+    if (m == NULL) return;
+    for (int k = 0; m->fifo && k < m->points; k++) {
+        free(m->fifo[k].keys);
+    }
+    free(m->fifo);
+    free(m->hist);
+    free(m->hashes);
+    free(m->stack);
+    free(m);
+}
+
+
+
+/**
+ * Forget the stream, keeping the current rate.
+ *
+ * @return void
+ */
+void mrc_reset(struct mrc *m) {
+    m->count = 0;
+    memset(m->hist, 0, (m->points + 2) * sizeof(*m->hist));
+    for (int k = 0; k < m->points; k++) {
+        m->fifo[k].head = m->fifo[k].count = 0;
+        m->fifo[k].misses = 0;
+    }
+    m->cold = 0;
+    m->refs = m->sampled = 0;
+}
+
+
+
+// ============================ FIFO ============================
+
+static long *fifo_slot(const struct mrc *m, struct fifo_sim *f, int k) {
+    return &f->keys[(f->head + k) % m->budget];
+}
+
+
+
+static void fifo_remove(const struct mrc *m, struct fifo_sim *f, long page) {
+    for (int k = 0; k < f->count; k++) {
+        if (*fifo_slot(m, f, k) != page) continue;
+        for (; k < f->count - 1; k++) {
+            *fifo_slot(m, f, k) = *fifo_slot(m, f, k + 1);
+        }
+        f->count--;
+        return;
+    }
+}
+
+
+
+/**
+ * Reference a page in a miniature FIFO cache, shrinking it first if the
+ * rate went down.
+ */
+static void fifo_access(const struct mrc *m, struct fifo_sim *f, long page, int capacity) {
+    if (capacity > m->budget) capacity = m->budget;
+    for (; f->count > capacity; f->count--) {
+        f->head = (f->head + 1) % m->budget;
+    }
+    for (int k = 0; k < f->count; k++) {
+        if (*fifo_slot(m, f, k) == page) return;
+    }
+    f->misses++;
+    if (capacity == 0) return;
+    if (f->count == capacity) {
+        f->head = (f->head + 1) % m->budget;
+        f->count--;
+    }
+    *fifo_slot(m, f, f->count++) = page;
+}
+
+
+
+// ============================ SAMPLING ============================
+
+/**
+ * Make room for a new sampled page with hash h.
+ *
+ * @return bool: Whether the page is still sampled, false if its own hash
+ *         is the largest and the threshold dropped below it.
+ */
+static bool make_room(struct mrc *m, unsigned int h) {
+    int max = 0;
+    for (int k = 1; k < m->count; k++) {
+        if (m->hashes[k] > m->hashes[max]) max = k;
+    }
+    if (h > m->hashes[max]) {
+        m->threshold = h;
+        return false;
+    }
+    long page = m->stack[max];
+    m->threshold = m->hashes[max];
+    memmove(&m->stack[max], &m->stack[max + 1], (m->count - max - 1) * sizeof(*m->stack));
+    memmove(&m->hashes[max], &m->hashes[max + 1], (m->count - max - 1) * sizeof(*m->hashes));
+    m->count--;
+    for (int k = 0; k < m->points; k++) {
+        fifo_remove(m, &m->fifo[k], page);
+    }
+    return true;
+}
+
+
+
+/**
+ * Feed a reference to the sampler, the curves are up to date after every
+ * call.
+ *
+ * @param page: The page number.
+ * @return void
+ */
+void mrc_access(struct mrc *m, long page) {
+    m->refs++;
+    unsigned int h = hash_page(page);
+    if (h >= m->threshold) return;
+
+    int d = 0;
+    while (d < m->count && m->stack[d] != page) d++;
+    if (d == m->count) {
+        if (m->count == m->budget && !make_room(m, h)) return;
+        // make_room() may have dropped an entry, only the live ones move down
+        d = m->count;
+        m->cold++;
+        m->count++;
+    } else {
+        // Needs a cache of (d + 1) / rate pages to hit
+        double size = (d + 1) / mrc_rate(m);
+        int b = (int)ceil(size * m->points / m->max_size);
+        m->hist[b < 1 ? 1 : b > m->points ? m->points + 1 : b]++;
+    }
+    memmove(&m->stack[1], &m->stack[0], d * sizeof(*m->stack));
+    memmove(&m->hashes[1], &m->hashes[0], d * sizeof(*m->hashes));
+    m->stack[0] = page;
+    m->hashes[0] = h;
+    m->sampled++;
+
+    for (int k = 0; k < m->points; k++) {
+        fifo_access(m, &m->fifo[k], page, (int)(point_size(m, k + 1) * mrc_rate(m) + 0.5));
+    }
+}
+
+
+
+/**
+ * LRU miss ratio of a point.
+ *
+ * @param point: 1 to points.
+ * @return double: The miss ratio.
+ */
+double mrc_lru(const struct mrc *m, int point) {
+    if (m->sampled == 0) return 0.0;
+    double hits = 0;
+    for (int b = 1; b <= point; b++) hits += m->hist[b];
+    return 1.0 - hits / m->sampled;
+}
+
+
+
+/**
+ * FIFO miss ratio of a point.
+ *
+ * @param point: 1 to points.
+ * @return double: The miss ratio.
+ */
+double mrc_fifo(const struct mrc *m, int point) {
+    return m->sampled ? (double)m->fifo[point - 1].misses / m->sampled : 0.0;
+}
+
+
+
+/**
+ * Half width of the 95% interval of a miss ratio.
+ */
+double mrc_error(const struct mrc *m, double miss_ratio) {
+    if (m->sampled == 0) return 1.0;
+    return 1.96 * sqrt(miss_ratio * (1.0 - miss_ratio) / m->sampled);
+}
+
+
+
+/**
+ * Configure the sampler.
+ *
+ * The spec is a comma separated list of
+ *   rate=r, budget=pages, points=n, max=pages, every=references, exact, default
+ * e.g. "rate=0.05,budget=32,exact".
+ *
+ * @param spec: The configuration.
+ * @return int: 0 on success, -1 on failure.
+ */
+int mrc_configure(const char *spec) {
+    char buf[256];
+    snprintf(buf, sizeof(buf), "%s", spec);
+    for (char *token = strtok(buf, ","); token != NULL; token = strtok(NULL, ",")) {
+        char *value = strchr(token, '=');
+        if (value) *value++ = 0;
+        bool known = true;
+        if (value && strcmp(token, "rate") == 0) mrc_config.rate = atof(value);
+        else if (value && strcmp(token, "budget") == 0) mrc_config.budget = atoi(value);
+        else if (value && strcmp(token, "points") == 0) mrc_config.points = atoi(value);
+        else if (value && strcmp(token, "max") == 0) mrc_config.max_size = atoi(value);
+        else if (value && strcmp(token, "every") == 0) mrc_config.every = atol(value);
+        else if (strcmp(token, "exact") == 0) mrc_config.exact = true;
+        else if (strcmp(token, "default") != 0) known = false;
+        if (!known) {
+            fprintf(stderr, "mrc_configure: Error: Bad option %s\n", token);
+            return -1;
+        }
+    }
+    if (mrc_config.rate <= 0.0 || mrc_config.rate > 1.0 || mrc_config.budget < 1
+        || mrc_config.points < 1 || mrc_config.max_size < 1 || mrc_config.every < 0) {
+        fprintf(stderr, "mrc_configure: Error: Bad sampler, rate is in (0, 1]\n");
+        return -1;
+    }
+    return 0;
+}
+
+
+
+/**
+ * Print the curves, next to the exact ones if there are.
+ *
+ * @param m: The sampler.
+ * @param exact: Exact curves of the same stream, may be NULL.
+ * @return void
+ */
+void mrc_report(const struct mrc *m, const struct mrc *exact) {
+    size_t bytes = m->budget * (sizeof(*m->stack) + sizeof(*m->hashes) + m->points * sizeof(*m->fifo->keys))
+        + (m->points + 2) * sizeof(*m->hist) + m->points * sizeof(*m->fifo);
+    double lru_error = 0.0, fifo_error = 0.0;
+
+    printf("\n=========== MISS RATIO CURVES (%ld references) ===========\n", m->refs);
+    printf("Sampling rate %.4f, %d of %d pages tracked, %ld references sampled, %zu B\n",
+           mrc_rate(m), m->count, m->budget, m->sampled, bytes);
+    printf("%6s  %-16s  %-16s%s\n", "pages", "LRU", "FIFO", exact ? "  exact LRU  exact FIFO" : "");
+    for (int k = 1; k <= m->points; k++) {
+        double lru = mrc_lru(m, k), fifo = mrc_fifo(m, k);
+        printf("%6.0f  %6.2f%% +-%5.2f%%  %6.2f%% +-%5.2f%%", point_size(m, k),
+               100 * lru, 100 * mrc_error(m, lru), 100 * fifo, 100 * mrc_error(m, fifo));
+        if (exact) {
+            printf("  %8.2f%%  %9.2f%%", 100 * mrc_lru(exact, k), 100 * mrc_fifo(exact, k));
+            lru_error += fabs(lru - mrc_lru(exact, k));
+            fifo_error += fabs(fifo - mrc_fifo(exact, k));
+        }
+        printf("\n");
+    }
+    if (exact) {
+        printf("Mean absolute error: LRU %.2f%%, FIFO %.2f%%\n",
+               100 * lru_error / m->points, 100 * fifo_error / m->points);
+    }
+}
@@ -0,0 +1,62 @@
+#ifndef MRC_H
+#define MRC_H
+
+/**
+ * Sampled miss ratio curves (SHARDS) of the page stream of simulator.c.
+ */
+
+#include <stdbool.h>
+
+#define MRC_MODULUS (1u << 24)
+
+// Options of the sampler, from mrc_configure().
+struct mrc_config
+{
+    double rate;            // Initial sampling rate
+    int budget;             // Sampled pages tracked at most
+    int points;
+    int max_size;
+    long every;             // Print the curves every so many references, 0 for only at the end
+    bool exact;             // Also compute the exact curves to measure the error
+};
+
+extern struct mrc_config mrc_config;
+
+struct fifo_sim
+{
+    long *keys;             // Ring of the sampled pages in the cache
+    int head;
+    int count;
+    long misses;
+};
+
+struct mrc
+{
+    unsigned int threshold; // A page is sampled if hash(page) < threshold, rate = threshold / MRC_MODULUS
+    int budget;             // Sampled pages tracked at most
+    int points;             // Cache sizes on the curve
+    int max_size;           // Largest cache size, in pages
+
+    int count;              // Sampled pages tracked now
+    long *stack;            // Their LRU stack, most recent first
+    unsigned int *hashes;   // Hash of each stack entry
+    double *hist;           // Sampled references by LRU size bucket, [points + 1] is beyond max_size
+    double cold;            // Sampled references to pages seen for the first time
+    struct fifo_sim *fifo;  // A scaled-down FIFO cache per point
+
+    long refs;
+    long sampled;
+};
+
+int mrc_configure(const char *spec);
+struct mrc *mrc_create(double rate, int budget, int points, int max_size);
+void mrc_destroy(struct mrc *m);
+void mrc_reset(struct mrc *m);
+void mrc_access(struct mrc *m, long page);
+double mrc_rate(const struct mrc *m);
+double mrc_lru(const struct mrc *m, int point);
+double mrc_fifo(const struct mrc *m, int point);
+double mrc_error(const struct mrc *m, double miss_ratio);
+void mrc_report(const struct mrc *m, const struct mrc *exact);
+
+#endif
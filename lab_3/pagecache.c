@@ -0,0 +1,725 @@
+/**
+ * Host model of several processes mapping files and anonymous memory over
+ * one page cache, for page cache pressure when services share a machine.
+ *
+ * simulator.c models one process with its page table. Here every process
+ * has its own page table, and the frames (-f) hold both its anonymous
+ * pages and the page cache, which is shared: a file page read by one
+ * process is a minor fault for the next one mapping it.
+ *
+ * - readahead: a fault on a file page that follows the previous one reads
+ *   a window ahead, doubling up to readahead_max. A fault on a page marked
+ *   in that window starts the next window (async readahead). A random
+ *   fault reads around the page, unless the mapping is advised random.
+ * - writeback: shared mappings dirty the page cache, writers over
+ *   dirty_ratio flush down to dirty_background_ratio themselves, a
+ *   background flush writes everything every flush_interval references,
+ *   and reclaim writes what is left.
+ * - reclaim: active and inactive lists of anonymous and file pages. The
+ *   active list is shrunk to the size of the inactive one, a referenced
+ *   inactive page is activated, the others are evicted. Anonymous pages
+ *   go to swap. Anonymous and file lists are scanned in proportion to
+ *   their size weighted by swappiness and 200 - swappiness.
+ *
+ * Trace format, one operation per line:
+ *   <pid> mmap <vpage> <npages> <file> <file page> [ro|shared|private] [normal|sequential|random]
+ *   <pid> anon <vpage> <npages>
+ *   <pid> munmap <vpage>
+ *   <pid> r|w <address>
+ *   <pid> exit
+ * with # comments.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "simulator.h"
+#include "pagecache.h"
+
+struct page_cache page_cache = {
+    .readahead_max = 32,
+    .readahead_init = 4,
+    .swappiness = 60,
+    .dirty_ratio = 20,
+    .dirty_background_ratio = 10,
+    .flush_interval = 1000,
+    .trace = "mappings.txt",
+};
+
+// What is in a frame.
+struct pc_page
+{
+    bool used;
+    bool file;
+    int owner;              // File, or the pid of an anonymous page
+    int index;              // File page, or virtual page of an anonymous page
+    bool dirty;
+    bool referenced;
+    bool readahead_mark;    // A fault on it starts the next readahead window
+    bool readahead_unused;  // Read ahead and not referenced yet
+    int mapcount;           // Page tables mapping it
+    int list;
+    int prev;
+    int next;
+};
+
+static struct pc_page pages[NUM_OF_FRAMES];
+static struct { int head, tail, size; } lists[PC_LISTS];
+static struct pc_process procs[PC_MAX_PROCS];
+static struct pc_vma vmas[PC_MAX_VMAS];
+static char file_names[PC_MAX_FILES][PC_NAME_SIZE];
+static int file_size[PC_MAX_FILES];
+static int num_files;
+static int cache_frame[PC_MAX_FILES][PC_MAX_FILE_PAGES];   // Frame of a file page, -1 if not cached
+static int nr_dirty;        // Dirty file pages
+static long refs;
+static long scanned[2];     // Reclaim scans of anonymous and file pages
+
+
+
+// ============================ LISTS ============================
+
+static void list_del(int frame) {
+    struct pc_page *p = &pages[frame];
+    if (p->prev >= 0) pages[p->prev].next = p->next;
+    else lists[p->list].head = p->next;
+    if (p->next >= 0) pages[p->next].prev = p->prev;
+    else lists[p->list].tail = p->prev;
+    lists[p->list].size--;
+}
+
+
+
+static void list_add(int frame, int list) {
+    struct pc_page *p = &pages[frame];
+    p->list = list;
+    p->prev = -1;
+    p->next = lists[list].head;
+    if (lists[list].head >= 0) pages[lists[list].head].prev = frame;
+    else lists[list].tail = frame;
+    lists[list].head = frame;
+    lists[list].size++;
+}
+
+
+
+static void list_move(int frame, int list) {
+    list_del(frame);
+    list_add(frame, list);
+}
+
+
+
+static int resident(bool file) {
+    return file ? lists[PC_FILE_INACTIVE].size + lists[PC_FILE_ACTIVE].size
+                : lists[PC_ANON_INACTIVE].size + lists[PC_ANON_ACTIVE].size;
+}
+
+
+
+// ============================ WRITEBACK ============================
+
+static void writeback(int frame) {
+    pages[frame].dirty = false;
+    nr_dirty--;
+}
+
+
+
+static void set_dirty(int frame) {
+    struct pc_page *p = &pages[frame];
+    if (p->dirty) return;
+    p->dirty = true;
+    if (!p->file) return;
+    nr_dirty++;
+    if (nr_dirty > page_cache.peak_dirty) page_cache.peak_dirty = nr_dirty;
+
+    // The writer flushes the oldest dirty pages itself
+    if (nr_dirty * 100 <= page_cache.dirty_ratio * num_frames) return;
+    for (int list = PC_FILE_INACTIVE; list <= PC_FILE_ACTIVE; list++) {
+        for (int f = lists[list].tail; f >= 0; f = pages[f].prev) {
+            if (nr_dirty * 100 <= page_cache.dirty_background_ratio * num_frames) return;
+            if (!pages[f].dirty) continue;
+            writeback(f);
+            page_cache.writeback_throttled++;
+        }
+    }
+}
+
+
+
+static void flush(void) {
+    for (int f = 0; f < num_frames; f++) {
+        if (pages[f].used && pages[f].file && pages[f].dirty) {
+            writeback(f);
+            page_cache.writeback_flush++;
+        }
+    }
+}
+
+
+
+// ============================ RECLAIM ============================
+
+static void unmap_file_page(int frame) {
+    struct pc_page *p = &pages[frame];
+    for (int k = 0; k < PC_MAX_VMAS && p->mapcount > 0; k++) {
+        struct pc_vma *v = &vmas[k];
+        int vpage = v->start + p->index - v->file_page;
+        if (!v->used || v->file != p->owner || vpage < v->start || vpage >= v->start + v->npages) continue;
+        if (procs[v->pid].pte[vpage] == frame) {
+            procs[v->pid].pte[vpage] = -1;
+            p->mapcount--;
+        }
+    }
+}
+
+
+
+static void evict(int frame) {
+    struct pc_page *p = &pages[frame];
+    if (p->file) {
+        if (p->dirty) {
+            writeback(frame);
+            page_cache.writeback_reclaim++;
+        }
+        if (p->readahead_unused) page_cache.readahead_wasted++;
+        unmap_file_page(frame);
+        cache_frame[p->owner][p->index] = -1;
+        page_cache.evicted_file++;
+    } else {
+        // A clean page swapped in before still has its copy in the swap
+        if (p->dirty) page_cache.swap_outs++;
+        procs[p->owner].pte[p->index] = -1;
+        procs[p->owner].in_swap[p->index] = true;
+        page_cache.evicted_anon++;
+    }
+    list_del(frame);
+    p->used = false;
+}
+
+
+
+/**
+ * Scan one page of the anonymous or file lists.
+ *
+ * @return int: The frame freed, -1 if the page was activated instead.
+ */
+static int shrink(bool file) {
+    int inactive = file ? PC_FILE_INACTIVE : PC_ANON_INACTIVE;
+    int active = inactive + 1;
+    if (lists[active].size > lists[inactive].size || lists[inactive].size == 0) {
+        int f = lists[active].tail;
+        pages[f].referenced = false;
+        list_move(f, inactive);
+        page_cache.deactivations++;
+    }
+    int frame = lists[inactive].tail;
+    scanned[file]++;
+    if (pages[frame].referenced) {
+        pages[frame].referenced = false;
+        list_move(frame, active);
+        page_cache.activations++;
+        return -1;
+    }
+    evict(frame);
+    return frame;
+}
+
+
+
+/**
+ * Take a free frame, reclaiming one if there is none.
+ *
+ * @return int: The frame.
+ */
+static int alloc_frame(void) {
+    for (int f = 0; f < num_frames; f++) {
+        if (!pages[f].used) return f;
+    }
+    int frame = -1;
+    while (frame < 0) {
+        int anon = resident(false), file = resident(true);
+        double weight_anon = (double)page_cache.swappiness * anon;
+        double weight_file = (double)(200 - page_cache.swappiness) * file;
+        bool scan_file;
+        if (anon == 0 || file == 0 || weight_anon + weight_file == 0) scan_file = file > 0;
+        else scan_file = scanned[0] >= weight_anon / (weight_anon + weight_file) * (scanned[0] + scanned[1] + 1);
+        frame = shrink(scan_file);
+    }
+    return frame;
+}
+
+
+
+static int new_page(bool file, int owner, int index, int list) {
+    int frame = alloc_frame();
+    pages[frame] = (struct pc_page){ .used = true, .file = file, .owner = owner, .index = index };
+    list_add(frame, list);
+    int n = resident(file);
+    if (file && n > page_cache.peak_file) page_cache.peak_file = n;
+    if (!file && n > page_cache.peak_anon) page_cache.peak_anon = n;
+    return frame;
+}
+
+
+
+// ============================ READAHEAD ============================
+
+/**
+ * Read the pages of a window that are not cached.
+ *
+ * @param async_size: Pages before the end of the window to mark, 0 for none.
+ * @return void
+ */
+static void read_window(int file, int start, int size, int async_size) {
+    for (int p = start; p < start + size && p < file_size[file]; p++) {
+        if (cache_frame[file][p] >= 0) continue;
+        int frame = new_page(true, file, p, PC_FILE_INACTIVE);
+        pages[frame].readahead_unused = true;
+        cache_frame[file][p] = frame;
+        page_cache.file_reads++;
+        page_cache.readahead_pages++;
+    }
+    int mark = start + size - async_size;
+    if (async_size > 0 && mark < file_size[file] && cache_frame[file][mark] >= 0) {
+        pages[cache_frame[file][mark]].readahead_mark = true;
+    }
+}
+
+
+
+/**
+ * Bound a window, it never takes more than a quarter of the memory.
+ */
+static int window(int size) {
+    int max = num_frames / 4 > 0 ? num_frames / 4 : 1;
+    return size < max ? size : max;
+}
+
+
+
+/**
+ * Read a faulting file page and the window around or after it.
+ *
+ * @return int: The frame of the page.
+ */
+static int sync_readahead(struct pc_vma *v, int fpage) {
+    int max = window(page_cache.readahead_max);
+    if (v->advice == PC_SEQUENTIAL || (v->advice == PC_NORMAL && fpage == v->prev_page + 1)) {
+        int size = v->advice == PC_SEQUENTIAL ? max
+            : v->ra_size ? (2 * v->ra_size < max ? 2 * v->ra_size : max) : window(page_cache.readahead_init);
+        v->ra_start = fpage + 1;
+        v->ra_size = size;
+        v->ra_async = size / 2;
+        read_window(v->file, fpage + 1, size, v->ra_async);
+    } else if (v->advice == PC_NORMAL && max > 0) {
+        // Read around
+        int start = fpage - max / 2 > 0 ? fpage - max / 2 : 0;
+        v->ra_size = 0;
+        read_window(v->file, start, fpage - start, 0);
+        read_window(v->file, fpage + 1, max - (fpage - start) - 1, 0);
+    }
+    // Last, so the window cannot evict it
+    int frame = new_page(true, v->file, fpage, PC_FILE_INACTIVE);
+    cache_frame[v->file][fpage] = frame;
+    page_cache.file_reads++;
+    return frame;
+}
+
+
+
+/**
+ * A fault hit the marked page of a window: read the next one. The mark may
+ * come from the window of another mapping of the file, then this one
+ * starts small after the page.
+ */
+static void async_readahead(struct pc_vma *v, int fpage) {
+    int max = window(page_cache.readahead_max);
+    if (fpage < v->ra_start || fpage >= v->ra_start + v->ra_size) {
+        v->ra_start = fpage + 1;
+        v->ra_size = window(page_cache.readahead_init);
+    } else {
+        v->ra_start += v->ra_size;
+        v->ra_size = 2 * v->ra_size < max ? 2 * v->ra_size : max;
+    }
+    // Mark the first page, keeping one window in flight ahead of the reader
+    v->ra_async = v->ra_size;
+    page_cache.async_readaheads++;
+    read_window(v->file, v->ra_start, v->ra_size, v->ra_async);
+}
+
+
+
+// ============================ FAULTS ============================
+
+static struct pc_vma *find_vma(int pid, int vpage) {
+    for (int k = 0; k < PC_MAX_VMAS; k++) {
+        struct pc_vma *v = &vmas[k];
+        if (v->used && v->pid == pid && vpage >= v->start && vpage < v->start + v->npages) return v;
+    }
+    return NULL;
+}
+
+
+
+static void fault(struct pc_process *proc, int pid, struct pc_vma *v, int vpage) {
+    int frame;
+    if (v->file < 0 || proc->in_swap[vpage]) {
+        frame = new_page(false, pid, vpage, PC_ANON_INACTIVE);
+        if (proc->in_swap[vpage]) {
+            proc->in_swap[vpage] = false;
+            proc->major_faults++;
+            page_cache.swap_ins++;
+        } else {
+            // Zero filled, has no copy anywhere
+            pages[frame].dirty = true;
+            proc->minor_faults++;
+        }
+    } else {
+        int fpage = v->file_page + vpage - v->start;
+        frame = cache_frame[v->file][fpage];
+        if (frame >= 0) {
+            proc->minor_faults++;
+            if (pages[frame].readahead_unused) {
+                pages[frame].readahead_unused = false;
+                page_cache.readahead_hits++;
+            }
+            if (pages[frame].readahead_mark) {
+                pages[frame].readahead_mark = false;
+                pages[frame].referenced = true;
+                async_readahead(v, fpage);
+            }
+        } else {
+            proc->major_faults++;
+            frame = sync_readahead(v, fpage);
+        }
+        v->prev_page = fpage;
+    }
+    proc->pte[vpage] = frame;
+    pages[frame].mapcount++;
+}
+
+
+
+/**
+ * Copy a private file page to an anonymous page on the first write.
+ */
+static void copy_on_write(struct pc_process *proc, int pid, int vpage) {
+    int file_frame = proc->pte[vpage];
+    pages[file_frame].referenced = true;
+    int frame = new_page(false, pid, vpage, PC_ANON_INACTIVE);
+    if (proc->pte[vpage] == file_frame) pages[file_frame].mapcount--;
+    pages[frame].dirty = true;
+    pages[frame].mapcount = 1;
+    proc->pte[vpage] = frame;
+    proc->minor_faults++;
+}
+
+
+
+/**
+ * Reference an address of a process.
+ *
+ * @param pid: The process.
+ * @param address: Virtual address.
+ * @param write: Whether the access is a write.
+ * @return void
+ */
+void pagecache_access(int pid, int address, bool write) {
+    struct pc_process *proc = &procs[pid];
+    int vpage = address / PAGE_SIZE;
+    refs++;
+    proc->refs++;
+    if (page_cache.flush_interval > 0 && refs % page_cache.flush_interval == 0) flush();
+
+    struct pc_vma *v = vpage < PC_VPAGES ? find_vma(pid, vpage) : NULL;
+    if (v == NULL || (write && v->prot == PC_RO)) {
+        proc->segfaults++;
+        return;
+    }
+    if (proc->pte[vpage] < 0) fault(proc, pid, v, vpage);
+    int frame = proc->pte[vpage];
+    pages[frame].referenced = true;
+    if (!write) return;
+    if (pages[frame].file && v->prot == PC_PRIVATE) copy_on_write(proc, pid, vpage);
+    else set_dirty(frame);
+}
+
+
+
+// ============================ MAPPINGS ============================
+
+static int find_file(const char *name) {
+    for (int k = 0; k < num_files; k++) {
+        if (strcmp(file_names[k], name) == 0) return k;
+    }
+    if (num_files == PC_MAX_FILES) return -1;
+    snprintf(file_names[num_files], PC_NAME_SIZE, "%s", name);
+    return num_files++;
+}
+
+
+
+/**
+ * Map a file, or anonymous memory, into a process.
+ *
+ * @param pid: The process.
+ * @param start: First virtual page.
+ * @param npages: Pages to map.
+ * @param file: File name, NULL for anonymous memory.
+ * @param file_page: File page mapped at start.
+ * @param prot: Read only, shared or private.
+ * @param advice: Readahead advice.
+ * @return int: 0 on success, -1 on failure.
+ */
+int pagecache_mmap(int pid, int start, int npages, const char *file, int file_page,
+                   enum pc_prot prot, enum pc_advice advice) {
+    if (pid < 0 || pid >= PC_MAX_PROCS || start < 0 || npages < 1 || start + npages > PC_VPAGES
+        || file_page < 0 || file_page + npages > PC_MAX_FILE_PAGES) {
+        fprintf(stderr, "pagecache_mmap: Error: Bad mapping of %d pages at %d\n", npages, start);
+        return -1;
+    }
+    for (int vpage = start; vpage < start + npages; vpage++) {
+        if (find_vma(pid, vpage) != NULL) {
+            fprintf(stderr, "pagecache_mmap: Error: Page %d of process %d already mapped\n", vpage, pid);
+            return -1;
+        }
+    }
+    int id = file ? find_file(file) : -1;
+    int k = 0;
+    while (k < PC_MAX_VMAS && vmas[k].used) k++;
+    if ((file && id < 0) || k == PC_MAX_VMAS) {
+        fprintf(stderr, "pagecache_mmap: Error: Out of files or mappings\n");
+        return -1;
+    }
+    vmas[k] = (struct pc_vma){
+        .used = true, .pid = pid, .start = start, .npages = npages, .file = id,
+        .file_page = file_page, .prot = file ? prot : PC_PRIVATE, .advice = advice, .prev_page = -2,
+    };
+    if (id >= 0 && file_page + npages > file_size[id]) file_size[id] = file_page + npages;
+    procs[pid].used = true;
+    return 0;
+}
+
+
+
+/**
+ * Unmap the mapping starting at a page. Anonymous pages are freed, file
+ * pages stay in the page cache.
+ *
+ * @return int: 0 on success, -1 if there is no such mapping.
+ */
+int pagecache_munmap(int pid, int start) {
+    struct pc_vma *v = pid >= 0 && pid < PC_MAX_PROCS ? find_vma(pid, start) : NULL;
+    if (v == NULL || v->start != start) {
+        fprintf(stderr, "pagecache_munmap: Error: No mapping at page %d of process %d\n", start, pid);
+        return -1;
+    }
+    struct pc_process *proc = &procs[pid];
+    for (int vpage = v->start; vpage < v->start + v->npages; vpage++) {
+        int frame = proc->pte[vpage];
+        proc->pte[vpage] = -1;
+        proc->in_swap[vpage] = false;
+        if (frame < 0) continue;
+        if (pages[frame].file) {
+            pages[frame].mapcount--;
+        } else {
+            list_del(frame);
+            pages[frame].used = false;
+        }
+    }
+    v->used = false;
+    return 0;
+}
+
+
+
+void pagecache_exit(int pid) {
+    for (int k = 0; k < PC_MAX_VMAS; k++) {
+        if (vmas[k].used && vmas[k].pid == pid) pagecache_munmap(pid, vmas[k].start);
+    }
+}
+
+
+
+/**
+ * Forget every process, file and page.
+ *
+ * @return void
+ */
+void pagecache_reset(void) {
+    memset(pages, 0, sizeof(pages));
+    for (int k = 0; k < PC_LISTS; k++) {
+        lists[k].head = lists[k].tail = -1;
+        lists[k].size = 0;
+    }
+    memset(procs, 0, sizeof(procs));
+    for (int pid = 0; pid < PC_MAX_PROCS; pid++) {
+        for (int vpage = 0; vpage < PC_VPAGES; vpage++) procs[pid].pte[vpage] = -1;
+    }
+    memset(vmas, 0, sizeof(vmas));
+    memset(file_size, 0, sizeof(file_size));
+    memset(cache_frame, -1, sizeof(cache_frame));
+    num_files = nr_dirty = 0;
+    refs = scanned[0] = scanned[1] = 0;
+    page_cache.file_reads = page_cache.readahead_pages = 0;
+    page_cache.readahead_hits = page_cache.readahead_wasted = page_cache.async_readaheads = 0;
+    page_cache.writeback_flush = page_cache.writeback_throttled = page_cache.writeback_reclaim = 0;
+    page_cache.swap_outs = page_cache.swap_ins = 0;
+    page_cache.evicted_file = page_cache.evicted_anon = 0;
+    page_cache.activations = page_cache.deactivations = 0;
+    page_cache.peak_file = page_cache.peak_anon = page_cache.peak_dirty = 0;
+}
+
+
+
+/**
+ * Configure the model.
+ *
+ * The spec is a comma separated list of
+ *   trace=file, ra=pages, swappiness=0-200, dirty=percent,
+ *   background=percent, flush=references, default
+ * e.g. "trace=mappings.txt,ra=16,swappiness=100".
+ *
+ * @param spec: The configuration.
+ * @return int: 0 on success, -1 on failure.
+ */
+int pagecache_configure(const char *spec) {
+    char buf[256];
+    snprintf(buf, sizeof(buf), "%s", spec);
+    for (char *token = strtok(buf, ","); token != NULL; token = strtok(NULL, ",")) {
+        char *value = strchr(token, '=');
+        if (value) *value++ = 0;
+        bool known = true;
+        if (value && strcmp(token, "trace") == 0) snprintf(page_cache.trace, sizeof(page_cache.trace), "%s", value);
+        else if (value && strcmp(token, "ra") == 0) page_cache.readahead_max = atoi(value);
+        else if (value && strcmp(token, "swappiness") == 0) page_cache.swappiness = atoi(value);
+        else if (value && strcmp(token, "dirty") == 0) page_cache.dirty_ratio = atoi(value);
+        else if (value && strcmp(token, "background") == 0) page_cache.dirty_background_ratio = atoi(value);
+        else if (value && strcmp(token, "flush") == 0) page_cache.flush_interval = atol(value);
+        else if (strcmp(token, "default") != 0) known = false;
+        if (!known) {
+            fprintf(stderr, "pagecache_configure: Error: Bad option %s\n", token);
+            return -1;
+        }
+    }
+    if (page_cache.readahead_max < 0 || page_cache.swappiness < 0 || page_cache.swappiness > 200
+        || page_cache.dirty_ratio < 1 || page_cache.dirty_ratio > 100 || page_cache.dirty_background_ratio < 0
+        || page_cache.dirty_background_ratio > page_cache.dirty_ratio || page_cache.flush_interval < 0) {
+        fprintf(stderr, "pagecache_configure: Error: Bad page cache, swappiness is 0-200\n");
+        return -1;
+    }
+    if (page_cache.readahead_init > page_cache.readahead_max) page_cache.readahead_init = page_cache.readahead_max;
+    return 0;
+}
+
+
+
+/**
+ * Run a trace of mappings and references.
+ *
+ * @param filename: The trace.
+ * @return int: 0 on success, -1 on failure.
+ */
+int pagecache_run(const char *filename) {
+    FILE *file = fopen(filename, "r");
+    if (file == NULL) {
+        fprintf(stderr, "pagecache_run: Error: Cannot open file %s\n", filename);
+        return -1;
+    }
+    char line[256];
+    for (int number = 1; fgets(line, sizeof(line), file); number++) {
+        line[strcspn(line, "#\n")] = 0;
+        char op[16], name[PC_NAME_SIZE], prot[16] = "ro", advice[16] = "normal";
+        int pid, a, b, c;
+        int n = sscanf(line, "%d %15s", &pid, op);
+        if (n <= 0) continue;
+        bool ok = true;
+        if (n != 2 || pid < 0 || pid >= PC_MAX_PROCS) {
+            ok = false;
+        } else if (strcmp(op, "r") == 0 || strcmp(op, "w") == 0) {
+            ok = sscanf(line, "%*d %*s %d", &a) == 1 && a >= 0;
+            if (ok) pagecache_access(pid, a, op[0] == 'w');
+        } else if (strcmp(op, "mmap") == 0) {
+            ok = sscanf(line, "%*d %*s %d %d %31s %d %15s %15s", &a, &b, name, &c, prot, advice) >= 4;
+            enum pc_prot p = strcmp(prot, "shared") == 0 ? PC_SHARED : strcmp(prot, "private") == 0 ? PC_PRIVATE : PC_RO;
+            enum pc_advice adv = strcmp(advice, "sequential") == 0 ? PC_SEQUENTIAL
+                : strcmp(advice, "random") == 0 ? PC_RANDOM : PC_NORMAL;
+            ok = ok && pagecache_mmap(pid, a, b, name, c, p, adv) == 0;
+        } else if (strcmp(op, "anon") == 0) {
+            ok = sscanf(line, "%*d %*s %d %d", &a, &b) == 2 && pagecache_mmap(pid, a, b, NULL, 0, PC_PRIVATE, PC_NORMAL) == 0;
+        } else if (strcmp(op, "munmap") == 0) {
+            ok = sscanf(line, "%*d %*s %d", &a) == 1 && pagecache_munmap(pid, a) == 0;
+        } else if (strcmp(op, "exit") == 0) {
+            pagecache_exit(pid);
+        } else {
+            ok = false;
+        }
+        if (!ok) {
+            fprintf(stderr, "pagecache_run: Error: Bad line %d of %s\n", number, filename);
+            fclose(file);
+            return -1;
+        }
+    }
+    fclose(file);
+    return 0;
+}
+
+
+
+/**
+ * Print the pressure on the page cache, per process and per file.
+ *
+ * @return void
+ */
+void pagecache_report(void) {
+    long minor = 0, major = 0, segfaults = 0;
+    for (int pid = 0; pid < PC_MAX_PROCS; pid++) {
+        minor += procs[pid].minor_faults;
+        major += procs[pid].major_faults;
+        segfaults += procs[pid].segfaults;
+    }
+
+    printf("\n=========== PAGE CACHE (%d frames, %ld references) ===========\n", num_frames, refs);
+    printf("Readahead: %d pages, swappiness %d, dirty %d%%/%d%%, flush every %ld references\n",
+           page_cache.readahead_max, page_cache.swappiness, page_cache.dirty_ratio,
+           page_cache.dirty_background_ratio, page_cache.flush_interval);
+    printf("Resident: %d file pages (peak %d), %d anonymous (peak %d), %d dirty (peak %d)\n",
+           resident(true), page_cache.peak_file, resident(false), page_cache.peak_anon, nr_dirty, page_cache.peak_dirty);
+    printf("Faults: %ld minor, %ld major, %ld segmentation faults\n", minor, major, segfaults);
+    printf("File reads: %ld pages, %ld read ahead: %ld used, %ld wasted, %ld async windows\n",
+           page_cache.file_reads, page_cache.readahead_pages, page_cache.readahead_hits,
+           page_cache.readahead_wasted, page_cache.async_readaheads);
+    printf("Writeback: %ld by the flush, %ld by throttled writers, %ld by reclaim\n",
+           page_cache.writeback_flush, page_cache.writeback_throttled, page_cache.writeback_reclaim);
+    printf("Reclaim: %ld file and %ld anonymous pages evicted, %ld activations, %ld deactivations\n",
+           page_cache.evicted_file, page_cache.evicted_anon, page_cache.activations, page_cache.deactivations);
+    printf("Swap: %ld out, %ld in\n", page_cache.swap_outs, page_cache.swap_ins);
+
+    // RSS counts every mapped page, PSS splits shared ones between the processes mapping them
+    printf("%4s %8s %8s %8s %6s %8s\n", "pid", "refs", "minor", "major", "rss", "pss");
+    for (int pid = 0; pid < PC_MAX_PROCS; pid++) {
+        if (!procs[pid].used) continue;
+        int rss = 0;
+        double pss = 0;
+        for (int vpage = 0; vpage < PC_VPAGES; vpage++) {
+            int frame = procs[pid].pte[vpage];
+            if (frame < 0) continue;
+            rss++;
+            pss += 1.0 / pages[frame].mapcount;
+        }
+        printf("%4d %8ld %8ld %8ld %6d %8.1f\n", pid, procs[pid].refs, procs[pid].minor_faults,
+               procs[pid].major_faults, rss, pss);
+    }
+    printf("%-16s %6s %6s %6s\n", "file", "pages", "cached", "mapped");
+    for (int k = 0; k < num_files; k++) {
+        int cached = 0, mapped = 0;
+        for (int p = 0; p < file_size[k]; p++) {
+            if (cache_frame[k][p] < 0) continue;
+            cached++;
+            mapped += pages[cache_frame[k][p]].mapcount > 0;
+        }
+        printf("%-16s %6d %6d %6d\n", file_names[k], file_size[k], cached, mapped);
+    }
+}
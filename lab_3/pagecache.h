@@ -0,0 +1,115 @@
+#ifndef PAGECACHE_H
+#define PAGECACHE_H
+
+/**
+ * Host model of file-backed and anonymous mappings of several processes
+ * sharing one page cache (see pagecache.c).
+ */
+
+#include <stdbool.h>
+
+#define PC_MAX_PROCS 16
+#define PC_MAX_FILES 16
+#define PC_MAX_VMAS 64
+#define PC_VPAGES 4096          // Pages of a process address space
+#define PC_MAX_FILE_PAGES 4096
+#define PC_NAME_SIZE 32
+
+// Reclaim lists, Linux style.
+enum pc_list
+{
+    PC_ANON_INACTIVE,
+    PC_ANON_ACTIVE,
+    PC_FILE_INACTIVE,
+    PC_FILE_ACTIVE,
+    PC_LISTS
+};
+
+enum pc_prot
+{
+    PC_RO,              // Read only, a write is a segmentation fault
+    PC_SHARED,          // Writes dirty the page cache page
+    PC_PRIVATE          // Writes copy the page to an anonymous page
+};
+
+enum pc_advice
+{
+    PC_NORMAL,          // Read-around on a random fault, ramping readahead when sequential
+    PC_SEQUENTIAL,      // Always the largest window
+    PC_RANDOM           // No readahead
+};
+
+struct pc_vma
+{
+    bool used;
+    int pid;
+    int start;          // First virtual page
+    int npages;
+    int file;           // -1 for anonymous memory
+    int file_page;      // File page mapped at start
+    enum pc_prot prot;
+    enum pc_advice advice;
+
+    // Readahead state
+    int ra_start;       // Window of the last readahead
+    int ra_size;
+    int ra_async;       // Pages from the end of the window the next one is started at
+    int prev_page;      // File page of the last fault
+};
+
+struct pc_process
+{
+    bool used;
+    int pte[PC_VPAGES];         // Frame mapped at a virtual page, -1 if none
+    bool in_swap[PC_VPAGES];    // Anonymous page swapped out
+
+    // Statistics
+    long refs;
+    long minor_faults;          // Zero fill, page cache hit, copy on write
+    long major_faults;          // Read from a file or the swap
+    long segfaults;             // Unmapped page, or a write to a read only one
+};
+
+struct page_cache
+{
+    int readahead_max;          // Pages
+    int readahead_init;         // Pages of the first sequential window
+    int swappiness;             // 0-200, anon against file reclaim as in vm.swappiness
+    int dirty_ratio;            // Percent of the frames dirty before writers flush themselves
+    int dirty_background_ratio; // Percent the flushes go down to
+    long flush_interval;        // References between background flushes of every dirty page, 0 for none
+    char trace[256];            // Trace of mappings and references
+
+    // Statistics
+    long file_reads;            // Pages read from files
+    long readahead_pages;       // ... ahead of a fault
+    long readahead_hits;        // ... referenced before their eviction
+    long readahead_wasted;      // ... evicted untouched
+    long async_readaheads;      // Windows started by a hit on the marker page
+    long writeback_flush;       // Dirty file pages written by the background flush
+    long writeback_throttled;   // ... by writers over dirty_ratio
+    long writeback_reclaim;     // ... by reclaim
+    long swap_outs;
+    long swap_ins;
+    long evicted_file;
+    long evicted_anon;
+    long activations;           // Inactive pages referenced again, moved to the active list
+    long deactivations;
+    int peak_file;              // Most page cache pages resident at once
+    int peak_anon;
+    int peak_dirty;
+};
+
+extern struct page_cache page_cache;
+
+int pagecache_configure(const char *spec);
+void pagecache_reset(void);
+int pagecache_mmap(int pid, int start, int npages, const char *file, int file_page,
+                   enum pc_prot prot, enum pc_advice advice);
+int pagecache_munmap(int pid, int start);
+void pagecache_exit(int pid);
+void pagecache_access(int pid, int address, bool write);
+int pagecache_run(const char *filename);
+void pagecache_report(void);
+
+#endif
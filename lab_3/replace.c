@@ -0,0 +1,388 @@
+/**
+ * Frame replacement policies for demand paging in simulator.c.
+ *
+ * - fifo:   evict in load order
+ * - lru:    exact LRU, the reference the approximations are measured against
+ * - clock:  second chance, a hand skips (and clears) referenced frames
+ * - eclock: enhanced clock, prefers (unreferenced, clean) over
+ *           (unreferenced, dirty) over referenced frames
+ * - nfu:    not frequently used, counts ticks with the page referenced
+ * - aging:  NFU with 8-bit shift registers, so old references fade out
+ * - 2q:     FIFO probation queue (A1in), ghost queue of its evictions (A1out)
+ *           and an LRU main queue (Am) for pages referenced again
+ * - arc:    adaptive replacement cache, balances a recency list and a
+ *           frequency list with their ghost lists
+ *
+ * clock, eclock, nfu and aging only see the referenced and dirty bits,
+ * like a real kernel. lru, 2q and arc see every reference.
+ *
+ * victim() can be called several times in a row when the simulator
+ * reclaims down to a watermark, so frames freed before are skipped.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "simulator.h"
+#include "checkpoint.h"
+
+
+
+// ============================ PAGE LISTS ============================
+
+// Doubly linked lists of pages, a page is on at most one list at a time.
+// head is the MRU (or newest) end, tail the LRU (or oldest) end.
+struct page_list
+{
+    int head;
+    int tail;
+    int size;
+};
+
+static int list_of[MAX_NUM_OF_PAGES];   // Index of the list a page is on, -1 if none
+static int prev_page[MAX_NUM_OF_PAGES];
+static int next_page[MAX_NUM_OF_PAGES];
+static struct page_list lists[4];
+
+
+
+static void lists_reset(void) {
+    for (int k = 0; k < 4; k++) {
+        lists[k].head = lists[k].tail = -1;
+        lists[k].size = 0;
+    }
+    for (int page = 0; page < MAX_NUM_OF_PAGES; page++) {
+        list_of[page] = -1;
+    }
+}
+
+
+
+static void list_remove(int page) {
+    struct page_list *l = &lists[list_of[page]];
+    if (prev_page[page] != -1) next_page[prev_page[page]] = next_page[page];
+    else l->head = next_page[page];
+    if (next_page[page] != -1) prev_page[next_page[page]] = prev_page[page];
+    else l->tail = prev_page[page];
+    l->size--;
+    list_of[page] = -1;
+}
+
+
+
+/**
+ * Put a page at the head of a list, taking it off its current list.
+ */
+static void list_push(int list, int page) {
+    if (list_of[page] != -1) list_remove(page);
+    struct page_list *l = &lists[list];
+    prev_page[page] = -1;
+    next_page[page] = l->head;
+    if (l->head != -1) prev_page[l->head] = page;
+    else l->tail = page;
+    l->head = page;
+    l->size++;
+    list_of[page] = list;
+}
+
+
+
+/**
+ * Take the page at the tail of a list off it.
+ *
+ * @return int: The page, -1 if the list is empty.
+ */
+static int list_pop_tail(int list) {
+    int page = lists[list].tail;
+    if (page != -1) list_remove(page);
+    return page;
+}
+
+
+
+// ============================ FIFO ============================
+
+static int fifo_victim(int page) {
+    (void)page;
+    int victim = -1;
+    for (int f = 0; f < num_frames; f++) {
+        if (frame_table[f].page == -1) continue;
+        if (victim == -1 || frame_table[f].loaded_at < frame_table[victim].loaded_at) victim = f;
+    }
+    return victim;
+}
+
+
+
+// ============================ LRU ============================
+
+static int lru_victim(int page) {
+    (void)page;
+    int victim = -1;
+    for (int f = 0; f < num_frames; f++) {
+        if (frame_table[f].page == -1) continue;
+        if (victim == -1 || frame_table[f].last_use < frame_table[victim].last_use) victim = f;
+    }
+    return victim;
+}
+
+
+
+// ============================ CLOCK ============================
+
+static int clock_hand = 0;
+
+static void clock_reset(void) {
+    clock_hand = 0;
+}
+
+
+
+/**
+ * Second chance: skip referenced frames, clearing their bit.
+ */
+static int clock_victim(int page) {
+    (void)page;
+    for (;;) {
+        int f = clock_hand;
+        clock_hand = (clock_hand + 1) % num_frames;
+        int resident = frame_table[f].page;
+        if (resident == -1) continue;
+        if (!page_table[resident].referenced) return f;
+        clear_reference_bit(resident);
+    }
+}
+
+
+
+/**
+ * Enhanced clock: up to four sweeps over the frames
+ *   1. look for (0, 0) without touching the bits
+ *   2. look for (0, 1), clearing the referenced bit of every frame passed
+ *   3./4. repeat, now every frame is unreferenced
+ */
+static int eclock_victim(int page) {
+    (void)page;
+    for (int round = 0; round < 4; round++) {
+        bool want_dirty = round % 2 == 1;
+        for (int k = 0; k < num_frames; k++) {
+            int f = clock_hand;
+            clock_hand = (clock_hand + 1) % num_frames;
+            if (frame_table[f].page == -1) continue;
+            struct page_table_entry *pte = &page_table[frame_table[f].page];
+            if (!pte->referenced && pte->dirty == want_dirty) return f;
+            if (want_dirty) clear_reference_bit(frame_table[f].page);
+        }
+    }
+    return clock_hand;
+}
+
+
+
+// ============================ NFU / AGING ============================
+
+static int nfu_victim(int page) {
+    (void)page;
+    int victim = -1;
+    for (int f = 0; f < num_frames; f++) {
+        if (frame_table[f].page == -1) continue;
+        if (victim == -1 || frame_table[f].nfu < frame_table[victim].nfu
+            || (frame_table[f].nfu == frame_table[victim].nfu && frame_table[f].loaded_at < frame_table[victim].loaded_at)) {
+            victim = f;
+        }
+    }
+    return victim;
+}
+
+
+
+/**
+ * Lowest shift register, the referenced bit of the current tick breaks ties.
+ */
+static int aging_victim(int page) {
+    (void)page;
+    int victim = -1;
+    int victim_key = 0;
+    for (int f = 0; f < num_frames; f++) {
+        if (frame_table[f].page == -1) continue;
+        int key = frame_table[f].age << 1 | page_table[frame_table[f].page].referenced;
+        if (victim == -1 || key < victim_key
+            || (key == victim_key && frame_table[f].loaded_at < frame_table[victim].loaded_at)) {
+            victim = f;
+            victim_key = key;
+        }
+    }
+    return victim;
+}
+
+
+
+// ============================ 2Q ============================
+
+enum { Q_A1IN, Q_A1OUT, Q_AM };
+
+static void twoq_reset(void) {
+    lists_reset();
+}
+
+
+
+/**
+ * Evict from the probation queue while it is over a quarter of the frames,
+ * remembering the page in A1out (up to half the frames), else from Am.
+ */
+static int twoq_victim(int page) {
+    (void)page;
+    int kin = num_frames / 4 > 0 ? num_frames / 4 : 1;
+    int kout = num_frames / 2 > 0 ? num_frames / 2 : 1;
+    int evict;
+    if (lists[Q_A1IN].size > kin || lists[Q_AM].size == 0) {
+        evict = list_pop_tail(Q_A1IN);
+        list_push(Q_A1OUT, evict);
+        if (lists[Q_A1OUT].size > kout) list_pop_tail(Q_A1OUT);
+    } else {
+        evict = list_pop_tail(Q_AM);
+    }
+    return page_table[evict].frame_num;
+}
+
+static void twoq_loaded(int frame, int page) {
+    (void)frame;
+    list_push(list_of[page] == Q_A1OUT ? Q_AM : Q_A1IN, page);
+}
+
+static void twoq_access(int frame) {
+    int page = frame_table[frame].page;
+    if (list_of[page] == Q_AM) list_push(Q_AM, page);
+}
+
+
+
+// ============================ ARC ============================
+
+enum { ARC_T1, ARC_T2, ARC_B1, ARC_B2 };
+
+static int arc_p = 0;           // Target size of T1
+
+static void arc_reset(void) {
+    lists_reset();
+    arc_p = 0;
+}
+
+
+
+/**
+ * A ghost hit moves the target: towards recency on a B1 hit, towards
+ * frequency on a B2 hit.
+ */
+static void arc_fault(int page) {
+    int b1 = lists[ARC_B1].size, b2 = lists[ARC_B2].size;
+    if (list_of[page] == ARC_B1) {
+        int delta = b1 >= b2 ? 1 : b2 / b1;
+        arc_p = arc_p + delta < num_frames ? arc_p + delta : num_frames;
+    } else if (list_of[page] == ARC_B2) {
+        int delta = b2 >= b1 ? 1 : b1 / b2;
+        arc_p = arc_p - delta > 0 ? arc_p - delta : 0;
+    }
+}
+
+
+
+static int arc_victim(int page) {
+    int t1 = lists[ARC_T1].size;
+    int t2 = lists[ARC_T2].size;
+    int evict;
+    // Evicting down to a watermark can empty the list REPLACE picks, the
+    // other one has to give a page then
+    if (t1 > 0 && (t2 == 0 || t1 > arc_p || (list_of[page] == ARC_B2 && t1 == arc_p))) {
+        evict = list_pop_tail(ARC_T1);
+        list_push(ARC_B1, evict);
+    } else if (t2 > 0) {
+        evict = list_pop_tail(ARC_T2);
+        list_push(ARC_B2, evict);
+    } else {
+        // No resident page is on the lists, take the oldest frame
+        return fifo_victim(page);
+    }
+    return page_table[evict].frame_num;
+}
+
+
+
+/**
+ * Ghost hits go to T2, new pages to T1. The ghost lists are then trimmed
+ * so that |T1| + |B1| <= c and everything together <= 2c.
+ */
+static void arc_loaded(int frame, int page) {
+    (void)frame;
+    bool ghost = list_of[page] == ARC_B1 || list_of[page] == ARC_B2;
+    list_push(ghost ? ARC_T2 : ARC_T1, page);
+    if (lists[ARC_T1].size + lists[ARC_B1].size > num_frames) list_pop_tail(ARC_B1);
+    while (lists[ARC_T1].size + lists[ARC_T2].size + lists[ARC_B1].size + lists[ARC_B2].size > 2 * num_frames) {
+        if (list_pop_tail(ARC_B2) == -1) list_pop_tail(ARC_B1);
+    }
+}
+
+static void arc_access(int frame) {
+    list_push(ARC_T2, frame_table[frame].page);
+}
+
+
+
+static void no_reset(void) {}
+static void no_fault(int page) { (void)page; }
+static void no_loaded(int frame, int page) { (void)frame; (void)page; }
+static void no_access(int frame) { (void)frame; }
+
+const struct replace_ops replace_policies[] = {
+    { "fifo", no_reset, no_fault, fifo_victim, no_loaded, no_access },
+    { "lru", no_reset, no_fault, lru_victim, no_loaded, no_access },
+    { "clock", clock_reset, no_fault, clock_victim, no_loaded, no_access },
+    { "eclock", clock_reset, no_fault, eclock_victim, no_loaded, no_access },
+    { "nfu", no_reset, no_fault, nfu_victim, no_loaded, no_access },
+    { "aging", no_reset, no_fault, aging_victim, no_loaded, no_access },
+    { "2q", twoq_reset, no_fault, twoq_victim, twoq_loaded, twoq_access },
+    { "arc", arc_reset, arc_fault, arc_victim, arc_loaded, arc_access },
+};
+const int num_of_replace_policies = sizeof(replace_policies) / sizeof(replace_policies[0]);
+
+
+
+/**
+ * Find a policy by name.
+ *
+ * @return The policy, NULL if there is none with that name.
+ */
+const struct replace_ops *find_policy(const char *name) {
+    for (int k = 0; k < num_of_replace_policies; k++) {
+        if (strcmp(replace_policies[k].name, name) == 0) return &replace_policies[k];
+    }
+    return NULL;
+}
+
+
+
+/**
+ * Take a page the process unmapped off the policy lists, the other
+ * policies only look at the frame table.
+ *
+ * @return void
+ */
+void replace_forget(int page) {
+    if (list_of[page] != -1) list_remove(page);
+}
+
+
+
+/**
+ * Register the state of the policies for a checkpoint.
+ *
+ * @return void
+ */
+void replace_checkpoint(void) {
+    checkpoint_add("replace.list_of", list_of, sizeof(list_of), CHECKPOINT_STATE);
+    checkpoint_add("replace.prev_page", prev_page, sizeof(prev_page), CHECKPOINT_STATE);
+    checkpoint_add("replace.next_page", next_page, sizeof(next_page), CHECKPOINT_STATE);
+    checkpoint_add("replace.lists", lists, sizeof(lists), CHECKPOINT_STATE);
+    checkpoint_add("replace.clock_hand", &clock_hand, sizeof(clock_hand), CHECKPOINT_STATE);
+    checkpoint_add("replace.arc_p", &arc_p, sizeof(arc_p), CHECKPOINT_STATE);
+}
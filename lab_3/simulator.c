@@ -3,8 +3,39 @@
  * using a TLB (Translation Lookaside Buffer) to speed up the process.
  * 
  * ### NOTES ###
- * - Command to run: "gcc simulator.c -o simulator; ./simulator;"
+ * - Command to run: "gcc simulator.c replace.c cache.c frames.c swap.c zswap.c mrc.c daemon.c checkpoint.c pagecache.c tier.c smp.c -o simulator -lm; ./simulator;"
  * - The page_table and physical_memory arrays should hold char (1 byte) values.
+ * - Without options every page is preloaded from correct.txt. With -f (frames)
+ *   or -p (replacement policy) pages are loaded on demand instead, with
+ *   correct.txt as the backing store, and evicted by the policy when the
+ *   frames run out: "./simulator -q -f 64 -p all -W 30"
+ * - A trace token prefixed with "w" (e.g. "w16916") is a write.
+ * - -c runs the physical addresses through a data cache hierarchy (see
+ *   cache.c): "./simulator -q -c l1=2k:2:4,vipt,exclusive"
+ * - -a places pages with a frame allocator (see frames.c) instead of the
+ *   frames in correct.txt, "-a all" compares them: "./simulator -q -a all -f 64 -w 8"
+ * - -D gives page faults a swap device (see swap.c), "-D all" compares the
+ *   presets: "./simulator -q -f 64 -D sata,cluster=4,readahead=4 -D all"
+ * - -Z puts a compressed swap pool (see zswap.c) in front of the backing
+ *   store, its budget comes out of the frames: "./simulator -q -f 64 -Z pool=2k -D hdd"
+ * - -m samples the page stream into LRU and FIFO miss ratio curves in a
+ *   fixed budget (see mrc.c), "exact" shows the error: "./simulator -q -m rate=0.25,exact"
+ * - -S keeps the simulator resident and translates binary batches of
+ *   addresses sent over a Unix domain socket, or stdin with "-S -" (see
+ *   daemon.h): "./simulator -f 64 -S /tmp/simulator.sock"
+ * - -F runs the first references of the trace without statistics or
+ *   timing, -C saves the state after it and -R starts from a saved state
+ *   instead of reference zero (see checkpoint.c):
+ *   "./simulator -q -f 64 -p arc -F 500 -C warm.ckpt; ./simulator -q -f 64 -p arc -R warm.ckpt -D hdd"
+ * - -M runs a trace of several processes mapping files and anonymous
+ *   memory over a shared page cache instead (see pagecache.c and
+ *   mappings.txt): "./simulator -f 128 -M ra=16,swappiness=100"
+ * - -T splits the frames into a fast and a slow memory tier and migrates
+ *   hot pages to the fast one (see tier.c): "./simulator -q -T fast=32,sample"
+ * - -P runs the trace on several cores with a TLB each, evictions and
+ *   migrations shoot the pages down with IPIs (see smp.c), trace tokens
+ *   "p<address>" and "u<address>" are mprotect and munmap events:
+ *   "./simulator -q -f 64 -T fast=32 -P cores=8,batch=8"
  * 
  * ### TODO ###
  * -
@@ -18,35 +49,36 @@
 #include <string.h>
 #include <math.h>
 #include <stdbool.h>
+#include <unistd.h>
+#include "simulator.h"
+#include "cache.h"
+#include "swap.h"
+#include "zswap.h"
+#include "mrc.h"
+#include "daemon.h"
+#include "checkpoint.h"
+#include "pagecache.h"
+#include "tier.h"
+#include "smp.h"
 
 // Check TLB => Not in TLB => Check Page table => Not in page table => check backing store => 
 
 
-// Parameters given by the assignment
-#define MAX_NUM_OF_PAGES 256
-#define PAGE_SIZE 256
-#define NUM_OF_FRAMES 256
-#define FRAME_SIZE 256
-#define TLB_SIZE 16
-
-// TLB variables
-int tlb_head = 0;    // Points to the oldest entry (to evict next if TLB is full)
-int tlb_count = 0;   // Tracks the number of entries currently in the TLB
+// TLB variables, per core
+int tlb_head[MAX_CORES];    // Points to the oldest entry (to evict next if TLB is full)
+int tlb_count[MAX_CORES];   // Tracks the number of entries currently in the TLB
+int current_core = 0;
 
 // Page table
 // A 1D array of size 256, where the index is the
 // page number and the value is the frame number.
-struct page_table_entry
-{
-    int frame_num;  // The frame number (default is 0)
-    bool valid;     // 0 = invalid, 1 = valid (default is 0)
-};
 struct page_table_entry page_table[MAX_NUM_OF_PAGES];
 
 // TLB
-// A 2D array of size 16x2, where the first column is the page number
-// and the second column is the frame number.
-int tlb[TLB_SIZE][2];
+// A 2D array of size 16x3 for each core, where the first column is the
+// page number (-1 once invalidated), the second column is the frame
+// number and the third the dirty bit as cached by the TLB.
+int tlb[MAX_CORES][TLB_SIZE][3];
 
 // Physical memory
 // A 1D array of size 256*256, where the index is the
@@ -54,12 +86,41 @@ int tlb[TLB_SIZE][2];
 // the data stored in that frame.
 int physical_memory[NUM_OF_FRAMES * FRAME_SIZE];
 
+// Demand paging
+// The backing store holds the value of every virtual address (from
+// correct.txt), frame_table what is in each frame.
+int backing_store[MAX_NUM_OF_PAGES * PAGE_SIZE];
+struct frame_info frame_table[NUM_OF_FRAMES];
+bool demand_paging = false;
+int num_frames = NUM_OF_FRAMES;
+const struct replace_ops *policy;
+int tick_interval = 64;     // References between reference bit scans, 0 for none
+const struct alloc_ops *allocator;
+int reclaim_watermark = 1;  // Free frames the page fault handler reclaims up to
+long num_refs = 0;
+long trace_start = 0;       // References of the trace already run, by a fast-forward or a checkpoint
+long trace_end = -1;        // Reference of the trace to stop at, -1 for the end
+
+// Options
+bool verbose = true;
+int write_percent = 0;      // Share of references turned into writes
+bool simulate_caches = false;
+bool simulate_swap = false;
+bool simulate_zswap = false;
+bool simulate_tiers = false;
+bool simulate_cores = false;
+struct mrc *mrc_sampled;    // Miss ratio curves of the references, NULL without -m
+struct mrc *mrc_exact;      // The same unsampled, with -m exact
+
 // Statistic variables
 int num_addresses = 0;
 int page_faults = 0;
 int tlb_hits = 0;
 int tlb_misses = 0;
 int tlb_cur_size = 0;
+int evictions = 0;
+int writebacks = 0;         // Dirty pages written back on eviction
+int tlb_invalidations = 0;
 
 
 
@@ -76,8 +137,9 @@ void populate_page_table(const int val[]) {
     // Populate page table row with frame no.
     page_table[page_num].frame_num = frame_num;
     page_table[page_num].valid = true;
+    frame_table[frame_num].page = page_num;
     // Print success message.
-    printf("add_to_page_table: Added page %d -> frame %d\n", page_num, frame_num);
+    if (verbose) printf("add_to_page_table: Added page %d -> frame %d\n", page_num, frame_num);
 }
 
 
@@ -94,6 +156,37 @@ void populate_physical_memory(const int val[]){
 
 
 
+/**
+ * Populate backing store, for demand paging.
+ *
+ * @param val: An array of 3 integers [virtual address, physical address, value]
+ * @return void
+ */
+void populate_backing_store(const int val[]){
+    backing_store[val[0]] = val[2];
+}
+
+
+
+/**
+ * Place a page in the frame the allocator picks rather than the one
+ * correct.txt gives it, and rewrite the physical address to match.
+ *
+ * @param val: An array of 3 integers [virtual address, physical address, value]
+ * @return void
+ */
+void place_page(int val[]) {
+    int page_num = val[0] / PAGE_SIZE;
+    if (!page_table[page_num].valid) {
+        int frame_num = allocator->alloc(page_num);
+        frame_table[frame_num].page = page_num;
+        page_table[page_num].frame_num = frame_num;
+    }
+    val[1] = page_table[page_num].frame_num * FRAME_SIZE + val[0] % PAGE_SIZE;
+}
+
+
+
 /*
  * Populator.
  * Reads a file and populates the page table and physical memory.
@@ -103,7 +196,7 @@ void populate_physical_memory(const int val[]){
  */
 void populate(const char *filename) {
 
-    printf("populate: Reading file %s\n", filename);
+    if (verbose) printf("populate: Reading file %s\n", filename);
 
     // Open file
     FILE *file = fopen(filename, "r");
@@ -111,7 +204,7 @@ void populate(const char *filename) {
         fprintf(stderr, "populate: Error: Cannot open file %s\n", filename);
         exit(1);
     }
-    printf("populate: Opened file %s\n", filename);
+    if (verbose) printf("populate: Opened file %s\n", filename);
 
     // Read file
     char line[128];             // Buffer to store each line
@@ -133,16 +226,22 @@ void populate(const char *filename) {
             }
             token = strtok(NULL, " "); // Get next token
         }
-        // Send found values to populate_page_table and populate_physical_memory
-        populate_page_table(val);
-        populate_physical_memory(val);
+        // Send found values to populate_page_table and populate_physical_memory,
+        // or only keep them in the backing store when paging on demand
+        if (demand_paging) {
+            populate_backing_store(val);
+        } else {
+            if (allocator != NULL) place_page(val);
+            populate_page_table(val);
+            populate_physical_memory(val);
+        }
         // Increment number of addresses
         num_addresses++;
     }
 
     // Close file
     fclose(file);
-    printf("populate: Closed file %s\n", filename);
+    if (verbose) printf("populate: Closed file %s\n", filename);
 }
 
 
@@ -156,7 +255,7 @@ void populate(const char *filename) {
 int lookup_page_table(int page_num){
     struct page_table_entry frame_num = page_table[page_num];
     if (frame_num.valid) {
-        printf("lookup_page_table: Found page %d -> frame %d\n", page_num, frame_num.frame_num);
+        if (verbose) printf("lookup_page_table: Found page %d -> frame %d\n", page_num, frame_num.frame_num);
         return frame_num.frame_num;
     } else {
         return -1;
@@ -193,10 +292,10 @@ int lookup_physical_memory(int frame_num, int offset){
 */
 int check_TLB(int page_num){
     int i = 0;
-    while(i < tlb_count){
-        if(page_num == tlb[i][0]){
+    while(i < tlb_count[current_core]){
+        if(page_num == tlb[current_core][i][0]){
             tlb_hits++; // Increment the TLB hits            
-            return tlb[i][1];
+            return tlb[current_core][i][1];
         }
         i++;
     }
@@ -217,17 +316,21 @@ int check_TLB(int page_num){
  * @return void
  */
 void fifo(int page_num, int frame_num) {
+    int (*entries)[3] = tlb[current_core];
+    int *head = &tlb_head[current_core], *count = &tlb_count[current_core];
+
     // Add the new entry to the TLB
-    tlb[tlb_head][0] = page_num;  // Store the page number
-    tlb[tlb_head][1] = frame_num; // Store the frame number
+    entries[*head][0] = page_num;  // Store the page number
+    entries[*head][1] = frame_num; // Store the frame number
+    entries[*head][2] = page_table[page_num].dirty;
 
     // Move the tlb_head to the next position
-    tlb_head = (tlb_head + 1) % TLB_SIZE;
+    *head = (*head + 1) % TLB_SIZE;
 
     // Increment tlb_count if not full
-    if (tlb_count < TLB_SIZE) {
-        tlb_count++;
-        if (tlb_count == TLB_SIZE) {
+    if (*count < TLB_SIZE) {
+        (*count)++;
+        if (*count == TLB_SIZE) {
             //printf("FIFO: TLB is full\n");
         }
     }
@@ -251,46 +354,486 @@ void add_to_phys_mem(const int frame_num, const int offset, const int val){
 }
 
 
+/**
+ * Whether a core's TLB holds an entry for a page.
+ *
+ * @param core: The core.
+ * @param page_num: The page number.
+ * @return bool
+ */
+bool tlb_holds(int core, int page_num) {
+    for (int i = 0; i < tlb_count[core]; i++) {
+        if (tlb[core][i][0] == page_num) return true;
+    }
+    return false;
+}
+
+
+
+/**
+ * Drop the TLB entry of a page from a core's TLB, if it has one.
+ *
+ * @param core: The core.
+ * @param page_num: The page number.
+ * @return void
+ */
+void tlb_flush_page(int core, int page_num) {
+    for (int i = 0; i < tlb_count[core]; i++) {
+        if (tlb[core][i][0] == page_num) {
+            tlb[core][i][0] = -1;
+            tlb_invalidations++;
+        }
+    }
+}
+
+
+
+/**
+ * Drop every entry of a core's TLB.
+ *
+ * @param core: The core.
+ * @return void
+ */
+void tlb_flush_all(int core) {
+    for (int i = 0; i < tlb_count[core]; i++) {
+        if (tlb[core][i][0] != -1) tlb_invalidations++;
+    }
+    tlb_head[core] = tlb_count[core] = 0;
+}
+
+
+
+/**
+ * Drop the TLB entries of a page on every core, without a shootdown.
+ *
+ * @param page_num: The page number.
+ * @return void
+ */
+void tlb_invalidate(int page_num) {
+    for (int core = 0; core < (simulate_cores ? smp.cores : 1); core++) {
+        tlb_flush_page(core, page_num);
+    }
+}
+
+
+
+/**
+ * The translation of a page changed: drop its TLB entry and, with
+ * several cores, shoot it down on the others.
+ *
+ * @param page_num: The page number.
+ * @param cause: What changed it.
+ * @return void
+ */
+void tlb_shootdown(int page_num, enum smp_cause cause) {
+    if (simulate_cores) smp_shootdown(page_num, cause);
+    else tlb_flush_page(current_core, page_num);
+}
+
+
+
+/**
+ * Swap the pages of two frames, for memory tiering. The data, the page
+ * table and frame table entries move, the TLB entries and cache lines of
+ * the old frames are dropped.
+ *
+ * @param frame_a: A frame holding a page.
+ * @param frame_b: Another one.
+ * @return void
+ */
+void exchange_frames(int frame_a, int frame_b) {
+    int page_a = frame_table[frame_a].page, page_b = frame_table[frame_b].page;
+    int data[FRAME_SIZE];
+    memcpy(data, &physical_memory[frame_a * FRAME_SIZE], sizeof(data));
+    memcpy(&physical_memory[frame_a * FRAME_SIZE], &physical_memory[frame_b * FRAME_SIZE], sizeof(data));
+    memcpy(&physical_memory[frame_b * FRAME_SIZE], data, sizeof(data));
+    struct frame_info info = frame_table[frame_a];
+    frame_table[frame_a] = frame_table[frame_b];
+    frame_table[frame_b] = info;
+    page_table[page_a].frame_num = frame_b;
+    page_table[page_b].frame_num = frame_a;
+    tlb_shootdown(page_a, SMP_MIGRATE);
+    tlb_shootdown(page_b, SMP_MIGRATE);
+    if (simulate_caches) {
+        cache_flush_frame(frame_a);
+        cache_flush_frame(frame_b);
+    }
+    if (verbose) printf("exchange_frames: Page %d -> frame %d, page %d -> frame %d\n", page_a, frame_b, page_b, frame_a);
+}
+
+
+
+/**
+ * Clear the referenced bit of a page.
+ *
+ * The TLB entries go too, otherwise the next accesses would hit the TLB
+ * and never set the bit again.
+ *
+ * @param page_num: The page number.
+ * @return void
+ */
+void clear_reference_bit(int page_num) {
+    if (page_table[page_num].referenced) {
+        page_table[page_num].referenced = false;
+        tlb_invalidate(page_num);
+    }
+}
+
+
+
+/**
+ * Periodic reference bit scan (the OS timer tick).
+ *
+ * Shifts the referenced bit of every resident page into its aging
+ * register and NFU counter, then clears it.
+ *
+ * @return void
+ */
+void tick(void) {
+    for (int f = 0; f < num_frames; f++) {
+        int page_num = frame_table[f].page;
+        if (page_num == -1) continue;
+        bool referenced = page_table[page_num].referenced;
+        frame_table[f].age = frame_table[f].age >> 1 | referenced << 7;
+        frame_table[f].nfu += referenced;
+        clear_reference_bit(page_num);
+    }
+}
+
+
+
+/**
+ * Write a page to the backing store.
+ *
+ * @param page_num: The page number.
+ * @param data: Its contents.
+ * @return void
+ */
+void write_to_swap(int page_num, const int *data) {
+    if (simulate_swap) {
+        swap_write(page_num);
+    }
+    memcpy(&backing_store[page_num * PAGE_SIZE], data, PAGE_SIZE * sizeof(int));
+    writebacks++;
+}
+
+
+
+/**
+ * Evict the page in a frame, into the compressed pool or, if it is dirty,
+ * to the backing store.
+ *
+ * @param frame_num: The frame number.
+ * @param cause: Reclaim, or an munmap.
+ * @return void
+ */
+void evict_frame(int frame_num, enum smp_cause cause) {
+    int page_num = frame_table[frame_num].page;
+    struct page_table_entry *pte = &page_table[page_num];
+    int *data = &physical_memory[frame_num * FRAME_SIZE];
+    if (simulate_swap) {
+        swap_evict(page_num);
+    }
+    if (simulate_zswap && zswap_store(page_num, data, pte->dirty)) {
+        if (simulate_swap) swap_cpu(zswap.compress_ns);
+    } else if (pte->dirty) {
+        write_to_swap(page_num, data);
+    }
+    if (simulate_caches) {
+        cache_flush_frame(frame_num);
+    }
+    pte->valid = false;
+    pte->referenced = false;
+    pte->dirty = false;
+    tlb_shootdown(page_num, cause);
+    frame_table[frame_num].page = -1;
+    allocator->free(frame_num);
+    evictions++;
+    if (verbose) printf("evict_frame: Evicted page %d from frame %d\n", page_num, frame_num);
+}
+
+
+
+/**
+ * Load a page from the compressed pool or the backing store into a frame
+ * from the allocator.
+ *
+ * Without a free frame, the replacement policy evicts pages until
+ * reclaim_watermark frames are free.
+ *
+ * @param page_num: The page number.
+ * @return int: The frame number.
+ */
+int load_page(int page_num) {
+    int frame_num = allocator->alloc(page_num);
+    if (frame_num == -1) {
+        while (free_frames() < reclaim_watermark) {
+            evict_frame(policy->victim(page_num), SMP_EVICT);
+        }
+        frame_num = allocator->alloc(page_num);
+    }
+
+    bool dirty = false;
+    if (!simulate_zswap || !zswap_load(page_num, &physical_memory[frame_num * FRAME_SIZE], &dirty)) {
+        for (int offset = 0; offset < PAGE_SIZE; offset++) {
+            add_to_phys_mem(frame_num, offset, backing_store[page_num * PAGE_SIZE + offset]);
+        }
+    }
+    // A page from the pool may be newer than its backing store copy
+    page_table[page_num].dirty = dirty;
+    page_table[page_num].frame_num = frame_num;
+    page_table[page_num].valid = true;
+    frame_table[frame_num].page = page_num;
+    frame_table[frame_num].loaded_at = num_refs;
+    frame_table[frame_num].last_use = num_refs;
+    frame_table[frame_num].age = 0;
+    frame_table[frame_num].nfu = 0;
+    policy->loaded(frame_num, page_num);
+    if (simulate_tiers) {
+        tier_loaded(frame_num);
+    }
+    if (verbose) printf("load_page: Loaded page %d -> frame %d\n", page_num, frame_num);
+    return frame_num;
+}
+
+
+
+/**
+ * Swap in a faulting page, stalling for the device.
+ *
+ * The rest of the page's swap cluster comes with the same read, the
+ * readahead window after the cluster with a read of its own that the
+ * fault does not wait for. Together they take at most half the frames.
+ * They are mapped before the faulting page, so that reclaiming frames for
+ * them cannot evict it.
+ *
+ * @param page_num: The page number.
+ * @return void
+ */
+void swap_in(int page_num) {
+    int cluster[MAX_NUM_OF_PAGES];
+    int ahead[MAX_NUM_OF_PAGES];
+    int n_cluster = 0;
+    int n_ahead = 0;
+    int budget = num_frames / 2;
+    int first = page_num / swap.cluster * swap.cluster;
+    int end = first + swap.cluster;
+
+    for (int p = first; p < end && p < MAX_NUM_OF_PAGES && n_cluster < budget; p++) {
+        if (p != page_num && !page_table[p].valid && !(simulate_zswap && zswap_contains(p))) cluster[n_cluster++] = p;
+    }
+    for (int p = end; p < end + swap.readahead && p < MAX_NUM_OF_PAGES && n_cluster + n_ahead < budget; p++) {
+        if (!page_table[p].valid && !(simulate_zswap && zswap_contains(p))) ahead[n_ahead++] = p;
+    }
+    if (!swap_fault_in(page_num, n_cluster + 1)) {
+        n_cluster = 0;
+    }
+    swap_prefetch(cluster, n_cluster, false);
+    swap_prefetch(ahead, n_ahead, true);
+    for (int k = 0; k < n_cluster; k++) {
+        load_page(cluster[k]);
+    }
+    for (int k = 0; k < n_ahead; k++) {
+        load_page(ahead[k]);
+    }
+}
+
+
+
+/**
+ * Page fault handler.
+ *
+ * A page in the compressed pool costs its decompression, any other one a
+ * read from the swap device.
+ *
+ * @param page_num: The page number.
+ * @return int: The frame number.
+ */
+int handle_page_fault(int page_num) {
+    policy->fault(page_num);
+    if (simulate_zswap && zswap_fault(page_num)) {
+        if (simulate_swap) swap_cpu(zswap.decompress_ns);
+    } else if (simulate_swap) {
+        swap_in(page_num);
+    }
+    return load_page(page_num);
+}
+
+
+
 /**
  * Lookup function.
- * 
- * @param physical_address: The physical address to look up.
+ *
+ * Sets the referenced bit on a page walk and the dirty bit on a write,
+ * as the MMU does. With demand paging, a page fault loads the page.
+ *
+ * @param virtual_address: The virtual address to look up.
+ * @param write: Whether the access is a write.
  * @return int: The value stored in the physical memory.
  */
-int lookup(const int virtual_address) {
-    printf("\n");
+int lookup(const int virtual_address, bool write) {
+    if (verbose) printf("\n");
+    num_refs++;
+    if (simulate_cores) {
+        smp_switch(num_refs - 1);
+    }
+    if (simulate_swap) {
+        swap_tick();
+    }
+    if (demand_paging && tick_interval > 0 && num_refs % tick_interval == 0) {
+        tick();
+    }
 
     // Get page number and page offset.
     int page_num = floor(virtual_address / PAGE_SIZE);
     int offset = virtual_address % PAGE_SIZE;
 
+    if (mrc_sampled != NULL) {
+        mrc_access(mrc_sampled, page_num);
+        if (mrc_exact != NULL) mrc_access(mrc_exact, page_num);
+        if (mrc_config.every > 0 && num_refs % mrc_config.every == 0) mrc_report(mrc_sampled, mrc_exact);
+    }
+
     // Get frame num via TLB or page table.
     int frame_num = check_TLB(page_num);
     //printf("lookup: page_num: %d, offset: %d, frame_num: %d\n", page_num, offset, frame_num);
     
     if (frame_num == -1) {
-        printf("lookup: Error: Entry not found in TLB\n");
+        if (verbose) printf("lookup: Error: Entry not found in TLB\n");
         frame_num = lookup_page_table(page_num);
-        printf("lookup: frame_num after lookup_page_table: %d\n", frame_num);
+        if (verbose) printf("lookup: frame_num after lookup_page_table: %d\n", frame_num);
         // Catch page fault.
         //struct page_table_entry bool  = page_table[page_num].valid;
 
         if (frame_num == -1) {
             //printf("lookup: Error: Page fault\n");
             page_faults++;
-            return -1;
+            if (!demand_paging) {
+                if (simulate_cores) smp_retire();
+                return -1;
+            }
+            frame_num = handle_page_fault(page_num);
+        } else if (demand_paging) {
+            policy->access(frame_num);
+            if (simulate_swap) {
+                swap_wait(page_num);
+            }
         }
+        // The page walk sets the referenced (and dirty) bit.
+        page_table[page_num].referenced = true;
+        page_table[page_num].dirty |= write;
         // Perform FIFO on TLB.
         fifo(page_num, frame_num);
         //return lookup(virtual_address);
     } else {
-        printf("lookup: Found in TLB: page_num %d -> frame_num %d\n", page_num, frame_num);
+        if (verbose) printf("lookup: Found in TLB: page_num %d -> frame_num %d\n", page_num, frame_num);
+        if (demand_paging) {
+            policy->access(frame_num);
+        }
+        // A write through a clean TLB entry goes to the page table for the dirty bit.
+        for (int i = 0; write && i < tlb_count[current_core]; i++) {
+            if (tlb[current_core][i][0] == page_num && !tlb[current_core][i][2]) {
+                page_table[page_num].dirty = true;
+                tlb[current_core][i][2] = 1;
+            }
+        }
+    }
+    if (demand_paging) {
+        frame_table[frame_num].last_use = num_refs;
     }
 
-    printf("lookup: frame_num %d -> offset %d\n", frame_num, offset);
+    if (verbose) printf("lookup: frame_num %d -> offset %d\n", frame_num, offset);
+    if (simulate_caches) {
+        cache_access(virtual_address, frame_num * FRAME_SIZE + offset, write);
+    }
 
     // Return value from physical memory.
-    return lookup_physical_memory(frame_num, offset);
+    int value = lookup_physical_memory(frame_num, offset);
+    if (simulate_tiers) {
+        tier_access(frame_num, page_num);
+        tier_tick();
+    }
+    if (simulate_cores) {
+        smp_retire();
+    }
+    return value;
+}
+
+
+
+/**
+ * Reset the page table, TLB, frames and statistics for a new run.
+ *
+ * @return void
+ */
+void reset_simulation(void) {
+    memset(page_table, 0, sizeof(page_table));
+    memset(tlb, 0, sizeof(tlb));
+    memset(physical_memory, 0, sizeof(physical_memory));
+    memset(tlb_head, 0, sizeof(tlb_head));
+    memset(tlb_count, 0, sizeof(tlb_count));
+    for (int f = 0; f < NUM_OF_FRAMES; f++) {
+        frame_table[f] = (struct frame_info){ .page = -1 };
+    }
+    num_refs = 0;
+    page_faults = tlb_hits = tlb_misses = 0;
+    evictions = writebacks = tlb_invalidations = 0;
+    if (policy != NULL) policy->reset();
+    num_colors = cache_llc_colors();
+    if (allocator != NULL) allocator->reset();
+    if (simulate_caches) {
+        cache_reset();
+    }
+    if (simulate_swap) {
+        swap_reset();
+    }
+    if (simulate_zswap) {
+        zswap_reset();
+    }
+    if (simulate_tiers) {
+        tier_reset();
+    }
+    if (simulate_cores) {
+        smp_reset();
+    }
+    if (mrc_sampled != NULL) {
+        mrc_reset(mrc_sampled);
+        if (mrc_exact != NULL) mrc_reset(mrc_exact);
+    }
+}
+
+
+
+/**
+ * Change the mapping of a page from the trace, on the core of the next
+ * reference. "p" is an mprotect, the simulator has no protection bits so
+ * only the translation is dropped; "u" an munmap, the page is evicted
+ * (with demand paging, it faults in again from the backing store) or
+ * left invalid.
+ *
+ * @param kind: 'p' or 'u'.
+ * @param virtual_address: An address in the page.
+ * @return void
+ */
+void trace_event(char kind, int virtual_address) {
+    int page_num = virtual_address / PAGE_SIZE;
+    if (page_num < 0 || page_num >= MAX_NUM_OF_PAGES) return;
+    if (simulate_cores) {
+        smp_switch(num_refs);
+    }
+    if (kind == 'p') {
+        tlb_shootdown(page_num, SMP_MPROTECT);
+    } else if (page_table[page_num].valid && demand_paging) {
+        evict_frame(page_table[page_num].frame_num, SMP_MUNMAP);
+        replace_forget(page_num);
+    } else if (page_table[page_num].valid) {
+        page_table[page_num].valid = false;
+        tlb_shootdown(page_num, SMP_MUNMAP);
+    }
+    if (simulate_cores) {
+        smp_flush();
+    }
+    if (verbose) printf("trace_event: %s page %d\n", kind == 'p' ? "mprotect" : "munmap", page_num);
 }
 
 
@@ -298,6 +841,10 @@ int lookup(const int virtual_address) {
 /**
  * Lookup file.
  * 
+ * A token prefixed with "w" is a write, and -W turns a share of the
+ * other references into writes. Tokens prefixed with "p" and "u" are
+ * mprotect and munmap events (see trace_event()).
+ *
  * @param filename: The name of the file to read from.
  * @return void
  */
@@ -308,24 +855,254 @@ void lookup_file(const char *filename) {
         fprintf(stderr, "lookup_file: Error: Cannot open file %s\n", filename);
         exit(1);
     }
-    printf("lookup_file: Opened file %s\n", filename);
+    if (verbose) printf("lookup_file: Opened file %s\n", filename);
 
     // Read file
     char line[256];             // Buffer to store each line
-    while (fgets(line, sizeof(line), file)) {
+    long position = 0;          // References of the trace read so far
+    while (position != trace_end && fgets(line, sizeof(line), file)) {
         // Remove newline character
         line[strcspn(line, "\n")] = 0;
         // Split line into tokens on each space
         char *token = strtok(line, " ");
         // Select the values from the token.
-        while (token != NULL) {
+        for (; token != NULL && position != trace_end; position++) {
+            if (position < trace_start) {
+                token = strtok(NULL, " ");
+                continue;
+            }
+            if (token[0] == 'p' || token[0] == 'u') {
+                trace_event(token[0], atoi(token + 1));
+                token = strtok(NULL, " ");
+                continue;
+            }
             // Get logical address and lookup value
-            int virtual_address = atoi(token);
-            int res = lookup(virtual_address);
-            printf("%d >> %d\n", virtual_address, res);
+            bool write = token[0] == 'w' || token[0] == 'W';
+            int virtual_address = atoi(token + write);
+            // Same references become writes in every run
+            unsigned hash = (unsigned)(num_refs + 1) * 2654435761u;
+            write |= (int)((hash >> 16) % 100) < write_percent;
+            int res = lookup(virtual_address, write);
+            if (verbose) printf("%d >> %d\n", virtual_address, res);
             token = strtok(NULL, " "); // Get next token
         }
     }
+    fclose(file);
+}
+
+
+
+/**
+ * Run the trace with every replacement policy and compare them to LRU.
+ *
+ * @param filename: The name of the trace file.
+ * @return void
+ */
+void compare_policies(const char *filename) {
+    int faults[num_of_replace_policies];
+    int lru_faults = 0;
+    verbose = false;
+
+    printf("\n=========== POLICIES (%d frames, tick every %d references) ===========\n", num_frames, tick_interval);
+    for (int k = 0; k < num_of_replace_policies; k++) {
+        policy = &replace_policies[k];
+        reset_simulation();
+        lookup_file(filename);
+        faults[k] = page_faults;
+        if (strcmp(policy->name, "lru") == 0) lru_faults = page_faults;
+        printf("%-8s page faults %5d (%6.2f%%), writebacks %4d, TLB hits %5d",
+               policy->name, page_faults, 100.0 * page_faults / num_refs, writebacks, tlb_hits);
+        if (simulate_caches) printf(", AMAT %6.2f", cache_amat());
+        printf("\n");
+    }
+    printf("\nPage faults relative to LRU:\n");
+    for (int k = 0; k < num_of_replace_policies; k++) {
+        printf("%-8s %+6.2f%%\n", replace_policies[k].name,
+               lru_faults ? 100.0 * (faults[k] - lru_faults) / lru_faults : 0.0);
+    }
+}
+
+
+
+/**
+ * Run the trace with every frame allocator and compare how their
+ * placement does in the caches.
+ *
+ * @param filename: The name of the trace file.
+ * @return void
+ */
+void compare_allocators(const char *filename) {
+    struct cache_level *llc = &caches.levels[cache_llc()];
+    verbose = false;
+
+    printf("\n=========== ALLOCATORS (%d frames, %d colors, %s) ===========\n",
+           num_frames, cache_llc_colors(), demand_paging ? policy->name : "preloaded");
+    for (int k = 0; k < num_of_alloc_policies; k++) {
+        allocator = &alloc_policies[k];
+        reset_simulation();
+        if (!demand_paging) {
+            num_addresses = 0;
+            populate("correct.txt");
+        }
+        lookup_file(filename);
+        printf("%-10s %s hit rate %6.2f%%, %4ld conflict misses, AMAT %6.2f, unusable free space %.3f\n",
+               allocator->name, llc->name, llc->accesses ? 100.0 * llc->hits / llc->accesses : 0.0,
+               llc->conflicts, cache_amat(), average_unusable_free_index());
+    }
+}
+
+
+
+/**
+ * Run the trace with every swap device preset.
+ *
+ * @param filename: The name of the trace file.
+ * @return void
+ */
+void compare_devices(const char *filename) {
+    verbose = false;
+
+    printf("\n=========== SWAP DEVICES (%d frames, %s, cluster %d, readahead %d) ===========\n",
+           num_frames, policy->name, swap.cluster, swap.readahead);
+    for (int k = 0; k < num_of_swap_devices; k++) {
+        swap.device = swap_devices[k];
+        reset_simulation();
+        lookup_file(filename);
+        long long stall_ns = swap.fault_stall_ns + swap.readahead_stall_ns + swap.writeback_stall_ns;
+        printf("%-5s elapsed %10.3f ms, stalled %6.2f%%, %8.1f us per fault, device busy %6.2f%%\n",
+               swap.device.name, swap.now_ns / 1e6, swap.now_ns ? 100.0 * stall_ns / swap.now_ns : 0.0,
+               swap.faults ? swap.fault_stall_ns / 1e3 / swap.faults : 0.0,
+               swap.now_ns ? 100.0 * swap.busy_any_ns / swap_elapsed_ns() : 0.0);
+    }
+}
+
+
+
+/**
+ * Register the state of the simulator and its modules for checkpoints.
+ *
+ * @return void
+ */
+void register_state(void) {
+    // What has to match for a checkpoint to fit
+    static struct { int num_frames; bool demand_paging; char policy[16]; char allocator[16]; } config;
+    config.num_frames = num_frames;
+    config.demand_paging = demand_paging;
+    snprintf(config.policy, sizeof(config.policy), "%s", policy->name);
+    snprintf(config.allocator, sizeof(config.allocator), "%s", allocator ? allocator->name : "");
+    checkpoint_add("config", &config, sizeof(config), CHECKPOINT_CONFIG);
+
+    checkpoint_add("page_table", page_table, sizeof(page_table), CHECKPOINT_STATE);
+    checkpoint_add("tlb", tlb, sizeof(tlb), CHECKPOINT_STATE);
+    checkpoint_add("tlb_head", tlb_head, sizeof(tlb_head), CHECKPOINT_STATE);
+    checkpoint_add("tlb_count", tlb_count, sizeof(tlb_count), CHECKPOINT_STATE);
+    checkpoint_add("physical_memory", physical_memory, sizeof(physical_memory), CHECKPOINT_STATE);
+    checkpoint_add("backing_store", backing_store, sizeof(backing_store), CHECKPOINT_STATE);
+    checkpoint_add("frame_table", frame_table, sizeof(frame_table), CHECKPOINT_STATE);
+    checkpoint_add("num_refs", &num_refs, sizeof(num_refs), CHECKPOINT_STATE);
+    checkpoint_add("num_addresses", &num_addresses, sizeof(num_addresses), CHECKPOINT_STATE);
+    checkpoint_add("trace_start", &trace_start, sizeof(trace_start), CHECKPOINT_STATE);
+    checkpoint_add("page_faults", &page_faults, sizeof(page_faults), CHECKPOINT_STATS);
+    checkpoint_add("tlb_hits", &tlb_hits, sizeof(tlb_hits), CHECKPOINT_STATS);
+    checkpoint_add("tlb_misses", &tlb_misses, sizeof(tlb_misses), CHECKPOINT_STATS);
+    checkpoint_add("evictions", &evictions, sizeof(evictions), CHECKPOINT_STATS);
+    checkpoint_add("writebacks", &writebacks, sizeof(writebacks), CHECKPOINT_STATS);
+    checkpoint_add("tlb_invalidations", &tlb_invalidations, sizeof(tlb_invalidations), CHECKPOINT_STATS);
+
+    replace_checkpoint();
+    frames_checkpoint();
+    if (simulate_caches) {
+        cache_checkpoint();
+    }
+    if (simulate_zswap) {
+        zswap_checkpoint();
+    }
+    if (simulate_tiers) {
+        tier_checkpoint();
+    }
+    if (simulate_cores) {
+        smp_checkpoint();
+    }
+}
+
+
+
+/**
+ * Run the next references of the trace functionally: the pages, TLB,
+ * policy, allocator and caches warm up, the swap device and the miss ratio
+ * curves are left out and the statistics cleared afterwards.
+ *
+ * @param filename: The name of the trace file.
+ * @param refs: References to run.
+ * @return void
+ */
+void fast_forward(const char *filename, long refs) {
+    bool was_verbose = verbose, had_swap = simulate_swap;
+    struct mrc *sampled = mrc_sampled, *exact = mrc_exact;
+    verbose = simulate_swap = false;
+    mrc_sampled = mrc_exact = NULL;
+
+    trace_end = trace_start + refs;
+    lookup_file(filename);
+    trace_start = trace_end;
+    trace_end = -1;
+
+    verbose = was_verbose;
+    simulate_swap = had_swap;
+    mrc_sampled = sampled;
+    mrc_exact = exact;
+    checkpoint_clear_stats();
+    if (simulate_swap) {
+        swap_reset();
+    }
+}
+
+
+
+/**
+ * Print usage.
+ */
+void usage(const char *prog) {
+    fprintf(stderr,
+        "Usage: %s [-f frames] [-p policy] [-t refs] [-W percent] [-c caches]\n"
+        "       [-a allocator] [-s seed] [-w frames] [-D device] [-Z pool] [-m mrc] [-S socket]\n"
+        "       [-F refs] [-C checkpoint] [-R checkpoint] [-M page cache]\n"
+        "       [-T tiers] [-P cores] [-q]\n"
+        "  -f frames   Page on demand with this many frames (1-%d)\n"
+        "  -p policy   Page on demand with fifo, lru, clock, eclock, nfu, aging, 2q, arc,\n"
+        "              or all to compare them (default fifo)\n"
+        "  -t refs     References between reference bit scans, 0 for none (default 64)\n"
+        "  -W percent  Turn this share of the references into writes (default 0)\n"
+        "  -c caches   Simulate data caches, \"default\" or a list such as\n"
+        "              l1=1k:2:4,l2=4k:4:12,llc=16k:8:40,line=16,mem=200,walk=30,\n"
+        "              inclusive|exclusive|nine,pipt|vipt\n"
+        "  -a alloc    Place pages with sequential, random, buddy or colored frames,\n"
+        "              or all to compare them (default: as in correct.txt, sequential\n"
+        "              when paging on demand)\n"
+        "  -s seed     Seed of the random allocator (default 1)\n"
+        "  -w frames   Reclaim until this many frames are free on a fault (default 1)\n"
+        "  -D device   Page on demand from a swap device, all to compare the presets, or\n"
+        "              hdd|sata|nvme,lat=us,bw=MB/s,qd=n,cluster=pages,readahead=pages,\n"
+        "              ref=ns,page=bytes,async|sync (default nvme,cluster=1,ref=100)\n"
+        "  -Z pool     Page on demand through a compressed pool taken out of the frames,\n"
+        "              pool=bytes[k],max=bytes,compress=ns,decompress=ns (default 4k)\n"
+        "  -m mrc      Sampled LRU and FIFO miss ratio curves, rate=r,budget=pages,\n"
+        "              points=n,max=pages,every=refs,exact (default rate=0.1,budget=64)\n"
+        "  -S socket   Serve address batches on a Unix domain socket, - for stdin\n"
+        "  -F refs     Run this many references first without statistics\n"
+        "  -C file     Save a checkpoint before the measured references\n"
+        "  -R file     Start from a checkpoint, the trace goes on where it was taken\n"
+        "  -M cache    Run processes mapping files over a shared page cache in the frames,\n"
+        "              trace=file,ra=pages,swappiness=0-200,dirty=percent,background=percent,\n"
+        "              flush=refs (default trace=mappings.txt,ra=32,swappiness=60)\n"
+        "  -T tiers    Split the frames into a fast and a slow tier, fast=frames,fast_ns=ns,\n"
+        "              slow_ns=ns,migrate=ns,none|scan|sample,interval=refs,period=accesses,\n"
+        "              threshold=n,batch=pages (default fast=64,scan,interval=64)\n"
+        "  -P cores    Run the trace on cores with a TLB each, cores=n,quantum=refs,\n"
+        "              all|holders,batch=pages,full=pages,eager|lazy, costs in cycles\n"
+        "              ref=,local=,ipi=,target=,handler=,check= (default cores=4,quantum=16)\n"
+        "  -q          Only print the statistics\n",
+        prog, NUM_OF_FRAMES);
 }
 
 
@@ -333,19 +1110,181 @@ void lookup_file(const char *filename) {
 /**
  * Main function.
  */
-int main() {
+int main(int argc, char *argv[]) {
+    const char *policy_name = NULL;
+    const char *alloc_name = NULL;
+    bool all_devices = false;
+    const char *socket_path = NULL;
+    const char *save_path = NULL, *restore_path = NULL;
+    long warmup_refs = 0;
+    bool host_model = false;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "f:p:t:W:c:a:s:w:D:Z:m:S:F:C:R:M:T:P:q")) != -1) {
+        switch (opt) {
+        case 'f': num_frames = atoi(optarg); demand_paging = true; break;
+        case 'p': policy_name = optarg; demand_paging = true; break;
+        case 't': tick_interval = atoi(optarg); break;
+        case 'W': write_percent = atoi(optarg); break;
+        case 'c':
+            if (cache_configure(optarg) != 0) return 1;
+            simulate_caches = true;
+            break;
+        case 'a': alloc_name = optarg; break;
+        case 's': alloc_seed = strtoul(optarg, NULL, 10); break;
+        case 'w': reclaim_watermark = atoi(optarg); break;
+        case 'D':
+            if (strcmp(optarg, "all") == 0) all_devices = true;
+            else if (swap_configure(optarg) != 0) return 1;
+            simulate_swap = demand_paging = true;
+            break;
+        case 'Z':
+            if (zswap_configure(optarg) != 0) return 1;
+            simulate_zswap = demand_paging = true;
+            break;
+        case 'm':
+            if (mrc_configure(optarg) != 0) return 1;
+            mrc_sampled = mrc_create(mrc_config.rate, mrc_config.budget, mrc_config.points, mrc_config.max_size);
+            if (mrc_sampled == NULL) return 1;
+            if (mrc_config.exact) {
+                mrc_exact = mrc_create(1.0, MAX_NUM_OF_PAGES, mrc_config.points, mrc_config.max_size);
+                if (mrc_exact == NULL) return 1;
+            }
+            break;
+        case 'S': socket_path = optarg; verbose = false; break;
+        case 'F': warmup_refs = atol(optarg); break;
+        case 'C': save_path = optarg; break;
+        case 'R': restore_path = optarg; break;
+        case 'M':
+            if (pagecache_configure(optarg) != 0) return 1;
+            host_model = true;
+            break;
+        case 'T':
+            if (tier_configure(optarg) != 0) return 1;
+            simulate_tiers = true;
+            break;
+        case 'P':
+            if (smp_configure(optarg) != 0) return 1;
+            simulate_cores = true;
+            break;
+        case 'q': verbose = false; break;
+        default: usage(argv[0]); return 1;
+        }
+    }
+    if (simulate_zswap) {
+        // The pool is RAM too
+        num_frames -= (zswap.budget + FRAME_SIZE - 1) / FRAME_SIZE;
+    }
+    if (num_frames < 1 || num_frames > NUM_OF_FRAMES || tick_interval < 0
+        || reclaim_watermark < 1 || reclaim_watermark > num_frames || warmup_refs < 0
+        || (simulate_zswap && (save_path != NULL || restore_path != NULL))) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (host_model) {
+        pagecache_reset();
+        if (pagecache_run(page_cache.trace) != 0) return 1;
+        pagecache_report();
+        return 0;
+    }
+    if (policy_name == NULL) policy_name = "fifo";
+    policy = find_policy(policy_name);
+    if (policy == NULL && strcmp(policy_name, "all") != 0) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (alloc_name == NULL && demand_paging) alloc_name = "sequential";
+    if (alloc_name != NULL) {
+        allocator = find_allocator(alloc_name);
+        if ((allocator == NULL && strcmp(alloc_name, "all") != 0) || (allocator == NULL && policy == NULL)) {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    bool single_run = policy != NULL && (alloc_name == NULL || allocator != NULL);
+    bool checkpointing = warmup_refs > 0 || save_path != NULL || restore_path != NULL;
+    long stats_from = 0;    // num_refs where the printed statistics start
+    if ((all_devices && (policy == NULL || allocator == NULL))
+        || ((socket_path != NULL || checkpointing) && (!single_run || all_devices))) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (alloc_name != NULL && allocator == NULL) {
+        // Placement only shows in the caches
+        if (!simulate_caches && cache_configure("default") != 0) return 1;
+        simulate_caches = true;
+        if (demand_paging) populate("correct.txt");
+        compare_allocators("addresses.txt");
+        return 0;
+    }
+    if (demand_paging || allocator != NULL || simulate_tiers || simulate_cores) {
+        reset_simulation();
+    }
     populate("correct.txt");
-    lookup_file("addresses.txt");
+    if (policy == NULL) {
+        compare_policies("addresses.txt");
+        return 0;
+    }
+    if (all_devices) {
+        compare_devices("addresses.txt");
+        return 0;
+    }
+    if (checkpointing) {
+        register_state();
+        if (restore_path != NULL && checkpoint_restore(restore_path) != 0) return 1;
+        if (simulate_swap) {
+            // The device is timing only, it starts idle
+            swap_reset();
+        }
+        if (warmup_refs > 0) fast_forward("addresses.txt", warmup_refs);
+        if (save_path != NULL && checkpoint_save(save_path) != 0) return 1;
+        stats_from = num_refs;
+    }
+    if (socket_path != NULL) {
+        if (daemon_serve(socket_path) != 0) return 1;
+    } else {
+        lookup_file("addresses.txt");
+    }
     //printf("lookup: main: lookup(30198): %d\n", lookup(30198));
     //printf("lookup: main: lookup(53683): %d\n", lookup(53683));
     //printf("lookup: main: lookup(12107): %d\n", lookup(12107));
 
     // Print out statistics
     printf("\n=========== STATISTICS ===========\n");
-    printf("Number of addresses: %d\n", num_addresses);
+    // After a restore or fast-forward only the replayed references are counted
+    printf("Number of addresses: %d\n", checkpointing ? (int)(num_refs - stats_from) : num_addresses);
     printf("Page faults: %d\n", page_faults);
     printf("TLB hits: %d\n", tlb_hits);
     printf("TLB misses: %d\n", tlb_misses);
+    if (demand_paging) {
+        printf("Replacement policy: %s (%d frames)\n", policy->name, num_frames);
+        printf("Evictions: %d\n", evictions);
+        printf("Dirty writebacks: %d\n", writebacks);
+        printf("TLB invalidations: %d\n", tlb_invalidations);
+    }
+    if (allocator != NULL) {
+        frames_report(allocator);
+    }
+    if (simulate_zswap) {
+        zswap_report();
+    }
+    if (simulate_swap) {
+        swap_report();
+    }
+    if (simulate_tiers) {
+        tier_report();
+    }
+    if (simulate_cores) {
+        smp_report();
+    }
+    if (simulate_caches) {
+        cache_report(tlb_misses);
+    }
+    if (mrc_sampled != NULL) {
+        mrc_report(mrc_sampled, mrc_exact);
+    }
     
     printf("\n=========== BY SIZE ===========\n");
     printf("size of TLB: %d\n", TLB_SIZE);
@@ -354,4 +1293,3 @@ int main() {
 
     return 0;
 }
-
@@ -0,0 +1,116 @@
+#ifndef SIMULATOR_H
+#define SIMULATOR_H
+
+/**
+ * Shared state of the virtual memory simulator (simulator.c) and its
+ * frame replacement policies (replace.c).
+ */
+
+#include <stdbool.h>
+
+// Parameters given by the assignment
+#define MAX_NUM_OF_PAGES 256
+#define PAGE_SIZE 256
+#define NUM_OF_FRAMES 256
+#define FRAME_SIZE 256
+#define TLB_SIZE 16
+
+#define MAX_CORES 64    // Cores with a TLB each (see smp.c)
+
+// Page table entry, with the referenced and dirty bits the MMU sets
+// (see lookup()) and the OS clears.
+struct page_table_entry
+{
+    int frame_num;      // The frame number (default is 0)
+    bool valid;         // 0 = invalid, 1 = valid (default is 0)
+    bool referenced;    // Set by a page walk, cleared by the replacement policy
+    bool dirty;         // Set by a write, cleared on writeback
+};
+
+// What the OS knows about a frame, for demand paging.
+struct frame_info
+{
+    int page;               // Resident page, -1 if free
+    long loaded_at;         // Reference count at the fault that loaded it
+    long last_use;          // Reference count at the last access (exact LRU only)
+    unsigned char age;      // Aging shift register, shifted on every tick
+    unsigned int nfu;       // NFU counter, incremented on ticks with the page referenced
+};
+
+extern struct page_table_entry page_table[MAX_NUM_OF_PAGES];
+extern struct frame_info frame_table[NUM_OF_FRAMES];
+extern int num_frames;      // Frames available for demand paging
+extern long num_refs;       // References so far, the simulator's clock
+
+// Statistics of simulator.c.
+extern int num_addresses;
+extern int page_faults;
+extern int tlb_hits;
+extern int tlb_misses;
+extern int evictions;
+extern int writebacks;
+extern int tlb_invalidations;
+
+extern bool demand_paging;
+extern int current_core;    // Core running the reference, whose TLB it goes through
+
+bool tlb_holds(int core, int page_num);
+void tlb_flush_page(int core, int page_num);
+void tlb_flush_all(int core);
+
+void populate(const char *filename);
+int lookup(const int virtual_address, bool write);
+void reset_simulation(void);
+
+// Frame replacement policy.
+//
+// The core calls fault() on every page fault, victim() when no frame is
+// free, then loaded() once the page is in its frame. access() is called
+// for every later reference to a resident page; policies that model real
+// hardware (clock, aging) ignore it and only look at the referenced bits.
+struct replace_ops
+{
+    const char *name;
+    void (*reset)(void);
+    void (*fault)(int page);
+    int (*victim)(int page);
+    void (*loaded)(int frame, int page);
+    void (*access)(int frame);
+};
+
+extern const struct replace_ops replace_policies[];
+extern const int num_of_replace_policies;
+
+const struct replace_ops *find_policy(const char *name);
+void clear_reference_bit(int page);
+void write_to_swap(int page, const int *data);
+void replace_forget(int page);
+void replace_checkpoint(void);
+void exchange_frames(int frame_a, int frame_b);
+
+// Physical frame allocator.
+//
+// alloc() picks a free frame for a page (frames.c), -1 if there is none,
+// free() gives an evicted one back.
+struct alloc_ops
+{
+    const char *name;
+    void (*reset)(void);
+    int (*alloc)(int page);
+    void (*free)(int frame);
+};
+
+extern const struct alloc_ops alloc_policies[];
+extern const int num_of_alloc_policies;
+extern int num_colors;          // Page colors of the colored allocator
+extern unsigned int alloc_seed; // Seed of the random allocator
+
+const struct alloc_ops *find_allocator(const char *name);
+int free_frames(void);
+int largest_free_block(void);
+double unusable_free_index(int order);
+double average_unusable_free_index(void);
+void frames_report(const struct alloc_ops *allocator);
+void frames_checkpoint(void);
+
+#endif
@@ -0,0 +1,353 @@
+/**
+ * Multi-core TLB coherence for simulator.c.
+ *
+ * The trace is dealt out to the cores in turns of quantum references,
+ * each core translating through its own TLB. When a translation changes
+ * (an eviction, a tier migration, an mprotect or munmap event) the core
+ * doing it drops its own entry and shoots the page down on the others:
+ *
+ * - eager: an IPI round goes to the target cores, each takes an interrupt
+ *   and drops the pages, the initiator stalls until the last ack. The
+ *   pages of one reference are batched into rounds of at most batch
+ *   pages, always sent before the reference ends, so no frame is reused
+ *   while a stale entry can still be hit. Past full_flush pages a round
+ *   flushes the remote TLBs whole, as Linux's tlb_single_page_flush_ceiling.
+ * - lazy: no IPI, the pages are queued per core and dropped by the core
+ *   itself before its next reference (LATR style). A queue longer than
+ *   the TLB flushes it whole.
+ *
+ * The targets are every other core that ran the process (mm_cpumask) or
+ * only those whose TLB holds the page, what a hardware directory would
+ * give. Clearing a reference bit drops the entries without a shootdown,
+ * x86 does not flush for the accessed bit either.
+ *
+ * The cores run side by side, a remote core takes the interrupts in the
+ * middle of whatever it runs. They count in its stall cycles, the stall
+ * distribution is of what a reference waits for itself: the rounds it
+ * sends and the deferred pages it drops.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include "simulator.h"
+#include "smp.h"
+#include "checkpoint.h"
+
+#define MAX_BATCH 64
+
+struct smp_model smp = {
+    .cores = 4,
+    .quantum = 16,
+    .targets = SMP_ALL,
+    .batch = 1,
+    .full_flush = 33,
+    .lazy = false,
+    .ref_cycles = 100,
+    .local_cycles = 150,
+    .ipi_cycles = 1500,
+    .target_cycles = 60,
+    .handler_cycles = 700,
+    .lazy_cycles = 20,
+};
+
+static const char *cause_names[] = { "evictions", "migrations", "mprotect", "munmap" };
+
+static int pending[MAX_BATCH];              // Pages of the next IPI round
+static int num_pending;
+static int deferred[MAX_CORES][TLB_SIZE];   // Pages each core drops before its next reference
+static int num_deferred[MAX_CORES];         // TLB_SIZE + 1 once overflowed
+static bool ran[MAX_CORES];                 // The core ran the process
+static long long ref_stall;                 // Stall of the running reference
+
+
+
+static void charge(int core, long cycles) {
+    smp.core_stall[core] += cycles;
+    if (core == current_core) ref_stall += cycles;
+}
+
+
+
+static bool is_target(int core, const int *pages, int n) {
+    if (core == current_core || !ran[core]) return false;
+    if (smp.targets == SMP_ALL) return true;
+    for (int k = 0; k < n; k++) {
+        if (tlb_holds(core, pages[k])) return true;
+    }
+    return false;
+}
+
+
+
+/**
+ * Drop the deferred pages of a core about to run.
+ */
+static void sweep(int core) {
+    long cycles;
+    if (num_deferred[core] > TLB_SIZE) {
+        tlb_flush_all(core);
+        cycles = smp.local_cycles;
+    } else {
+        for (int k = 0; k < num_deferred[core]; k++) tlb_flush_page(core, deferred[core][k]);
+        cycles = num_deferred[core] * smp.lazy_cycles;
+    }
+    charge(core, cycles);
+    smp.remote_cycles += cycles;
+    num_deferred[core] = 0;
+}
+
+
+
+/**
+ * Make a core the one running, for the reference at a position of the
+ * trace.
+ *
+ * @param ref: References run before it.
+ * @return void
+ */
+void smp_switch(long ref) {
+    current_core = (int)(ref / smp.quantum % smp.cores);
+    ran[current_core] = true;
+    if (num_deferred[current_core] > 0) sweep(current_core);
+}
+
+
+
+/**
+ * Send the pending pages to the target cores in one IPI round.
+ *
+ * @return void
+ */
+void smp_flush(void) {
+    if (num_pending == 0) return;
+    bool full = num_pending > smp.full_flush;
+    long handler = smp.handler_cycles + (full ? 1 : num_pending) * smp.local_cycles;
+    int targets = 0;
+    for (int c = 0; c < smp.cores; c++) {
+        if (!is_target(c, pending, num_pending)) continue;
+        if (full) {
+            tlb_flush_all(c);
+            smp.full_flushes++;
+        } else {
+            for (int k = 0; k < num_pending; k++) tlb_flush_page(c, pending[k]);
+        }
+        charge(c, handler);
+        smp.remote_cycles += handler;
+        targets++;
+    }
+    if (targets > 0) {
+        long wait = smp.ipi_cycles + targets * smp.target_cycles + handler;
+        charge(current_core, wait);
+        smp.initiator_cycles += wait;
+        if (wait > smp.max_round_cycles) smp.max_round_cycles = wait;
+        smp.rounds++;
+        smp.ipis += targets;
+        smp.round_pages += num_pending;
+    }
+    num_pending = 0;
+}
+
+
+
+/**
+ * The translation of a page changed: drop it from the running core's TLB
+ * and shoot it down on the others.
+ *
+ * @param page_num: The page.
+ * @param cause: What changed it.
+ * @return void
+ */
+void smp_shootdown(int page_num, enum smp_cause cause) {
+    smp.invalidations[cause]++;
+    tlb_flush_page(current_core, page_num);
+    charge(current_core, smp.local_cycles);
+    smp.initiator_cycles += smp.local_cycles;
+    if (smp.lazy) {
+        for (int c = 0; c < smp.cores; c++) {
+            if (!is_target(c, &page_num, 1)) continue;
+            if (num_deferred[c] < TLB_SIZE) deferred[c][num_deferred[c]] = page_num;
+            else if (num_deferred[c] == TLB_SIZE) smp.overflows++;
+            if (num_deferred[c] <= TLB_SIZE) num_deferred[c]++;
+            smp.deferred++;
+        }
+        return;
+    }
+    pending[num_pending++] = page_num;
+    if (num_pending == smp.batch) smp_flush();
+}
+
+
+
+static int bit_length(long long x) {
+    int n = 0;
+    for (; x; x >>= 1) n++;
+    return n;
+}
+
+
+
+/**
+ * End the running core's reference: the last round goes out and the
+ * reference's stall is counted.
+ *
+ * @return void
+ */
+void smp_retire(void) {
+    smp_flush();
+    smp.core_refs[current_core]++;
+    // The costs are the user's, a stall can go past the histogram
+    int b = bit_length(ref_stall);
+    smp.stall_hist[b < SMP_STALL_BUCKETS ? b : SMP_STALL_BUCKETS - 1]++;
+    ref_stall = 0;
+}
+
+
+
+/**
+ * Reset the cores and the statistics.
+ *
+ * @return void
+ */
+void smp_reset(void) {
+    num_pending = 0;
+    memset(num_deferred, 0, sizeof(num_deferred));
+    memset(ran, 0, sizeof(ran));
+    ref_stall = 0;
+    memset(smp.invalidations, 0, sizeof(smp) - offsetof(struct smp_model, invalidations));
+    current_core = 0;
+}
+
+
+
+/**
+ * Configure the cores.
+ *
+ * The spec is a comma separated list of
+ *   cores=n, quantum=references, all|holders, batch=pages, full=pages,
+ *   eager|lazy, ref=cycles, local=cycles, ipi=cycles, target=cycles,
+ *   handler=cycles, check=cycles, default
+ * e.g. "cores=8,holders,batch=16".
+ *
+ * @param spec: The configuration.
+ * @return int: 0 on success, -1 on failure.
+ */
+int smp_configure(const char *spec) {
+    char buf[256];
+    snprintf(buf, sizeof(buf), "%s", spec);
+    for (char *token = strtok(buf, ","); token != NULL; token = strtok(NULL, ",")) {
+        char *value = strchr(token, '=');
+        if (value) *value++ = 0;
+        bool known = true;
+        if (value && strcmp(token, "cores") == 0) smp.cores = atoi(value);
+        else if (value && strcmp(token, "quantum") == 0) smp.quantum = atoi(value);
+        else if (!value && strcmp(token, "all") == 0) smp.targets = SMP_ALL;
+        else if (!value && strcmp(token, "holders") == 0) smp.targets = SMP_HOLDERS;
+        else if (value && strcmp(token, "batch") == 0) smp.batch = atoi(value);
+        else if (value && strcmp(token, "full") == 0) smp.full_flush = atoi(value);
+        else if (!value && strcmp(token, "eager") == 0) smp.lazy = false;
+        else if (!value && strcmp(token, "lazy") == 0) smp.lazy = true;
+        else if (value && strcmp(token, "ref") == 0) smp.ref_cycles = atol(value);
+        else if (value && strcmp(token, "local") == 0) smp.local_cycles = atol(value);
+        else if (value && strcmp(token, "ipi") == 0) smp.ipi_cycles = atol(value);
+        else if (value && strcmp(token, "target") == 0) smp.target_cycles = atol(value);
+        else if (value && strcmp(token, "handler") == 0) smp.handler_cycles = atol(value);
+        else if (value && strcmp(token, "check") == 0) smp.lazy_cycles = atol(value);
+        else if (value || strcmp(token, "default") != 0) known = false;
+        if (!known) {
+            fprintf(stderr, "smp_configure: Error: Bad option %s\n", token);
+            return -1;
+        }
+    }
+    if (smp.cores < 1 || smp.cores > MAX_CORES || smp.quantum < 1 || smp.batch < 1 || smp.batch > MAX_BATCH
+        || smp.full_flush < 0 || smp.ref_cycles < 1 || smp.local_cycles < 0 || smp.ipi_cycles < 0
+        || smp.target_cycles < 0 || smp.handler_cycles < 0 || smp.lazy_cycles < 0) {
+        fprintf(stderr, "smp_configure: Error: Bad cores, at most %d cores and batches of %d pages\n",
+                MAX_CORES, MAX_BATCH);
+        return -1;
+    }
+    smp_reset();
+    return 0;
+}
+
+
+
+/**
+ * Register the deferred pages and the statistics for a checkpoint.
+ *
+ * @return void
+ */
+void smp_checkpoint(void) {
+    checkpoint_add("smp.config", &smp, offsetof(struct smp_model, invalidations), CHECKPOINT_CONFIG);
+    checkpoint_add("smp.deferred", deferred, sizeof(deferred), CHECKPOINT_STATE);
+    checkpoint_add("smp.num_deferred", num_deferred, sizeof(num_deferred), CHECKPOINT_STATE);
+    checkpoint_add("smp.ran", ran, sizeof(ran), CHECKPOINT_STATE);
+    checkpoint_add("smp.stats", smp.invalidations,
+                   sizeof(smp) - offsetof(struct smp_model, invalidations), CHECKPOINT_STATS);
+}
+
+
+
+/**
+ * Stall of the reference at a share of the distribution, as the upper
+ * bound of its histogram bucket, the last bucket only has a lower one.
+ */
+static const char *percentile(char *buf, size_t len, long refs, double share) {
+    long seen = 0;
+    int b;
+    for (b = 0; b < SMP_STALL_BUCKETS - 1; b++) {
+        seen += smp.stall_hist[b];
+        if (seen >= share * refs) break;
+    }
+    if (b < SMP_STALL_BUCKETS - 1) {
+        snprintf(buf, len, "<= %lld", b ? (1LL << b) - 1 : 0);
+    } else {
+        snprintf(buf, len, ">= %lld", 1LL << (SMP_STALL_BUCKETS - 2));
+    }
+    return buf;
+}
+
+
+
+/**
+ * Print the shootdowns and what they cost each core.
+ *
+ * @return void
+ */
+void smp_report(void) {
+    long refs = 0, changed = 0;
+    long long stall = smp.initiator_cycles + smp.remote_cycles;
+    for (int c = 0; c < smp.cores; c++) refs += smp.core_refs[c];
+    for (int k = 0; k < SMP_CAUSES; k++) changed += smp.invalidations[k];
+
+    printf("\n=========== CORES ===========\n");
+    printf("Cores: %d, %d references a turn, %s, targets %s", smp.cores, smp.quantum,
+           smp.lazy ? "lazy" : "eager", smp.targets == SMP_ALL ? "all" : "holders");
+    if (!smp.lazy) printf(", batch %d, full flush above %d pages", smp.batch, smp.full_flush);
+    printf("\n");
+    printf("Translations changed: %ld (", changed);
+    for (int k = 0; k < SMP_CAUSES; k++) printf("%s%s %ld", k ? ", " : "", cause_names[k], smp.invalidations[k]);
+    printf(")\n");
+    if (smp.lazy) {
+        printf("Deferred invalidations: %ld, TLBs flushed on overflow: %ld\n", smp.deferred, smp.overflows);
+    } else {
+        printf("IPI rounds: %ld, IPIs: %ld (%.2f a round), %.2f pages a round, remote TLBs flushed whole: %ld\n",
+               smp.rounds, smp.ipis, smp.rounds ? (double)smp.ipis / smp.rounds : 0.0,
+               smp.rounds ? (double)smp.round_pages / smp.rounds : 0.0, smp.full_flushes);
+        printf("Initiator wait per round: %.0f cycles average, %ld max\n",
+               smp.rounds ? (double)(smp.initiator_cycles - changed * smp.local_cycles) / smp.rounds : 0.0,
+               smp.max_round_cycles);
+    }
+    printf("Stall cycles: %lld initiators, %lld remote, %.3f%% of %lld reference cycles\n",
+           smp.initiator_cycles, smp.remote_cycles,
+           refs ? 100.0 * stall / ((long long)refs * smp.ref_cycles) : 0.0, (long long)refs * smp.ref_cycles);
+    char p50[32], p99[32], p999[32];
+    printf("Stall per reference: p50 %s, p99 %s, p99.9 %s cycles\n",
+           percentile(p50, sizeof(p50), refs, 0.5), percentile(p99, sizeof(p99), refs, 0.99),
+           percentile(p999, sizeof(p999), refs, 0.999));
+    for (int c = 0; c < smp.cores; c++) {
+        printf("Core %2d: %6ld references, %9lld stall cycles, %7.1f a reference\n", c, smp.core_refs[c],
+               smp.core_stall[c], smp.core_refs[c] ? (double)smp.core_stall[c] / smp.core_refs[c] : 0.0);
+    }
+}
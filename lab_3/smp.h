@@ -0,0 +1,73 @@
+#ifndef SMP_H
+#define SMP_H
+
+/**
+ * Several cores with private TLBs running the trace, and the TLB
+ * shootdowns keeping them coherent (see smp.c).
+ */
+
+#include <stdbool.h>
+#include "simulator.h"
+
+// Why a translation changed.
+enum smp_cause
+{
+    SMP_EVICT,          // Reclaim unmapped the page
+    SMP_MIGRATE,        // The page moved to another frame (see exchange_frames())
+    SMP_MPROTECT,       // "p" trace event
+    SMP_MUNMAP,         // "u" trace event
+    SMP_CAUSES
+};
+
+// Cores an IPI round goes to.
+enum smp_targets
+{
+    SMP_ALL,            // Every other core that ran the process, as mm_cpumask
+    SMP_HOLDERS         // Only the cores whose TLB holds one of the pages
+};
+
+#define SMP_STALL_BUCKETS 32
+
+struct smp_model
+{
+    int cores;
+    int quantum;                // References a core runs before the next one's turn
+    enum smp_targets targets;
+    int batch;                  // Pages an IPI round carries at most, 1 for a round per page
+    int full_flush;             // Pages above which the remote TLBs are flushed whole
+    bool lazy;                  // No IPI, remote cores drop the pages before their next reference
+    long ref_cycles;            // A reference without stalls, for the overhead
+    long local_cycles;          // invlpg of one page
+    long ipi_cycles;            // Sending an IPI and waiting for its delivery
+    long target_cycles;         // ... per destination
+    long handler_cycles;        // Interrupt on a remote core, the initiator waits for its ack
+    long lazy_cycles;           // A remote core checking a deferred page
+
+    // Statistics
+    long invalidations[SMP_CAUSES];
+    long rounds;                // IPI rounds
+    long ipis;
+    long round_pages;           // Pages the rounds carried
+    long full_flushes;          // Remote TLBs flushed whole
+    long deferred;              // Pages left to the remote cores
+    long overflows;             // ... more than a TLB, flushed whole
+    long long initiator_cycles;
+    long long remote_cycles;
+    long max_round_cycles;
+    long core_refs[MAX_CORES];
+    long long core_stall[MAX_CORES];
+    long stall_hist[SMP_STALL_BUCKETS];     // References by the bit length of their stall cycles, the last bucket also longer ones
+};
+
+extern struct smp_model smp;
+
+int smp_configure(const char *spec);
+void smp_reset(void);
+void smp_switch(long ref);
+void smp_shootdown(int page_num, enum smp_cause cause);
+void smp_flush(void);
+void smp_retire(void);
+void smp_checkpoint(void);
+void smp_report(void);
+
+#endif
@@ -0,0 +1,318 @@
+/**
+ * Swap device model for simulator.c.
+ *
+ * The simulation runs on a clock: every reference costs ref_ns of compute,
+ * a page fault stalls until the device has read the page. The device
+ * serves up to queue_depth requests at once, each takes its latency plus
+ * the transfer of its pages at the device bandwidth. The swap slot of a
+ * page is its page number, so neighbouring pages are contiguous on the
+ * device and a cluster is read in one request.
+ *
+ * - clustered swap-in: a fault reads the whole aligned cluster of the page
+ *   in one request and maps the other pages too
+ * - readahead: the pages after the cluster are read asynchronously, a
+ *   reference to one of them before its read finished stalls for the rest
+ * - async writeback: dirty victims are queued and the fault goes on, the
+ *   writes still compete with reads for the device. A fault on a page
+ *   whose write has not finished finds it in the swap cache.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "simulator.h"
+#include "swap.h"
+
+const struct swap_device swap_devices[] = {
+    { "hdd", 8000000, 150, 1 },
+    { "sata", 100000, 500, 32 },
+    { "nvme", 20000, 3000, 64 },
+};
+const int num_of_swap_devices = sizeof(swap_devices) / sizeof(swap_devices[0]);
+
+struct swap_model swap = {
+    .device = { "nvme", 20000, 3000, 64 },
+    .cluster = 1,
+    .readahead = 0,
+    .async_writeback = true,
+    .ref_ns = 100,
+    .io_page_size = 4096,
+};
+
+static long long busy_until[MAX_QUEUE_DEPTH];   // Per queue slot
+static long long ready_at[MAX_NUM_OF_PAGES];    // When the read of a prefetched page finishes
+static long long written_at[MAX_NUM_OF_PAGES];  // When the writeback of a page finishes
+static bool prefetched[MAX_NUM_OF_PAGES];       // Brought in without a fault, not referenced yet
+static long long busy_any_until;
+
+
+
+/**
+ * Queue a request on the first free slot.
+ *
+ * @param pages: Pages to transfer.
+ * @return long long: The time the request finishes.
+ */
+static long long submit(int pages) {
+    int slot = 0;
+    for (int k = 1; k < swap.device.queue_depth; k++) {
+        if (busy_until[k] < busy_until[slot]) slot = k;
+    }
+    long long start = busy_until[slot] > swap.now_ns ? busy_until[slot] : swap.now_ns;
+    long long service = swap.device.latency_ns
+        + (long long)pages * swap.io_page_size * 1000 / swap.device.bandwidth_mbs;
+    busy_until[slot] = start + service;
+    swap.busy_ns += service;
+    // Requests start in submission order or later, extend the busy time by
+    // the part past the busy period so far
+    if (start >= busy_any_until) swap.busy_any_ns += service;
+    else if (busy_until[slot] > busy_any_until) swap.busy_any_ns += busy_until[slot] - busy_any_until;
+    if (busy_until[slot] > busy_any_until) busy_any_until = busy_until[slot];
+    return busy_until[slot];
+}
+
+
+
+/**
+ * Advance the clock by the compute time of a reference.
+ *
+ * @return void
+ */
+void swap_tick(void) {
+    swap.now_ns += swap.ref_ns;
+}
+
+
+
+/**
+ * Read a faulting page, with the rest of its cluster, and stall until it
+ * is in.
+ *
+ * @param page: The faulting page.
+ * @param pages: Pages read in the same request, the page included.
+ * @return bool: Whether the device read it, false if the page was found in
+ *         the swap cache.
+ */
+bool swap_fault_in(int page, int pages) {
+    swap.faults++;
+    if (written_at[page] > swap.now_ns) {
+        swap.swap_cache_hits++;
+        return false;
+    }
+    long long done = submit(pages);
+    swap.reads++;
+    swap.read_pages += pages;
+    swap.fault_stall_ns += done - swap.now_ns;
+    swap.now_ns = done;
+    return true;
+}
+
+
+
+/**
+ * Account pages brought in without a fault of their own.
+ *
+ * @param pages: The pages.
+ * @param n: Number of pages.
+ * @param async: Whether they need a read of their own (readahead), false
+ *        if they came with the faulting page's cluster.
+ * @return void
+ */
+void swap_prefetch(const int *pages, int n, bool async) {
+    long long done = swap.now_ns;
+    if (async && n > 0) {
+        done = submit(n);
+        swap.reads++;
+        swap.read_pages += n;
+    }
+    for (int k = 0; k < n; k++) {
+        ready_at[pages[k]] = done;
+        prefetched[pages[k]] = true;
+    }
+    swap.prefetched += n;
+}
+
+
+
+/**
+ * A resident page is referenced for the first time through the page
+ * table: wait if its readahead has not finished yet.
+ *
+ * @param page: The page.
+ * @return void
+ */
+void swap_wait(int page) {
+    if (!prefetched[page]) return;
+    prefetched[page] = false;
+    swap.prefetch_hits++;
+    if (ready_at[page] > swap.now_ns) {
+        swap.readahead_stall_ns += ready_at[page] - swap.now_ns;
+        swap.now_ns = ready_at[page];
+    }
+}
+
+
+
+/**
+ * A page leaves its frame.
+ *
+ * @param page: The page.
+ * @return void
+ */
+void swap_evict(int page) {
+    prefetched[page] = false;
+}
+
+
+
+/**
+ * Write a page back.
+ *
+ * @param page: The page.
+ * @return void
+ */
+void swap_write(int page) {
+    written_at[page] = submit(1);
+    swap.writes++;
+    if (!swap.async_writeback) {
+        swap.writeback_stall_ns += written_at[page] - swap.now_ns;
+        swap.now_ns = written_at[page];
+    }
+}
+
+
+
+/**
+ * Account CPU time spent on a page fault or eviction.
+ *
+ * @param ns: The time.
+ * @return void
+ */
+void swap_cpu(long long ns) {
+    swap.now_ns += ns;
+    swap.cpu_ns += ns;
+}
+
+
+
+/**
+ * Reset the clock, the device and the statistics.
+ *
+ * @return void
+ */
+void swap_reset(void) {
+    memset(busy_until, 0, sizeof(busy_until));
+    memset(ready_at, 0, sizeof(ready_at));
+    memset(written_at, 0, sizeof(written_at));
+    memset(prefetched, 0, sizeof(prefetched));
+    swap.now_ns = 0;
+    swap.fault_stall_ns = swap.readahead_stall_ns = swap.writeback_stall_ns = 0;
+    swap.cpu_ns = 0;
+    swap.busy_ns = swap.busy_any_ns = 0;
+    busy_any_until = 0;
+    swap.faults = swap.reads = swap.read_pages = swap.writes = 0;
+    swap.swap_cache_hits = swap.prefetched = swap.prefetch_hits = 0;
+}
+
+
+
+/**
+ * Configure the model.
+ *
+ * The spec is a comma separated list of
+ *   hdd, sata, nvme                   device preset
+ *   lat=us, bw=MB/s, qd=requests      device parameters
+ *   cluster=pages, readahead=pages, ref=ns, page=bytes
+ *   async, sync                       writeback
+ * e.g. "sata,cluster=8,readahead=4".
+ *
+ * @param spec: The configuration.
+ * @return int: 0 on success, -1 on failure.
+ */
+int swap_configure(const char *spec) {
+    char buf[256];
+    snprintf(buf, sizeof(buf), "%s", spec);
+    for (char *token = strtok(buf, ","); token != NULL; token = strtok(NULL, ",")) {
+        char *value = strchr(token, '=');
+        if (value) *value++ = 0;
+        bool known = true;
+        bool preset = false;
+        for (int k = 0; k < num_of_swap_devices; k++) {
+            if (!value && strcmp(token, swap_devices[k].name) == 0) {
+                swap.device = swap_devices[k];
+                preset = true;
+            }
+        }
+        if (preset) continue;
+        if (value && strcmp(token, "lat") == 0) swap.device.latency_ns = atol(value) * 1000;
+        else if (value && strcmp(token, "bw") == 0) swap.device.bandwidth_mbs = atol(value);
+        else if (value && strcmp(token, "qd") == 0) swap.device.queue_depth = atoi(value);
+        else if (value && strcmp(token, "cluster") == 0) swap.cluster = atoi(value);
+        else if (value && strcmp(token, "readahead") == 0) swap.readahead = atoi(value);
+        else if (value && strcmp(token, "ref") == 0) swap.ref_ns = atol(value);
+        else if (value && strcmp(token, "page") == 0) swap.io_page_size = atoi(value);
+        else if (strcmp(token, "async") == 0) swap.async_writeback = true;
+        else if (strcmp(token, "sync") == 0) swap.async_writeback = false;
+        else known = false;
+        if (!known) {
+            fprintf(stderr, "swap_configure: Error: Bad option %s\n", token);
+            return -1;
+        }
+    }
+    if (swap.device.latency_ns < 0 || swap.device.bandwidth_mbs < 1
+        || swap.device.queue_depth < 1 || swap.device.queue_depth > MAX_QUEUE_DEPTH
+        || swap.cluster < 1 || swap.readahead < 0 || swap.ref_ns < 0 || swap.io_page_size < 1) {
+        fprintf(stderr, "swap_configure: Error: Bad device, queue depth is 1-%d\n", MAX_QUEUE_DEPTH);
+        return -1;
+    }
+    swap_reset();
+    return 0;
+}
+
+
+
+/**
+ * Time until the last request finished, writebacks still in flight at the
+ * end of the trace included.
+ *
+ * @return long long: Nanoseconds.
+ */
+long long swap_elapsed_ns(void) {
+    long long elapsed_ns = swap.now_ns;
+    for (int k = 0; k < swap.device.queue_depth; k++) {
+        if (busy_until[k] > elapsed_ns) elapsed_ns = busy_until[k];
+    }
+    return elapsed_ns;
+}
+
+
+
+/**
+ * Print where the time went and how busy the device was.
+ *
+ * @return void
+ */
+void swap_report(void) {
+    long long compute_ns = num_refs * swap.ref_ns;
+    long long stall_ns = swap.fault_stall_ns + swap.readahead_stall_ns + swap.writeback_stall_ns;
+    long long elapsed_ns = swap_elapsed_ns();
+
+    printf("\n=========== SWAP ===========\n");
+    printf("Device: %s, %ld us, %ld MB/s, queue depth %d, %d B pages\n", swap.device.name,
+           swap.device.latency_ns / 1000, swap.device.bandwidth_mbs, swap.device.queue_depth, swap.io_page_size);
+    printf("Swap-in cluster: %d, readahead: %d, %s writeback\n", swap.cluster, swap.readahead,
+           swap.async_writeback ? "async" : "sync");
+    printf("Reads: %ld (%ld pages), writes: %ld, swap cache hits: %ld\n",
+           swap.reads, swap.read_pages, swap.writes, swap.swap_cache_hits);
+    printf("Prefetched pages: %ld, referenced before eviction: %ld\n", swap.prefetched, swap.prefetch_hits);
+    printf("Elapsed: %.3f ms, compute %.3f ms\n", swap.now_ns / 1e6, compute_ns / 1e6);
+    printf("Stalls: %.3f ms (%.2f%%): faults %.3f ms, readahead %.3f ms, writeback %.3f ms\n",
+           stall_ns / 1e6, swap.now_ns ? 100.0 * stall_ns / swap.now_ns : 0.0,
+           swap.fault_stall_ns / 1e6, swap.readahead_stall_ns / 1e6, swap.writeback_stall_ns / 1e6);
+    if (swap.cpu_ns) printf("Compression: %.3f ms\n", swap.cpu_ns / 1e6);
+    printf("Average fault stall: %.1f us over %ld faults\n",
+           swap.faults ? swap.fault_stall_ns / 1e3 / swap.faults : 0.0, swap.faults);
+    printf("Device busy: %.2f%% of the time, utilization of the queue slots: %.2f%%\n",
+           elapsed_ns ? 100.0 * swap.busy_any_ns / elapsed_ns : 0.0,
+           elapsed_ns ? 100.0 * swap.busy_ns / ((double)elapsed_ns * swap.device.queue_depth) : 0.0);
+}
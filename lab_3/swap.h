@@ -0,0 +1,63 @@
+#ifndef SWAP_H
+#define SWAP_H
+
+/**
+ * Swap device model for demand paging in simulator.c: what a page fault
+ * costs in time.
+ */
+
+#include <stdbool.h>
+
+#define MAX_QUEUE_DEPTH 64
+
+struct swap_device
+{
+    const char *name;
+    long latency_ns;        // Per request: seek and rotation, or flash read
+    long bandwidth_mbs;     // MB/s
+    int queue_depth;        // Requests served in parallel
+};
+
+struct swap_model
+{
+    struct swap_device device;
+    int cluster;            // Pages per swap-in, the aligned cluster of the faulting page
+    int readahead;          // Pages after the cluster read asynchronously
+    bool async_writeback;   // Dirty victims are written in the background
+    long ref_ns;            // Compute time per reference
+    int io_page_size;       // Bytes a page stands for on the device
+
+    // Statistics
+    long long now_ns;       // Simulated time
+    long long fault_stall_ns;
+    long long readahead_stall_ns;   // Waiting for a prefetch still in flight
+    long long writeback_stall_ns;   // Synchronous writeback only
+    long long cpu_ns;       // Compressing and decompressing pages (zswap)
+    long long busy_ns;      // Service time of all requests
+    long long busy_any_ns;  // Time with at least one request in service
+    long faults;            // Faults that went to the device or the swap cache
+    long reads;
+    long read_pages;
+    long writes;
+    long swap_cache_hits;   // Faults on pages still being written back, no read
+    long prefetched;        // Pages brought in without a fault
+    long prefetch_hits;     // ... and referenced before their eviction
+};
+
+extern struct swap_model swap;
+extern const struct swap_device swap_devices[];
+extern const int num_of_swap_devices;
+
+int swap_configure(const char *spec);
+void swap_reset(void);
+void swap_tick(void);
+bool swap_fault_in(int page, int pages);
+void swap_prefetch(const int *pages, int n, bool async);
+void swap_wait(int page);
+void swap_evict(int page);
+void swap_write(int page);
+void swap_cpu(long long ns);
+long long swap_elapsed_ns(void);
+void swap_report(void);
+
+#endif
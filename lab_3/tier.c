@@ -0,0 +1,327 @@
+/**
+ * Two-tier physical memory for simulator.c.
+ *
+ * The frames below fast_frames are DRAM, the others a slower, larger tier
+ * (CXL or persistent memory). Pages are placed by the allocator, so with
+ * the sequential one the fast tier fills first, and every interval a
+ * background pass promotes the hottest slow pages by exchanging them with
+ * the coldest fast ones:
+ *
+ * - scan: the access bit of every frame is shifted into a history byte,
+ *   a page is hot when its bit was set in threshold of the last 8 scans
+ * - sample: one access in sample_period is counted (PEBS style), the
+ *   counts are halved every pass, a page is hot with threshold samples
+ *
+ * A page only moves to a colder frame's place, and at most batch pages a
+ * pass, which bounds the migration bandwidth. Each move costs migrate_ns
+ * and drops the page's TLB entries and cache lines (see exchange_frames()).
+ * Frames are only exchanged, never moved to a free frame, the allocator
+ * keeps owning which frames are free.
+ *
+ * The report compares a policy to the best static placement, the most
+ * accessed pages of the whole run pinned in the fast tier. With demand
+ * paging that is not a bound, the pages also come and go.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include "simulator.h"
+#include "tier.h"
+#include "checkpoint.h"
+
+struct tier_model tiers = {
+    .fast_frames = 64,
+    .fast_ns = 80,
+    .slow_ns = 250,
+    .migrate_ns = 2000,
+    .policy = TIER_SCAN,
+    .interval = 64,
+    .sample_period = 8,
+    .threshold = 2,
+    .batch = 4,
+};
+
+static const char *policy_names[] = { "none", "scan", "sample" };
+
+static bool accessed[NUM_OF_FRAMES];        // Access bit since the last scan
+static unsigned char history[NUM_OF_FRAMES];
+static unsigned int samples[NUM_OF_FRAMES];
+static long sample_clock;
+static long page_accesses[MAX_NUM_OF_PAGES];
+
+
+
+static bool is_fast(int frame_num) {
+    return frame_num < tiers.fast_frames;
+}
+
+
+
+static int bits(unsigned int x) {
+    int n = 0;
+    for (; x; x &= x - 1) n++;
+    return n;
+}
+
+
+
+static unsigned int hotness(int frame_num) {
+    return tiers.policy == TIER_SCAN ? history[frame_num] : samples[frame_num];
+}
+
+
+
+static bool is_hot(int frame_num) {
+    unsigned int h = tiers.policy == TIER_SCAN ? (unsigned int)bits(history[frame_num]) : samples[frame_num];
+    return h >= (unsigned int)tiers.threshold;
+}
+
+
+
+/**
+ * A new page was loaded into a frame, it starts cold.
+ *
+ * @return void
+ */
+void tier_loaded(int frame_num) {
+    accessed[frame_num] = false;
+    history[frame_num] = 0;
+    samples[frame_num] = 0;
+}
+
+
+
+/**
+ * Account an access to a frame.
+ *
+ * @param frame_num: The frame.
+ * @param page_num: The page in it.
+ * @return void
+ */
+void tier_access(int frame_num, int page_num) {
+    if (is_fast(frame_num)) tiers.fast_accesses++;
+    else tiers.slow_accesses++;
+    accessed[frame_num] = true;
+    if (tiers.policy == TIER_SAMPLE && ++sample_clock % tiers.sample_period == 0) samples[frame_num]++;
+    page_accesses[page_num]++;
+}
+
+
+
+static void swap_hotness(int a, int b) {
+    bool acc = accessed[a];
+    unsigned char hist = history[a];
+    unsigned int smp = samples[a];
+    accessed[a] = accessed[b];
+    history[a] = history[b];
+    samples[a] = samples[b];
+    accessed[b] = acc;
+    history[b] = hist;
+    samples[b] = smp;
+}
+
+
+
+/**
+ * Promote the hottest slow pages in place of the coldest fast ones.
+ */
+static void migrate(void) {
+    for (int k = 0; k < tiers.batch; k++) {
+        int hot = -1, cold = -1;
+        for (int f = 0; f < num_frames; f++) {
+            if (frame_table[f].page == -1) continue;
+            if (is_fast(f)) {
+                if (cold == -1 || hotness(f) < hotness(cold)) cold = f;
+            } else if (is_hot(f) && (hot == -1 || hotness(f) > hotness(hot))) {
+                hot = f;
+            }
+        }
+        if (hot == -1 || cold == -1 || hotness(hot) <= hotness(cold)) return;
+        exchange_frames(hot, cold);
+        swap_hotness(hot, cold);
+        tiers.promotions++;
+        tiers.demotions++;
+        tiers.migrate_total_ns += 2 * tiers.migrate_ns;
+    }
+}
+
+
+
+/**
+ * Advance by one reference, running a pass every interval.
+ *
+ * @return void
+ */
+void tier_tick(void) {
+    if (tiers.policy == TIER_NONE || num_refs % tiers.interval != 0) return;
+    tiers.passes++;
+    if (tiers.policy == TIER_SCAN) {
+        for (int f = 0; f < num_frames; f++) {
+            history[f] = history[f] >> 1 | (accessed[f] ? 0x80 : 0);
+            accessed[f] = false;
+        }
+    }
+    migrate();
+    if (tiers.policy == TIER_SAMPLE) {
+        for (int f = 0; f < num_frames; f++) samples[f] >>= 1;
+    }
+}
+
+
+
+/**
+ * Reset the hotness and the statistics.
+ *
+ * @return void
+ */
+void tier_reset(void) {
+    memset(accessed, 0, sizeof(accessed));
+    memset(history, 0, sizeof(history));
+    memset(samples, 0, sizeof(samples));
+    memset(page_accesses, 0, sizeof(page_accesses));
+    sample_clock = 0;
+    tiers.fast_accesses = tiers.slow_accesses = 0;
+    tiers.passes = tiers.promotions = tiers.demotions = 0;
+    tiers.migrate_total_ns = 0;
+}
+
+
+
+/**
+ * Configure the tiers.
+ *
+ * The spec is a comma separated list of
+ *   fast=frames, fast_ns=ns, slow_ns=ns, migrate=ns,
+ *   none|scan|sample, interval=references, period=accesses,
+ *   threshold=n, batch=pages, default
+ * e.g. "fast=32,slow_ns=400,sample,period=4".
+ *
+ * @param spec: The configuration.
+ * @return int: 0 on success, -1 on failure.
+ */
+int tier_configure(const char *spec) {
+    char buf[256];
+    snprintf(buf, sizeof(buf), "%s", spec);
+    for (char *token = strtok(buf, ","); token != NULL; token = strtok(NULL, ",")) {
+        char *value = strchr(token, '=');
+        if (value) *value++ = 0;
+        bool known = true;
+        bool policy = false;
+        for (int k = 0; k < 3; k++) {
+            if (!value && strcmp(token, policy_names[k]) == 0) {
+                tiers.policy = k;
+                policy = true;
+            }
+        }
+        if (policy) continue;
+        if (value && strcmp(token, "fast") == 0) tiers.fast_frames = atoi(value);
+        else if (value && strcmp(token, "fast_ns") == 0) tiers.fast_ns = atol(value);
+        else if (value && strcmp(token, "slow_ns") == 0) tiers.slow_ns = atol(value);
+        else if (value && strcmp(token, "migrate") == 0) tiers.migrate_ns = atol(value);
+        else if (value && strcmp(token, "interval") == 0) tiers.interval = atoi(value);
+        else if (value && strcmp(token, "period") == 0) tiers.sample_period = atoi(value);
+        else if (value && strcmp(token, "threshold") == 0) tiers.threshold = atoi(value);
+        else if (value && strcmp(token, "batch") == 0) tiers.batch = atoi(value);
+        else if (strcmp(token, "default") != 0) known = false;
+        if (!known) {
+            fprintf(stderr, "tier_configure: Error: Bad option %s\n", token);
+            return -1;
+        }
+    }
+    if (tiers.fast_frames < 0 || tiers.fast_frames > NUM_OF_FRAMES) {
+        fprintf(stderr, "tier_configure: Error: Bad fast=%d, at most %d fast frames\n", tiers.fast_frames, NUM_OF_FRAMES);
+        return -1;
+    }
+    if (tiers.fast_ns < 0) {
+        fprintf(stderr, "tier_configure: Error: Bad fast_ns=%ld, at least 0 ns\n", tiers.fast_ns);
+        return -1;
+    }
+    if (tiers.slow_ns < 0) {
+        fprintf(stderr, "tier_configure: Error: Bad slow_ns=%ld, at least 0 ns\n", tiers.slow_ns);
+        return -1;
+    }
+    if (tiers.migrate_ns < 0) {
+        fprintf(stderr, "tier_configure: Error: Bad migrate=%ld, at least 0 ns\n", tiers.migrate_ns);
+        return -1;
+    }
+    if (tiers.interval < 1) {
+        fprintf(stderr, "tier_configure: Error: Bad interval=%d, at least 1 reference\n", tiers.interval);
+        return -1;
+    }
+    if (tiers.sample_period < 1) {
+        fprintf(stderr, "tier_configure: Error: Bad period=%d, at least 1 access\n", tiers.sample_period);
+        return -1;
+    }
+    if (tiers.threshold < 1) {
+        fprintf(stderr, "tier_configure: Error: Bad threshold=%d, at least 1\n", tiers.threshold);
+        return -1;
+    }
+    if (tiers.batch < 0) {
+        fprintf(stderr, "tier_configure: Error: Bad batch=%d, at least 0 pages\n", tiers.batch);
+        return -1;
+    }
+    tier_reset();
+    return 0;
+}
+
+
+
+/**
+ * Register the hotness and the statistics for a checkpoint.
+ *
+ * @return void
+ */
+void tier_checkpoint(void) {
+    checkpoint_add("tier.fast_frames", &tiers.fast_frames, sizeof(tiers.fast_frames), CHECKPOINT_CONFIG);
+    checkpoint_add("tier.accessed", accessed, sizeof(accessed), CHECKPOINT_STATE);
+    checkpoint_add("tier.history", history, sizeof(history), CHECKPOINT_STATE);
+    checkpoint_add("tier.samples", samples, sizeof(samples), CHECKPOINT_STATE);
+    checkpoint_add("tier.sample_clock", &sample_clock, sizeof(sample_clock), CHECKPOINT_STATE);
+    checkpoint_add("tier.page_accesses", page_accesses, sizeof(page_accesses), CHECKPOINT_STATS);
+    checkpoint_add("tier.stats", &tiers.fast_accesses,
+                   sizeof(tiers) - offsetof(struct tier_model, fast_accesses), CHECKPOINT_STATS);
+}
+
+
+
+static int by_accesses(const void *a, const void *b) {
+    long x = *(const long *)a, y = *(const long *)b;
+    return (x < y) - (x > y);
+}
+
+
+
+/**
+ * Print the share of the accesses the fast tier served, against the best
+ * static placement, and what the migrations cost.
+ *
+ * @return void
+ */
+void tier_report(void) {
+    long accesses = tiers.fast_accesses + tiers.slow_accesses;
+    long sorted[MAX_NUM_OF_PAGES];
+    memcpy(sorted, page_accesses, sizeof(sorted));
+    qsort(sorted, MAX_NUM_OF_PAGES, sizeof(sorted[0]), by_accesses);
+    long best = 0;
+    int fast = tiers.fast_frames < num_frames ? tiers.fast_frames : num_frames;
+    for (int k = 0; k < fast && k < MAX_NUM_OF_PAGES; k++) best += sorted[k];
+    long long access_ns = (long long)tiers.fast_accesses * tiers.fast_ns + (long long)tiers.slow_accesses * tiers.slow_ns;
+
+    printf("\n=========== MEMORY TIERS ===========\n");
+    printf("Fast tier: %d frames, %ld ns, slow tier: %d frames, %ld ns, migration: %ld ns per page\n",
+           fast, tiers.fast_ns, num_frames - fast, tiers.slow_ns, tiers.migrate_ns);
+    printf("Policy: %s every %d references, threshold %d, batch %d", policy_names[tiers.policy],
+           tiers.interval, tiers.threshold, tiers.batch);
+    if (tiers.policy == TIER_SAMPLE) printf(", 1 in %d accesses sampled", tiers.sample_period);
+    printf("\n");
+    printf("Accesses in the fast tier: %.2f%% (%ld of %ld), best static placement %.2f%%\n",
+           accesses ? 100.0 * tiers.fast_accesses / accesses : 0.0, tiers.fast_accesses, accesses,
+           accesses ? 100.0 * best / accesses : 0.0);
+    printf("Promotions: %ld, demotions: %ld over %ld passes, migration: %.3f us\n",
+           tiers.promotions, tiers.demotions, tiers.passes, tiers.migrate_total_ns / 1e3);
+    printf("Average memory latency: %.1f ns, %.1f ns with migrations (all fast: %ld ns, all slow: %ld ns)\n",
+           accesses ? (double)access_ns / accesses : 0.0,
+           accesses ? (double)(access_ns + tiers.migrate_total_ns) / accesses : 0.0, tiers.fast_ns, tiers.slow_ns);
+}
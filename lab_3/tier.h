@@ -0,0 +1,49 @@
+#ifndef TIER_H
+#define TIER_H
+
+/**
+ * Two-tier physical memory (see tier.c): fast DRAM frames and a slower,
+ * larger tier, with pages migrated between them by hotness.
+ */
+
+#include <stdbool.h>
+
+enum tier_policy
+{
+    TIER_NONE,          // Pages stay where they were placed
+    TIER_SCAN,          // Access bit scanned every interval, hotness is its history
+    TIER_SAMPLE         // One access in sample_period counted, halved every interval
+};
+
+struct tier_model
+{
+    int fast_frames;        // Frames below it are the fast tier, the others the slow one
+    long fast_ns;           // Access latency of each tier
+    long slow_ns;
+    long migrate_ns;        // Moving a page between the tiers, copy and TLB shootdown
+    enum tier_policy policy;
+    int interval;           // References between migration passes
+    int sample_period;
+    int threshold;          // Hotness a slow page needs for promotion
+    int batch;              // Pages promoted per pass at most
+
+    // Statistics
+    long fast_accesses;
+    long slow_accesses;
+    long passes;
+    long promotions;
+    long demotions;
+    long long migrate_total_ns;
+};
+
+extern struct tier_model tiers;
+
+int tier_configure(const char *spec);
+void tier_reset(void);
+void tier_loaded(int frame_num);
+void tier_access(int frame_num, int page_num);
+void tier_tick(void);
+void tier_checkpoint(void);
+void tier_report(void);
+
+#endif
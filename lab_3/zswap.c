@@ -0,0 +1,435 @@
+/**
+ * Compressed swap tier for simulator.c.
+ *
+ * Evicted pages are compressed into a RAM pool instead of going to the
+ * backing store. A fault on a page in the pool decompresses it, which
+ * costs decompress_ns instead of a device read. The pool keeps its
+ * compressed bytes within a budget. When it is over budget, it writes
+ * its oldest pages back to the backing store (zswap writeback). Pages
+ * that compress to more than max_size are rejected and go to the
+ * backing store directly. Pages that are one repeated byte are stored
+ * without data.
+ *
+ * The budget is RAM: simulator.c takes it out of the frames.
+ *
+ * The codec is an LZ4-style block format: sequences of a token (literal
+ * length << 4 | match length - 4), literals, a 16 bit little-endian
+ * offset and length continuation bytes of 255 for lengths from 15 up.
+ * The last sequence has literals only.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include "simulator.h"
+#include "zswap.h"
+#include "checkpoint.h"
+
+#define MIN_MATCH 4
+#define HASH_BITS 12
+
+struct zswap_pool zswap = {
+    .budget = 4096,
+    .max_size = PAGE_SIZE * 3 / 4,
+    .compress_ns = 5000,
+    .decompress_ns = 1000,
+};
+
+struct zswap_entry
+{
+    bool valid;
+    bool dirty;             // The backing store copy is stale
+    unsigned char *data;    // NULL for a same-filled page
+    int size;
+    unsigned char fill;
+    long stored_at;
+};
+
+static struct zswap_entry entries[MAX_NUM_OF_PAGES];
+static bool evicted_before[MAX_NUM_OF_PAGES];
+static long store_clock = 0;
+
+
+
+// ============================ CODEC ============================
+
+static unsigned int hash4(const unsigned char *p) {
+    unsigned int v = p[0] | p[1] << 8 | p[2] << 16 | (unsigned int)p[3] << 24;
+    return v * 2654435761u >> (32 - HASH_BITS);
+}
+
+
+
+/**
+ * Write the continuation bytes of a length.
+ *
+ * @return int: The new position, -1 if dst is full.
+ */
+static int put_length(unsigned char *dst, int pos, int capacity, int len) {
+    for (; len >= 255; len -= 255) {
+        if (pos >= capacity) return -1;
+        dst[pos++] = 255;
+    }
+    if (pos >= capacity) return -1;
+    dst[pos++] = len;
+    return pos;
+}
+
+
+
+/**
+ * Write a sequence, a match length of 0 ends the block with literals only.
+ *
+ * @return int: The new position, -1 if dst is full.
+ */
+static int put_sequence(unsigned char *dst, int pos, int capacity, const unsigned char *literals, int nlit,
+                        int offset, int mlen) {
+    int ml = mlen ? mlen - MIN_MATCH : 0;
+    if (pos >= capacity) return -1;
+    dst[pos++] = (nlit < 15 ? nlit : 15) << 4 | (ml < 15 ? ml : 15);
+    if (nlit >= 15 && (pos = put_length(dst, pos, capacity, nlit - 15)) < 0) return -1;
+    if (pos + nlit > capacity) return -1;
+    memcpy(dst + pos, literals, nlit);
+    pos += nlit;
+    if (mlen == 0) return pos;
+    if (pos + 2 > capacity) return -1;
+    dst[pos++] = offset & 0xff;
+    dst[pos++] = offset >> 8;
+    if (ml >= 15 && (pos = put_length(dst, pos, capacity, ml - 15)) < 0) return -1;
+    return pos;
+}
+
+
+
+/**
+ * Compress a block, greedy matching with a hash table of 4 byte prefixes.
+ *
+ * @param src: The data.
+ * @param len: Its length.
+ * @param dst: The output buffer.
+ * @param capacity: Its size.
+ * @return int: Compressed length, -1 if it does not fit in capacity.
+ */
+int lz_compress(const unsigned char *src, int len, unsigned char *dst, int capacity) {
+    int table[1 << HASH_BITS];
+    int anchor = 0;
+    int ip = 0;
+    int pos = 0;
+
+    for (int k = 0; k < 1 << HASH_BITS; k++) table[k] = -1;
+    while (ip + MIN_MATCH <= len) {
+        unsigned int h = hash4(src + ip);
+        int ref = table[h];
+        table[h] = ip;
+        if (ref < 0 || ip - ref > 65535 || memcmp(src + ref, src + ip, MIN_MATCH) != 0) {
+            ip++;
+            continue;
+        }
+        int mlen = MIN_MATCH;
+        while (ip + mlen < len && src[ref + mlen] == src[ip + mlen]) mlen++;
+        pos = put_sequence(dst, pos, capacity, src + anchor, ip - anchor, ip - ref, mlen);
+        if (pos < 0) return -1;
+        ip += mlen;
+        anchor = ip;
+    }
+    return put_sequence(dst, pos, capacity, src + anchor, len - anchor, 0, 0);
+}
+
+
+
+/**
+ * Read the continuation bytes of a length.
+ *
+ * @return int: The new position, -1 past the end of src.
+ */
+static int get_length(const unsigned char *src, int ip, int len, int *value) {
+    int b;
+    do {
+        if (ip >= len) return -1;
+        b = src[ip++];
+        *value += b;
+    } while (b == 255);
+    return ip;
+}
+
+
+
+/**
+ * Decompress a block.
+ *
+ * @param src: The compressed data.
+ * @param len: Its length.
+ * @param dst: The output buffer.
+ * @param capacity: Its size.
+ * @return int: Decompressed length, -1 if the block is corrupt or does not
+ *         fit in capacity.
+ */
+int lz_decompress(const unsigned char *src, int len, unsigned char *dst, int capacity) {
+    int ip = 0;
+    int op = 0;
+
+    while (ip < len) {
+        int token = src[ip++];
+        int nlit = token >> 4;
+        if (nlit == 15 && (ip = get_length(src, ip, len, &nlit)) < 0) return -1;
+        if (ip + nlit > len || op + nlit > capacity) return -1;
+        memcpy(dst + op, src + ip, nlit);
+        ip += nlit;
+        op += nlit;
+        if (ip == len) break;
+
+        if (ip + 2 > len) return -1;
+        int offset = src[ip] | src[ip + 1] << 8;
+        ip += 2;
+        int mlen = token & 15;
+        if (mlen == 15 && (ip = get_length(src, ip, len, &mlen)) < 0) return -1;
+        mlen += MIN_MATCH;
+        if (offset == 0 || offset > op || op + mlen > capacity) return -1;
+        // Byte by byte, the match may overlap its own output
+        for (int k = 0; k < mlen; k++, op++) dst[op] = dst[op - offset];
+    }
+    return op;
+}
+
+
+
+// ============================ POOL ============================
+
+static void drop(int page) {
+    struct zswap_entry *e = &entries[page];
+    free(e->data);
+    zswap.used -= e->size;
+    *e = (struct zswap_entry){ 0 };
+}
+
+
+
+/**
+ * Decompress an entry into a page. Memory holds bytes (see the NOTES of
+ * simulator.c), stored as signed char values.
+ */
+static void unpack(int page, int *data) {
+    struct zswap_entry *e = &entries[page];
+    unsigned char bytes[PAGE_SIZE];
+    if (e->data == NULL) {
+        memset(bytes, e->fill, PAGE_SIZE);
+    } else if (lz_decompress(e->data, e->size, bytes, PAGE_SIZE) != PAGE_SIZE) {
+        fprintf(stderr, "zswap: Error: Page %d does not decompress\n", page);
+        exit(1);
+    }
+    for (int k = 0; k < PAGE_SIZE; k++) {
+        data[k] = (signed char)bytes[k];
+    }
+}
+
+
+
+/**
+ * Write the oldest page out to the backing store, if the store's copy is
+ * stale, and free its entry.
+ */
+static void write_back_oldest(void) {
+    int oldest = -1;
+    for (int page = 0; page < MAX_NUM_OF_PAGES; page++) {
+        if (entries[page].valid && (oldest == -1 || entries[page].stored_at < entries[oldest].stored_at)) {
+            oldest = page;
+        }
+    }
+    if (entries[oldest].dirty) {
+        int data[PAGE_SIZE];
+        unpack(oldest, data);
+        write_to_swap(oldest, data);
+    }
+    drop(oldest);
+    zswap.written_back++;
+}
+
+
+
+/**
+ * Store an evicted page.
+ *
+ * @param page: The page number.
+ * @param data: Its contents.
+ * @param dirty: Whether the backing store copy is stale.
+ * @return bool: Whether the pool took it, false if it is rejected.
+ */
+bool zswap_store(int page, const int *data, bool dirty) {
+    struct zswap_entry *e = &entries[page];
+    unsigned char bytes[PAGE_SIZE];
+    unsigned char buf[PAGE_SIZE];
+
+    evicted_before[page] = true;
+    if (e->valid) drop(page);
+    int same = 1;
+    for (int k = 0; k < PAGE_SIZE; k++) {
+        bytes[k] = data[k];
+        same &= bytes[k] == bytes[0];
+    }
+    if (same) {
+        e->fill = bytes[0];
+        zswap.same_filled++;
+    } else {
+        int size = lz_compress(bytes, PAGE_SIZE, buf, zswap.max_size);
+        if (size < 0 || size > zswap.budget) {
+            zswap.rejected++;
+            return false;
+        }
+        e->data = malloc(size);
+        if (e->data == NULL) {
+            perror("zswap_store: malloc");
+            return false;
+        }
+        memcpy(e->data, buf, size);
+        e->size = size;
+        zswap.bytes_in += PAGE_SIZE;
+        zswap.bytes_out += size;
+    }
+    e->valid = true;
+    e->dirty = dirty;
+    e->stored_at = ++store_clock;
+    zswap.used += e->size;
+    zswap.stored++;
+    while (zswap.used > zswap.budget) {
+        write_back_oldest();
+    }
+    return true;
+}
+
+
+
+bool zswap_contains(int page) {
+    return entries[page].valid;
+}
+
+
+
+/**
+ * Account a page fault.
+ *
+ * @param page: The faulting page.
+ * @return bool: Whether the pool holds the page.
+ */
+bool zswap_fault(int page) {
+    if (entries[page].valid) {
+        zswap.hits++;
+        return true;
+    }
+    zswap.misses++;
+    zswap.refault_misses += evicted_before[page];
+    return false;
+}
+
+
+
+/**
+ * Take a page out of the pool.
+ *
+ * @param page: The page number.
+ * @param data: Where to decompress it.
+ * @param dirty: Set to whether the backing store copy is stale.
+ * @return bool: Whether the pool held the page.
+ */
+bool zswap_load(int page, int *data, bool *dirty) {
+    if (!entries[page].valid) return false;
+    unpack(page, data);
+    *dirty = entries[page].dirty;
+    drop(page);
+    return true;
+}
+
+
+
+/**
+ * Empty the pool and clear the statistics.
+ *
+ * @return void
+ */
+void zswap_reset(void) {
+    for (int page = 0; page < MAX_NUM_OF_PAGES; page++) {
+        drop(page);
+        evicted_before[page] = false;
+    }
+    store_clock = 0;
+    zswap.used = 0;
+    zswap.stored = zswap.same_filled = zswap.rejected = zswap.written_back = 0;
+    zswap.hits = zswap.misses = zswap.refault_misses = 0;
+    zswap.bytes_in = zswap.bytes_out = 0;
+}
+
+
+
+/**
+ * Configure the pool.
+ *
+ * The spec is a comma separated list of
+ *   pool=bytes[k], max=bytes, compress=ns, decompress=ns, default
+ * e.g. "pool=2k,decompress=500".
+ *
+ * @param spec: The configuration.
+ * @return int: 0 on success, -1 on failure.
+ */
+int zswap_configure(const char *spec) {
+    char buf[256];
+    snprintf(buf, sizeof(buf), "%s", spec);
+    for (char *token = strtok(buf, ","); token != NULL; token = strtok(NULL, ",")) {
+        char *value = strchr(token, '=');
+        if (value) *value++ = 0;
+        bool known = true;
+        if (value && strcmp(token, "pool") == 0) {
+            char *end;
+            zswap.budget = strtol(value, &end, 10);
+            if (*end == 'k' || *end == 'K') zswap.budget *= 1024;
+        }
+        else if (value && strcmp(token, "max") == 0) zswap.max_size = atoi(value);
+        else if (value && strcmp(token, "compress") == 0) zswap.compress_ns = atol(value);
+        else if (value && strcmp(token, "decompress") == 0) zswap.decompress_ns = atol(value);
+        else if (strcmp(token, "default") != 0) known = false;
+        if (!known) {
+            fprintf(stderr, "zswap_configure: Error: Bad option %s\n", token);
+            return -1;
+        }
+    }
+    if (zswap.budget < 1 || zswap.max_size < 1 || zswap.max_size > PAGE_SIZE
+        || zswap.compress_ns < 0 || zswap.decompress_ns < 0) {
+        fprintf(stderr, "zswap_configure: Error: Bad pool, max is 1-%d\n", PAGE_SIZE);
+        return -1;
+    }
+    zswap_reset();
+    return 0;
+}
+
+
+
+/**
+ * Print the compression ratio and how many faults the pool served.
+ *
+ * @return void
+ */
+void zswap_report(void) {
+    long faults = zswap.hits + zswap.misses;
+    long refaults = zswap.hits + zswap.refault_misses;
+    printf("\n=========== ZSWAP ===========\n");
+    printf("Pool: %d of %d B used (%d frames of RAM), max %d B per page\n", zswap.used, zswap.budget,
+           (zswap.budget + FRAME_SIZE - 1) / FRAME_SIZE, zswap.max_size);
+    printf("Stored: %ld, same-filled: %ld, rejected: %ld, written back: %ld\n",
+           zswap.stored, zswap.same_filled, zswap.rejected, zswap.written_back);
+    printf("Compression ratio: %.2f (%lld -> %lld B)\n",
+           zswap.bytes_out ? (double)zswap.bytes_in / zswap.bytes_out : 0.0, zswap.bytes_in, zswap.bytes_out);
+    printf("Faults served: %ld of %ld (%.2f%%), %.2f%% of the refaults\n", zswap.hits, faults,
+           faults ? 100.0 * zswap.hits / faults : 0.0, refaults ? 100.0 * zswap.hits / refaults : 0.0);
+}
+
+
+
+/**
+ * Register the statistics of the pool, to clear them after a fast-forward.
+ * The compressed pages are on the heap and not checkpointed.
+ *
+ * @return void
+ */
+void zswap_checkpoint(void) {
+    checkpoint_add("zswap.stats", &zswap.stored,
+                   sizeof(zswap) - offsetof(struct zswap_pool, stored), CHECKPOINT_STATS);
+}
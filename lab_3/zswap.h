@@ -0,0 +1,45 @@
+#ifndef ZSWAP_H
+#define ZSWAP_H
+
+/**
+ * Compressed in-memory swap tier (zswap/zram style) between the frames
+ * and the backing store of simulator.c.
+ */
+
+#include <stdbool.h>
+
+struct zswap_pool
+{
+    int budget;             // Bytes of compressed data the pool may hold
+    int max_size;           // Pages compressing to more are rejected
+    long compress_ns;       // Modeled cost of storing a page
+    long decompress_ns;     // Modeled cost of loading a page
+
+    // Statistics
+    int used;               // Bytes held now
+    long stored;
+    long same_filled;       // Pages of a single repeated byte, stored without data
+    long rejected;          // Did not compress below max_size
+    long written_back;      // Pushed out to the backing store to stay in the budget
+    long hits;              // Faults served from the pool
+    long misses;            // Faults that went to the backing store
+    long refault_misses;    // ... for pages that had been evicted before
+    long long bytes_in;     // Page bytes compressed
+    long long bytes_out;    // Compressed bytes
+};
+
+extern struct zswap_pool zswap;
+
+int lz_compress(const unsigned char *src, int len, unsigned char *dst, int capacity);
+int lz_decompress(const unsigned char *src, int len, unsigned char *dst, int capacity);
+
+int zswap_configure(const char *spec);
+void zswap_reset(void);
+bool zswap_store(int page, const int *data, bool dirty);
+bool zswap_contains(int page);
+bool zswap_fault(int page);
+bool zswap_load(int page, int *data, bool *dirty);
+void zswap_report(void);
+void zswap_checkpoint(void);
+
+#endif
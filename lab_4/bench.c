@@ -0,0 +1,529 @@
+/*
+ * bench.c
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <sys/resource.h>
+#include <linux/perf_event.h>
+#include "bench.h"
+
+const char *bench_counter_names[BENCH_NUM_COUNTERS] = { "cycles", "instructions", "cache_misses" };
+
+// Two sided 95% Student t quantiles for 1..30 degrees of freedom.
+static const double t95[] = {
+    12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+    2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+    2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042,
+};
+
+
+
+/**
+ * Default configuration.
+ */
+void bench_config_init(struct bench_config *cfg) {
+    memset(cfg, 0, sizeof(*cfg));
+    cfg->warmup = 1;
+    cfg->reps = 3;
+    cfg->cache = BENCH_CACHE_KEEP;
+    cfg->format = BENCH_TEXT;
+}
+
+
+
+/**
+ * Handle one of the BENCH_OPTIONS getopt() letters.
+ *
+ * @return int: 1 if handled, 0 if the option is not a harness option, -1 on a bad value.
+ */
+int bench_parse_option(struct bench_config *cfg, int opt, const char *arg) {
+    switch (opt) {
+    case 'w':
+        cfg->warmup = atoi(arg);
+        return cfg->warmup >= 0 ? 1 : -1;
+    case 'r':
+        cfg->reps = atoi(arg);
+        return cfg->reps >= 1 && cfg->reps <= BENCH_MAX_REPS ? 1 : -1;
+    case 'c':
+        if (strcmp(arg, "keep") == 0) cfg->cache = BENCH_CACHE_KEEP;
+        else if (strcmp(arg, "drop") == 0) cfg->cache = BENCH_CACHE_DROP;
+        else if (strcmp(arg, "warm") == 0) cfg->cache = BENCH_CACHE_WARM;
+        else return -1;
+        return 1;
+    case 'o':
+        if (strcmp(arg, "text") == 0) cfg->format = BENCH_TEXT;
+        else if (strcmp(arg, "csv") == 0) cfg->format = BENCH_CSV;
+        else if (strcmp(arg, "json") == 0) cfg->format = BENCH_JSON;
+        else return -1;
+        return 1;
+    case 'P':
+        cfg->perf = 1;
+        return 1;
+    }
+    return 0;
+}
+
+
+
+/**
+ * Check whether a name is in a comma separated list ("all" matches everything).
+ */
+int bench_in_list(const char *list, const char *name) {
+    if (strcmp(list, "all") == 0) return 1;
+    size_t len = strlen(name);
+    for (const char *p = list; (p = strstr(p, name)) != NULL; p += len) {
+        if ((p == list || p[-1] == ',') && (p[len] == ',' || p[len] == '\0')) return 1;
+    }
+    return 0;
+}
+
+
+
+/**
+ * Monotonic time in microseconds.
+ */
+double bench_now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+
+
+/**
+ * Compare doubles for qsort.
+ */
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+
+
+/**
+ * Nearest-rank percentile of a sorted sample.
+ */
+static double percentile(const double *sorted, int n, double p) {
+    int rank = (int)ceil(p / 100.0 * n);
+    if (rank < 1) rank = 1;
+    if (rank > n) rank = n;
+    return sorted[rank - 1];
+}
+
+
+
+/**
+ * Compute statistics of a sample.
+ *
+ * Sorts samples in place.
+ *
+ * @param samples: The sample.
+ * @param n: Sample size.
+ * @param out: The statistics.
+ */
+void bench_compute_stats(double *samples, int n, struct bench_stats *out) {
+    memset(out, 0, sizeof(*out));
+    out->n = n;
+    if (n == 0) {
+        return;
+    }
+    qsort(samples, n, sizeof(*samples), cmp_double);
+
+    double sum = 0;
+    for (int k = 0; k < n; k++) sum += samples[k];
+    out->mean = sum / n;
+
+    double sq = 0;
+    for (int k = 0; k < n; k++) sq += (samples[k] - out->mean) * (samples[k] - out->mean);
+    out->stddev = n > 1 ? sqrt(sq / (n - 1)) : 0;
+
+    out->min = samples[0];
+    out->max = samples[n - 1];
+    out->median = n % 2 ? samples[n / 2] : (samples[n / 2 - 1] + samples[n / 2]) / 2;
+    out->p95 = percentile(samples, n, 95);
+    out->p99 = percentile(samples, n, 99);
+
+    double t = n - 1 <= 0 ? 0 : n - 1 <= 30 ? t95[n - 2] : 1.960;
+    double half = t * out->stddev / sqrt(n);
+    out->ci_lo = out->mean - half;
+    out->ci_hi = out->mean + half;
+}
+
+
+
+/**
+ * Add a latency to a histogram.
+ *
+ * Values below BENCH_HIST_SUB get a bucket each, above that every power
+ * of two is split in BENCH_HIST_SUB linear sub-buckets.
+ *
+ * @param ns: The latency in nanoseconds.
+ */
+void bench_hist_add(struct bench_hist *h, double ns) {
+    unsigned long long v = ns < 0 ? 0 : (unsigned long long)ns;
+    int idx;
+    if (v < BENCH_HIST_SUB) {
+        idx = v;
+    } else {
+        int e = 63 - __builtin_clzll(v);        // v is in [2^e, 2^(e+1))
+        int sub = (v >> (e - 3)) & (BENCH_HIST_SUB - 1);
+        idx = (e - 2) * BENCH_HIST_SUB + sub;
+    }
+    if (idx >= BENCH_HIST_BUCKETS) idx = BENCH_HIST_BUCKETS - 1;
+    h->buckets[idx]++;
+    h->count++;
+    h->sum_ns += ns;
+    if (ns > h->max_ns) h->max_ns = ns;
+}
+
+
+
+/**
+ * Add the counts of one histogram to another.
+ */
+void bench_hist_merge(struct bench_hist *dst, const struct bench_hist *src) {
+    for (int k = 0; k < BENCH_HIST_BUCKETS; k++) {
+        dst->buckets[k] += src->buckets[k];
+    }
+    dst->count += src->count;
+    dst->sum_ns += src->sum_ns;
+    if (src->max_ns > dst->max_ns) dst->max_ns = src->max_ns;
+}
+
+
+
+/**
+ * Percentile of a histogram.
+ *
+ * @param p: The percentile, 0-100.
+ * @return double: Upper bound of the bucket holding the percentile in ns (capped at the max).
+ */
+double bench_hist_percentile(const struct bench_hist *h, double p) {
+    if (h->count == 0) {
+        return 0;
+    }
+    unsigned long long rank = (unsigned long long)ceil(p / 100.0 * h->count);
+    if (rank < 1) rank = 1;
+    unsigned long long seen = 0;
+    for (int k = 0; k < BENCH_HIST_BUCKETS; k++) {
+        seen += h->buckets[k];
+        if (seen >= rank) {
+            double upper;
+            if (k < BENCH_HIST_SUB) {
+                upper = k + 1;
+            } else {
+                int e = k / BENCH_HIST_SUB + 2;
+                int sub = k % BENCH_HIST_SUB;
+                upper = (double)(BENCH_HIST_SUB + sub + 1) * (1ULL << (e - 3));
+            }
+            return upper < h->max_ns ? upper : h->max_ns;
+        }
+    }
+    return h->max_ns;
+}
+
+
+
+/**
+ * Drop or warm the page cache according to the configuration.
+ *
+ * Dropping writes back dirty data and then tries the global
+ * /proc/sys/vm/drop_caches (root only); otherwise cfg->cache_path is
+ * evicted with POSIX_FADV_DONTNEED. Warming reads cfg->cache_path once.
+ *
+ * @return int: 0 on success, -1 if the cache could not be controlled.
+ */
+int bench_cache_control(const struct bench_config *cfg) {
+    if (cfg->cache == BENCH_CACHE_KEEP) {
+        return 0;
+    }
+
+    if (cfg->cache == BENCH_CACHE_DROP) {
+        sync();
+        int fd = open("/proc/sys/vm/drop_caches", O_WRONLY);
+        if (fd != -1) {
+            int ok = write(fd, "1", 1) == 1;
+            close(fd);
+            if (ok) return 0;
+        }
+        if (cfg->cache_path == NULL) {
+            return -1;
+        }
+        fd = open(cfg->cache_path, O_RDONLY);
+        if (fd == -1) {
+            return 0; // Nothing cached for a file that does not exist
+        }
+        fdatasync(fd);
+        int res = posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED) == 0 ? 0 : -1;
+        close(fd);
+        return res;
+    }
+
+    // Warm: read the whole file once
+    if (cfg->cache_path == NULL) {
+        return -1;
+    }
+    int fd = open(cfg->cache_path, O_RDONLY);
+    if (fd == -1) {
+        return 0;
+    }
+    static char buf[1 << 20];
+    while (read(fd, buf, sizeof(buf)) > 0) {
+        continue;
+    }
+    close(fd);
+    return 0;
+}
+
+
+
+/**
+ * Open one perf counter for this process and the threads it creates.
+ */
+static int perf_open(unsigned type, unsigned long long config) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.inherit = 1;
+    attr.exclude_hv = 1;
+    return syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+
+
+/**
+ * Microseconds in a timeval.
+ */
+static double tv_us(struct timeval tv) {
+    return tv.tv_sec * 1e6 + tv.tv_usec;
+}
+
+
+
+/**
+ * Run a benchmark.
+ *
+ * Every run, warm-up or timed, calls setup (untimed, may be NULL), then
+ * the cache control, then times fn. Resource usage and perf counters
+ * are averaged over the timed runs.
+ *
+ * @param cfg: The configuration.
+ * @param setup: Called before every run, not timed.
+ * @param fn: The code under test, returns 0 on success.
+ * @param arg: Passed to setup and fn.
+ * @param res: The result.
+ * @return int: 0 on success, -1 if setup or fn failed.
+ */
+int bench_run(const struct bench_config *cfg, int (*setup)(void *arg), int (*fn)(void *arg),
+              void *arg, struct bench_result *res) {
+    static int cache_warned = 0, perf_warned = 0;
+    double samples[BENCH_MAX_REPS];
+    int fds[BENCH_NUM_COUNTERS] = { -1, -1, -1 };
+    memset(res, 0, sizeof(*res));
+
+    if (cfg->perf) {
+        fds[0] = perf_open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+        fds[1] = perf_open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+        fds[2] = perf_open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+        res->have_counters = fds[0] != -1 && fds[1] != -1 && fds[2] != -1;
+        if (!res->have_counters && !perf_warned++) {
+            perror("bench_run: perf_event_open");
+        }
+    }
+
+    for (int run = 0; run < cfg->warmup + cfg->reps; run++) {
+        int timed = run >= cfg->warmup;
+        if (setup != NULL && setup(arg) != 0) {
+            res->wall_us.n = 0;
+            goto out;
+        }
+        if (bench_cache_control(cfg) != 0 && !cache_warned++) {
+            fprintf(stderr, "bench_run: Warning: cannot control the page cache, results include cached data\n");
+        }
+
+        struct rusage ru0, ru1;
+        unsigned long long c0[BENCH_NUM_COUNTERS] = { 0 }, c1[BENCH_NUM_COUNTERS] = { 0 };
+        getrusage(RUSAGE_SELF, &ru0);
+        if (res->have_counters) {
+            for (int k = 0; k < BENCH_NUM_COUNTERS; k++) {
+                ioctl(fds[k], PERF_EVENT_IOC_RESET, 0);
+                ioctl(fds[k], PERF_EVENT_IOC_ENABLE, 0);
+            }
+        }
+
+        double start = bench_now_us();
+        int failed = fn(arg) != 0;
+        double elapsed = bench_now_us() - start;
+
+        if (res->have_counters) {
+            for (int k = 0; k < BENCH_NUM_COUNTERS; k++) {
+                ioctl(fds[k], PERF_EVENT_IOC_DISABLE, 0);
+                if (read(fds[k], &c1[k], sizeof(c1[k])) != sizeof(c1[k])) c1[k] = c0[k];
+            }
+        }
+        getrusage(RUSAGE_SELF, &ru1);
+
+        if (failed) {
+            res->wall_us.n = 0;
+            goto out;
+        }
+        if (!timed) {
+            continue;
+        }
+
+        int r = run - cfg->warmup;
+        samples[r] = elapsed;
+        res->user_us += tv_us(ru1.ru_utime) - tv_us(ru0.ru_utime);
+        res->sys_us += tv_us(ru1.ru_stime) - tv_us(ru0.ru_stime);
+        res->majflt += ru1.ru_majflt - ru0.ru_majflt;
+        res->minflt += ru1.ru_minflt - ru0.ru_minflt;
+        res->inblock += ru1.ru_inblock - ru0.ru_inblock;
+        res->oublock += ru1.ru_oublock - ru0.ru_oublock;
+        res->nvcsw += ru1.ru_nvcsw - ru0.ru_nvcsw;
+        res->nivcsw += ru1.ru_nivcsw - ru0.ru_nivcsw;
+        for (int k = 0; k < BENCH_NUM_COUNTERS; k++) {
+            res->counters[k] += c1[k] - c0[k];
+        }
+    }
+
+    bench_compute_stats(samples, cfg->reps, &res->wall_us);
+    res->user_us /= cfg->reps;
+    res->sys_us /= cfg->reps;
+    res->majflt /= cfg->reps;
+    res->minflt /= cfg->reps;
+    res->inblock /= cfg->reps;
+    res->oublock /= cfg->reps;
+    res->nvcsw /= cfg->reps;
+    res->nivcsw /= cfg->reps;
+    for (int k = 0; k < BENCH_NUM_COUNTERS; k++) {
+        res->counters[k] /= cfg->reps;
+    }
+
+out:
+    for (int k = 0; k < BENCH_NUM_COUNTERS; k++) {
+        if (fds[k] != -1) close(fds[k]);
+    }
+    return res->wall_us.n > 0 ? 0 : -1;
+}
+
+
+
+/**
+ * Print the CSV header (text and JSON have none).
+ *
+ * @param keys: Comma separated names of the caller's parameters.
+ */
+void bench_print_header(const struct bench_config *cfg, const char *keys) {
+    if (cfg->format != BENCH_CSV) {
+        return;
+    }
+    printf("%s,reps,median_us,mean_us,stddev_us,ci95_lo_us,ci95_hi_us,p95_us,min_us,max_us,"
+           "mib_per_s,user_us,sys_us,majflt,minflt,inblock,oublock,nvcsw,nivcsw", keys);
+    if (cfg->perf) {
+        for (int k = 0; k < BENCH_NUM_COUNTERS; k++) printf(",%s", bench_counter_names[k]);
+    }
+    printf("\n");
+}
+
+
+
+/**
+ * Print a JSON value, numbers raw and everything else quoted.
+ */
+static void print_json_value(const char *v, size_t len) {
+    char *end;
+    char tmp[64];
+    if (len > 0 && len < sizeof(tmp)) {
+        memcpy(tmp, v, len);
+        tmp[len] = '\0';
+        strtod(tmp, &end);
+        if (*end == '\0') {
+            printf("%s", tmp);
+            return;
+        }
+    }
+    putchar('"');
+    for (size_t k = 0; k < len; k++) {
+        if (v[k] == '"' || v[k] == '\\') putchar('\\');
+        putchar(v[k]);
+    }
+    putchar('"');
+}
+
+
+
+/**
+ * Print one result.
+ *
+ * Text keeps the lab's tuple format: (values..., median, p95, stddev) in us.
+ *
+ * @param keys: Comma separated parameter names.
+ * @param values: Comma separated parameter values, same order as keys.
+ * @param bytes: Bytes moved per run, for throughput (0 = not applicable).
+ * @param res: The result.
+ */
+void bench_print(const struct bench_config *cfg, const char *keys, const char *values,
+                 double bytes, const struct bench_result *res) {
+    const struct bench_stats *w = &res->wall_us;
+    double mibs = bytes > 0 && w->median > 0 ? bytes / (1 << 20) / (w->median / 1e6) : 0;
+
+    if (cfg->format == BENCH_TEXT) {
+        printf("(");
+        for (const char *p = values; *p; p++) {
+            if (*p == ',') printf(", ");
+            else putchar(*p);
+        }
+        printf(", %.0f, %.0f, %.0f)\n", w->median, w->p95, w->stddev);
+    } else if (cfg->format == BENCH_CSV) {
+        printf("%s,%d,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f,%.2f,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f",
+               values, w->n, w->median, w->mean, w->stddev, w->ci_lo, w->ci_hi, w->p95, w->min, w->max,
+               mibs, res->user_us, res->sys_us, res->majflt, res->minflt, res->inblock, res->oublock,
+               res->nvcsw, res->nivcsw);
+        if (cfg->perf) {
+            for (int k = 0; k < BENCH_NUM_COUNTERS; k++) {
+                if (res->have_counters) printf(",%.0f", res->counters[k]);
+                else printf(",");
+            }
+        }
+        printf("\n");
+    } else {
+        // One JSON object per line
+        printf("{");
+        const char *k = keys, *v = values;
+        while (*k && *v) {
+            size_t kl = strcspn(k, ","), vl = strcspn(v, ",");
+            printf("\"%.*s\":", (int)kl, k);
+            print_json_value(v, vl);
+            printf(",");
+            k += kl + (k[kl] == ',');
+            v += vl + (v[vl] == ',');
+        }
+        printf("\"reps\":%d,\"wall_us\":{\"median\":%.1f,\"mean\":%.1f,\"stddev\":%.1f,\"ci95\":[%.1f,%.1f],"
+               "\"p95\":%.1f,\"p99\":%.1f,\"min\":%.1f,\"max\":%.1f},\"mib_per_s\":%.2f,"
+               "\"user_us\":%.1f,\"sys_us\":%.1f,\"majflt\":%.1f,\"minflt\":%.1f,\"inblock\":%.1f,"
+               "\"oublock\":%.1f,\"nvcsw\":%.1f,\"nivcsw\":%.1f",
+               w->n, w->median, w->mean, w->stddev, w->ci_lo, w->ci_hi, w->p95, w->p99, w->min, w->max,
+               mibs, res->user_us, res->sys_us, res->majflt, res->minflt, res->inblock, res->oublock,
+               res->nvcsw, res->nivcsw);
+        if (res->have_counters) {
+            for (int c = 0; c < BENCH_NUM_COUNTERS; c++) {
+                printf(",\"%s\":%.0f", bench_counter_names[c], res->counters[c]);
+            }
+        }
+        printf("}\n");
+    }
+    fflush(stdout);
+}
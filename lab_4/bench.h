@@ -0,0 +1,93 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+/*
+ * bench.h
+ *
+ * Benchmark harness shared by the lab 4 benchmarks: warm-up and timed
+ * repetitions, page cache control between runs, robust statistics,
+ * getrusage/perf counters and text/CSV/JSON output.
+ */
+
+#define BENCH_MAX_REPS 1000
+#define BENCH_NUM_COUNTERS 3
+#define BENCH_HIST_SUB 8                        // Sub-buckets per power of two
+#define BENCH_HIST_BUCKETS (62 * BENCH_HIST_SUB)
+
+// getopt() letters handled by bench_parse_option(), append to the program's own.
+#define BENCH_OPTIONS "w:r:c:o:P"
+#define BENCH_USAGE \
+    "  -w warmup   Untimed warm-up runs per point (default 1)\n" \
+    "  -r reps     Timed repetitions per point (default 3)\n" \
+    "  -c cache    keep, drop (flush and drop page cache) or warm (pre-read) between runs\n" \
+    "  -o format   text, csv or json\n" \
+    "  -P          Also read perf counters (cycles, instructions, cache misses)\n"
+
+enum bench_cache { BENCH_CACHE_KEEP, BENCH_CACHE_DROP, BENCH_CACHE_WARM };
+enum bench_format { BENCH_TEXT, BENCH_CSV, BENCH_JSON };
+
+struct bench_config {
+    int warmup;
+    int reps;
+    enum bench_cache cache;
+    const char *cache_path;     // File to drop or warm between runs, NULL = none
+    int perf;
+    enum bench_format format;
+};
+
+// Order statistics and spread of a sample.
+struct bench_stats {
+    int n;
+    double min;
+    double max;
+    double mean;
+    double median;
+    double p95;
+    double p99;
+    double stddev;
+    double ci_lo;               // 95% confidence interval of the mean
+    double ci_hi;
+};
+
+// Result of one grid point, resource usage is the mean per timed run.
+struct bench_result {
+    struct bench_stats wall_us;
+    double user_us;
+    double sys_us;
+    double majflt;
+    double minflt;
+    double inblock;
+    double oublock;
+    double nvcsw;
+    double nivcsw;
+    int have_counters;
+    double counters[BENCH_NUM_COUNTERS];
+};
+
+// Log-linear latency histogram (about 12% resolution), for per-operation
+// latencies where keeping every sample is too expensive.
+struct bench_hist {
+    unsigned long long count;
+    double sum_ns;
+    double max_ns;
+    unsigned long long buckets[BENCH_HIST_BUCKETS];
+};
+
+extern const char *bench_counter_names[BENCH_NUM_COUNTERS];
+
+void bench_config_init(struct bench_config *cfg);
+int bench_parse_option(struct bench_config *cfg, int opt, const char *arg);
+int bench_in_list(const char *list, const char *name);
+double bench_now_us(void);
+void bench_compute_stats(double *samples, int n, struct bench_stats *out);
+void bench_hist_add(struct bench_hist *h, double ns);
+void bench_hist_merge(struct bench_hist *dst, const struct bench_hist *src);
+double bench_hist_percentile(const struct bench_hist *h, double p);
+int bench_cache_control(const struct bench_config *cfg);
+int bench_run(const struct bench_config *cfg, int (*setup)(void *arg), int (*fn)(void *arg),
+              void *arg, struct bench_result *res);
+void bench_print_header(const struct bench_config *cfg, const char *keys);
+void bench_print(const struct bench_config *cfg, const char *keys, const char *values,
+                 double bytes, const struct bench_result *res);
+
+#endif
@@ -0,0 +1,596 @@
+/*
+ * filter.c
+ *
+ * An expression is a list of tests combined with "and" (or nothing),
+ * "or", "not" and parentheses, e.g.
+ *
+ *   "name=*.c or name=*.h and size>4k and not regex=^./build/"
+ *
+ * Tests are field, operator and value without spaces:
+ *
+ *   name=glob   name!=glob    Entry name (fnmatch)
+ *   path=glob   path!=glob    Whole path as the walker built it
+ *   regex=ere   regex!=ere    Extended regular expression on the path
+ *   size<n      ...           Bytes, k/M/G/T suffixes (powers of 1024)
+ *   mtime<age   ...           Seconds since the last change, s/m/h/d/w suffixes
+ *   type=fdl                  Any of f, d, l, p, s, c, b
+ *   inode=a-b   inode>=n      Inode number, a range with =
+ *   depth<=n    ...           Below the root of the walk, its entries are 1
+ *
+ * with <, <=, >, >=, = and != on the numbers.
+ *
+ * The tests compile to instructions setting an accumulator and "and" and
+ * "or" to conditional jumps, so an entry stops at the first test deciding
+ * it. Name globs that are a literal or "*" and a literal suffix get
+ * instructions of their own instead of a fnmatch() call.
+ *
+ * The expression tree is kept to prune directories: depth tests, path
+ * globs and anchored regexes are decided for everything below a
+ * directory at once, in three-valued logic, and when the whole expression
+ * comes out false the walker does not open the directory.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <fnmatch.h>
+#include "filter.h"
+
+enum {
+    OP_NAME_EQ,
+    OP_NAME_SUFFIX,
+    OP_NAME_GLOB,
+    OP_PATH_GLOB,
+    OP_REGEX,
+    OP_SIZE,
+    OP_AGE,
+    OP_INODE,
+    OP_DEPTH,
+    OP_TYPE,
+    OP_NOT,
+    OP_JUMP_FALSE,
+    OP_JUMP_TRUE,
+};
+
+enum { NODE_TEST, NODE_NOT, NODE_AND, NODE_OR };
+
+// Three-valued results of the pruning
+enum { NO, YES, MAYBE };
+
+#define MAX_TOKENS 256
+
+struct parser {
+    struct filter *f;
+    char *tokens[MAX_TOKENS];
+    int num_tokens;
+    int pos;
+};
+
+
+
+static int emit(struct filter *f, unsigned char op, unsigned int arg, unsigned long long lo, unsigned long long hi) {
+    if (f->code_len == FILTER_MAX_INSNS) {
+        fprintf(stderr, "filter_compile: Error: Expression too long\n");
+        return -1;
+    }
+    f->code[f->code_len] = (struct filter_insn){ op, arg, lo, hi };
+    return f->code_len++;
+}
+
+
+
+static int new_node(struct filter *f, unsigned char kind, int left, int right) {
+    if (f->num_nodes == FILTER_MAX_INSNS) {
+        fprintf(stderr, "filter_compile: Error: Expression too long\n");
+        return -1;
+    }
+    f->nodes[f->num_nodes] = (struct filter_node){ kind, left, right };
+    return f->num_nodes++;
+}
+
+
+
+static int add_string(struct filter *f, const char *s, size_t len) {
+    if (f->num_strings == FILTER_MAX_STRINGS || (f->strings[f->num_strings] = strndup(s, len)) == NULL) {
+        fprintf(stderr, "filter_compile: Error: Too many patterns\n");
+        return -1;
+    }
+    f->lengths[f->num_strings] = len;
+    return f->num_strings++;
+}
+
+
+
+/**
+ * Length of the literal start of a glob.
+ */
+static size_t glob_prefix(const char *glob) {
+    return strcspn(glob, "*?[\\");
+}
+
+
+
+/**
+ * Start of a regex anchored with "^" as far as it is plain characters and
+ * ".", NULL if there is none.
+ *
+ * In the result a backslash quotes the next character and an unquoted "."
+ * matches any, as in the regex, so both "^./build/" and "^\./build/"
+ * decide the walk below ./build.
+ */
+static char *regex_prefix(const char *re) {
+    static const char meta[] = ".[]()*+?{}|^$\\";
+    if (re[0] != '^' || strchr(re, '|') != NULL) {
+        return NULL;
+    }
+    char *prefix = malloc(2 * strlen(re) + 1);
+    if (prefix == NULL) {
+        return NULL;
+    }
+    size_t len = 0, last = 0;
+    const char *p = re + 1;
+    for (;;) {
+        size_t start = len;
+        if (p[0] == '\\' && p[1] != '\0' && strchr(meta, p[1]) != NULL) {
+            // An escaped metacharacter is a literal, quoted again if it is special here
+            if (p[1] == '.' || p[1] == '\\') prefix[len++] = '\\';
+            prefix[len++] = p[1];
+            p += 2;
+        } else if (p[0] != '\0' && (p[0] == '.' || strchr(meta, p[0]) == NULL)) {
+            prefix[len++] = *p++;
+        } else {
+            break;
+        }
+        last = start;
+    }
+    // The last character is optional before a quantifier
+    if (len > 0 && *p != '\0' && strchr("*?{", *p) != NULL) {
+        len = last;
+    }
+    prefix[len] = '\0';
+    if (len == 0) {
+        free(prefix);
+        return NULL;
+    }
+    return prefix;
+}
+
+
+
+/**
+ * Parse a number with a unit suffix.
+ *
+ * @return int: 0 on success, -1 if it is not a number.
+ */
+static int parse_number(const char *s, const char *units, const unsigned long long *scales, unsigned long long *value) {
+    char *end;
+    if (*s < '0' || *s > '9') {
+        return -1;
+    }
+    *value = strtoull(s, &end, 10);
+    if (*end != '\0') {
+        const char *unit = units ? strchr(units, *end) : NULL;
+        if (unit == NULL || end[1] != '\0') {
+            return -1;
+        }
+        *value *= scales[unit - units];
+    }
+    return 0;
+}
+
+
+
+static int type_bit(mode_t mode) {
+    if (S_ISREG(mode)) return 1;
+    if (S_ISDIR(mode)) return 2;
+    if (S_ISLNK(mode)) return 4;
+    if (S_ISFIFO(mode)) return 8;
+    if (S_ISSOCK(mode)) return 16;
+    if (S_ISCHR(mode)) return 32;
+    if (S_ISBLK(mode)) return 64;
+    return 0;
+}
+
+
+
+/**
+ * Compile one test, followed by a NOT for "!=".
+ *
+ * @return int: The test's node, -1 on error.
+ */
+static int parse_test(struct filter *f, const char *token) {
+    static const unsigned long long size_scales[] = { 1ULL << 10, 1ULL << 10, 1ULL << 20, 1ULL << 30, 1ULL << 40 };
+    static const unsigned long long age_scales[] = { 1, 60, 3600, 86400, 7 * 86400 };
+    size_t field_len = strcspn(token, "<>=!");
+    const char *op = token + field_len;
+    int negate = 0;
+    unsigned long long lo = 0, hi = ULLONG_MAX, v;
+    int insn;
+
+    const char *value = op + 1;
+    if (strncmp(op, "<=", 2) == 0 || strncmp(op, ">=", 2) == 0 || strncmp(op, "!=", 2) == 0) {
+        value++;
+    } else if (*op == '\0' || *op == '!') {
+        fprintf(stderr, "filter_compile: Error: Bad test %s\n", token);
+        return -1;
+    }
+    negate = op[0] == '!';
+    int equality = op[0] == '=' || op[0] == '!';
+
+    if (strncmp(token, "name", field_len) == 0 && field_len == 4 && equality) {
+        size_t len = strlen(value);
+        if (glob_prefix(value) == len) {
+            insn = emit(f, OP_NAME_EQ, add_string(f, value, len), 0, 0);
+        } else if (value[0] == '*' && glob_prefix(value + 1) == len - 1) {
+            insn = emit(f, OP_NAME_SUFFIX, add_string(f, value + 1, len - 1), 0, 0);
+        } else {
+            insn = emit(f, OP_NAME_GLOB, add_string(f, value, len), 0, 0);
+        }
+    } else if (strncmp(token, "path", field_len) == 0 && field_len == 4 && equality) {
+        insn = emit(f, OP_PATH_GLOB, add_string(f, value, strlen(value)), glob_prefix(value), 0);
+    } else if (strncmp(token, "regex", field_len) == 0 && field_len == 5 && equality) {
+        if (f->num_regexes == FILTER_MAX_REGEXES || regcomp(&f->regexes[f->num_regexes], value, REG_EXTENDED | REG_NOSUB) != 0) {
+            fprintf(stderr, "filter_compile: Error: Bad regex %s\n", value);
+            return -1;
+        }
+        f->regex_prefixes[f->num_regexes] = regex_prefix(value);
+        insn = emit(f, OP_REGEX, f->num_regexes++, 0, 0);
+    } else if (strncmp(token, "type", field_len) == 0 && field_len == 4 && equality) {
+        static const char types[] = "fdlpscb";     // In the order of type_bit()
+        int mask = 0;
+        for (const char *c = value; *c; c++) {
+            const char *t = strchr(types, *c);
+            if (t == NULL) {
+                fprintf(stderr, "filter_compile: Error: Bad type %c\n", *c);
+                return -1;
+            }
+            mask |= 1 << (t - types);
+        }
+        insn = emit(f, OP_TYPE, mask, 0, 0);
+    } else {
+        unsigned char code;
+        const char *units = NULL;
+        const unsigned long long *scales = NULL;
+        if (strncmp(token, "size", field_len) == 0 && field_len == 4) {
+            code = OP_SIZE;
+            units = "kKMGT";
+            scales = size_scales;
+        } else if (strncmp(token, "mtime", field_len) == 0 && field_len == 5) {
+            code = OP_AGE;
+            units = "smhdw";
+            scales = age_scales;
+        } else if (strncmp(token, "inode", field_len) == 0 && field_len == 5) {
+            code = OP_INODE;
+        } else if (strncmp(token, "depth", field_len) == 0 && field_len == 5) {
+            code = OP_DEPTH;
+        } else {
+            fprintf(stderr, "filter_compile: Error: Bad test %s\n", token);
+            return -1;
+        }
+
+        const char *dash = equality ? strchr(value, '-') : NULL;
+        if (dash != NULL) {
+            char first[64];
+            snprintf(first, sizeof(first), "%.*s", (int)(dash - value), value);
+            if (parse_number(first, units, scales, &lo) != 0 || parse_number(dash + 1, units, scales, &hi) != 0) {
+                fprintf(stderr, "filter_compile: Error: Bad range %s\n", token);
+                return -1;
+            }
+        } else {
+            if (parse_number(value, units, scales, &v) != 0) {
+                fprintf(stderr, "filter_compile: Error: Bad number %s\n", token);
+                return -1;
+            }
+            if (equality) {
+                lo = hi = v;
+            } else if (op[0] == '<') {
+                if (op[1] == '=') hi = v;
+                else if (v == 0) lo = 1, hi = 0;
+                else hi = v - 1;
+            } else {
+                if (op[1] == '=') lo = v;
+                else if (v == ULLONG_MAX) lo = 1, hi = 0;
+                else lo = v + 1;
+            }
+        }
+        insn = emit(f, code, 0, lo, hi);
+    }
+    if (insn < 0 || (int)f->code[insn].arg < 0) {
+        return -1;
+    }
+
+    int node = new_node(f, NODE_TEST, insn, -1);
+    if (negate && node >= 0) {
+        node = emit(f, OP_NOT, 0, 0, 0) < 0 ? -1 : new_node(f, NODE_NOT, node, -1);
+    }
+    return node;
+}
+
+
+
+static int parse_or(struct parser *p);
+
+
+
+static const char *peek(struct parser *p) {
+    return p->pos < p->num_tokens ? p->tokens[p->pos] : NULL;
+}
+
+
+
+static int parse_unary(struct parser *p) {
+    const char *token = peek(p);
+    if (token == NULL || strcmp(token, ")") == 0 || strcmp(token, "and") == 0 || strcmp(token, "or") == 0) {
+        fprintf(stderr, "filter_compile: Error: Expected a test at %s\n", token ? token : "the end");
+        return -1;
+    }
+    p->pos++;
+    if (strcmp(token, "not") == 0 || strcmp(token, "!") == 0) {
+        int operand = parse_unary(p);
+        if (operand < 0 || emit(p->f, OP_NOT, 0, 0, 0) < 0) {
+            return -1;
+        }
+        return new_node(p->f, NODE_NOT, operand, -1);
+    }
+    if (strcmp(token, "(") == 0) {
+        int node = parse_or(p);
+        if (node < 0) {
+            return -1;
+        }
+        if (peek(p) == NULL || strcmp(peek(p), ")") != 0) {
+            fprintf(stderr, "filter_compile: Error: Missing )\n");
+            return -1;
+        }
+        p->pos++;
+        return node;
+    }
+    return parse_test(p->f, token);
+}
+
+
+
+/**
+ * Parse operands joined by an operator, each followed by a jump past the
+ * others when it decides the result.
+ */
+static int parse_chain(struct parser *p, int (*operand)(struct parser *), const char *word,
+                       unsigned char jump, unsigned char kind) {
+    int jumps[MAX_TOKENS];
+    int num_jumps = 0;
+    int node = operand(p);
+    for (;;) {
+        const char *token = peek(p);
+        if (node < 0 || token == NULL || strcmp(token, ")") == 0) break;
+        if (strcmp(token, word) == 0) {
+            p->pos++;
+        } else if (kind == NODE_OR || strcmp(token, "or") == 0) {
+            break;      // A following "or" ends an "and" chain, anything else is an implicit "and"
+        }
+        if ((jumps[num_jumps++] = emit(p->f, jump, 0, 0, 0)) < 0) {
+            return -1;
+        }
+        int right = operand(p);
+        node = right < 0 ? -1 : new_node(p->f, kind, node, right);
+    }
+    for (int k = 0; k < num_jumps; k++) {
+        p->f->code[jumps[k]].arg = p->f->code_len;
+    }
+    return node;
+}
+
+
+
+static int parse_and(struct parser *p) {
+    return parse_chain(p, parse_unary, "and", OP_JUMP_FALSE, NODE_AND);
+}
+
+
+
+static int parse_or(struct parser *p) {
+    return parse_chain(p, parse_and, "or", OP_JUMP_TRUE, NODE_OR);
+}
+
+
+
+/**
+ * Compile an expression.
+ *
+ * @param expr: The expression, see the top of filter.c.
+ * @return struct filter *: The compiled filter, NULL on error (printed).
+ */
+struct filter *filter_compile(const char *expr) {
+    struct filter *f = calloc(1, sizeof(*f));
+    char *copy = strdup(expr);
+    if (f == NULL || copy == NULL) {
+        perror("filter_compile");
+        exit(1);
+    }
+    f->now = time(NULL);
+
+    // Split on spaces, with parentheses at the ends of a word as tokens of their own
+    struct parser p = { .f = f };
+    int status = 0;
+    for (char *word = strtok(copy, " \t\n"); word != NULL && status == 0; word = strtok(NULL, " \t\n")) {
+        size_t closing = 0;
+        while (*word == '(' && p.num_tokens < MAX_TOKENS) {
+            p.tokens[p.num_tokens++] = "(";
+            word++;
+        }
+        size_t len = strlen(word);
+        while (len > 0 && word[len - 1] == ')') {
+            word[--len] = '\0';
+            closing++;
+        }
+        if (len > 0 && p.num_tokens < MAX_TOKENS) p.tokens[p.num_tokens++] = word;
+        while (closing-- > 0 && p.num_tokens < MAX_TOKENS) p.tokens[p.num_tokens++] = ")";
+        if (p.num_tokens == MAX_TOKENS) {
+            fprintf(stderr, "filter_compile: Error: Expression too long\n");
+            status = -1;
+        }
+    }
+
+    if (status == 0 && p.num_tokens > 0) {
+        f->root = parse_or(&p);
+        if (f->root >= 0 && p.pos < p.num_tokens) {
+            fprintf(stderr, "filter_compile: Error: Unexpected %s\n", p.tokens[p.pos]);
+            f->root = -1;
+        }
+        status = f->root < 0 ? -1 : 0;
+    } else if (status == 0) {
+        f->root = -1;   // Empty, everything matches
+    }
+    free(copy);
+    if (status != 0) {
+        filter_free(f);
+        return NULL;
+    }
+    return f;
+}
+
+
+
+/**
+ * Check an entry.
+ *
+ * @param f: The filter.
+ * @param path: Path of the entry as the walker built it.
+ * @param name: Its last component.
+ * @param depth: Its depth, the entries of the root are 1.
+ * @param st: Its status.
+ * @return int: 1 if it matches, 0 if not.
+ */
+int filter_match(const struct filter *f, const char *path, const char *name, int depth, const struct stat *st) {
+    size_t name_len = strlen(name);
+    unsigned long long x;
+    int acc = 1;
+    for (int pc = 0; pc < f->code_len; pc++) {
+        const struct filter_insn *in = &f->code[pc];
+        switch (in->op) {
+        case OP_NAME_EQ:
+            acc = name_len == f->lengths[in->arg] && memcmp(name, f->strings[in->arg], name_len) == 0;
+            break;
+        case OP_NAME_SUFFIX:
+            acc = name_len >= f->lengths[in->arg]
+                && memcmp(name + name_len - f->lengths[in->arg], f->strings[in->arg], f->lengths[in->arg]) == 0;
+            break;
+        case OP_NAME_GLOB: acc = fnmatch(f->strings[in->arg], name, 0) == 0; break;
+        case OP_PATH_GLOB: acc = fnmatch(f->strings[in->arg], path, 0) == 0; break;
+        case OP_REGEX: acc = regexec(&f->regexes[in->arg], path, 0, NULL, 0) == 0; break;
+        case OP_SIZE: x = st->st_size; acc = x >= in->lo && x <= in->hi; break;
+        case OP_AGE:
+            x = f->now > st->st_mtime ? (unsigned long long)(f->now - st->st_mtime) : 0;
+            acc = x >= in->lo && x <= in->hi;
+            break;
+        case OP_INODE: x = st->st_ino; acc = x >= in->lo && x <= in->hi; break;
+        case OP_DEPTH: x = depth; acc = x >= in->lo && x <= in->hi; break;
+        case OP_TYPE: acc = (type_bit(st->st_mode) & in->arg) != 0; break;
+        case OP_NOT: acc = !acc; break;
+        case OP_JUMP_FALSE: if (!acc) pc = in->arg - 1; break;
+        case OP_JUMP_TRUE: if (acc) pc = in->arg - 1; break;
+        }
+    }
+    return acc;
+}
+
+
+
+/**
+ * Whether a literal path prefix can start the path of something below
+ * a directory, dir ending in a slash.
+ */
+static int prefix_below(const char *prefix, size_t prefix_len, const char *dir, size_t dir_len) {
+    return memcmp(prefix, dir, prefix_len < dir_len ? prefix_len : dir_len) == 0 ? MAYBE : NO;
+}
+
+
+
+/**
+ * prefix_below() for a regex_prefix(), with its quoting and "." wildcards.
+ */
+static int regex_prefix_below(const char *prefix, const char *dir, size_t dir_len) {
+    for (size_t k = 0; *prefix != '\0' && k < dir_len; k++) {
+        if (*prefix == '\\') {
+            prefix++;
+        } else if (*prefix == '.') {
+            prefix++;
+            continue;
+        }
+        if (*prefix++ != dir[k]) {
+            return NO;
+        }
+    }
+    return MAYBE;
+}
+
+
+
+static int decide(const struct filter *f, int node, const char *dir, size_t dir_len, unsigned long long depth) {
+    const struct filter_node *n = &f->nodes[node];
+    int l, r;
+    switch (n->kind) {
+    case NODE_NOT:
+        l = decide(f, n->left, dir, dir_len, depth);
+        return l == MAYBE ? MAYBE : l == YES ? NO : YES;
+    case NODE_AND:
+        if ((l = decide(f, n->left, dir, dir_len, depth)) == NO) return NO;
+        if ((r = decide(f, n->right, dir, dir_len, depth)) == NO) return NO;
+        return l == YES && r == YES ? YES : MAYBE;
+    case NODE_OR:
+        if ((l = decide(f, n->left, dir, dir_len, depth)) == YES) return YES;
+        if ((r = decide(f, n->right, dir, dir_len, depth)) == YES) return YES;
+        return l == NO && r == NO ? NO : MAYBE;
+    }
+
+    const struct filter_insn *in = &f->code[n->left];
+    switch (in->op) {
+    case OP_DEPTH:
+        if (in->hi < depth) return NO;
+        return in->lo <= depth && in->hi == ULLONG_MAX ? YES : MAYBE;
+    case OP_PATH_GLOB:
+        return prefix_below(f->strings[in->arg], in->lo, dir, dir_len);
+    case OP_REGEX:
+        if (f->regex_prefixes[in->arg] == NULL) return MAYBE;
+        return regex_prefix_below(f->regex_prefixes[in->arg], dir, dir_len);
+    }
+    return MAYBE;
+}
+
+
+
+/**
+ * Check whether anything below a directory can match.
+ *
+ * @param f: The filter.
+ * @param dir_path: Path of the directory as the walker built it.
+ * @param dir_depth: Its depth, the root is 0.
+ * @return int: 0 if nothing below it can match, the walker skips it.
+ */
+int filter_descend(const struct filter *f, const char *dir_path, int dir_depth) {
+    if (f->root < 0) {
+        return 1;
+    }
+    // Everything below has this path and a slash in front
+    size_t len = strlen(dir_path);
+    char dir[len + 2];
+    memcpy(dir, dir_path, len);
+    dir[len] = '/';
+    dir[len + 1] = '\0';
+    return decide(f, f->root, dir, len + 1, dir_depth + 1) != NO;
+}
+
+
+
+/**
+ * Free a filter.
+ */
+void filter_free(struct filter *f) {
+    for (int k = 0; k < f->num_strings; k++) {
+        free(f->strings[k]);
+    }
+    for (int k = 0; k < f->num_regexes; k++) {
+        regfree(&f->regexes[k]);
+        free(f->regex_prefixes[k]);
+    }
+    free(f);
+}
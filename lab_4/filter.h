@@ -0,0 +1,53 @@
+#ifndef FILTER_H
+#define FILTER_H
+
+/*
+ * filter.h
+ *
+ * Predicate expressions over directory entries (name and path globs,
+ * regular expressions, size, age, type, inode and depth), compiled once
+ * into a small bytecode that the walker threads evaluate per entry.
+ */
+#include <regex.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#define FILTER_MAX_INSNS 256
+#define FILTER_MAX_STRINGS 64
+#define FILTER_MAX_REGEXES 16
+
+struct filter_insn {
+    unsigned char op;
+    unsigned int arg;               // String, regex, type mask or jump target
+    unsigned long long lo;          // Inclusive range of the numeric tests
+    unsigned long long hi;
+};
+
+// Expression tree, kept for the pruning decisions on directories.
+struct filter_node {
+    unsigned char kind;
+    int left;                       // Operands (node indices), the test's instruction for a leaf
+    int right;
+};
+
+struct filter {
+    struct filter_insn code[FILTER_MAX_INSNS];
+    int code_len;
+    struct filter_node nodes[FILTER_MAX_INSNS];
+    int num_nodes;
+    int root;
+    char *strings[FILTER_MAX_STRINGS];
+    size_t lengths[FILTER_MAX_STRINGS];
+    int num_strings;
+    regex_t regexes[FILTER_MAX_REGEXES];
+    char *regex_prefixes[FILTER_MAX_REGEXES];   // Start of an anchored regex, see regex_prefix(), NULL if none
+    int num_regexes;
+    time_t now;                     // Ages are relative to the compile time
+};
+
+struct filter *filter_compile(const char *expr);
+int filter_match(const struct filter *f, const char *path, const char *name, int depth, const struct stat *st);
+int filter_descend(const struct filter *f, const char *dir_path, int dir_depth);
+void filter_free(struct filter *f);
+
+#endif
@@ -0,0 +1,303 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <linux/fs.h>
+#include "bench.h"
+
+/**
+ * Test file generator.
+ *
+ * Stages large test files without pushing every byte through user space.
+ * A template extent of 2^j bytes is written once and then replicated by
+ * the kernel, or the space is only allocated. Each mode is timed with the
+ * bench harness against the stdio path task_2 uses.
+ *
+ * Modes:
+ * - stdio:      fwrite 2^j byte chunks (every byte copied from user space)
+ * - reflink:    FICLONERANGE doubling, shares extents (btrfs, xfs, ...)
+ * - copy_range: copy_file_range doubling, the kernel copies (or reflinks)
+ * - sendfile:   sendfile from a memfd holding the template
+ * - fallocate:  allocate the extents only, contents read back as zeros
+ * - zero:       fallocate plus FALLOC_FL_ZERO_RANGE over the whole file
+ *
+ * Command to run: "gcc -O2 gen_file.c bench.c -o gen_file -lm; ./gen_file -m all -s 34"
+ */
+
+// Options
+size_t total_size = 1 << 30;    // 1 GiB = 2^30 bytes
+size_t template_size = 1 << 20; // 2^j bytes
+int durable = 0;                // fdatasync before returning
+
+// One grid point, passed to the harness.
+struct gen_point {
+    const char *path;
+    int (*generate)(int fd);
+};
+
+
+
+/**
+ * Write the 'A' filled template extent at the start of fd.
+ *
+ * @return int: 0 on success, -1 on failure.
+ */
+int write_template(int fd) {
+    char *buf = malloc(template_size);
+    if (buf == NULL) {
+        return -1;
+    }
+    memset(buf, 'A', template_size);
+    int res = pwrite(fd, buf, template_size, 0) == (ssize_t)template_size ? 0 : -1;
+    free(buf);
+    return res;
+}
+
+
+
+/**
+ * Mode "stdio": the current path, every chunk goes through fwrite.
+ */
+int generate_stdio(int fd) {
+    int copy = dup(fd);
+    FILE *file = copy == -1 ? NULL : fdopen(copy, "w");
+    if (file == NULL && copy != -1) close(copy);
+    char *chunk = malloc(template_size);
+    int res = file != NULL && chunk != NULL ? 0 : -1;
+    if (chunk != NULL) memset(chunk, 'A', template_size);
+    for (size_t written = 0; written < total_size && res == 0; written += template_size) {
+        if (fwrite(chunk, 1, template_size, file) != template_size) res = -1;
+    }
+    if (file != NULL && fclose(file) != 0) res = -1;
+    free(chunk);
+    return res;
+}
+
+
+
+/**
+ * Mode "reflink": double the file with FICLONERANGE, log2(size / 2^j) calls.
+ */
+int generate_reflink(int fd) {
+    if (write_template(fd) == -1) {
+        return -1;
+    }
+    for (size_t have = template_size; have < total_size; ) {
+        size_t n = total_size - have < have ? total_size - have : have;
+        struct file_clone_range range = { .src_fd = fd, .src_offset = 0, .src_length = n, .dest_offset = have };
+        if (ioctl(fd, FICLONERANGE, &range) == -1) {
+            perror("FICLONERANGE");
+            return -1;
+        }
+        have += n;
+    }
+    return 0;
+}
+
+
+
+/**
+ * Mode "copy_range": double the file with copy_file_range.
+ */
+int generate_copy_range(int fd) {
+    if (write_template(fd) == -1) {
+        return -1;
+    }
+    for (size_t have = template_size; have < total_size; ) {
+        size_t n = total_size - have < have ? total_size - have : have;
+        loff_t in = 0, out = have;
+        while (n > 0) {
+            ssize_t done = copy_file_range(fd, &in, fd, &out, n, 0);
+            if (done <= 0) {
+                if (done < 0 && errno == EINTR) continue;
+                perror("copy_file_range");
+                return -1;
+            }
+            n -= done;
+            have += done;
+        }
+    }
+    return 0;
+}
+
+
+
+/**
+ * Mode "sendfile": the template lives in a memfd and is sent
+ * size / 2^j times without entering user space again.
+ */
+int generate_sendfile(int fd) {
+    int mfd = memfd_create("gen_file_template", MFD_CLOEXEC);
+    if (mfd == -1) {
+        perror("memfd_create");
+        return -1;
+    }
+    int res = write_template(mfd);
+    for (size_t written = 0; written < total_size && res == 0; ) {
+        off_t in = 0;
+        ssize_t n = sendfile(fd, mfd, &in, template_size);
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) continue;
+            perror("sendfile");
+            res = -1;
+        } else {
+            written += n;
+        }
+    }
+    close(mfd);
+    return res;
+}
+
+
+
+/**
+ * Mode "fallocate": reserve the blocks, nothing is written.
+ */
+int generate_fallocate(int fd) {
+    if (fallocate(fd, 0, 0, total_size) == -1) {
+        perror("fallocate");
+        return -1;
+    }
+    return 0;
+}
+
+
+
+/**
+ * Mode "zero": reserve the blocks and have the filesystem zero them.
+ */
+int generate_zero(int fd) {
+    if (fallocate(fd, 0, 0, total_size) == -1 || fallocate(fd, FALLOC_FL_ZERO_RANGE, 0, total_size) == -1) {
+        perror("fallocate");
+        return -1;
+    }
+    return 0;
+}
+
+
+
+struct mode {
+    const char *name;
+    int (*generate)(int fd);
+};
+
+struct mode modes[] = {
+    { "stdio", generate_stdio },
+    { "reflink", generate_reflink },
+    { "copy_range", generate_copy_range },
+    { "sendfile", generate_sendfile },
+    { "fallocate", generate_fallocate },
+    { "zero", generate_zero },
+};
+#define NUM_OF_MODES (int)(sizeof(modes) / sizeof(modes[0]))
+
+
+
+/**
+ * Harness setup: start every run without a test file.
+ */
+int gen_point_setup(void *arg) {
+    struct gen_point *pt = arg;
+    remove(pt->path);
+    return 0;
+}
+
+
+
+/**
+ * Harness body: generate the file once.
+ */
+int gen_point_run(void *arg) {
+    struct gen_point *pt = arg;
+    int fd = open(pt->path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1) {
+        perror("Failed to create file");
+        return -1;
+    }
+    int res = pt->generate(fd);
+    if (res == 0 && durable && fdatasync(fd) == -1) {
+        perror("fdatasync");
+        res = -1;
+    }
+    close(fd);
+    return res;
+}
+
+
+
+/**
+ * Print usage.
+ */
+void usage(const char *prog) {
+    fprintf(stderr,
+        "Usage: %s [-m modes] [-s log2size] [-j log2template] [-d] [-k] [-p path] [harness options]\n"
+        "  -m modes    Comma list of stdio,reflink,copy_range,sendfile,fallocate,zero or all (default all)\n"
+        "  -s log2size File size 2^s bytes (default 30)\n"
+        "  -j log2tmpl Template extent 2^j bytes, at least 12 (default 20)\n"
+        "  -d          fdatasync the file, so the time includes getting it to disk\n"
+        "  -k          Keep the last generated file\n"
+        BENCH_USAGE,
+        prog);
+}
+
+
+
+/**
+ * Main.
+ *
+ * Prints one result per mode (mode, j), see bench_print().
+ */
+int main(int argc, char *argv[]) {
+    const char *path = "./test_file.txt";
+    const char *mode_list = "all";
+    int keep = 0;
+    struct bench_config cfg;
+    bench_config_init(&cfg);
+
+    int opt;
+    while ((opt = getopt(argc, argv, "m:s:j:dkp:" BENCH_OPTIONS)) != -1) {
+        switch (opt) {
+        case 'm': mode_list = optarg; break;
+        case 's': total_size = (size_t)1 << atoi(optarg); break;
+        case 'j': template_size = (size_t)1 << atoi(optarg); break;
+        case 'd': durable = 1; break;
+        case 'k': keep = 1; break;
+        case 'p': path = optarg; break;
+        default:
+            if (bench_parse_option(&cfg, opt, optarg) != 1) {
+                usage(argv[0]);
+                return 1;
+            }
+        }
+    }
+    if (template_size < 4096 || template_size > total_size) {
+        usage(argv[0]);
+        return 1;
+    }
+    cfg.cache_path = path;
+
+    const char *keys = "mode,j";
+    bench_print_header(&cfg, keys);
+    for (int m = 0; m < NUM_OF_MODES; m++) {
+        if (!bench_in_list(mode_list, modes[m].name)) continue;
+        struct gen_point pt = { path, modes[m].generate };
+        struct bench_result res;
+        if (bench_run(&cfg, gen_point_setup, gen_point_run, &pt, &res) != 0) {
+            fprintf(stderr, "%s: not supported here, skipping\n", modes[m].name);
+            continue;
+        }
+        char values[64];
+        snprintf(values, sizeof(values), "%s,%d", modes[m].name, __builtin_ctzl(template_size));
+        bench_print(&cfg, keys, values, total_size, &res);
+    }
+    if (!keep) {
+        remove(path);
+    }
+    return 0;
+}
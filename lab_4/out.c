@@ -0,0 +1,286 @@
+/*
+ * out.c
+ *
+ * A record always lands whole in one chunk, and the threads take a lock
+ * around each writev(), so records of different threads never mix even
+ * on a pipe, where only writes up to PIPE_BUF are atomic. The lock is
+ * taken once per up to a MiB of output instead of once per line as with
+ * printf().
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/uio.h>
+#include "out.h"
+
+const char *out_format_names[OUT_FORMATS] = { "text", "nul", "ndjson", "binary" };
+
+static pthread_mutex_t out_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static const char digit_pairs[] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+    "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+
+
+/**
+ * Find a format by name.
+ *
+ * @return int: The format, -1 if there is none with that name.
+ */
+int out_find_format(const char *name) {
+    for (int k = 0; k < OUT_FORMATS; k++) {
+        if (strcmp(out_format_names[k], name) == 0) return k;
+    }
+    return -1;
+}
+
+
+
+/**
+ * Set up a thread's buffers.
+ *
+ * @param b: The buffers.
+ * @param fd: Where they are written.
+ * @param format: The record format.
+ * @return int: 0 on success, -1 if out of memory.
+ */
+int out_init(struct out_buf *b, int fd, enum out_format format) {
+    memset(b, 0, sizeof(*b));
+    b->fd = fd;
+    b->format = format;
+    for (int k = 0; k < OUT_CHUNKS; k++) {
+        if ((b->chunks[k] = malloc(OUT_CHUNK)) == NULL) {
+            out_free(b);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+
+
+/**
+ * Write buffers in full, retrying after short writes.
+ */
+static int write_all(int fd, struct iovec *iov, int n) {
+    while (n > 0) {
+        ssize_t w = writev(fd, iov, n);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        while (n > 0 && (size_t)w >= iov->iov_len) {
+            w -= iov->iov_len;
+            iov++;
+            n--;
+        }
+        if (n > 0) {
+            iov->iov_base = (char *)iov->iov_base + w;
+            iov->iov_len -= w;
+        }
+    }
+    return 0;
+}
+
+
+
+/**
+ * Write out the filled buffers in one writev().
+ *
+ * @return int: 0 on success, -1 if the write failed.
+ */
+int out_flush(struct out_buf *b) {
+    struct iovec iov[OUT_CHUNKS];
+    int n = 0;
+    for (int k = 0; k <= b->cur && k < OUT_CHUNKS; k++) {
+        if (b->used[k] == 0) continue;
+        iov[n].iov_base = b->chunks[k];
+        iov[n].iov_len = b->used[k];
+        b->bytes += b->used[k];
+        n++;
+    }
+    if (n > 0 && !b->failed) {
+        pthread_mutex_lock(&out_lock);
+        if (write_all(b->fd, iov, n) != 0) {
+            perror("out_flush: writev");
+            b->failed = 1;
+        }
+        pthread_mutex_unlock(&out_lock);
+        b->writes++;
+    }
+    memset(b->used, 0, sizeof(b->used));
+    b->cur = 0;
+    return b->failed ? -1 : 0;
+}
+
+
+
+/**
+ * Room for a record of at most n bytes.
+ *
+ * @return char *: Where to format it, NULL if it is larger than a chunk.
+ */
+static char *reserve(struct out_buf *b, size_t n) {
+    if (n > OUT_CHUNK) {
+        return NULL;
+    }
+    if (OUT_CHUNK - b->used[b->cur] < n && ++b->cur == OUT_CHUNKS) {
+        out_flush(b);
+    }
+    return b->chunks[b->cur] + b->used[b->cur];
+}
+
+
+
+/**
+ * Format an unsigned number, two digits at a time.
+ *
+ * @return char *: The end of the number.
+ */
+static char *put_number(char *p, unsigned long long v) {
+    char tmp[20];
+    int n = sizeof(tmp);
+    while (v >= 100) {
+        const char *d = &digit_pairs[v % 100 * 2];
+        v /= 100;
+        tmp[--n] = d[1];
+        tmp[--n] = d[0];
+    }
+    if (v >= 10) {
+        tmp[--n] = digit_pairs[v * 2 + 1];
+        tmp[--n] = digit_pairs[v * 2];
+    } else {
+        tmp[--n] = '0' + v;
+    }
+    memcpy(p, tmp + n, sizeof(tmp) - n);
+    return p + sizeof(tmp) - n;
+}
+
+
+
+static char *put_string(char *p, const char *s, size_t len) {
+    memcpy(p, s, len);
+    return p + len;
+}
+
+
+
+/**
+ * Format a JSON string literal, escaped as du_json_string() does.
+ */
+static char *put_json_string(char *p, const char *s, size_t len) {
+    static const char hex[] = "0123456789abcdef";
+    *p++ = '"';
+    for (size_t k = 0; k < len; k++) {
+        // Copy the run up to the next character to escape in one go
+        size_t run = k;
+        while (run < len && (unsigned char)s[run] >= 0x20 && s[run] != '"' && s[run] != '\\') run++;
+        p = put_string(p, s + k, run - k);
+        if ((k = run) == len) break;
+        unsigned char c = s[k];
+        if (c == '"' || c == '\\') {
+            *p++ = '\\';
+            *p++ = c;
+        } else {
+            p = put_string(p, "\\u00", 4);
+            *p++ = hex[c >> 4];
+            *p++ = hex[c & 15];
+        }
+    }
+    *p++ = '"';
+    return p;
+}
+
+
+
+/**
+ * Add an entry to a thread's buffers.
+ *
+ * @param b: The buffers.
+ * @param path: Path of the entry.
+ * @param path_len: Its length.
+ * @param name: Its last component.
+ * @param inode: Inode number.
+ * @param size: Size in bytes.
+ */
+void out_entry(struct out_buf *b, const char *path, size_t path_len, const char *name,
+               unsigned long long inode, unsigned long long size) {
+    size_t name_len = b->format == OUT_TEXT ? strlen(name) : 0;
+    size_t max = b->format == OUT_TEXT ? name_len + 40
+               : b->format == OUT_NDJSON ? path_len * 6 + 80
+               : path_len + sizeof(struct out_record) + 1;
+    char *start = reserve(b, max);
+    char *heap = NULL;
+    if (start == NULL) {
+        // Longer than a chunk, written on its own after the buffered records
+        if ((heap = start = malloc(max)) == NULL) {
+            return;
+        }
+    }
+
+    char *p = start;
+    switch (b->format) {
+    case OUT_TEXT:
+        p = put_string(p, "File: ", 6);
+        p = put_string(p, name, name_len);
+        p = put_string(p, ", Inode: ", 9);
+        p = put_number(p, inode);
+        *p++ = '\n';
+        break;
+    case OUT_NUL:
+        p = put_string(p, path, path_len);
+        *p++ = '\0';
+        break;
+    case OUT_NDJSON:
+        p = put_string(p, "{\"path\":", 8);
+        p = put_json_string(p, path, path_len);
+        p = put_string(p, ",\"inode\":", 9);
+        p = put_number(p, inode);
+        p = put_string(p, ",\"size\":", 8);
+        p = put_number(p, size);
+        p = put_string(p, "}\n", 2);
+        break;
+    default: {
+        struct out_record r = { inode, size, path_len };
+        p = put_string(p, (const char *)&r, sizeof(r));
+        p = put_string(p, path, path_len);
+        break;
+    }
+    }
+    b->entries++;
+
+    if (heap != NULL) {
+        struct iovec iov = { heap, p - heap };
+        out_flush(b);
+        if (!b->failed) {
+            pthread_mutex_lock(&out_lock);
+            if (write_all(b->fd, &iov, 1) != 0) {
+                perror("out_entry: writev");
+                b->failed = 1;
+            }
+            pthread_mutex_unlock(&out_lock);
+            b->writes++;
+        }
+        b->bytes += p - heap;
+        free(heap);
+    } else {
+        b->used[b->cur] += p - start;
+    }
+}
+
+
+
+/**
+ * Free a thread's buffers, out_flush() them first.
+ */
+void out_free(struct out_buf *b) {
+    for (int k = 0; k < OUT_CHUNKS; k++) {
+        free(b->chunks[k]);
+        b->chunks[k] = NULL;
+    }
+}
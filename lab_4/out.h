@@ -0,0 +1,54 @@
+#ifndef OUT_H
+#define OUT_H
+
+/*
+ * out.h
+ *
+ * Output path of the walker threads: each thread formats its entries
+ * into buffers of its own, with hand-rolled integer formatting, and
+ * hands them to the kernel in one writev() per OUT_CHUNKS buffers.
+ */
+#include <stddef.h>
+
+#define OUT_CHUNK (64 * 1024)
+#define OUT_CHUNKS 16                   // Buffers per writev(), 1 MiB
+
+// Binary records are this header followed by path_len bytes of path,
+// packed and in host byte order.
+struct out_record {
+    unsigned long long inode;
+    unsigned long long size;
+    unsigned int path_len;
+} __attribute__((packed));
+
+enum out_format {
+    OUT_TEXT,               // "File: name, Inode: n" lines, as print_content()
+    OUT_NUL,                // Paths ending in a NUL byte, for xargs -0
+    OUT_NDJSON,             // {"path":...,"inode":n,"size":n} lines
+    OUT_BINARY,             // struct out_record stream
+    OUT_FORMATS
+};
+
+extern const char *out_format_names[OUT_FORMATS];
+
+struct out_buf {
+    int fd;
+    enum out_format format;
+    char *chunks[OUT_CHUNKS];
+    size_t used[OUT_CHUNKS];
+    int cur;                            // Chunk being filled
+    int failed;                         // A write failed, later output is dropped
+    // Statistics
+    unsigned long long entries;
+    unsigned long long bytes;
+    unsigned long long writes;
+};
+
+int out_find_format(const char *name);
+int out_init(struct out_buf *b, int fd, enum out_format format);
+void out_entry(struct out_buf *b, const char *path, size_t path_len, const char *name,
+               unsigned long long inode, unsigned long long size);
+int out_flush(struct out_buf *b);
+void out_free(struct out_buf *b);
+
+#endif
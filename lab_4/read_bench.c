@@ -0,0 +1,323 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "bench.h"
+
+/**
+ * Read path benchmark.
+ *
+ * The read side of task_2: reads a test file in chunks of 2^i bytes with
+ * different system calls, access patterns and kernel hints, once with a
+ * cold and once with a warm page cache.
+ *
+ * Command to run: "gcc -O2 read_bench.c bench.c -o read_bench -lm; ./read_bench -m all -a all"
+ */
+
+enum method { METHOD_READ, METHOD_PREAD, METHOD_MMAP };
+const char *method_names[] = { "read", "pread", "mmap" };
+
+// Access hints, posix_fadvise() for read/pread and madvise() for mmap.
+enum hint { HINT_NONE, HINT_SEQUENTIAL, HINT_RANDOM, HINT_WILLNEED };
+const char *hint_names[] = { "none", "sequential", "random", "willneed" };
+const int fadvise_hints[] = { POSIX_FADV_NORMAL, POSIX_FADV_SEQUENTIAL, POSIX_FADV_RANDOM, POSIX_FADV_WILLNEED };
+const int madvise_hints[] = { MADV_NORMAL, MADV_SEQUENTIAL, MADV_RANDOM, MADV_WILLNEED };
+
+enum pattern { PATTERN_SEQUENTIAL, PATTERN_REVERSE, PATTERN_STRIDED, PATTERN_RANDOM };
+const char *pattern_names[] = { "seq", "reverse", "strided", "random" };
+
+const char *cache_names[] = { "cold", "warm" };
+
+// Options
+size_t total_size = 1 << 30;    // 1 GiB = 2^30 bytes
+size_t stride = 16;             // Chunks skipped per step in the strided pattern
+
+// One grid point, passed to the harness.
+struct read_point {
+    const char *path;
+    enum method method;
+    enum hint hint;
+    enum pattern pattern;
+    size_t nio;
+};
+
+
+
+/**
+ * Create the test file unless it already has the right size.
+ *
+ * @return int: 0 on success, -1 on failure.
+ */
+int prepare_test_file(const char path[]) {
+    struct stat st;
+    if (stat(path, &st) == 0 && (size_t)st.st_size == total_size) {
+        return 0;
+    }
+
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1) {
+        perror("Failed to create file");
+        return -1;
+    }
+    static char buf[1 << 20];
+    memset(buf, 'A', sizeof(buf));
+    for (size_t written = 0; written < total_size; ) {
+        size_t n = total_size - written < sizeof(buf) ? total_size - written : sizeof(buf);
+        ssize_t w = write(fd, buf, n);
+        if (w <= 0) {
+            perror("Failed to write to file");
+            close(fd);
+            return -1;
+        }
+        written += w;
+    }
+    fsync(fd);
+    close(fd);
+    return 0;
+}
+
+
+
+/**
+ * Access order.
+ *
+ * Walks every chunk of the file exactly once in the order of a pattern.
+ * The random order is a full-period LCG over the (power of two) number
+ * of chunks, so it needs no permutation table.
+ */
+struct access_order {
+    enum pattern pattern;
+    size_t chunks;
+    size_t per_phase;   // Strided: accesses per pass over the file
+    size_t step;        // Strided: distance in chunks
+    size_t k;           // Accesses done
+    size_t state;       // Random: LCG state
+};
+
+void order_init(struct access_order *o, enum pattern pattern, size_t chunks) {
+    memset(o, 0, sizeof(*o));
+    o->pattern = pattern;
+    o->chunks = chunks;
+    o->step = stride < chunks ? stride : chunks;
+    o->per_phase = chunks / o->step;
+}
+
+
+
+/**
+ * Next chunk index.
+ *
+ * @return int: 1 and the index in idx, 0 when every chunk has been visited.
+ */
+int order_next(struct access_order *o, size_t *idx) {
+    if (o->k == o->chunks) {
+        return 0;
+    }
+    switch (o->pattern) {
+    case PATTERN_SEQUENTIAL:
+        *idx = o->k;
+        break;
+    case PATTERN_REVERSE:
+        *idx = o->chunks - 1 - o->k;
+        break;
+    case PATTERN_STRIDED:
+        *idx = (o->k % o->per_phase) * o->step + o->k / o->per_phase;
+        break;
+    case PATTERN_RANDOM:
+        // a = 1 (mod 4) and odd c give a full period modulo a power of two
+        o->state = (o->state * 2654435761u + 12345) & (o->chunks - 1);
+        *idx = o->state;
+        break;
+    }
+    o->k++;
+    return 1;
+}
+
+
+
+/**
+ * Read the file with read(2) or pread(2).
+ *
+ * read() only seeks when the pattern is not sequential.
+ */
+int read_file_syscall(struct read_point *pt) {
+    int fd = open(pt->path, O_RDONLY);
+    if (fd == -1) {
+        perror("Failed to open file");
+        return -1;
+    }
+    if (pt->hint != HINT_NONE) {
+        posix_fadvise(fd, 0, 0, fadvise_hints[pt->hint]);
+    }
+
+    char *buf = malloc(pt->nio);
+    struct access_order o;
+    order_init(&o, pt->pattern, total_size / pt->nio);
+    size_t idx = 0;
+    int res = buf != NULL ? 0 : -1;
+    while (res == 0 && order_next(&o, &idx)) {
+        off_t off = (off_t)idx * pt->nio;
+        ssize_t n;
+        if (pt->method == METHOD_PREAD) {
+            n = pread(fd, buf, pt->nio, off);
+        } else {
+            if (pt->pattern != PATTERN_SEQUENTIAL) lseek(fd, off, SEEK_SET);
+            n = read(fd, buf, pt->nio);
+        }
+        if (n != (ssize_t)pt->nio) {
+            perror("Failed to read file");
+            res = -1;
+        }
+    }
+
+    free(buf);
+    close(fd);
+    return res;
+}
+
+
+
+/**
+ * Read the file through a mapping, copying every chunk out with memcpy
+ * so the same bytes are touched as with read().
+ */
+int read_file_mmap(struct read_point *pt) {
+    int fd = open(pt->path, O_RDONLY);
+    if (fd == -1) {
+        perror("Failed to open file");
+        return -1;
+    }
+    char *map = mmap(NULL, total_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        perror("mmap");
+        return -1;
+    }
+    if (pt->hint != HINT_NONE && madvise(map, total_size, madvise_hints[pt->hint]) == -1) {
+        perror("madvise");
+    }
+
+    char *buf = malloc(pt->nio);
+    struct access_order o;
+    order_init(&o, pt->pattern, total_size / pt->nio);
+    size_t idx = 0;
+    while (buf != NULL && order_next(&o, &idx)) {
+        memcpy(buf, map + idx * pt->nio, pt->nio);
+    }
+
+    int res = buf != NULL ? 0 : -1;
+    free(buf);
+    munmap(map, total_size);
+    return res;
+}
+
+
+
+/**
+ * Harness body: read the whole file once.
+ */
+int read_point_run(void *arg) {
+    struct read_point *pt = arg;
+    return pt->method == METHOD_MMAP ? read_file_mmap(pt) : read_file_syscall(pt);
+}
+
+
+
+/**
+ * Print usage.
+ */
+void usage(const char *prog) {
+    fprintf(stderr,
+        "Usage: %s [-m methods] [-a hints] [-x patterns] [-k caches] [-i imin[:imax]] [-s log2size] [-S stride] [-p path] [harness options]\n"
+        "  -m methods  Comma list of read,pread,mmap or all (default all)\n"
+        "  -a hints    Comma list of none,sequential,random,willneed or all (default none)\n"
+        "  -x patterns Comma list of seq,reverse,strided,random or all (default all)\n"
+        "  -k caches   Comma list of cold,warm (default cold,warm)\n"
+        "  -i range    Chunk sizes 2^i, step 2 (default 6:20)\n"
+        "  -s log2size File size 2^s bytes (default 30)\n"
+        "  -S stride   Chunks between accesses in the strided pattern, power of two (default 16)\n"
+        BENCH_USAGE
+        "The cache option -c is ignored, -k selects cold (dropped) or warm (pre-read) runs.\n",
+        prog);
+}
+
+
+
+/**
+ * Main.
+ *
+ * Prints one result per grid point (method, hint, pattern, cache, i), see bench_print().
+ */
+int main(int argc, char *argv[]) {
+    const char *path = "./test_file.txt";
+    const char *method_list = "all";
+    const char *hint_list = "none";
+    const char *pattern_list = "all";
+    const char *cache_list = "cold,warm";
+    int imin = 6, imax = 20;
+    struct bench_config cfg;
+    bench_config_init(&cfg);
+
+    int opt;
+    while ((opt = getopt(argc, argv, "m:a:x:k:i:s:S:p:" BENCH_OPTIONS)) != -1) {
+        switch (opt) {
+        case 'm': method_list = optarg; break;
+        case 'a': hint_list = optarg; break;
+        case 'x': pattern_list = optarg; break;
+        case 'k': cache_list = optarg; break;
+        case 'i':
+            if (sscanf(optarg, "%d:%d", &imin, &imax) == 1) imax = imin;
+            break;
+        case 's': total_size = (size_t)1 << atoi(optarg); break;
+        case 'S': stride = atol(optarg); break;
+        case 'p': path = optarg; break;
+        default:
+            if (bench_parse_option(&cfg, opt, optarg) != 1) {
+                usage(argv[0]);
+                return 1;
+            }
+        }
+    }
+    if (imin < 0 || imax > 30 || imin > imax || stride < 1 || (stride & (stride - 1)) != 0 || total_size < ((size_t)1 << imax)) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (prepare_test_file(path) != 0) {
+        return 1;
+    }
+    cfg.cache_path = path;
+
+    const char *keys = "method,hint,pattern,cache,i";
+    bench_print_header(&cfg, keys);
+    for (int m = METHOD_READ; m <= METHOD_MMAP; m++) {
+        if (!bench_in_list(method_list, method_names[m])) continue;
+        for (int h = HINT_NONE; h <= HINT_WILLNEED; h++) {
+            if (!bench_in_list(hint_list, hint_names[h])) continue;
+            for (int x = PATTERN_SEQUENTIAL; x <= PATTERN_RANDOM; x++) {
+                if (!bench_in_list(pattern_list, pattern_names[x])) continue;
+                for (int c = 0; c < 2; c++) {
+                    if (!bench_in_list(cache_list, cache_names[c])) continue;
+                    cfg.cache = c == 0 ? BENCH_CACHE_DROP : BENCH_CACHE_WARM;
+                    for (int i = imin; i <= imax; i = i + 2) {
+                        struct read_point pt = { path, m, h, x, (size_t)1 << i };
+                        struct bench_result res;
+                        if (bench_run(&cfg, NULL, read_point_run, &pt, &res) != 0) {
+                            fprintf(stderr, "%s: failed at i=%d\n", method_names[m], i);
+                            continue;
+                        }
+                        char values[96];
+                        snprintf(values, sizeof(values), "%s,%s,%s,%s,%d",
+                                 method_names[m], hint_names[h], pattern_names[x], cache_names[c], i);
+                        bench_print(&cfg, keys, values, total_size, &res);
+                    }
+                }
+            }
+        }
+    }
+    return 0;
+}
@@ -1,14 +1,42 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <dirent.h>
 #include <sys/stat.h>
 #include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "filter.h"
+#include "out.h"
+#include "bench.h"
+
+/**
+ * Usage:
+ * "./task_1"                       Print every file below "." (original lab task).
+ * "./task_1 -d [options] [path]"   Disk usage mode, see usage() below.
+ * "./task_1 -e expr [path]"        Only the entries matching expr (see filter.c),
+ *                                  also in disk usage mode: "./task_1 -e 'name=*.txt and depth<=2'"
+ * "./task_1 -l format [path]"      Parallel listing through per-thread buffers (see out.c)
+ *                                  as text, nul, ndjson or binary: "./task_1 -l nul -j 8 / | xargs -0 ..."
+ * "./task_1 -b entries"            Benchmark of the output stage alone, entries per second
+ *                                  of each format against printf(): "./task_1 -b 1000000 -j 8"
+ *
+ * Command to run: "gcc -O2 task_1.c filter.c out.c bench.c -o task_1 -pthread -lm; ./task_1 -d"
+ */
+
+#define MAX_THREADS 256
+#define DEFAULT_THREADS 4
+#define DEFAULT_TOP_N 10
+
+struct filter *walk_filter = NULL;     // Entries to print or count, NULL for all
 
 
 
 /**
  * Print content.
- * 
+ *
  * A function which searches in a directory and
  * prints out the file name and inode number for each
  * file in the directory.
@@ -19,8 +47,14 @@
  * "./test_folder/nested_folder_1"
  * "./test_folder/nested_folder_2"
  * "./test_folder/nested_folder_2/nested_folder_3"
+ *
+ * With walk_filter only the matching files are printed, and directories
+ * nothing below can match are not opened.
+ *
+ * @param path: The directory.
+ * @param depth: Its depth below the first call, 0 there.
  */
-int print_content(char path[]){
+int print_content(char path[], int depth){
 
     DIR *dir;
     struct dirent *entry;   // Directory entry buffer.
@@ -53,20 +87,909 @@ int print_content(char path[]){
                 continue;
             }
             // Make recursive call
-            print_content(full_path);
-        } else {
+            if (walk_filter == NULL || filter_descend(walk_filter, full_path, depth + 1)) {
+                print_content(full_path, depth + 1);
+            }
+        } else if (walk_filter == NULL || filter_match(walk_filter, full_path, entry->d_name, depth + 1, &file_stat)) {
             printf("File: %s, Inode: %ld\n", entry->d_name, file_stat.st_ino);
         }
     }
 
     // Close the directory
     closedir(dir);
+    return 0;
+}
+
+
+
+// ============================ DISK USAGE MODE ============================
+
+// Directory node.
+// One node per directory. The scanning thread owns the node while it reads
+// the directory, after that the only writes are atomic adds from children
+// rolling their subtree totals up on completion.
+struct dir_node {
+    char *path;
+    int depth;
+    struct dir_node *parent;
+    struct dir_node *first_child;   // Only linked by the thread scanning the parent
+    struct dir_node *next_sibling;
+    struct dir_node *next_work;     // Work queue link
+    atomic_int pending;             // Unfinished child directories + 1 for the scan itself
+    atomic_ullong apparent;         // Subtree sum of st_size
+    atomic_ullong allocated;        // Subtree sum of st_blocks * 512
+    atomic_ullong files;            // Subtree count of non-directories
+    atomic_ullong dirs;             // Subtree count of directories (including this one)
+};
+
+// A file in a largest-N list.
+struct big_file {
+    unsigned long long size;
+    char *path;
+};
+
+// Per-thread accumulator.
+// Never shared while the walk runs, merged once all threads are joined.
+struct du_thread {
+    pthread_t thread;
+    struct big_file *top;   // Min-heap on size, top[0] is the smallest kept file
+    int top_count;
+    unsigned long long errors;
+};
+
+// Work queue of directories waiting to be scanned (LIFO keeps the walk depth-first-ish).
+struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    struct dir_node *head;
+    int outstanding;        // Queued + currently scanned directories
+} du_queue = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, NULL, 0 };
+
+// Options
+int du_threads = DEFAULT_THREADS;
+int du_top_n = DEFAULT_TOP_N;
+int du_max_depth = -1;      // -1 = no limit on printed depth
+int du_json = 0;
+
+// Files with more than one link seen so far, each is counted once as du does.
+// Open addressing on (st_dev, st_ino), inode 0 marks a free slot.
+struct du_link {
+    dev_t dev;
+    ino_t ino;
+};
+struct {
+    pthread_mutex_t lock;
+    struct du_link *slots;
+    size_t cap;             // Power of two
+    size_t count;
+} du_links = { PTHREAD_MUTEX_INITIALIZER, NULL, 0, 0 };
+
+
+
+/**
+ * Push a directory to the work queue.
+ */
+void du_queue_push(struct dir_node *node) {
+    pthread_mutex_lock(&du_queue.lock);
+    node->next_work = du_queue.head;
+    du_queue.head = node;
+    du_queue.outstanding++;
+    pthread_cond_signal(&du_queue.cond);
+    pthread_mutex_unlock(&du_queue.lock);
+}
+
+
+
+/**
+ * Pop a directory from the work queue.
+ *
+ * Blocks until there is work or the walk is finished.
+ *
+ * @return The next directory, or NULL when every directory has been scanned.
+ */
+struct dir_node *du_queue_pop(void) {
+    pthread_mutex_lock(&du_queue.lock);
+    while (du_queue.head == NULL && du_queue.outstanding > 0) {
+        pthread_cond_wait(&du_queue.cond, &du_queue.lock);
+    }
+    struct dir_node *node = du_queue.head;
+    if (node != NULL) {
+        du_queue.head = node->next_work;
+    }
+    pthread_mutex_unlock(&du_queue.lock);
+    return node;
+}
+
+
+
+/**
+ * Mark a popped directory as scanned.
+ *
+ * Wakes every waiting thread when the last directory is done.
+ */
+void du_queue_done(void) {
+    pthread_mutex_lock(&du_queue.lock);
+    if (--du_queue.outstanding == 0) {
+        pthread_cond_broadcast(&du_queue.cond);
+    }
+    pthread_mutex_unlock(&du_queue.lock);
+}
+
+
+
+/**
+ * Find the slot of a file in du_links, or the free slot where it belongs.
+ */
+struct du_link *du_link_slot(struct du_link *slots, size_t cap, dev_t dev, ino_t ino) {
+    size_t h = ((unsigned long long)dev * 0x9e3779b97f4a7c15ULL) ^ (unsigned long long)ino * 0xff51afd7ed558ccdULL;
+    for (size_t k = h & (cap - 1); ; k = (k + 1) & (cap - 1)) {
+        if (slots[k].ino == 0 || (slots[k].ino == ino && slots[k].dev == dev)) {
+            return &slots[k];
+        }
+    }
+}
+
+
+
+/**
+ * Check whether a hard linked file is seen for the first time.
+ *
+ * Only files with st_nlink > 1 go through here, so the lock is rarely taken.
+ *
+ * @return int: 1 the first time a (dev, inode) pair is seen, 0 after that.
+ */
+int du_link_first(dev_t dev, ino_t ino) {
+    pthread_mutex_lock(&du_links.lock);
+    if (2 * (du_links.count + 1) > du_links.cap) {
+        size_t cap = du_links.cap ? du_links.cap * 2 : 1024;
+        struct du_link *slots = calloc(cap, sizeof(*slots));
+        if (slots == NULL) {
+            perror("du_link_first");
+            exit(1);
+        }
+        for (size_t k = 0; k < du_links.cap; k++) {
+            if (du_links.slots[k].ino != 0) {
+                *du_link_slot(slots, cap, du_links.slots[k].dev, du_links.slots[k].ino) = du_links.slots[k];
+            }
+        }
+        free(du_links.slots);
+        du_links.slots = slots;
+        du_links.cap = cap;
+    }
+    struct du_link *slot = du_link_slot(du_links.slots, du_links.cap, dev, ino);
+    int first = slot->ino == 0;
+    if (first) {
+        slot->dev = dev;
+        slot->ino = ino;
+        du_links.count++;
+    }
+    pthread_mutex_unlock(&du_links.lock);
+    return first;
+}
+
+
+
+/**
+ * Create a directory node.
+ */
+struct dir_node *du_node_new(const char *path, struct dir_node *parent) {
+    struct dir_node *node = calloc(1, sizeof(*node));
+    if (node == NULL || (node->path = strdup(path)) == NULL) {
+        perror("du_node_new");
+        exit(1);
+    }
+    node->parent = parent;
+    node->depth = parent ? parent->depth + 1 : 0;
+    atomic_init(&node->pending, 1);
+    atomic_init(&node->dirs, 1);
+    return node;
 }
 
 
 
-int main(){
-    print_content(".");
+/**
+ * Complete a directory.
+ *
+ * Called once when the directory itself has been scanned and once per
+ * child subtree that finishes. The call that drops pending to zero owns
+ * the final totals and adds them to the parent, which may complete the
+ * parent in turn. The roll-up only uses atomics, so no lock is held.
+ */
+void du_node_complete(struct dir_node *node) {
+    while (node != NULL && atomic_fetch_sub_explicit(&node->pending, 1, memory_order_acq_rel) == 1) {
+        struct dir_node *parent = node->parent;
+        if (parent != NULL) {
+            atomic_fetch_add_explicit(&parent->apparent, atomic_load_explicit(&node->apparent, memory_order_relaxed), memory_order_relaxed);
+            atomic_fetch_add_explicit(&parent->allocated, atomic_load_explicit(&node->allocated, memory_order_relaxed), memory_order_relaxed);
+            atomic_fetch_add_explicit(&parent->files, atomic_load_explicit(&node->files, memory_order_relaxed), memory_order_relaxed);
+            atomic_fetch_add_explicit(&parent->dirs, atomic_load_explicit(&node->dirs, memory_order_relaxed), memory_order_relaxed);
+        }
+        node = parent;
+    }
+}
+
+
+
+/**
+ * Check whether a file is large enough for a largest-N min-heap.
+ *
+ * @param top: The heap, room for du_top_n entries.
+ * @param count: Number of entries currently in the heap.
+ * @param size: Allocated size of the file.
+ */
+int du_top_wants(const struct big_file *top, int count, unsigned long long size) {
+    return du_top_n > 0 && (count < du_top_n || size > top[0].size);
+}
+
+
+
+/**
+ * Insert a file into a largest-N min-heap.
+ *
+ * The heap takes ownership of path, the evicted smallest entry is freed.
+ * Only call after du_top_wants() said yes.
+ *
+ * @param top: The heap, room for du_top_n entries.
+ * @param count: Number of entries currently in the heap.
+ * @param size: Allocated size of the file.
+ * @param path: Heap allocated path of the file.
+ */
+void du_top_insert(struct big_file *top, int *count, unsigned long long size, char *path) {
+    int i;
+    if (*count < du_top_n) {
+        // Sift up
+        i = (*count)++;
+        while (i > 0 && top[(i - 1) / 2].size > size) {
+            top[i] = top[(i - 1) / 2];
+            i = (i - 1) / 2;
+        }
+    } else {
+        // Replace the root and sift down
+        free(top[0].path);
+        i = 0;
+        for (;;) {
+            int c = 2 * i + 1;
+            if (c >= *count) break;
+            if (c + 1 < *count && top[c + 1].size < top[c].size) c++;
+            if (top[c].size >= size) break;
+            top[i] = top[c];
+            i = c;
+        }
+    }
+    top[i].size = size;
+    top[i].path = path;
+}
+
+
+
+/**
+ * Scan one directory.
+ *
+ * Files are summed into locals and added to the node in one go, sub
+ * directories get a node of their own and are pushed to the work queue.
+ * A file with several hard links counts in the directory where the walk
+ * meets it first, like du.
+ */
+void du_scan(struct du_thread *self, struct dir_node *node) {
+    unsigned long long apparent = 0, allocated = 0, files = 0;
+    struct stat st;
+
+    int fd = open(node->path, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    DIR *dir = fd == -1 ? NULL : fdopendir(fd);
+    if (dir == NULL) {
+        perror(node->path);
+        if (fd != -1) close(fd);
+        self->errors++;
+        du_node_complete(node);
+        return;
+    }
+
+    // The directory's own blocks count towards its subtree, unless only matching files count
+    if (walk_filter == NULL && fstat(fd, &st) == 0) {
+        apparent += st.st_size;
+        allocated += (unsigned long long)st.st_blocks * 512;
+    }
+
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+            continue;
+        }
+
+        // Stat relative to the open directory, do not follow symlinks
+        if (fstatat(fd, entry->d_name, &st, AT_SYMLINK_NOFOLLOW) == -1) {
+            self->errors++;
+            continue;
+        }
+
+        size_t len = strlen(node->path) + strlen(entry->d_name) + 2;
+        char child_path[len];
+        snprintf(child_path, len, "%s/%s", node->path, entry->d_name);
+
+        if (S_ISDIR(st.st_mode)) {
+            if (walk_filter != NULL && !filter_descend(walk_filter, child_path, node->depth + 1)) {
+                continue;
+            }
+            struct dir_node *child = du_node_new(child_path, node);
+            child->next_sibling = node->first_child;
+            node->first_child = child;
+            atomic_fetch_add_explicit(&node->pending, 1, memory_order_relaxed);
+            du_queue_push(child);
+        } else if ((walk_filter == NULL || filter_match(walk_filter, child_path, entry->d_name, node->depth + 1, &st))
+                   && (st.st_nlink <= 1 || du_link_first(st.st_dev, st.st_ino))) {
+            unsigned long long blocks = (unsigned long long)st.st_blocks * 512;
+            apparent += st.st_size;
+            allocated += blocks;
+            files++;
+            if (du_top_wants(self->top, self->top_count, blocks)) {
+                char *path = strdup(child_path);
+                if (path != NULL) {
+                    du_top_insert(self->top, &self->top_count, blocks, path);
+                }
+            }
+        }
+    }
+    closedir(dir);
+
+    atomic_fetch_add_explicit(&node->apparent, apparent, memory_order_relaxed);
+    atomic_fetch_add_explicit(&node->allocated, allocated, memory_order_relaxed);
+    atomic_fetch_add_explicit(&node->files, files, memory_order_relaxed);
+    du_node_complete(node);
+}
+
+
+
+/**
+ * Disk usage worker thread.
+ */
+void *du_worker(void *arg) {
+    struct du_thread *self = arg;
+    struct dir_node *node;
+    while ((node = du_queue_pop()) != NULL) {
+        du_scan(self, node);
+        du_queue_done();
+    }
+    return NULL;
+}
+
+
+
+/**
+ * Compare directories by allocated size, largest first.
+ */
+int du_cmp_dir(const void *a, const void *b) {
+    unsigned long long x = atomic_load(&(*(struct dir_node **)a)->allocated);
+    unsigned long long y = atomic_load(&(*(struct dir_node **)b)->allocated);
+    return (x < y) - (x > y);
+}
+
+
+
+/**
+ * Compare files by size, largest first.
+ */
+int du_cmp_file(const void *a, const void *b) {
+    unsigned long long x = ((const struct big_file *)a)->size;
+    unsigned long long y = ((const struct big_file *)b)->size;
+    return (x < y) - (x > y);
+}
+
+
+
+/**
+ * Collect the directories within du_max_depth into an array.
+ */
+void du_collect(struct dir_node *node, struct dir_node ***list, size_t *count, size_t *cap) {
+    if (du_max_depth >= 0 && node->depth > du_max_depth) {
+        return;
+    }
+    if (*count == *cap) {
+        *cap = *cap ? *cap * 2 : 1024;
+        *list = realloc(*list, *cap * sizeof(**list));
+        if (*list == NULL) {
+            perror("du_collect");
+            exit(1);
+        }
+    }
+    (*list)[(*count)++] = node;
+    for (struct dir_node *c = node->first_child; c != NULL; c = c->next_sibling) {
+        du_collect(c, list, count, cap);
+    }
+}
+
+
+
+/**
+ * Print a string as a JSON string literal.
+ */
+void du_json_string(const char *s) {
+    putchar('"');
+    for (; *s; s++) {
+        unsigned char c = *s;
+        if (c == '"' || c == '\\') {
+            printf("\\%c", c);
+        } else if (c < 0x20) {
+            printf("\\u%04x", c);
+        } else {
+            putchar(c);
+        }
+    }
+    putchar('"');
+}
+
+
+
+/**
+ * Print a directory subtree as nested JSON objects.
+ */
+void du_json_tree(struct dir_node *node) {
+    printf("{\"path\":");
+    du_json_string(node->path);
+    printf(",\"apparent\":%llu,\"allocated\":%llu,\"files\":%llu,\"dirs\":%llu,\"children\":[",
+        atomic_load(&node->apparent), atomic_load(&node->allocated),
+        atomic_load(&node->files), atomic_load(&node->dirs));
+    if (du_max_depth < 0 || node->depth < du_max_depth) {
+        for (struct dir_node *c = node->first_child; c != NULL; c = c->next_sibling) {
+            du_json_tree(c);
+            if (c->next_sibling != NULL) putchar(',');
+        }
+    }
+    printf("]}");
+}
+
+
+
+/**
+ * Free a directory subtree.
+ */
+void du_free(struct dir_node *node) {
+    struct dir_node *c = node->first_child;
+    while (c != NULL) {
+        struct dir_node *next = c->next_sibling;
+        du_free(c);
+        c = next;
+    }
+    free(node->path);
+    free(node);
+}
+
+
+
+/**
+ * Disk usage.
+ *
+ * Walks the tree below path with du_threads threads and prints either a
+ * report sorted by allocated size or the whole tree as JSON, followed by
+ * the largest du_top_n files.
+ *
+ * @param path: The root of the walk.
+ * @return int: 0 on success, 1 if any entry could not be read.
+ */
+int disk_usage(const char *path) {
+    struct du_thread *threads = calloc(du_threads, sizeof(*threads));
+    if (threads == NULL) {
+        perror("disk_usage");
+        return 1;
+    }
+
+    struct dir_node *root = du_node_new(path, NULL);
+    du_queue_push(root);
+
+    for (int t = 0; t < du_threads; t++) {
+        threads[t].top = calloc(du_top_n ? du_top_n : 1, sizeof(struct big_file));
+        if (threads[t].top == NULL || pthread_create(&threads[t].thread, NULL, du_worker, &threads[t]) != 0) {
+            fprintf(stderr, "disk_usage: Error: Cannot start thread %d\n", t);
+            exit(1);
+        }
+    }
+
+    // Join and merge the per-thread largest-N heaps
+    struct big_file *top = calloc(du_top_n ? du_top_n : 1, sizeof(*top));
+    int top_count = 0;
+    unsigned long long errors = 0;
+    for (int t = 0; t < du_threads; t++) {
+        pthread_join(threads[t].thread, NULL);
+        for (int k = 0; k < threads[t].top_count; k++) {
+            struct big_file f = threads[t].top[k];
+            if (du_top_wants(top, top_count, f.size)) {
+                du_top_insert(top, &top_count, f.size, f.path);
+            } else {
+                free(f.path);
+            }
+        }
+        errors += threads[t].errors;
+        free(threads[t].top);
+    }
+    qsort(top, top_count, sizeof(*top), du_cmp_file);
+
+    if (du_json) {
+        printf("{\"tree\":");
+        du_json_tree(root);
+        printf(",\"largest\":[");
+        for (int k = 0; k < top_count; k++) {
+            printf("%s{\"path\":", k ? "," : "");
+            du_json_string(top[k].path);
+            printf(",\"allocated\":%llu}", top[k].size);
+        }
+        printf("],\"errors\":%llu}\n", errors);
+    } else {
+        struct dir_node **list = NULL;
+        size_t count = 0, cap = 0;
+        du_collect(root, &list, &count, &cap);
+        qsort(list, count, sizeof(*list), du_cmp_dir);
+
+        printf("=========== DIRECTORIES ===========\n");
+        printf("%16s %16s %12s %10s  %s\n", "allocated", "apparent", "files", "dirs", "path");
+        for (size_t k = 0; k < count; k++) {
+            printf("%16llu %16llu %12llu %10llu  %s\n",
+                atomic_load(&list[k]->allocated), atomic_load(&list[k]->apparent),
+                atomic_load(&list[k]->files), atomic_load(&list[k]->dirs), list[k]->path);
+        }
+        free(list);
+
+        printf("\n=========== LARGEST FILES ===========\n");
+        for (int k = 0; k < top_count; k++) {
+            printf("%16llu  %s\n", top[k].size, top[k].path);
+        }
+        if (errors) {
+            printf("\nUnreadable entries: %llu\n", errors);
+        }
+    }
+
+    for (int k = 0; k < top_count; k++) {
+        free(top[k].path);
+    }
+    free(top);
+    free(threads);
+    du_free(root);
+    free(du_links.slots);
+    return errors ? 1 : 0;
+}
+
+
+
+// ============================ LIST MODE ============================
+
+// Listing thread, with its own output buffers.
+struct list_thread {
+    pthread_t thread;
+    struct out_buf out;
+    unsigned long long errors;
+};
+
+int list_format = -1;       // enum out_format of the parallel listing, -1 for print_content()
+
+
+
+/**
+ * Scan one directory for the listing.
+ *
+ * Files go to the thread's buffers, sub directories to the work queue.
+ * Unlike print_content() symbolic links are not followed.
+ */
+void list_scan(struct list_thread *self, struct dir_node *node) {
+    struct stat st;
+    int fd = open(node->path, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    DIR *dir = fd == -1 ? NULL : fdopendir(fd);
+    if (dir == NULL) {
+        perror(node->path);
+        if (fd != -1) close(fd);
+        self->errors++;
+        return;
+    }
+
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+            continue;
+        }
+        if (fstatat(fd, entry->d_name, &st, AT_SYMLINK_NOFOLLOW) == -1) {
+            self->errors++;
+            continue;
+        }
+
+        size_t len = strlen(node->path) + strlen(entry->d_name) + 2;
+        char child_path[len];
+        snprintf(child_path, len, "%s/%s", node->path, entry->d_name);
+
+        if (S_ISDIR(st.st_mode)) {
+            if (walk_filter == NULL || filter_descend(walk_filter, child_path, node->depth + 1)) {
+                struct dir_node *child = du_node_new(child_path, node);
+                child->parent = NULL;   // The node is freed once scanned
+                du_queue_push(child);
+            }
+        } else if (walk_filter == NULL || filter_match(walk_filter, child_path, entry->d_name, node->depth + 1, &st)) {
+            out_entry(&self->out, child_path, len - 1, entry->d_name, st.st_ino, st.st_size);
+        }
+    }
+    closedir(dir);
+}
+
+
+
+/**
+ * Listing worker thread.
+ */
+void *list_worker(void *arg) {
+    struct list_thread *self = arg;
+    struct dir_node *node;
+    while ((node = du_queue_pop()) != NULL) {
+        list_scan(self, node);
+        free(node->path);
+        free(node);
+        du_queue_done();
+    }
+    out_flush(&self->out);
+    return NULL;
+}
+
+
+
+/**
+ * List every file below path with du_threads threads, in list_format.
+ *
+ * The order of the entries is the order the threads flush them in.
+ *
+ * @param path: The root of the walk.
+ * @return int: 0 on success, 1 if any entry could not be read or written.
+ */
+int list_content(const char *path) {
+    struct list_thread *threads = calloc(du_threads, sizeof(*threads));
+    if (threads == NULL) {
+        perror("list_content");
+        return 1;
+    }
+    du_queue_push(du_node_new(path, NULL));
+
+    for (int t = 0; t < du_threads; t++) {
+        if (out_init(&threads[t].out, STDOUT_FILENO, list_format) != 0
+            || pthread_create(&threads[t].thread, NULL, list_worker, &threads[t]) != 0) {
+            fprintf(stderr, "list_content: Error: Cannot start thread %d\n", t);
+            exit(1);
+        }
+    }
+
+    unsigned long long errors = 0;
+    int failed = 0;
+    for (int t = 0; t < du_threads; t++) {
+        pthread_join(threads[t].thread, NULL);
+        errors += threads[t].errors;
+        failed |= threads[t].out.failed;
+        out_free(&threads[t].out);
+    }
+    if (errors) {
+        fprintf(stderr, "Unreadable entries: %llu\n", errors);
+    }
+    free(threads);
+    return errors || failed ? 1 : 0;
+}
+
+
+
+// ============================ OUTPUT BENCHMARK ============================
+
+#define BENCH_PATHS 4096
+
+// One benchmark point, passed to the harness.
+struct out_bench {
+    int format;             // enum out_format, OUT_FORMATS for printf()
+    int threads;
+    long entries;           // Per run, over all threads
+    int fd;                 // /dev/null
+    FILE *file;             // The same for printf()
+    unsigned long long bytes;
+};
+
+struct out_bench_thread {
+    pthread_t thread;
+    struct out_bench *point;
+    long first;
+    long count;
+    unsigned long long bytes;
+};
+
+// Synthetic entries, built once so that only the output stage is timed
+char *bench_paths[BENCH_PATHS];
+size_t bench_path_lens[BENCH_PATHS];
+const char *bench_names[BENCH_PATHS];
+
+
+
+/**
+ * Output benchmark thread, writes its share of the entries.
+ */
+void *out_bench_worker(void *arg) {
+    struct out_bench_thread *self = arg;
+    struct out_bench *pt = self->point;
+    long end = self->first + self->count;
+    if (pt->format == OUT_FORMATS) {
+        // The original path, one printf() and a stdio lock per entry
+        for (long i = self->first; i < end; i++) {
+            int k = i % BENCH_PATHS;
+            int n = fprintf(pt->file, "File: %s, Inode: %ld\n", bench_names[k], 1000000L + i);
+            self->bytes += n > 0 ? n : 0;
+        }
+        return NULL;
+    }
+    struct out_buf out;
+    if (out_init(&out, pt->fd, pt->format) != 0) {
+        return NULL;
+    }
+    for (long i = self->first; i < end; i++) {
+        int k = i % BENCH_PATHS;
+        out_entry(&out, bench_paths[k], bench_path_lens[k], bench_names[k], 1000000 + i, i * 37 % 100000);
+    }
+    out_flush(&out);
+    self->bytes = out.bytes;
+    out_free(&out);
+    return NULL;
+}
+
+
+
+/**
+ * One timed run: the threads write pt->entries entries between them.
+ */
+int out_bench_run(void *arg) {
+    struct out_bench *pt = arg;
+    struct out_bench_thread threads[MAX_THREADS];
+    long share = pt->entries / pt->threads;
+    pt->bytes = 0;
+    for (int t = 0; t < pt->threads; t++) {
+        threads[t] = (struct out_bench_thread){ .point = pt, .first = t * share,
+                                                .count = t == pt->threads - 1 ? pt->entries - t * share : share };
+        if (pthread_create(&threads[t].thread, NULL, out_bench_worker, &threads[t]) != 0) {
+            perror("out_bench_run: pthread_create");
+            return -1;
+        }
+    }
+    for (int t = 0; t < pt->threads; t++) {
+        pthread_join(threads[t].thread, NULL);
+        pt->bytes += threads[t].bytes;
+    }
+    if (pt->format == OUT_FORMATS) {
+        fflush(pt->file);
+    }
+    return 0;
+}
+
+
+
+/**
+ * Benchmark the output stage alone.
+ *
+ * Synthetic entries are written to /dev/null by 1 and du_threads threads
+ * in every format in formats ("all" or a list, "printf" for the original
+ * per entry printf()), one result per point, see bench_print().
+ *
+ * @return int: 0 on success, 1 on failure.
+ */
+int out_benchmark(const struct bench_config *cfg, long entries, const char *formats) {
+    struct out_bench pt = { .entries = entries };
+    pt.fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+    pt.file = fopen("/dev/null", "w");
+    if (pt.fd == -1 || pt.file == NULL) {
+        perror("out_benchmark: /dev/null");
+        return 1;
+    }
+    for (int k = 0; k < BENCH_PATHS; k++) {
+        char path[128];
+        int len = snprintf(path, sizeof(path), "./data/project_%02d/src/module_%03d/file_%04d.dat",
+                           k % 37, k % 211, k);
+        bench_paths[k] = strdup(path);
+        bench_path_lens[k] = len;
+        bench_names[k] = strrchr(bench_paths[k], '/') + 1;
+    }
+
+    const char *keys = "format,threads,entries,entries_per_s";
+    bench_print_header(cfg, keys);
+    for (int f = 0; f <= OUT_FORMATS; f++) {
+        const char *name = f < OUT_FORMATS ? out_format_names[f] : "printf";
+        if (!bench_in_list(formats, name)) continue;
+        int thread_counts[2] = { 1, du_threads };
+        for (int c = 0; c < (du_threads > 1 ? 2 : 1); c++) {
+            int threads = thread_counts[c];
+            struct bench_result res;
+            pt.format = f;
+            pt.threads = threads;
+            if (bench_run(cfg, NULL, out_bench_run, &pt, &res) != 0) {
+                fprintf(stderr, "out_benchmark: %s failed with %d threads\n", name, threads);
+                continue;
+            }
+            char values[96];
+            snprintf(values, sizeof(values), "%s,%d,%ld,%.0f", name, threads, entries,
+                     res.wall_us.median > 0 ? entries / (res.wall_us.median / 1e6) : 0.0);
+            bench_print(cfg, keys, values, pt.bytes, &res);
+        }
+    }
+
+    for (int k = 0; k < BENCH_PATHS; k++) {
+        free(bench_paths[k]);
+    }
+    fclose(pt.file);
+    close(pt.fd);
     return 0;
 }
 
+
+
+/**
+ * Print usage.
+ */
+void usage(const char *prog) {
+    fprintf(stderr,
+        "Usage: %s [-e expr] [-d [-j threads] [-n top] [-m depth] [-f text|json]] [path]\n"
+        "       %s [-e expr] -l format [-j threads] [path]\n"
+        "       %s -b entries [-l formats] [-j threads] [bench options]\n"
+        "  -e expr     Only print (or count) the entries matching expr, tests name=glob,\n"
+        "              path=glob, regex=ere, size<n[kMGT], mtime<n[smhdw], type=fdl...,\n"
+        "              inode=a-b, depth<=n with and, or, not and parentheses\n"
+        "  -d          Disk usage mode (per directory sizes and largest files)\n"
+        "  -j threads  Worker threads (default %d)\n"
+        "  -n top      Number of largest files to report (default %d)\n"
+        "  -m depth    Only report directories down to this depth\n"
+        "  -f format   text = sorted report, json = directory tree\n"
+        "  -l format   List files with -j threads as text, nul, ndjson or binary\n"
+        "  -b entries  Benchmark the output stage with this many entries, -l selects\n"
+        "              the formats (default all, printf is the original output)\n"
+        BENCH_USAGE,
+        prog, prog, prog, DEFAULT_THREADS, DEFAULT_TOP_N);
+}
+
+
+
+int main(int argc, char *argv[]){
+    int du_mode = 0;
+    const char *formats = NULL;
+    long bench_entries = 0;
+    struct bench_config cfg;
+    bench_config_init(&cfg);
+    int opt;
+    while ((opt = getopt(argc, argv, "e:dj:n:m:f:l:b:" BENCH_OPTIONS)) != -1) {
+        switch (opt) {
+        case 'e':
+            walk_filter = filter_compile(optarg);
+            if (walk_filter == NULL) return 1;
+            break;
+        case 'd': du_mode = 1; break;
+        case 'j': du_threads = atoi(optarg); break;
+        case 'n': du_top_n = atoi(optarg); break;
+        case 'm': du_max_depth = atoi(optarg); break;
+        case 'f':
+            if (strcmp(optarg, "json") != 0 && strcmp(optarg, "text") != 0) {
+                usage(argv[0]);
+                return 1;
+            }
+            du_json = strcmp(optarg, "json") == 0;
+            break;
+        case 'l': formats = optarg; break;
+        case 'b': bench_entries = atol(optarg); break;
+        default:
+            if (bench_parse_option(&cfg, opt, optarg) != 1) {
+                usage(argv[0]);
+                return 1;
+            }
+        }
+    }
+    if (formats != NULL && bench_entries == 0) {
+        list_format = out_find_format(formats);
+    }
+    if (du_threads < 1 || du_threads > MAX_THREADS || du_top_n < 0 || bench_entries < 0
+        || (formats != NULL && bench_entries == 0 && list_format < 0)) {
+        usage(argv[0]);
+        return 1;
+    }
+    char *path = optind < argc ? argv[optind] : ".";
+
+    if (bench_entries > 0) {
+        return out_benchmark(&cfg, bench_entries, formats ? formats : "all");
+    }
+    if (du_mode) {
+        return disk_usage(path);
+    }
+    if (list_format >= 0) {
+        return list_content(path);
+    }
+    print_content(path, 0);
+    return 0;
+}
@@ -1,14 +1,47 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <dirent.h>
 #include <sys/stat.h>
 #include <string.h>
-#include <time.h>
-#include <sys/time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <limits.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <pthread.h>
+#include "uring.h"
+#include "bench.h"
+
+/**
+ * Write path benchmark.
+ *
+ * Writes a test file in chunks of 2^i bytes through an application-level
+ * buffer of 2^j bytes, once per I/O engine, and prints the time it took.
+ * With -t the same amount of data is instead written by T threads with
+ * pwrite, to separate files or to disjoint regions of one shared file.
+ *
+ * Command to run: "gcc -O2 task_2.c uring.c bench.c -o task_2 -lm -pthread; ./task_2 -e all -y all"
+ */
+
+#define DIRECT_ALIGN 4096
+#define MAX_QUEUE_DEPTH 256
+
+// Sync modes, applied once after the whole file is written.
+enum sync_mode { SYNC_NONE, SYNC_FSYNC, SYNC_FDATASYNC };
+const char *sync_names[] = { "none", "fsync", "fdatasync" };
+
+// Options
+size_t total_size = 1 << 30;    // 1 GiB = 2^30 bytes
+int queue_depth = 8;            // io_uring queue depth
+enum sync_mode sync_mode = SYNC_NONE;
+
+
 
 /**
  * Delete old test file.
- * 
+ *
  * Used for cleaning up the directory before creating a new test file.
  */
 int delete_old_test_file(const char path[]) {
@@ -22,16 +55,117 @@ int delete_old_test_file(const char path[]) {
 
 
 
+/**
+ * Make a chunk.
+ *
+ * @param nio: The chunk size.
+ * @return A heap buffer of nio bytes filled with 'A'.
+ */
+char *make_chunk(size_t nio) {
+    char *chunk = malloc(nio);
+    if (chunk == NULL) {
+        perror("make_chunk");
+        return NULL;
+    }
+    memset(chunk, 'A', nio);    // Fill buffer with 'A'
+    return chunk;
+}
+
+
+
+/**
+ * Flush to stable storage according to sync_mode.
+ *
+ * @return int: 0 on success, -1 on failure.
+ */
+int sync_file(int fd) {
+    int res = 0;
+    if (sync_mode == SYNC_FSYNC) res = fsync(fd);
+    if (sync_mode == SYNC_FDATASYNC) res = fdatasync(fd);
+    if (res == -1) perror("sync_file");
+    return res;
+}
+
+
+
+/**
+ * Write a whole buffer.
+ *
+ * Retries short writes.
+ *
+ * @return int: 0 on success, -1 on failure.
+ */
+int write_all(int fd, const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        buf += n;
+        len -= n;
+    }
+    return 0;
+}
+
+
+
+/**
+ * Copy chunks into a buffer and flush it whenever it is full.
+ *
+ * Shared by the engines that gather chunks into an application buffer
+ * before handing it to the kernel.
+ *
+ * @param buf: The buffer, nbuf bytes.
+ * @param flush: Called with every full buffer and its file offset.
+ * @return int: 0 on success, -1 if flush failed.
+ */
+int fill_and_flush(const char *chunk, size_t nio, char *buf, size_t nbuf,
+                   int (*flush)(void *ctx, const char *buf, size_t len, off_t offset), void *ctx) {
+    size_t pos = 0;
+    off_t offset = 0;
+    for (size_t written = 0; written < total_size; written += nio) {
+        for (size_t off = 0; off < nio; ) {
+            size_t n = nio - off < nbuf - pos ? nio - off : nbuf - pos;
+            memcpy(buf + pos, chunk + off, n);
+            pos += n;
+            off += n;
+            if (pos == nbuf) {
+                if (flush(ctx, buf, nbuf, offset) == -1) return -1;
+                offset += nbuf;
+                pos = 0;
+            }
+        }
+    }
+    if (pos > 0 && flush(ctx, buf, pos, offset) == -1) return -1;
+    return 0;
+}
+
+
+
+/**
+ * Flush callback writing to the file descriptor in ctx.
+ */
+int flush_write(void *ctx, const char *buf, size_t len, off_t offset) {
+    (void)offset;
+    return write_all(*(int *)ctx, buf, len);
+}
+
+
+
+// ============================ ENGINES ============================
+
 /**
  * Create and write to a test file.
- * 
+ *
  * Used for writing data to a testfile with differnet sizes of application-level buffers.
- * 
+ * Engine "stdio": fwrite through a setvbuf buffer.
+ *
  * @param path The path to the file.
- * @param i The chunk size = 2^i.
- * @param j The buffer size = 2^j.
+ * @param nio The chunk size = 2^i.
+ * @param nbuf The buffer size = 2^j.
  */
-int create_test_file(const char path[], int i, int j) {
+int create_test_file(const char path[], size_t nio, size_t nbuf) {
     FILE *file = fopen(path, "w");
     if (!file) {
         perror("Failed to create file");
@@ -40,7 +174,6 @@ int create_test_file(const char path[], int i, int j) {
 
     // Set application-level buffer
     static char app_buffer[1 << 20]; // 1 MiB static buffer
-    size_t nbuf = 1 << j;            // 2^j
     if (nbuf > sizeof(app_buffer)) {
         fprintf(stderr, "Requested buffer size too large.\n");
         fclose(file);
@@ -49,56 +182,672 @@ int create_test_file(const char path[], int i, int j) {
     setvbuf(file, app_buffer, _IOFBF, nbuf);
 
     // Write data in chunks of 2^i bytes
-    size_t nio = 1 << i;        // 2^i
-    char chunk[nio];            // Static chunk buffer
-    memset(chunk, 'A', nio);    // Fill buffer with 'A'
-    chunk[nio] = '\0';          // Null-terminate the string
+    char *chunk = make_chunk(nio);
+    if (chunk == NULL) {
+        fclose(file);
+        return -1;
+    }
 
-    // Writing to file 
-    size_t total_size = 1 << 30; // 1 GiB = 2^30 bytes
+    // Writing to file
     for (size_t written = 0; written < total_size; written += nio) {
-        //if (fwrite(chunk, 1, nio, file) != nio) {
-        if (fputs(chunk, file) == EOF) {
+        if (fwrite(chunk, 1, nio, file) != nio) {
             perror("Failed to write to file");
             fclose(file);
+            free(chunk);
             return -1;
         }
     }
+    free(chunk);
 
+    int res = fflush(file) == 0 ? sync_file(fileno(file)) : -1;
     fclose(file);
+    return res;
+}
+
+
+
+/**
+ * Engine "write": raw write(2) of a 2^j byte buffer, chunks bigger than
+ * the buffer are written directly.
+ */
+int create_test_file_write(const char path[], size_t nio, size_t nbuf) {
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1) {
+        perror("Failed to create file");
+        return -1;
+    }
+
+    char *chunk = make_chunk(nio);
+    char *buf = malloc(nbuf);
+    int res = -1;
+    if (chunk != NULL && buf != NULL) {
+        if (nio >= nbuf) {
+            res = 0;
+            for (size_t written = 0; written < total_size && res == 0; written += nio) {
+                res = write_all(fd, chunk, nio);
+            }
+        } else {
+            res = fill_and_flush(chunk, nio, buf, nbuf, flush_write, &fd);
+        }
+        if (res == -1) perror("Failed to write to file");
+    }
+    if (res == 0) res = sync_file(fd);
+
+    free(buf);
+    free(chunk);
+    close(fd);
+    return res;
+}
+
+
+
+/**
+ * Engine "pwritev": no copying, every chunk becomes one iovec and up to
+ * 2^j bytes (or IOV_MAX chunks) go out in one pwritev(2).
+ */
+int create_test_file_pwritev(const char path[], size_t nio, size_t nbuf) {
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1) {
+        perror("Failed to create file");
+        return -1;
+    }
+
+    size_t batch = nio >= nbuf ? 1 : nbuf / nio;
+    if (batch > IOV_MAX) batch = IOV_MAX;
+
+    char *chunk = make_chunk(nio);
+    struct iovec *iov = malloc(batch * sizeof(*iov));
+    int res = -1;
+    if (chunk != NULL && iov != NULL) {
+        for (size_t k = 0; k < batch; k++) {
+            iov[k].iov_base = chunk;
+            iov[k].iov_len = nio;
+        }
+        res = 0;
+        off_t offset = 0;
+        while ((size_t)offset < total_size && res == 0) {
+            size_t left = (total_size - offset) / nio;
+            int cnt = left < batch ? left : batch;
+            ssize_t n = pwritev(fd, iov, cnt, offset);
+            if (n < 0 && errno != EINTR) {
+                perror("Failed to write to file");
+                res = -1;
+            } else if (n > 0) {
+                // Short writes only happen on full disks, finish the batch with pwrite
+                size_t want = cnt * nio;
+                offset += n;
+                while ((size_t)n < want && res == 0) {
+                    ssize_t m = pwrite(fd, chunk + (n % nio), nio - (n % nio), offset);
+                    if (m <= 0) { perror("Failed to write to file"); res = -1; }
+                    else { n += m; offset += m; }
+                }
+            }
+        }
+    }
+    if (res == 0) res = sync_file(fd);
+
+    free(iov);
+    free(chunk);
+    close(fd);
+    return res;
+}
+
+
+
+/**
+ * Engine "direct": O_DIRECT writes from an aligned buffer of
+ * max(2^j, DIRECT_ALIGN) bytes, bypassing the page cache.
+ */
+int create_test_file_direct(const char path[], size_t nio, size_t nbuf) {
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0644);
+    if (fd == -1) {
+        perror("Failed to create file with O_DIRECT");
+        return -1;
+    }
+
+    if (nbuf < DIRECT_ALIGN) nbuf = DIRECT_ALIGN;
+    char *chunk = make_chunk(nio);
+    void *buf = NULL;
+    int res = -1;
+    if (chunk != NULL && posix_memalign(&buf, DIRECT_ALIGN, nbuf) == 0) {
+        res = fill_and_flush(chunk, nio, buf, nbuf, flush_write, &fd);
+        if (res == -1) perror("Failed to write to file");
+    }
+    if (res == 0) res = sync_file(fd);
+
+    free(buf);
+    free(chunk);
+    close(fd);
+    return res;
+}
+
+
+
+/**
+ * Engine "mmap": the file is sized up front, mapped and filled with
+ * memcpy. The buffer size has no meaning here, msync(MS_SYNC) replaces
+ * the fsync/fdatasync step when a sync mode is selected.
+ */
+int create_test_file_mmap(const char path[], size_t nio, size_t nbuf) {
+    (void)nbuf;
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1) {
+        perror("Failed to create file");
+        return -1;
+    }
+    if (ftruncate(fd, total_size) == -1) {
+        perror("ftruncate");
+        close(fd);
+        return -1;
+    }
+
+    char *map = mmap(NULL, total_size, PROT_WRITE, MAP_SHARED, fd, 0);
+    char *chunk = make_chunk(nio);
+    int res = -1;
+    if (map != MAP_FAILED && chunk != NULL) {
+        for (size_t written = 0; written < total_size; written += nio) {
+            memcpy(map + written, chunk, nio);
+        }
+        res = 0;
+        if (sync_mode != SYNC_NONE && msync(map, total_size, MS_SYNC) == -1) {
+            perror("msync");
+            res = -1;
+        }
+    } else {
+        perror("mmap");
+    }
+
+    if (map != MAP_FAILED) munmap(map, total_size);
+    free(chunk);
+    close(fd);
+    return res;
+}
+
+
+
+/**
+ * Reap one io_uring write completion.
+ *
+ * @param lens: Submitted length of each buffer, indexed by user_data.
+ * @param idx: Set to the buffer of the completed write.
+ * @return int: 0 if the write completed in full, -1 if it failed or was
+ *              short, -2 if no completion could be waited for (idx unset).
+ */
+int uring_reap_write(struct uring *ring, const size_t *lens, int *idx) {
+    struct io_uring_cqe cqe;
+    if (uring_wait(ring, &cqe) == -1) {
+        perror("io_uring wait");
+        return -2;
+    }
+    *idx = cqe.user_data;
+    if (cqe.res < 0) {
+        errno = -cqe.res;
+        perror("io_uring write");
+        return -1;
+    }
+    if ((size_t)cqe.res != lens[*idx]) {
+        fprintf(stderr, "io_uring write: Error: short write of %d of %zu bytes\n", cqe.res, lens[*idx]);
+        return -1;
+    }
+    return 0;
+}
+
+
+
+/**
+ * Engine "uring": queue_depth buffers of 2^j bytes kept in flight with
+ * io_uring write requests.
+ */
+int create_test_file_uring(const char path[], size_t nio, size_t nbuf) {
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1) {
+        perror("Failed to create file");
+        return -1;
+    }
+
+    struct uring ring;
+    if (uring_init(&ring, queue_depth) == -1) {
+        perror("io_uring_setup");
+        close(fd);
+        return -1;
+    }
+
+    char *chunk = make_chunk(nio);
+    char *bufs = malloc((size_t)queue_depth * nbuf);
+    int res = chunk != NULL && bufs != NULL ? 0 : -1;
+    int in_flight = 0, next = 0;
+    size_t pos = 0;
+    size_t lens[MAX_QUEUE_DEPTH];
+    off_t offset = 0;
+
+    for (size_t written = 0; written < total_size && res == 0; written += nio) {
+        for (size_t off = 0; off < nio && res == 0; ) {
+            char *buf = bufs + (size_t)next * nbuf;
+            size_t n = nio - off < nbuf - pos ? nio - off : nbuf - pos;
+            memcpy(buf + pos, chunk + off, n);
+            pos += n;
+            off += n;
+            if (pos < nbuf && !(off == nio && written + nio >= total_size)) continue;
+
+            // Buffer full, queue it
+            struct io_uring_sqe *sqe = uring_get_sqe(&ring);
+            if (sqe == NULL) {
+                fprintf(stderr, "io_uring write: Error: submission queue full\n");
+                res = -1;
+                break;
+            }
+            sqe->opcode = IORING_OP_WRITE;
+            sqe->fd = fd;
+            sqe->addr = (unsigned long)buf;
+            sqe->len = pos;
+            sqe->off = offset;
+            sqe->user_data = next;
+            lens[next] = pos;
+            offset += pos;
+            pos = 0;
+            in_flight++;
+
+            // Reuse the oldest buffer once every buffer is in flight
+            if (in_flight == queue_depth) {
+                int r = uring_reap_write(&ring, lens, &next);
+                if (r != -2) in_flight--;
+                if (r != 0) res = -1;
+            } else {
+                uring_submit(&ring, 0);
+                next++;
+            }
+        }
+    }
+    while (in_flight > 0) {
+        int idx, r = uring_reap_write(&ring, lens, &idx);
+        if (r != 0) res = -1;
+        if (r == -2) break;
+        in_flight--;
+    }
+    if (res == 0) res = sync_file(fd);
+
+    uring_exit(&ring);
+    free(bufs);
+    free(chunk);
+    close(fd);
+    return res;
+}
+
+
+
+struct engine {
+    const char *name;
+    int (*create)(const char path[], size_t nio, size_t nbuf);
+};
+
+struct engine engines[] = {
+    { "stdio", create_test_file },
+    { "write", create_test_file_write },
+    { "pwritev", create_test_file_pwritev },
+    { "direct", create_test_file_direct },
+    { "mmap", create_test_file_mmap },
+    { "uring", create_test_file_uring },
+};
+#define NUM_OF_ENGINES (int)(sizeof(engines) / sizeof(engines[0]))
+
+
+
+// One grid point, passed to the harness.
+struct write_point {
+    const char *path;
+    struct engine *engine;
+    size_t nio;
+    size_t nbuf;
+};
+
+
+
+/**
+ * Harness setup: start every run without a test file.
+ */
+int write_point_setup(void *arg) {
+    struct write_point *pt = arg;
+    return delete_old_test_file(pt->path);
+}
+
+
+
+/**
+ * Harness body: write the test file once.
+ */
+int write_point_run(void *arg) {
+    struct write_point *pt = arg;
+    return pt->engine->create(pt->path, pt->nio, pt->nbuf);
+}
+
+
+
+// ============================ CONCURRENT WRITERS ============================
+
+#define MAX_THREADS 256
+
+enum layout { LAYOUT_FILES, LAYOUT_SHARED };
+const char *layout_names[] = { "files", "shared" };
+
+// One writer thread. Thread k owns bytes [base, base + share) of its file, the
+// last one also the remainder of total_size that does not divide evenly.
+struct writer {
+    pthread_t thread;
+    int fd;
+    off_t base;
+    size_t share;
+    size_t nbuf;
+    double elapsed_us;
+    struct bench_hist hist;     // Latency of every pwrite call
+    int failed;
+};
+
+// One concurrent grid point, passed to the harness.
+struct concurrent_point {
+    const char *path;
+    enum layout layout;
+    int preallocate;
+    int threads;
+    size_t nbuf;
+    struct writer writers[MAX_THREADS];
+};
+
+
+
+/**
+ * Writer thread: pwrite its share of the data in 2^j byte calls.
+ */
+void *writer_thread(void *arg) {
+    struct writer *w = arg;
+    char *buf = make_chunk(w->nbuf);
+    if (buf == NULL) {
+        w->failed = 1;
+        return NULL;
+    }
+
+    double start = bench_now_us();
+    for (size_t done = 0; done < w->share; ) {
+        size_t len = w->share - done < w->nbuf ? w->share - done : w->nbuf;
+        double t0 = bench_now_us();
+        ssize_t n = pwrite(w->fd, buf, len, w->base + done);
+        bench_hist_add(&w->hist, (bench_now_us() - t0) * 1000);
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) continue;
+            perror("writer_thread: pwrite");
+            w->failed = 1;
+            break;
+        }
+        done += n;
+    }
+    w->elapsed_us = bench_now_us() - start;
+    free(buf);
+    return NULL;
+}
+
+
+
+/**
+ * Harness setup: create (and optionally preallocate) the files, untimed.
+ */
+int concurrent_setup(void *arg) {
+    struct concurrent_point *pt = arg;
+    size_t share = total_size / pt->threads;
+    char name[PATH_MAX];
+
+    for (int k = 0; k < pt->threads; k++) {
+        struct writer *w = &pt->writers[k];
+        memset(w, 0, sizeof(*w));
+        w->share = share;
+        w->nbuf = pt->nbuf;
+        if (k == pt->threads - 1) {
+            // The last thread also writes what does not divide evenly
+            w->share = total_size - k * share;
+        }
+
+        if (pt->layout == LAYOUT_SHARED && k > 0) {
+            w->fd = pt->writers[0].fd;
+            w->base = k * share;
+            continue;
+        }
+        if (pt->layout == LAYOUT_FILES) {
+            snprintf(name, sizeof(name), "%s.%d", pt->path, k);
+        } else {
+            snprintf(name, sizeof(name), "%s", pt->path);
+        }
+        delete_old_test_file(name);
+        w->fd = open(name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (w->fd == -1) {
+            perror("concurrent_setup: open");
+            return -1;
+        }
+        size_t len = pt->layout == LAYOUT_FILES ? w->share : total_size;
+        if (pt->preallocate && fallocate(w->fd, 0, 0, len) == -1) {
+            perror("concurrent_setup: fallocate");
+            return -1;
+        }
+    }
     return 0;
 }
 
 
 
+/**
+ * Harness body: run the writer threads, sync and close the files.
+ */
+int concurrent_run(void *arg) {
+    struct concurrent_point *pt = arg;
+    int res = 0;
+
+    for (int k = 0; k < pt->threads; k++) {
+        if (pthread_create(&pt->writers[k].thread, NULL, writer_thread, &pt->writers[k]) != 0) {
+            fprintf(stderr, "concurrent_run: Error: Cannot start thread %d\n", k);
+            exit(1);
+        }
+    }
+    for (int k = 0; k < pt->threads; k++) {
+        pthread_join(pt->writers[k].thread, NULL);
+        res |= -pt->writers[k].failed;
+    }
+
+    int files = pt->layout == LAYOUT_FILES ? pt->threads : 1;
+    for (int k = 0; k < files; k++) {
+        if (res == 0) res = sync_file(pt->writers[k].fd);
+        close(pt->writers[k].fd);
+    }
+    return res;
+}
+
+
+
+/**
+ * Remove the files of a concurrent point.
+ */
+void concurrent_cleanup(struct concurrent_point *pt) {
+    char name[PATH_MAX];
+    for (int k = 0; k < pt->threads; k++) {
+        snprintf(name, sizeof(name), "%s.%d", pt->path, k);
+        delete_old_test_file(name);
+    }
+    delete_old_test_file(pt->path);
+}
+
+
+
+/**
+ * Print one row per thread and one aggregate row ("all") of a concurrent point.
+ *
+ * Per-thread throughput and write latencies come from the last timed run,
+ * the wall time statistics are those of the whole point.
+ */
+void concurrent_print(const struct bench_config *cfg, const char *keys, struct concurrent_point *pt,
+                      const struct bench_result *res) {
+    struct bench_hist all;
+    memset(&all, 0, sizeof(all));
+    char values[256];
+
+    for (int k = 0; k <= pt->threads; k++) {
+        const struct bench_hist *h = &all;
+        double mibs;
+        char thread[16];
+        if (k < pt->threads) {
+            struct writer *w = &pt->writers[k];
+            bench_hist_merge(&all, &w->hist);
+            h = &w->hist;
+            mibs = w->elapsed_us > 0 ? w->share / (double)(1 << 20) / (w->elapsed_us / 1e6) : 0;
+            snprintf(thread, sizeof(thread), "%d", k);
+        } else {
+            mibs = res->wall_us.median > 0 ? total_size / (double)(1 << 20) / (res->wall_us.median / 1e6) : 0;
+            snprintf(thread, sizeof(thread), "all");
+        }
+        snprintf(values, sizeof(values), "%s,%d,%d,%s,%d,%s,%.2f,%.1f,%.1f,%.1f,%.1f",
+                 layout_names[pt->layout], pt->preallocate, pt->threads, sync_names[sync_mode],
+                 __builtin_ctzl(pt->nbuf), thread, mibs,
+                 bench_hist_percentile(h, 50) / 1000, bench_hist_percentile(h, 99) / 1000,
+                 bench_hist_percentile(h, 99.9) / 1000, h->max_ns / 1000);
+        bench_print(cfg, keys, values, total_size, res);
+    }
+}
+
+
+
+/**
+ * Run the concurrent writer grid: thread counts x sync modes x buffer sizes.
+ */
+int run_concurrent(struct bench_config *cfg, const char *path, const char *thread_list, enum layout layout,
+                   int preallocate, const char *sync_list, int jmin, int jmax) {
+    const char *keys = "layout,fallocate,threads,sync,j,thread,thread_mib_per_s,"
+                       "lat_p50_us,lat_p99_us,lat_p999_us,lat_max_us";
+    struct concurrent_point *pt = calloc(1, sizeof(*pt));
+    if (pt == NULL) {
+        perror("run_concurrent");
+        return 1;
+    }
+    pt->path = path;
+    pt->layout = layout;
+    pt->preallocate = preallocate;
+
+    bench_print_header(cfg, keys);
+    for (const char *t = thread_list; *t; t += strcspn(t, ",") + (t[strcspn(t, ",")] == ',')) {
+        pt->threads = atoi(t);
+        if (pt->threads < 1 || pt->threads > MAX_THREADS) {
+            fprintf(stderr, "run_concurrent: Error: thread count must be 1-%d\n", MAX_THREADS);
+            free(pt);
+            return 1;
+        }
+        for (int s = SYNC_NONE; s <= SYNC_FDATASYNC; s++) {
+            if (!bench_in_list(sync_list, sync_names[s])) continue;
+            sync_mode = s;
+            for (int j = jmin; j <= jmax; j = j + 2) {
+                pt->nbuf = (size_t)1 << j;
+                if (total_size / pt->threads < pt->nbuf) continue;
+                struct bench_result res;
+                if (bench_run(cfg, concurrent_setup, concurrent_run, pt, &res) != 0) {
+                    fprintf(stderr, "run_concurrent: failed with %d threads, j=%d\n", pt->threads, j);
+                    continue;
+                }
+                concurrent_print(cfg, keys, pt, &res);
+            }
+        }
+    }
+    concurrent_cleanup(pt);
+    free(pt);
+    return 0;
+}
+
+
+
+/**
+ * Print usage.
+ */
+void usage(const char *prog) {
+    fprintf(stderr,
+        "Usage: %s [-e engines | -t threads [-l layout] [-f]] [-y syncs] [-j jmin[:jmax]] [-s log2size] [-q depth] [-p path] [harness options]\n"
+        "  -e engines  Comma list of stdio,write,pwritev,direct,mmap,uring or all (default stdio)\n"
+        "  -y syncs    Comma list of none,fsync,fdatasync or all (default none)\n"
+        "  -j range    Buffer sizes 2^j, step 2 (default 20)\n"
+        "  -s log2size File size 2^s bytes (default 30)\n"
+        "  -q depth    io_uring queue depth (default 8)\n"
+        "  -t threads  Comma list of writer thread counts, runs the concurrent pwrite benchmark\n"
+        "  -l layout   files (one file per thread) or shared (disjoint regions of one file)\n"
+        "  -f          Preallocate the files with fallocate before writing\n"
+        BENCH_USAGE,
+        prog);
+}
+
+
+
 /**
  * Main.
+ *
+ * Prints one result per grid point (engine, sync, i, j), see bench_print().
  */
-int main() {
+int main(int argc, char *argv[]) {
     // Test file path
-    const char path[] = "./test_file.txt";
-
-    for (int j = 20; j < 21; j = j + 2) {
-        //prinf("Running test with buffer size = %d\n", j);
-        for (int i = 6; i <= j; i = i + 2) {
-            //printf("Running test with chunk size = %d and buffer size = %d\n", i, j);
-
-            // Start timer, call create_test_file, stop timer
-            struct timeval start, end;
-            gettimeofday(&start, NULL);
-            for (int ii = 0; ii < 3; ii++) {
-                delete_old_test_file(path);
-                create_test_file(path, i, j);
+    const char *path = "./test_file.txt";
+    const char *engine_list = "stdio";
+    const char *sync_list = "none";
+    const char *thread_list = NULL;
+    enum layout layout = LAYOUT_FILES;
+    int preallocate = 0;
+    int jmin = 20, jmax = 20;
+    struct bench_config cfg;
+    bench_config_init(&cfg);
+
+    int opt;
+    while ((opt = getopt(argc, argv, "e:y:j:s:q:p:t:l:f" BENCH_OPTIONS)) != -1) {
+        switch (opt) {
+        case 'e': engine_list = optarg; break;
+        case 'y': sync_list = optarg; break;
+        case 'j':
+            if (sscanf(optarg, "%d:%d", &jmin, &jmax) == 1) jmax = jmin;
+            break;
+        case 's': total_size = (size_t)1 << atoi(optarg); break;
+        case 'q': queue_depth = atoi(optarg); break;
+        case 'p': path = optarg; break;
+        case 't': thread_list = optarg; break;
+        case 'l': layout = strcmp(optarg, "shared") == 0 ? LAYOUT_SHARED : LAYOUT_FILES; break;
+        case 'f': preallocate = 1; break;
+        default:
+            if (bench_parse_option(&cfg, opt, optarg) != 1) {
+                usage(argv[0]);
+                return 1;
             }
-            gettimeofday(&end, NULL);
+        }
+    }
+    if (jmin < 6 || jmax > 20 || jmin > jmax || queue_depth < 1 || queue_depth > MAX_QUEUE_DEPTH
+        || total_size < ((size_t)1 << jmax)) {
+        usage(argv[0]);
+        return 1;
+    }
+    cfg.cache_path = path;
+
+    if (thread_list != NULL) {
+        return run_concurrent(&cfg, path, thread_list, layout, preallocate, sync_list, jmin, jmax);
+    }
 
-            // Calculate time
-            long elapsed = ((end.tv_sec - start.tv_sec) * 1000000L + end.tv_usec) - start.tv_usec;
+    bench_print_header(&cfg, "engine,sync,i,j");
+    for (int e = 0; e < NUM_OF_ENGINES; e++) {
+        if (!bench_in_list(engine_list, engines[e].name)) continue;
+        for (int s = SYNC_NONE; s <= SYNC_FDATASYNC; s++) {
+            if (!bench_in_list(sync_list, sync_names[s])) continue;
+            sync_mode = s;
+            for (int j = jmin; j <= jmax; j = j + 2) {
+                for (int i = 6; i <= j; i = i + 2) {
+                    struct write_point pt = { path, &engines[e], (size_t)1 << i, (size_t)1 << j };
+                    struct bench_result res;
+                    if (bench_run(&cfg, write_point_setup, write_point_run, &pt, &res) != 0) {
+                        fprintf(stderr, "%s: failed at i=%d j=%d, skipping engine\n", engines[e].name, i, j);
+                        j = jmax + 1;
+                        break;
+                    }
 
-            // Print time
-            //printf("Time: %ld\n\n", elapsed / 3);
-            printf("(%d, %d, %ld)\n", i, j, elapsed / 3);
+                    char values[64];
+                    snprintf(values, sizeof(values), "%s,%s,%d,%d", engines[e].name, sync_names[s], i, j);
+                    bench_print(&cfg, "engine,sync,i,j", values, total_size, &res);
+                }
+            }
         }
     }
+    delete_old_test_file(path);
+    return 0;
 }
-
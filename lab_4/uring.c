@@ -0,0 +1,143 @@
+/*
+ * uring.c
+ */
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include "uring.h"
+
+
+
+/**
+ * Set up a ring.
+ *
+ * @param ring: The ring to initialise.
+ * @param entries: Submission queue depth.
+ * @return int: 0 on success, -1 on failure (errno set).
+ */
+int uring_init(struct uring *ring, unsigned entries) {
+    struct io_uring_params p;
+    memset(ring, 0, sizeof(*ring));
+    memset(&p, 0, sizeof(p));
+
+    ring->fd = syscall(__NR_io_uring_setup, entries, &p);
+    if (ring->fd < 0) {
+        return -1;
+    }
+    ring->entries = p.sq_entries;
+
+    // Map the rings and the SQE array
+    ring->sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    ring->cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    ring->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+
+    ring->sq_ptr = mmap(NULL, ring->sq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    ring->cq_ptr = mmap(NULL, ring->cq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+    ring->sqes = mmap(NULL, ring->sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if (ring->sq_ptr == MAP_FAILED || ring->cq_ptr == MAP_FAILED || ring->sqes == MAP_FAILED) {
+        uring_exit(ring);
+        return -1;
+    }
+
+    char *sq = ring->sq_ptr;
+    char *cq = ring->cq_ptr;
+    ring->sq_head = (unsigned *)(sq + p.sq_off.head);
+    ring->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+    ring->sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+    ring->sq_array = (unsigned *)(sq + p.sq_off.array);
+    ring->cq_head = (unsigned *)(cq + p.cq_off.head);
+    ring->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+    ring->cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+    ring->sqe_tail = *ring->sq_tail;
+    return 0;
+}
+
+
+
+/**
+ * Get a free submission queue entry.
+ *
+ * @return The zeroed entry, or NULL if the submission queue is full.
+ */
+struct io_uring_sqe *uring_get_sqe(struct uring *ring) {
+    unsigned head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+    if (ring->sqe_tail - head >= ring->entries) {
+        return NULL;
+    }
+    struct io_uring_sqe *sqe = &ring->sqes[ring->sqe_tail & *ring->sq_mask];
+    ring->sqe_tail++;
+    memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+
+
+/**
+ * Submit every entry handed out since the last submit.
+ *
+ * @param wait_nr: Number of completions to wait for (0 = do not wait).
+ * @return int: Number of entries submitted, -1 on failure (errno set).
+ */
+int uring_submit(struct uring *ring, unsigned wait_nr) {
+    unsigned tail = *ring->sq_tail;
+    unsigned to_submit = ring->sqe_tail - tail;
+    for (; tail != ring->sqe_tail; tail++) {
+        ring->sq_array[tail & *ring->sq_mask] = tail & *ring->sq_mask;
+    }
+    __atomic_store_n(ring->sq_tail, tail, __ATOMIC_RELEASE);
+
+    if (to_submit == 0 && wait_nr == 0) {
+        return 0;
+    }
+    return syscall(__NR_io_uring_enter, ring->fd, to_submit, wait_nr,
+                   wait_nr ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+}
+
+
+
+/**
+ * Pop a completion if there is one.
+ *
+ * @return int: 1 if cqe was filled in, 0 if the completion queue is empty.
+ */
+int uring_peek(struct uring *ring, struct io_uring_cqe *cqe) {
+    unsigned head = *ring->cq_head;
+    if (head == __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) {
+        return 0;
+    }
+    *cqe = ring->cqes[head & *ring->cq_mask];
+    __atomic_store_n(ring->cq_head, head + 1, __ATOMIC_RELEASE);
+    return 1;
+}
+
+
+
+/**
+ * Pop a completion, waiting for one if needed.
+ *
+ * @return int: 0 on success, -1 on failure (errno set).
+ */
+int uring_wait(struct uring *ring, struct io_uring_cqe *cqe) {
+    while (!uring_peek(ring, cqe)) {
+        if (uring_submit(ring, 1) < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+
+
+/**
+ * Tear down a ring.
+ */
+void uring_exit(struct uring *ring) {
+    if (ring->sqes != NULL && ring->sqes != MAP_FAILED) munmap(ring->sqes, ring->sqes_len);
+    if (ring->cq_ptr != NULL && ring->cq_ptr != MAP_FAILED) munmap(ring->cq_ptr, ring->cq_len);
+    if (ring->sq_ptr != NULL && ring->sq_ptr != MAP_FAILED) munmap(ring->sq_ptr, ring->sq_len);
+    if (ring->fd > 0) close(ring->fd);
+    memset(ring, 0, sizeof(*ring));
+}
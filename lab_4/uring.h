@@ -0,0 +1,42 @@
+#ifndef URING_H
+#define URING_H
+
+/*
+ * uring.h
+ *
+ * Minimal io_uring wrapper on top of the raw system calls, so the
+ * benchmarks do not need liburing installed.
+ */
+#include <linux/io_uring.h>
+
+struct uring {
+    int fd;
+    unsigned entries;
+    // Submission queue
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    unsigned sqe_tail;              // Next SQE handed out by uring_get_sqe()
+    struct io_uring_sqe *sqes;
+    // Completion queue
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_cqe *cqes;
+    // Mappings
+    void *sq_ptr;
+    void *cq_ptr;
+    size_t sq_len;
+    size_t cq_len;
+    size_t sqes_len;
+};
+
+int uring_init(struct uring *ring, unsigned entries);
+struct io_uring_sqe *uring_get_sqe(struct uring *ring);
+int uring_submit(struct uring *ring, unsigned wait_nr);
+int uring_peek(struct uring *ring, struct io_uring_cqe *cqe);
+int uring_wait(struct uring *ring, struct io_uring_cqe *cqe);
+void uring_exit(struct uring *ring);
+
+#endif
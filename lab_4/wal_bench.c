@@ -0,0 +1,475 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/uio.h>
+#include "bench.h"
+
+/**
+ * Group-commit write-ahead log benchmark.
+ *
+ * The durability side of task_2: P producer threads each append small
+ * records to a shared log and wait until their record is durable before
+ * appending the next one, as transactions waiting for their commit do.
+ * A committer thread collects the pending records for up to a group-commit
+ * window, writes them in one call and makes them durable with one sync,
+ * so the cost of a sync is shared by every record of the group. Reports
+ * commit throughput against the commit latency the producers saw.
+ *
+ * Command to run: "gcc -O2 wal_bench.c bench.c -o wal_bench -lm -pthread; ./wal_bench -t 1,4,16 -g 0,100,1000 -y all"
+ */
+
+#define MAX_PRODUCERS 256
+#define MAX_RECORD (64 * 1024)
+
+// How a group is made durable.
+enum sync_mode { SYNC_NONE, SYNC_FSYNC, SYNC_FDATASYNC, SYNC_DSYNC, SYNC_RWF_DSYNC };
+const char *sync_names[] = { "none", "fsync", "fdatasync", "dsync", "rwf_dsync" };
+
+// Every record starts with this header, the payload follows.
+struct wal_header {
+    unsigned long long lsn;     // Log offset of the record
+    unsigned int len;           // Payload bytes
+    unsigned int producer;
+};
+
+// One producer thread.
+struct producer {
+    pthread_t thread;
+    int id;
+    struct wal *wal;
+    struct bench_hist hist;     // Append to durable, per record
+    int failed;
+};
+
+// The log, passed to the harness as one grid point.
+struct wal {
+    const char *path;
+    enum sync_mode sync_mode;
+    int producers;
+    size_t record;              // Payload bytes per record
+    int records;                // Records per producer
+    double window_us;           // Longest wait for more records before a commit
+    int prewrite;
+
+    int fd;
+    off_t offset;               // Where the next group is written
+    pthread_mutex_t lock;
+    pthread_cond_t appended;    // Signalled to the committer
+    pthread_cond_t durable;     // Broadcast to the producers
+    char *bufs[2];              // Filled by the producers while the other one is written
+    size_t used;
+    int cur;
+    int pending;                // Records in bufs[cur]
+    double first_us;            // When the oldest of them was appended
+    int active;                 // Producers not done yet
+    unsigned long long next_lsn;
+    unsigned long long durable_lsn;
+    int failed;
+
+    // Statistics of the last run
+    unsigned long long groups;
+    unsigned long long committed;
+    struct producer threads[MAX_PRODUCERS];
+};
+
+// Options
+int records_per_producer = 1000;
+size_t record_size = 128;
+
+
+
+/**
+ * Write a whole buffer at an offset.
+ *
+ * Retries short writes, the buffer goes out with one call unless the
+ * kernel returns early.
+ *
+ * @return int: 0 on success, -1 on failure.
+ */
+int pwrite_all(int fd, const char *buf, size_t len, off_t offset, int flags) {
+    while (len > 0) {
+        struct iovec iov = { (void *)buf, len };
+        ssize_t n = flags ? pwritev2(fd, &iov, 1, offset, flags) : pwrite(fd, buf, len, offset);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        buf += n;
+        len -= n;
+        offset += n;
+    }
+    return 0;
+}
+
+
+
+/**
+ * Write a group at the end of the log and make it durable.
+ *
+ * @return int: 0 on success, -1 on failure.
+ */
+int commit_group(struct wal *w, const char *buf, size_t len) {
+    int flags = w->sync_mode == SYNC_RWF_DSYNC ? RWF_DSYNC : 0;
+    if (pwrite_all(w->fd, buf, len, w->offset, flags) != 0) {
+        perror("commit_group: write");
+        return -1;
+    }
+    w->offset += len;
+    int res = 0;
+    if (w->sync_mode == SYNC_FSYNC) res = fsync(w->fd);
+    if (w->sync_mode == SYNC_FDATASYNC) res = fdatasync(w->fd);
+    if (res == -1) perror("commit_group: sync");
+    return res;
+}
+
+
+
+/**
+ * Absolute CLOCK_MONOTONIC time of a bench_now_us() value.
+ */
+struct timespec monotonic_at(double us) {
+    struct timespec ts;
+    ts.tv_sec = (time_t)(us / 1e6);
+    ts.tv_nsec = (long)((us - ts.tv_sec * 1e6) * 1e3);
+    if (ts.tv_nsec >= 1000000000L) {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000L;
+    }
+    return ts;
+}
+
+
+
+/**
+ * Committer thread: write out groups until every producer is done.
+ *
+ * A group is closed when the window since its oldest record has passed,
+ * or earlier once every producer still running has a record in it, since
+ * none of them can append another one before the commit. With a window
+ * of 0 a group is whatever was appended during the previous commit.
+ */
+void *committer_thread(void *arg) {
+    struct wal *w = arg;
+
+    pthread_mutex_lock(&w->lock);
+    for (;;) {
+        while (w->pending == 0 && w->active > 0) {
+            pthread_cond_wait(&w->appended, &w->lock);
+        }
+        if (w->pending == 0) {
+            break;
+        }
+        struct timespec deadline = monotonic_at(w->first_us + w->window_us);
+        while (w->pending < w->active && bench_now_us() < w->first_us + w->window_us) {
+            pthread_cond_timedwait(&w->appended, &w->lock, &deadline);
+        }
+
+        char *buf = w->bufs[w->cur];
+        size_t len = w->used;
+        int records = w->pending;
+        unsigned long long lsn = w->next_lsn;
+        w->cur ^= 1;
+        w->used = 0;
+        w->pending = 0;
+        pthread_mutex_unlock(&w->lock);
+
+        int res = commit_group(w, buf, len);
+
+        pthread_mutex_lock(&w->lock);
+        if (res != 0) {
+            w->failed = 1;
+            pthread_cond_broadcast(&w->durable);
+            break;
+        }
+        w->durable_lsn = lsn;
+        w->groups++;
+        w->committed += records;
+        pthread_cond_broadcast(&w->durable);
+    }
+    pthread_mutex_unlock(&w->lock);
+    return NULL;
+}
+
+
+
+/**
+ * Producer thread: append records one at a time and wait for each commit.
+ */
+void *producer_thread(void *arg) {
+    struct producer *p = arg;
+    struct wal *w = p->wal;
+    size_t len = sizeof(struct wal_header) + w->record;
+
+    for (int k = 0; k < w->records; k++) {
+        double t0 = bench_now_us();
+        pthread_mutex_lock(&w->lock);
+        if (w->failed) {
+            pthread_mutex_unlock(&w->lock);
+            p->failed = 1;
+            break;
+        }
+        char *rec = w->bufs[w->cur] + w->used;
+        struct wal_header h = { w->next_lsn, w->record, p->id };
+        memcpy(rec, &h, sizeof(h));
+        memset(rec + sizeof(h), 'A' + p->id % 26, w->record);
+        w->used += len;
+        w->next_lsn += len;
+        unsigned long long lsn = w->next_lsn;
+        if (w->pending++ == 0) {
+            w->first_us = t0;
+        }
+        pthread_cond_signal(&w->appended);
+
+        while (w->durable_lsn < lsn && !w->failed) {
+            pthread_cond_wait(&w->durable, &w->lock);
+        }
+        pthread_mutex_unlock(&w->lock);
+        bench_hist_add(&p->hist, (bench_now_us() - t0) * 1000);
+    }
+
+    pthread_mutex_lock(&w->lock);
+    w->active--;
+    pthread_cond_signal(&w->appended);
+    pthread_mutex_unlock(&w->lock);
+    return NULL;
+}
+
+
+
+/**
+ * Harness setup: create the log file and reset the state, untimed.
+ *
+ * With prewrite the file is filled with zeros and synced first, as a
+ * log that recycles its segments would be, so that the commits overwrite
+ * allocated blocks and fdatasync has no size or extent change to log.
+ */
+int wal_setup(void *arg) {
+    struct wal *w = arg;
+    size_t len = sizeof(struct wal_header) + w->record;
+    size_t total = len * w->records * w->producers;
+
+    if (w->fd >= 0) {
+        close(w->fd);
+    }
+    remove(w->path);
+    int flags = O_WRONLY | O_CREAT | O_TRUNC | (w->sync_mode == SYNC_DSYNC ? O_DSYNC : 0);
+    if ((w->fd = open(w->path, flags, 0644)) == -1) {
+        perror("wal_setup: open");
+        return -1;
+    }
+    if (w->prewrite) {
+        char *zeros = calloc(1, 1 << 20);
+        int res = zeros == NULL ? -1 : 0;
+        for (size_t done = 0; res == 0 && done < total; done += 1 << 20) {
+            size_t n = total - done < (1 << 20) ? total - done : (1 << 20);
+            res = pwrite_all(w->fd, zeros, n, done, 0);
+        }
+        free(zeros);
+        if (res != 0 || fsync(w->fd) != 0) {
+            perror("wal_setup: prewrite");
+            return -1;
+        }
+    }
+
+    w->offset = 0;
+    w->used = 0;
+    w->cur = 0;
+    w->pending = 0;
+    w->active = w->producers;
+    w->next_lsn = 0;
+    w->durable_lsn = 0;
+    w->failed = 0;
+    w->groups = 0;
+    w->committed = 0;
+    for (int k = 0; k < w->producers; k++) {
+        memset(&w->threads[k], 0, sizeof(w->threads[k]));
+        w->threads[k].id = k;
+        w->threads[k].wal = w;
+    }
+    return 0;
+}
+
+
+
+/**
+ * Harness body: run the committer and the producers until all records are durable.
+ */
+int wal_run(void *arg) {
+    struct wal *w = arg;
+    pthread_t committer;
+    int res = 0;
+
+    if (pthread_create(&committer, NULL, committer_thread, w) != 0) {
+        fprintf(stderr, "wal_run: Error: Cannot start the committer\n");
+        exit(1);
+    }
+    for (int k = 0; k < w->producers; k++) {
+        if (pthread_create(&w->threads[k].thread, NULL, producer_thread, &w->threads[k]) != 0) {
+            fprintf(stderr, "wal_run: Error: Cannot start producer %d\n", k);
+            exit(1);
+        }
+    }
+    for (int k = 0; k < w->producers; k++) {
+        pthread_join(w->threads[k].thread, NULL);
+        res |= -w->threads[k].failed;
+    }
+    pthread_join(committer, NULL);
+    return res | -w->failed;
+}
+
+
+
+/**
+ * Print one grid point.
+ *
+ * Group counts and commit latencies are those of the last timed run,
+ * throughput is over the median wall time of the point.
+ */
+void wal_print(const struct bench_config *cfg, const char *keys, struct wal *w,
+               const struct bench_result *res) {
+    struct bench_hist all;
+    memset(&all, 0, sizeof(all));
+    for (int k = 0; k < w->producers; k++) {
+        bench_hist_merge(&all, &w->threads[k].hist);
+    }
+    double secs = res->wall_us.median / 1e6;
+    double commits = secs > 0 ? w->committed / secs : 0;
+    double groups = secs > 0 ? w->groups / secs : 0;
+    double per_group = w->groups > 0 ? (double)w->committed / w->groups : 0;
+
+    char values[256];
+    snprintf(values, sizeof(values), "%s,%d,%.0f,%zu,%.0f,%.0f,%.2f,%.1f,%.1f,%.1f,%.1f",
+             sync_names[w->sync_mode], w->producers, w->window_us, w->record, commits, groups, per_group,
+             bench_hist_percentile(&all, 50) / 1000, bench_hist_percentile(&all, 99) / 1000,
+             bench_hist_percentile(&all, 99.9) / 1000, all.max_ns / 1000);
+    bench_print(cfg, keys, values, (double)w->offset, res);
+}
+
+
+
+/**
+ * Print usage.
+ */
+void usage(const char *prog) {
+    fprintf(stderr,
+        "Usage: %s [-t producers] [-g windows] [-y syncs] [-s bytes] [-n records] [-f] [-p path] [harness options]\n"
+        "  -t producers Comma list of producer thread counts (default 1,4,16)\n"
+        "  -g windows   Comma list of group-commit windows in microseconds (default 0,100,1000)\n"
+        "  -y syncs     Comma list of none,fsync,fdatasync,dsync,rwf_dsync or all (default fdatasync)\n"
+        "  -s bytes     Record payload size (default 128)\n"
+        "  -n records   Records per producer (default 1000)\n"
+        "  -f           Fill the log with zeros and sync it before each run\n"
+        BENCH_USAGE
+        "dsync opens the log with O_DSYNC, rwf_dsync passes RWF_DSYNC to each pwritev2().\n",
+        prog);
+}
+
+
+
+/**
+ * Main.
+ *
+ * Prints one result per grid point (sync, producers, window), see bench_print().
+ */
+int main(int argc, char *argv[]) {
+    const char *path = "./wal_test.log";
+    const char *producer_list = "1,4,16";
+    const char *window_list = "0,100,1000";
+    const char *sync_list = "fdatasync";
+    int prewrite = 0;
+    struct bench_config cfg;
+    bench_config_init(&cfg);
+
+    int opt;
+    while ((opt = getopt(argc, argv, "t:g:y:s:n:fp:" BENCH_OPTIONS)) != -1) {
+        switch (opt) {
+        case 't': producer_list = optarg; break;
+        case 'g': window_list = optarg; break;
+        case 'y': sync_list = optarg; break;
+        case 's': record_size = atol(optarg); break;
+        case 'n': records_per_producer = atoi(optarg); break;
+        case 'f': prewrite = 1; break;
+        case 'p': path = optarg; break;
+        default:
+            if (bench_parse_option(&cfg, opt, optarg) != 1) {
+                usage(argv[0]);
+                return 1;
+            }
+        }
+    }
+    if (record_size < 1 || record_size > MAX_RECORD || records_per_producer < 1) {
+        usage(argv[0]);
+        return 1;
+    }
+    cfg.cache_path = path;
+
+    struct wal *w = calloc(1, sizeof(*w));
+    if (w == NULL) {
+        perror("main");
+        return 1;
+    }
+    w->path = path;
+    w->record = record_size;
+    w->records = records_per_producer;
+    w->prewrite = prewrite;
+    w->fd = -1;
+    pthread_mutex_init(&w->lock, NULL);
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&w->appended, &attr);
+    pthread_cond_init(&w->durable, NULL);
+
+    const char *keys = "sync,producers,window_us,record,commits_per_s,groups_per_s,records_per_group,"
+                       "lat_p50_us,lat_p99_us,lat_p999_us,lat_max_us";
+    bench_print_header(&cfg, keys);
+    int status = 0;
+    for (int s = SYNC_NONE; s <= SYNC_RWF_DSYNC && status == 0; s++) {
+        if (!bench_in_list(sync_list, sync_names[s])) continue;
+        w->sync_mode = s;
+        for (const char *t = producer_list; *t && status == 0; t += strcspn(t, ",") + (t[strcspn(t, ",")] == ',')) {
+            w->producers = atoi(t);
+            if (w->producers < 1 || w->producers > MAX_PRODUCERS) {
+                fprintf(stderr, "main: Error: producer count must be 1-%d\n", MAX_PRODUCERS);
+                status = 1;
+                break;
+            }
+            // Each producer has at most one record in flight
+            size_t cap = w->producers * (sizeof(struct wal_header) + w->record);
+            free(w->bufs[0]);
+            free(w->bufs[1]);
+            w->bufs[0] = malloc(cap);
+            w->bufs[1] = malloc(cap);
+            if (w->bufs[0] == NULL || w->bufs[1] == NULL) {
+                perror("main");
+                status = 1;
+                break;
+            }
+            for (const char *g = window_list; *g; g += strcspn(g, ",") + (g[strcspn(g, ",")] == ',')) {
+                w->window_us = atof(g);
+                struct bench_result res;
+                if (bench_run(&cfg, wal_setup, wal_run, w, &res) != 0) {
+                    fprintf(stderr, "%s: failed with %d producers, window %.0f us\n",
+                            sync_names[s], w->producers, w->window_us);
+                    continue;
+                }
+                wal_print(&cfg, keys, w, &res);
+            }
+        }
+    }
+
+    if (w->fd >= 0) {
+        close(w->fd);
+    }
+    remove(path);
+    free(w->bufs[0]);
+    free(w->bufs[1]);
+    free(w);
+    return status;
+}
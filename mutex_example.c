@@ -7,9 +7,15 @@
 #include <linux/delay.h>
 #include <linux/mutex.h>
 #include <linux/kthread.h>
+#include <linux/sched/task.h>
+#include "seminar/example_mutex/lockprof.h"
 
 static DEFINE_MUTEX(mutex);
 
+// Read with "cat /sys/kernel/debug/lockprof_mutex_example/thread_{1,2}"
+static struct lockprof_site thread_1_site = LOCKPROF_SITE("thread_1");
+static struct lockprof_site thread_2_site = LOCKPROF_SITE("thread_2");
+
 static struct task_struct *thread1;
 static struct task_struct *thread2;
 
@@ -19,10 +25,10 @@ int thread_2(void *arg);
 int thread_1(void *arg)
 {
     pr_info("In thread 1 \n");
-    while (!mutex_trylock(&mutex)) continue;
+    lockprof_mutex_spin_lock(&thread_1_site, &mutex);
     pr_info("Thread 1: mutex is locked\n");
     msleep(3000);
-    mutex_unlock(&mutex);
+    lockprof_mutex_unlock(&thread_1_site, &mutex);
     pr_info("Thread 1: mutex is unlocked\n");
     return 0;
 }
@@ -30,10 +36,10 @@ int thread_1(void *arg)
 int thread_2(void *arg)
 {
     pr_info("In thread 2 \n");
-    while (!mutex_trylock(&mutex)) continue;
+    lockprof_mutex_spin_lock(&thread_2_site, &mutex);
     pr_info("Thread 2: mutex is locked\n");
     msleep(1000);
-    mutex_unlock(&mutex);
+    lockprof_mutex_unlock(&thread_2_site, &mutex);
     pr_info("Thread 2: mutex is unlocked\n");
     return 0;
 }
@@ -45,14 +51,20 @@ static int __init mutex_example_init(void){
     
 
     pr_info("mutex_example started\n");
+
+    lockprof_init();
+    if (lockprof_register(&thread_1_site) || lockprof_register(&thread_2_site))
+        goto ERROR_LOCKPROF;
     
     thread1 = kthread_create(thread_1 , NULL, "Thread1");
     if (IS_ERR(thread1))
         goto ERROR_THREAD_1;
+    get_task_struct(thread1);   // Kept for kthread_stop() in exit, the thread may be gone by then
 
     thread2 = kthread_create(thread_2, NULL, "Thread2");
     if (IS_ERR(thread2))
         goto ERROR_THREAD_2;
+    get_task_struct(thread2);
 
     wake_up_process(thread1);
     wake_up_process(thread2);
@@ -60,11 +72,14 @@ static int __init mutex_example_init(void){
     return 0;
 
     ERROR_THREAD_2:
-        kthread_stop(thread2);
         pr_err("Failed to create thread 2\n");
-    ERROR_THREAD_1:
         kthread_stop(thread1);
+        put_task_struct(thread1);
+        goto ERROR_LOCKPROF;
+    ERROR_THREAD_1:
         pr_err("Failed to create thread 1\n");
+    ERROR_LOCKPROF:
+        lockprof_exit();
     return -1;
 
 
@@ -94,6 +109,13 @@ static int __init mutex_example_init(void){
 }
 
 static void __exit mutex_example_exit(void){
+    // The threads may still be sleeping in their profiled section, wait for
+    // them before the counters are freed
+    kthread_stop(thread1);
+    kthread_stop(thread2);
+    put_task_struct(thread1);
+    put_task_struct(thread2);
+    lockprof_exit();
     pr_info("mutex_example exit\n");
 }
 
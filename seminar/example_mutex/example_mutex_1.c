@@ -7,8 +7,10 @@ MODULE_IMPORT_NS(mutex_lock);
 #include <linux/module.h>
 #include <linux/mutex.h>
 #include <linux/printk.h>
+#include "lockprof.h"
 
 static DEFINE_MUTEX(shared_mutex);
+static struct lockprof_site init_site = LOCKPROF_SITE("init");
 struct mutex *get_shared_mutex(void)
 {
     return &shared_mutex;
@@ -18,9 +20,19 @@ EXPORT_SYMBOL(get_shared_mutex);
 static int __init example_mutex_init(void)
 {
 
+    int ret;
+
     pr_info("example_mutex_1 init\n");
 
-    while(mutex_trylock(&shared_mutex) != 0) continue;
+    lockprof_init();
+    ret = lockprof_register(&init_site);
+    if (ret) {
+        pr_err("example_mutex_1 Failed to register the lockprof site\n");
+        lockprof_exit();
+        return ret;
+    }
+
+    lockprof_mutex_spin_lock(&init_site, &shared_mutex);
     
     pr_info("example_mutex_1 is locked\n");
 
@@ -34,8 +46,9 @@ static void __exit example_mutex_exit(void)
 {
 
     // Unlocks mutex, other module have to wait 
-    mutex_unlock(&shared_mutex);
+    lockprof_mutex_unlock(&init_site, &shared_mutex);
     pr_info("example_mutex_1 is unlocked\n");
+    lockprof_exit();
     pr_info("example_mutex_1 exit\n");
 }
 
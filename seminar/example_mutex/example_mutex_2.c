@@ -7,6 +7,10 @@ MODULE_IMPORT_NS(mutex_lock);
 #include <linux/module.h>
 #include <linux/mutex.h>
 #include <linux/printk.h>
+#include "lockprof.h"
+
+static struct lockprof_site init_site = LOCKPROF_SITE("init");
+static struct mutex *held_mutex;
 
 extern struct mutex *get_shared_mutex(void);
 
@@ -27,18 +31,33 @@ static int __init example_mutex_init(void)
 
     pr_info("example_mutex_2 init\n");
 
-    while(mutex_trylock(shared_mutex) != 0) continue;
-    
-    pr_info("example_mutex_2 is locked\n");
+    lockprof_init();
+    if (lockprof_register(&init_site)) {
+        pr_err("example_mutex_2 Failed to register the lockprof site\n");
+        lockprof_exit();
+        return -1;
+    }
 
-    if (mutex_is_locked(shared_mutex) == 0)
-        pr_info("The example_mutex_2 failed to lock!\n");
+    // One attempt, counted as contended while example_mutex_1 holds the
+    // mutex. Waiting here would never end: example_mutex_1 keeps it until it
+    // is unloaded, which this module's use of its symbol prevents.
+    if (lockprof_mutex_trylock(&init_site, shared_mutex)) {
+        held_mutex = shared_mutex;
+        pr_info("example_mutex_2 is locked\n");
+    } else {
+        pr_info("example_mutex_2 found the mutex locked\n");
+    }
 
     return 0;
 }
 
 static void __exit example_mutex_exit(void)
 {
+    if (held_mutex) {
+        lockprof_mutex_unlock(&init_site, held_mutex);
+        pr_info("example_mutex_2 is unlocked\n");
+    }
+    lockprof_exit();
     pr_info("example_mutex_2 exit\n");
 }
 
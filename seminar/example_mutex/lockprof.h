@@ -0,0 +1,289 @@
+#ifndef LOCKPROF_H
+#define LOCKPROF_H
+
+/*
+ * lockprof.h
+ *
+ * Contention profiling for the mutex examples. Every place that takes a
+ * lock is a site (struct lockprof_site); the lockprof_mutex_*() wrappers
+ * record per site, into per-CPU counters and histograms:
+ *
+ * - wait time: from the first attempt to holding the lock
+ * - hold time: from holding the lock to unlocking it
+ * - contention: acquisitions that found the lock taken
+ *
+ * Each module gets a debugfs directory, one file per site:
+ *
+ *   cat /sys/kernel/debug/lockprof_<module>/<site>
+ *
+ * Usage:
+ *
+ *   static struct lockprof_site site = LOCKPROF_SITE("thread_1");
+ *   init:   lockprof_init(); lockprof_register(&site);
+ *   thread: lockprof_mutex_lock(&site, &mutex); ... lockprof_mutex_unlock(&site, &mutex);
+ *   exit:   lockprof_exit();
+ *
+ * The histograms are log-linear with the bucket layout of the userspace
+ * stats.h, so module and userspace percentiles compare directly.
+ */
+#include <linux/debugfs.h>
+#include <linux/ktime.h>
+#include <linux/log2.h>
+#include <linux/mutex.h>
+#include <linux/percpu.h>
+#include <linux/processor.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
+
+#define LOCKPROF_SUB 8                          // Sub-buckets per power of two
+#define LOCKPROF_BUCKETS (62 * LOCKPROF_SUB)
+#define LOCKPROF_MAX_SITES 16
+
+struct lockprof_cpu {
+    u64 acquisitions;
+    u64 contended;
+    u64 wait_max;
+    u64 hold_max;
+    u64 wait[LOCKPROF_BUCKETS];
+    u64 hold[LOCKPROF_BUCKETS];
+};
+
+struct lockprof_site {
+    const char *name;
+    struct lockprof_cpu __percpu *cpus;
+    u64 acquired_ns;                            // Only written by the holder
+};
+
+#define LOCKPROF_SITE(site_name) { .name = site_name }
+
+static struct dentry *lockprof_dir;
+static struct lockprof_site *lockprof_sites[LOCKPROF_MAX_SITES];
+static int lockprof_num_sites;
+
+
+
+static inline int lockprof_index(u64 v)
+{
+    int e, idx;
+
+    if (v < LOCKPROF_SUB)
+        return v;
+    e = ilog2(v);                               // v is in [2^e, 2^(e+1))
+    idx = (e - 2) * LOCKPROF_SUB + ((v >> (e - 3)) & (LOCKPROF_SUB - 1));
+    return idx < LOCKPROF_BUCKETS ? idx : LOCKPROF_BUCKETS - 1;
+}
+
+
+
+/*
+ * Percentile (0-1000, in tenths of a percent) of a histogram, as the
+ * upper bound of its bucket capped at the max.
+ */
+static u64 lockprof_percentile(const u64 *buckets, u64 count, u64 max_ns, int permille)
+{
+    u64 rank = div_u64(count * permille + 999, 1000);
+    u64 seen = 0;
+    int k;
+
+    if (count == 0)
+        return 0;
+    for (k = 0; k < LOCKPROF_BUCKETS; k++) {
+        seen += buckets[k];
+        if (seen >= rank) {
+            u64 upper = k < LOCKPROF_SUB ? k + 1
+                : (u64)(LOCKPROF_SUB + k % LOCKPROF_SUB + 1) << (k / LOCKPROF_SUB - 1);
+            return min(upper, max_ns);
+        }
+    }
+    return max_ns;
+}
+
+
+
+static void lockprof_print(struct seq_file *m, const char *what, const u64 *buckets, u64 count, u64 max_ns)
+{
+    seq_printf(m, "%s_ns p50 %llu p99 %llu p99.9 %llu max %llu\n", what,
+               lockprof_percentile(buckets, count, max_ns, 500),
+               lockprof_percentile(buckets, count, max_ns, 990),
+               lockprof_percentile(buckets, count, max_ns, 999), max_ns);
+}
+
+
+
+/*
+ * debugfs file of a site: totals, percentiles and a line per CPU.
+ */
+static int lockprof_show(struct seq_file *m, void *v)
+{
+    struct lockprof_site *site = m->private;
+    struct lockprof_cpu *sum;
+    int cpu, k;
+
+    sum = kzalloc(sizeof(*sum), GFP_KERNEL);
+    if (!sum)
+        return -ENOMEM;
+    for_each_possible_cpu(cpu) {
+        struct lockprof_cpu *c = per_cpu_ptr(site->cpus, cpu);
+
+        sum->acquisitions += c->acquisitions;
+        sum->contended += c->contended;
+        sum->wait_max = max(sum->wait_max, c->wait_max);
+        sum->hold_max = max(sum->hold_max, c->hold_max);
+        for (k = 0; k < LOCKPROF_BUCKETS; k++) {
+            sum->wait[k] += c->wait[k];
+            sum->hold[k] += c->hold[k];
+        }
+    }
+
+    seq_printf(m, "site %s\nacquisitions %llu\ncontended %llu\n", site->name,
+               sum->acquisitions, sum->contended);
+    lockprof_print(m, "wait", sum->wait, sum->acquisitions, sum->wait_max);
+    lockprof_print(m, "hold", sum->hold, sum->acquisitions, sum->hold_max);
+    for_each_possible_cpu(cpu) {
+        struct lockprof_cpu *c = per_cpu_ptr(site->cpus, cpu);
+
+        if (c->acquisitions)
+            seq_printf(m, "cpu%d acquisitions %llu contended %llu wait_max_ns %llu hold_max_ns %llu\n",
+                       cpu, c->acquisitions, c->contended, c->wait_max, c->hold_max);
+    }
+    kfree(sum);
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(lockprof);
+
+
+
+/*
+ * Create the debugfs directory of the module. The profile still works
+ * without debugfs, it just cannot be read.
+ */
+static inline int lockprof_init(void)
+{
+    lockprof_dir = debugfs_create_dir("lockprof_" KBUILD_MODNAME, NULL);
+    return 0;
+}
+
+
+
+static inline int lockprof_register(struct lockprof_site *site)
+{
+    if (lockprof_num_sites == LOCKPROF_MAX_SITES)
+        return -ENOSPC;
+    site->cpus = alloc_percpu(struct lockprof_cpu);
+    if (!site->cpus)
+        return -ENOMEM;
+    lockprof_sites[lockprof_num_sites++] = site;
+    debugfs_create_file(site->name, 0444, lockprof_dir, site, &lockprof_fops);
+    return 0;
+}
+
+
+
+static inline void lockprof_exit(void)
+{
+    // Waits for open readers, so the counters can go afterwards
+    debugfs_remove_recursive(lockprof_dir);
+    while (lockprof_num_sites > 0) {
+        struct lockprof_site *site = lockprof_sites[--lockprof_num_sites];
+
+        free_percpu(site->cpus);
+        site->cpus = NULL;
+    }
+}
+
+
+
+/*
+ * Record an acquisition that started at t0, on the current CPU.
+ */
+static inline void lockprof_acquired(struct lockprof_site *site, u64 t0, bool contended)
+{
+    struct lockprof_cpu *c;
+    u64 now = ktime_get_ns();
+
+    site->acquired_ns = now;
+    if (!site->cpus)
+        return;
+    c = get_cpu_ptr(site->cpus);
+    c->acquisitions++;
+    c->contended += contended;
+    c->wait[lockprof_index(now - t0)]++;
+    c->wait_max = max(c->wait_max, now - t0);
+    put_cpu_ptr(site->cpus);
+}
+
+
+
+static inline void lockprof_released(struct lockprof_site *site)
+{
+    struct lockprof_cpu *c;
+    u64 held = ktime_get_ns() - site->acquired_ns;
+
+    if (!site->cpus)
+        return;
+    c = get_cpu_ptr(site->cpus);
+    c->hold[lockprof_index(held)]++;
+    c->hold_max = max(c->hold_max, held);
+    put_cpu_ptr(site->cpus);
+}
+
+
+
+/*
+ * mutex_lock() with profiling: a failed first trylock counts as contended.
+ */
+static inline void lockprof_mutex_lock(struct lockprof_site *site, struct mutex *lock)
+{
+    u64 t0 = ktime_get_ns();
+    bool contended = !mutex_trylock(lock);
+
+    if (contended)
+        mutex_lock(lock);
+    lockprof_acquired(site, t0, contended);
+}
+
+
+
+/*
+ * Busy-wait on mutex_trylock(), as the examples do, with profiling.
+ */
+static inline void lockprof_mutex_spin_lock(struct lockprof_site *site, struct mutex *lock)
+{
+    u64 t0 = ktime_get_ns();
+    bool contended = false;
+
+    while (!mutex_trylock(lock)) {
+        contended = true;
+        cpu_relax();
+    }
+    lockprof_acquired(site, t0, contended);
+}
+
+
+
+/*
+ * mutex_trylock() with profiling: a failure counts as a contended attempt
+ * without an acquisition.
+ */
+static inline int lockprof_mutex_trylock(struct lockprof_site *site, struct mutex *lock)
+{
+    u64 t0 = ktime_get_ns();
+
+    if (mutex_trylock(lock)) {
+        lockprof_acquired(site, t0, false);
+        return 1;
+    }
+    if (site->cpus)
+        this_cpu_inc(site->cpus->contended);
+    return 0;
+}
+
+
+
+static inline void lockprof_mutex_unlock(struct lockprof_site *site, struct mutex *lock)
+{
+    lockprof_released(site);
+    mutex_unlock(lock);
+}
+
+#endif
@@ -0,0 +1,255 @@
+/*
+ * lock_bench.c
+ *
+ * Userspace version of mutex_example.c and example_mutex_{1,2}.c: threads
+ * compete for one lock, and the time to acquire it, throughput and
+ * fairness are measured instead of only logged.
+ *
+ * Every thread loops: acquire, critical section of cs iterations on
+ * shared data, release, then think iterations of private work. Each
+ * point runs for a fixed time.
+ *
+ * With -p, every point is also a lockprof.h site ("lock/threads/cs") and
+ * the wait/hold/contention profile of all points is written as JSON.
+ *
+ * Command to run: "gcc -O2 lock_bench.c lockprof.c -o lock_bench -pthread; ./lock_bench -l all -t 1,2,4,8 -c 0,100,1000"
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <sched.h>
+#include <unistd.h>
+#include "locks.h"
+#include "lockprof.h"
+#include "stats.h"
+
+#define MAX_THREADS 256
+#define SHARED_WORDS 8
+
+// Per-thread state and results
+struct worker {
+    pthread_t thread;
+    int id;
+    struct lock_thread lt;
+    unsigned long long ops;
+    struct hist acquire_ns;         // Time from calling lock() to holding the lock
+} __attribute__((aligned(CACHE_LINE)));
+
+// Data protected by the lock
+struct shared {
+    union lock lock;
+    unsigned long long counter;
+    volatile unsigned long long data[SHARED_WORDS];
+};
+
+// Options
+int duration_ms = 1000;
+int think = 100;
+int pin = 0;
+
+// Current point
+const struct lock_ops *ops;
+struct shared shared;
+int cs_len;
+struct lockprof_site *site;         // NULL unless profiling
+struct lockprof_site **sites;       // Every point's site, freed after the dump
+int num_sites;
+atomic_int start_flag;
+atomic_int stop_flag;
+
+
+
+/**
+ * Worker thread.
+ */
+void *worker_thread(void *arg) {
+    struct worker *w = arg;
+    if (pin) pin_thread(w->id);
+    ops->thread_init(&shared.lock, &w->lt);
+    volatile unsigned long long local = 0;
+
+    while (!atomic_load_explicit(&start_flag, memory_order_acquire)) cpu_relax();
+
+    while (!atomic_load_explicit(&stop_flag, memory_order_relaxed)) {
+        int contended = 0;
+        unsigned long long t0 = site ? lockprof_begin(site, &contended) : now_ns();
+        ops->lock(&shared.lock, &w->lt);
+        if (site) lockprof_acquired(site, t0, contended);
+        hist_add(&w->acquire_ns, now_ns() - t0);
+
+        // Critical section
+        for (int k = 0; k < cs_len; k++) {
+            shared.data[k % SHARED_WORDS]++;
+        }
+        shared.counter++;
+
+        if (site) lockprof_release(site);
+        ops->unlock(&shared.lock, &w->lt);
+        w->ops++;
+
+        // Non-critical section
+        for (int k = 0; k < think; k++) {
+            local++;
+        }
+    }
+    return NULL;
+}
+
+
+
+/**
+ * Run one point: one lock type, thread count and critical section length.
+ *
+ * @return int: 0 on success, -1 if the lock lost an update.
+ */
+int run_point(const struct lock_ops *type, int threads, int cs, int csv, int profile) {
+    static struct worker workers[MAX_THREADS];
+    memset(workers, 0, sizeof(workers));
+    memset(&shared, 0, sizeof(shared));
+    ops = type;
+    cs_len = cs;
+    ops->init(&shared.lock);
+    site = NULL;
+    if (profile) {
+        char name[64];
+        snprintf(name, sizeof(name), "%s/%d/%d", type->name, threads, cs);
+        struct lockprof_site **grown = realloc(sites, (num_sites + 1) * sizeof(*sites));
+        site = malloc(sizeof(*site));
+        if (grown == NULL || site == NULL || lockprof_register(site, name) == -1) {
+            perror("run_point");
+            exit(1);
+        }
+        sites = grown;
+        sites[num_sites++] = site;
+    }
+    atomic_store(&start_flag, 0);
+    atomic_store(&stop_flag, 0);
+
+    for (int k = 0; k < threads; k++) {
+        workers[k].id = k;
+        if (pthread_create(&workers[k].thread, NULL, worker_thread, &workers[k]) != 0) {
+            fprintf(stderr, "run_point: Error: Cannot start thread %d\n", k);
+            exit(1);
+        }
+    }
+    unsigned long long start = now_ns();
+    atomic_store_explicit(&start_flag, 1, memory_order_release);
+    usleep(duration_ms * 1000);
+    atomic_store(&stop_flag, 1);
+
+    struct hist all;
+    memset(&all, 0, sizeof(all));
+    unsigned long long total = 0, min_ops = ~0ULL, max_ops = 0;
+    double sum_sq = 0;
+    for (int k = 0; k < threads; k++) {
+        pthread_join(workers[k].thread, NULL);
+        hist_merge(&all, &workers[k].acquire_ns);
+        total += workers[k].ops;
+        sum_sq += (double)workers[k].ops * workers[k].ops;
+        if (workers[k].ops < min_ops) min_ops = workers[k].ops;
+        if (workers[k].ops > max_ops) max_ops = workers[k].ops;
+        if (type->thread_init == clh_thread_init) free(workers[k].lt.clh_mine);
+    }
+    double elapsed = (now_ns() - start) / 1e9;
+    if (type->init == clh_init) free(atomic_load(&shared.lock.clh_tail));
+    if (type->init == mutex_init) pthread_mutex_destroy(&shared.lock.mutex);
+
+    // Jain's fairness index: 1 = every thread got the same share, 1/n = one thread got everything
+    double jain = sum_sq > 0 ? (double)total * total / (threads * sum_sq) : 0;
+    double spread = max_ops > 0 ? (double)min_ops / max_ops : 0;
+
+    printf(csv ? "%s,%d,%d,%.0f,%.4f,%.4f,%llu,%llu,%llu,%llu\n"
+               : "(%s, %d, %d, %.0f, %.4f, %.4f, %llu, %llu, %llu, %llu)\n",
+           type->name, threads, cs, total / elapsed, jain, spread,
+           hist_percentile(&all, 50), hist_percentile(&all, 99), hist_percentile(&all, 99.9), all.max);
+    fflush(stdout);
+
+    if (shared.counter != total) {
+        fprintf(stderr, "%s: Error: counter %llu != %llu acquisitions\n", type->name, shared.counter, total);
+        return -1;
+    }
+    return 0;
+}
+
+
+
+/**
+ * Print usage.
+ */
+void usage(const char *prog) {
+    fprintf(stderr,
+        "Usage: %s [-l locks] [-t threads] [-c cs] [-n think] [-d ms] [-a] [-o text|csv] [-p file]\n"
+        "  -l locks    Comma list of mutex,trylock,spin,ticket,mcs,clh,futex or all (default all)\n"
+        "  -t threads  Comma list of thread counts (default 1,2,4)\n"
+        "  -c cs       Comma list of critical section lengths in iterations (default 0,100,1000)\n"
+        "  -n think    Iterations of private work between acquisitions (default 100)\n"
+        "  -d ms       Duration of every point (default 1000)\n"
+        "  -a          Pin threads to CPUs round-robin\n"
+        "  -p file     Write the lock profile of every point as JSON (- for stdout)\n"
+        "Output: (lock, threads, cs, ops/s, jain fairness, min/max ops, acquire p50, p99, p99.9, max ns)\n",
+        prog);
+}
+
+
+
+int main(int argc, char *argv[]) {
+    const char *lock_list = "all";
+    const char *thread_list = "1,2,4";
+    const char *cs_list = "0,100,1000";
+    const char *profile_path = NULL;
+    int csv = 0;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "l:t:c:n:d:ao:p:")) != -1) {
+        switch (opt) {
+        case 'l': lock_list = optarg; break;
+        case 't': thread_list = optarg; break;
+        case 'c': cs_list = optarg; break;
+        case 'n': think = atoi(optarg); break;
+        case 'd': duration_ms = atoi(optarg); break;
+        case 'a': pin = 1; break;
+        case 'o': csv = strcmp(optarg, "csv") == 0; break;
+        case 'p': profile_path = optarg; break;
+        default: usage(argv[0]); return 1;
+        }
+    }
+    if (duration_ms < 1 || think < 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (csv) {
+        printf("lock,threads,cs,ops_per_s,jain,min_max,acquire_p50_ns,acquire_p99_ns,acquire_p999_ns,acquire_max_ns\n");
+    }
+    int res = 0;
+    for (int l = 0; l < NUM_OF_LOCK_TYPES; l++) {
+        if (!in_list(lock_list, lock_types[l].name)) continue;
+        for (const char *t = thread_list; *t; t += strcspn(t, ",") + (t[strcspn(t, ",")] == ',')) {
+            int threads = atoi(t);
+            if (threads < 1 || threads > MAX_THREADS) {
+                fprintf(stderr, "Thread count must be 1-%d\n", MAX_THREADS);
+                return 1;
+            }
+            for (const char *c = cs_list; *c; c += strcspn(c, ",") + (c[strcspn(c, ",")] == ',')) {
+                res |= run_point(&lock_types[l], threads, atoi(c), csv, profile_path != NULL);
+            }
+        }
+    }
+
+    if (profile_path != NULL) {
+        FILE *f = strcmp(profile_path, "-") == 0 ? stdout : fopen(profile_path, "w");
+        if (f == NULL || lockprof_dump_json(f) == -1) {
+            perror(profile_path);
+            return 1;
+        }
+        if (f != stdout) fclose(f);
+        lockprof_unregister_all();
+        for (int k = 0; k < num_sites; k++) {
+            free(sites[k]);
+        }
+        free(sites);
+    }
+    return res ? 1 : 0;
+}
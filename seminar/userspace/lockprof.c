@@ -0,0 +1,122 @@
+/*
+ * lockprof.c
+ */
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "lockprof.h"
+
+static pthread_mutex_t sites_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct lockprof_site *sites;     // In registration order
+
+
+
+/**
+ * Set up a site and add it to the dump.
+ *
+ * @param name: Copied, unique names keep the dump readable.
+ * @return int: 0 on success, -1 on failure.
+ */
+int lockprof_register(struct lockprof_site *site, const char *name) {
+    memset(site, 0, sizeof(*site));
+    site->num_cpus = sysconf(_SC_NPROCESSORS_CONF);
+    if (site->num_cpus < 1) site->num_cpus = 1;
+    site->name = strdup(name);
+    site->cpus = aligned_alloc(64, site->num_cpus * sizeof(*site->cpus));
+    if (site->name == NULL || site->cpus == NULL) {
+        free(site->name);
+        free(site->cpus);
+        return -1;
+    }
+    memset(site->cpus, 0, site->num_cpus * sizeof(*site->cpus));
+
+    pthread_mutex_lock(&sites_lock);
+    struct lockprof_site **p = &sites;
+    while (*p != NULL) p = &(*p)->next;
+    *p = site;
+    pthread_mutex_unlock(&sites_lock);
+    return 0;
+}
+
+
+
+/**
+ * Free the counters of every site, the sites themselves belong to the caller.
+ */
+void lockprof_unregister_all(void) {
+    pthread_mutex_lock(&sites_lock);
+    while (sites != NULL) {
+        struct lockprof_site *site = sites;
+        sites = site->next;
+        free(site->name);
+        free(site->cpus);
+        site->name = NULL;
+        site->cpus = NULL;
+    }
+    pthread_mutex_unlock(&sites_lock);
+}
+
+
+
+/**
+ * Write the percentiles of the per-CPU histograms of a site, merged.
+ */
+static void dump_hist(FILE *f, const char *what, atomic_ullong *const buckets[], int num_cpus, unsigned long long max) {
+    static struct hist h;
+    memset(&h, 0, sizeof(h));
+    for (int cpu = 0; cpu < num_cpus; cpu++) {
+        for (int k = 0; k < HIST_BUCKETS; k++) {
+            h.buckets[k] += atomic_load_explicit(&buckets[cpu][k], memory_order_relaxed);
+        }
+    }
+    for (int k = 0; k < HIST_BUCKETS; k++) h.count += h.buckets[k];
+    h.max = max;
+    fprintf(f, "\"%s_ns\": {\"p50\": %llu, \"p99\": %llu, \"p999\": %llu, \"max\": %llu}", what,
+            hist_percentile(&h, 50), hist_percentile(&h, 99), hist_percentile(&h, 99.9), max);
+}
+
+
+
+/**
+ * Write the profile of every site as one JSON object.
+ *
+ * @return int: 0 on success, -1 if the write failed.
+ */
+int lockprof_dump_json(FILE *f) {
+    pthread_mutex_lock(&sites_lock);
+    fprintf(f, "{\"sites\": [");
+    for (struct lockprof_site *site = sites; site != NULL; site = site->next) {
+        unsigned long long acquisitions = 0, contended = 0, wait_max = 0, hold_max = 0;
+        atomic_ullong *wait[site->num_cpus], *hold[site->num_cpus];
+        for (int cpu = 0; cpu < site->num_cpus; cpu++) {
+            struct lockprof_cpu *c = &site->cpus[cpu];
+            acquisitions += atomic_load(&c->acquisitions);
+            contended += atomic_load(&c->contended);
+            if (atomic_load(&c->wait_max) > wait_max) wait_max = atomic_load(&c->wait_max);
+            if (atomic_load(&c->hold_max) > hold_max) hold_max = atomic_load(&c->hold_max);
+            wait[cpu] = c->wait;
+            hold[cpu] = c->hold;
+        }
+
+        fprintf(f, "%s\n  {\"name\": \"%s\", \"acquisitions\": %llu, \"contended\": %llu, ",
+                site == sites ? "" : ",", site->name, acquisitions, contended);
+        dump_hist(f, "wait", wait, site->num_cpus, wait_max);
+        fprintf(f, ", ");
+        dump_hist(f, "hold", hold, site->num_cpus, hold_max);
+        fprintf(f, ", \"cpus\": [");
+        int first = 1;
+        for (int cpu = 0; cpu < site->num_cpus; cpu++) {
+            struct lockprof_cpu *c = &site->cpus[cpu];
+            if (atomic_load(&c->acquisitions) == 0 && atomic_load(&c->contended) == 0) continue;
+            fprintf(f, "%s{\"cpu\": %d, \"acquisitions\": %llu, \"contended\": %llu}", first ? "" : ", ",
+                    cpu, (unsigned long long)atomic_load(&c->acquisitions),
+                    (unsigned long long)atomic_load(&c->contended));
+            first = 0;
+        }
+        fprintf(f, "]}");
+    }
+    fprintf(f, "\n]}\n");
+    pthread_mutex_unlock(&sites_lock);
+    return ferror(f) ? -1 : 0;
+}
@@ -0,0 +1,122 @@
+#ifndef USER_LOCKPROF_H
+#define USER_LOCKPROF_H
+
+/*
+ * lockprof.h
+ *
+ * Userspace version of seminar/example_mutex/lockprof.h: wait time, hold
+ * time and contention per lock site, in per-CPU counters and histograms
+ * (same bucket layout as stats.h). Instead of debugfs, the profile of
+ * every registered site is written as JSON by lockprof_dump_json().
+ *
+ * Any lock can be wrapped:
+ *
+ *   unsigned long long t0 = lockprof_begin(&site, &contended);
+ *   lock(...);
+ *   lockprof_acquired(&site, t0, contended);
+ *   ...
+ *   lockprof_release(&site);
+ *   unlock(...);
+ *
+ * An acquisition is contended when the lock was held when it started.
+ * For pthread mutexes lockprof_mutex_lock() tells that exactly with a
+ * trylock first.
+ */
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include "stats.h"
+
+struct lockprof_cpu {
+    atomic_ullong acquisitions;
+    atomic_ullong contended;
+    atomic_ullong wait_max;
+    atomic_ullong hold_max;
+    atomic_ullong wait[HIST_BUCKETS];
+    atomic_ullong hold[HIST_BUCKETS];
+} __attribute__((aligned(64)));
+
+struct lockprof_site {
+    char *name;
+    int num_cpus;
+    struct lockprof_cpu *cpus;
+    atomic_int held;
+    unsigned long long acquired_ns;     // Only written by the holder
+    struct lockprof_site *next;
+};
+
+int lockprof_register(struct lockprof_site *site, const char *name);
+void lockprof_unregister_all(void);
+int lockprof_dump_json(FILE *f);
+
+
+
+static inline struct lockprof_cpu *lockprof_this_cpu(struct lockprof_site *site) {
+    int cpu = sched_getcpu();
+    return &site->cpus[cpu >= 0 ? cpu % site->num_cpus : 0];
+}
+
+static inline void lockprof_max(atomic_ullong *max, unsigned long long v) {
+    unsigned long long old = atomic_load_explicit(max, memory_order_relaxed);
+    while (v > old && !atomic_compare_exchange_weak_explicit(max, &old, v, memory_order_relaxed, memory_order_relaxed)) continue;
+}
+
+
+
+/**
+ * Start an acquisition.
+ *
+ * @param contended: Set to 1 if the lock is held right now.
+ * @return Start time for lockprof_acquired().
+ */
+static inline unsigned long long lockprof_begin(struct lockprof_site *site, int *contended) {
+    *contended = atomic_load_explicit(&site->held, memory_order_relaxed);
+    return now_ns();
+}
+
+
+
+/**
+ * Record an acquisition that started at t0, on the current CPU.
+ */
+static inline void lockprof_acquired(struct lockprof_site *site, unsigned long long t0, int contended) {
+    unsigned long long now = now_ns();
+    atomic_store_explicit(&site->held, 1, memory_order_relaxed);
+    site->acquired_ns = now;
+    struct lockprof_cpu *c = lockprof_this_cpu(site);
+    atomic_fetch_add_explicit(&c->acquisitions, 1, memory_order_relaxed);
+    if (contended) atomic_fetch_add_explicit(&c->contended, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&c->wait[hist_index(now - t0)], 1, memory_order_relaxed);
+    lockprof_max(&c->wait_max, now - t0);
+}
+
+
+
+/**
+ * Record the hold time, call before unlocking.
+ */
+static inline void lockprof_release(struct lockprof_site *site) {
+    unsigned long long held = now_ns() - site->acquired_ns;
+    atomic_store_explicit(&site->held, 0, memory_order_relaxed);
+    struct lockprof_cpu *c = lockprof_this_cpu(site);
+    atomic_fetch_add_explicit(&c->hold[hist_index(held)], 1, memory_order_relaxed);
+    lockprof_max(&c->hold_max, held);
+}
+
+
+
+static inline void lockprof_mutex_lock(struct lockprof_site *site, pthread_mutex_t *m) {
+    unsigned long long t0 = now_ns();
+    int contended = pthread_mutex_trylock(m) != 0;
+    if (contended) pthread_mutex_lock(m);
+    lockprof_acquired(site, t0, contended);
+}
+
+static inline void lockprof_mutex_unlock(struct lockprof_site *site, pthread_mutex_t *m) {
+    lockprof_release(site);
+    pthread_mutex_unlock(m);
+}
+
+#endif
@@ -0,0 +1,259 @@
+#ifndef LOCKS_H
+#define LOCKS_H
+
+/*
+ * locks.h
+ *
+ * Userspace lock implementations for the lock benchmark. Every lock is
+ * used through struct lock_ops with a per-thread struct lock_thread, which
+ * the queue locks (MCS, CLH) use for their nodes.
+ */
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <limits.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include "stats.h"
+
+#define CACHE_LINE 64
+#define FUTEX_SPIN 100              // Spins before the adaptive futex lock sleeps
+
+// MCS queue node
+struct mcs_node {
+    _Atomic(struct mcs_node *) next;
+    atomic_int locked;
+} __attribute__((aligned(CACHE_LINE)));
+
+// CLH queue node
+struct clh_node {
+    atomic_int locked;
+} __attribute__((aligned(CACHE_LINE)));
+
+// Per-thread lock state
+struct lock_thread {
+    struct mcs_node mcs;
+    struct clh_node *clh_mine;      // Node this thread enqueues next
+    struct clh_node *clh_pred;      // Predecessor, recycled as clh_mine on unlock
+};
+
+// A lock of any kind, padded so two locks never share a cache line.
+union lock {
+    pthread_mutex_t mutex;
+    atomic_int flag;                // spin, futex (0 free, 1 locked, 2 locked with waiters)
+    struct {
+        atomic_uint next;
+        atomic_uint serving;
+    } ticket;
+    _Atomic(struct mcs_node *) mcs_tail;
+    _Atomic(struct clh_node *) clh_tail;
+    char pad[CACHE_LINE];
+} __attribute__((aligned(CACHE_LINE)));
+
+struct lock_ops {
+    const char *name;
+    void (*init)(union lock *l);
+    void (*thread_init)(union lock *l, struct lock_thread *t);
+    void (*lock)(union lock *l, struct lock_thread *t);
+    void (*unlock)(union lock *l, struct lock_thread *t);
+};
+
+
+
+// ============================ PTHREAD MUTEX ============================
+
+static inline void mutex_init(union lock *l) {
+    pthread_mutex_init(&l->mutex, NULL);
+}
+
+static inline void mutex_lock(union lock *l, struct lock_thread *t) {
+    (void)t;
+    pthread_mutex_lock(&l->mutex);
+}
+
+static inline void mutex_unlock(union lock *l, struct lock_thread *t) {
+    (void)t;
+    pthread_mutex_unlock(&l->mutex);
+}
+
+/**
+ * trylock-spin.
+ *
+ * The pattern of the kernel examples: while (!mutex_trylock(&mutex)) continue;
+ */
+static inline void trylock_lock(union lock *l, struct lock_thread *t) {
+    (void)t;
+    while (pthread_mutex_trylock(&l->mutex) != 0) continue;
+}
+
+
+
+// ============================ SPINLOCK ============================
+
+static inline void flag_init(union lock *l) {
+    atomic_init(&l->flag, 0);
+}
+
+/**
+ * Test-and-test-and-set spinlock: spin on a plain load so waiters do not
+ * keep stealing the cache line from the owner.
+ */
+static inline void spin_lock(union lock *l, struct lock_thread *t) {
+    (void)t;
+    for (;;) {
+        if (atomic_exchange_explicit(&l->flag, 1, memory_order_acquire) == 0) return;
+        while (atomic_load_explicit(&l->flag, memory_order_relaxed) != 0) cpu_relax();
+    }
+}
+
+static inline void spin_unlock(union lock *l, struct lock_thread *t) {
+    (void)t;
+    atomic_store_explicit(&l->flag, 0, memory_order_release);
+}
+
+
+
+// ============================ TICKET LOCK ============================
+
+static inline void ticket_init(union lock *l) {
+    atomic_init(&l->ticket.next, 0);
+    atomic_init(&l->ticket.serving, 0);
+}
+
+static inline void ticket_lock(union lock *l, struct lock_thread *t) {
+    (void)t;
+    unsigned me = atomic_fetch_add_explicit(&l->ticket.next, 1, memory_order_relaxed);
+    while (atomic_load_explicit(&l->ticket.serving, memory_order_acquire) != me) cpu_relax();
+}
+
+static inline void ticket_unlock(union lock *l, struct lock_thread *t) {
+    (void)t;
+    unsigned s = atomic_load_explicit(&l->ticket.serving, memory_order_relaxed);
+    atomic_store_explicit(&l->ticket.serving, s + 1, memory_order_release);
+}
+
+
+
+// ============================ MCS QUEUE LOCK ============================
+
+static inline void mcs_init(union lock *l) {
+    atomic_init(&l->mcs_tail, NULL);
+}
+
+/**
+ * MCS: every waiter spins on the locked flag of its own node.
+ */
+static inline void mcs_lock(union lock *l, struct lock_thread *t) {
+    struct mcs_node *me = &t->mcs;
+    atomic_store_explicit(&me->next, NULL, memory_order_relaxed);
+    atomic_store_explicit(&me->locked, 1, memory_order_relaxed);
+    struct mcs_node *pred = atomic_exchange_explicit(&l->mcs_tail, me, memory_order_acq_rel);
+    if (pred == NULL) return;
+    atomic_store_explicit(&pred->next, me, memory_order_release);
+    while (atomic_load_explicit(&me->locked, memory_order_acquire)) cpu_relax();
+}
+
+static inline void mcs_unlock(union lock *l, struct lock_thread *t) {
+    struct mcs_node *me = &t->mcs;
+    struct mcs_node *next = atomic_load_explicit(&me->next, memory_order_acquire);
+    if (next == NULL) {
+        struct mcs_node *expected = me;
+        if (atomic_compare_exchange_strong_explicit(&l->mcs_tail, &expected, NULL,
+                                                    memory_order_release, memory_order_relaxed)) {
+            return;
+        }
+        // A successor is between the exchange and linking itself in
+        while ((next = atomic_load_explicit(&me->next, memory_order_acquire)) == NULL) cpu_relax();
+    }
+    atomic_store_explicit(&next->locked, 0, memory_order_release);
+}
+
+
+
+// ============================ CLH QUEUE LOCK ============================
+
+static inline void clh_init(union lock *l) {
+    struct clh_node *dummy = aligned_alloc(CACHE_LINE, sizeof(*dummy));
+    atomic_init(&dummy->locked, 0);
+    atomic_init(&l->clh_tail, dummy);
+}
+
+static inline void clh_thread_init(union lock *l, struct lock_thread *t) {
+    (void)l;
+    t->clh_mine = aligned_alloc(CACHE_LINE, sizeof(*t->clh_mine));
+    atomic_init(&t->clh_mine->locked, 0);
+    t->clh_pred = NULL;
+}
+
+/**
+ * CLH: every waiter spins on the node of its predecessor and takes that
+ * node over on unlock, so nodes migrate between threads.
+ */
+static inline void clh_lock(union lock *l, struct lock_thread *t) {
+    atomic_store_explicit(&t->clh_mine->locked, 1, memory_order_relaxed);
+    t->clh_pred = atomic_exchange_explicit(&l->clh_tail, t->clh_mine, memory_order_acq_rel);
+    while (atomic_load_explicit(&t->clh_pred->locked, memory_order_acquire)) cpu_relax();
+}
+
+static inline void clh_unlock(union lock *l, struct lock_thread *t) {
+    (void)l;
+    struct clh_node *mine = t->clh_mine;
+    t->clh_mine = t->clh_pred;
+    atomic_store_explicit(&mine->locked, 0, memory_order_release);
+}
+
+
+
+// ============================ ADAPTIVE FUTEX MUTEX ============================
+
+static inline long futex(atomic_int *addr, int op, int val) {
+    return syscall(SYS_futex, addr, op, val, NULL, NULL, 0);
+}
+
+/**
+ * Futex mutex (Drepper, "Futexes Are Tricky", mutex 3) that spins
+ * FUTEX_SPIN times before going to sleep.
+ */
+static inline void futex_lock(union lock *l, struct lock_thread *t) {
+    (void)t;
+    int c = 0;
+    for (int k = 0; k < FUTEX_SPIN; k++) {
+        c = 0;
+        if (atomic_compare_exchange_weak_explicit(&l->flag, &c, 1, memory_order_acquire, memory_order_relaxed)) return;
+        cpu_relax();
+    }
+    if (c != 2) c = atomic_exchange_explicit(&l->flag, 2, memory_order_acquire);
+    while (c != 0) {
+        futex(&l->flag, FUTEX_WAIT_PRIVATE, 2);
+        c = atomic_exchange_explicit(&l->flag, 2, memory_order_acquire);
+    }
+}
+
+static inline void futex_unlock(union lock *l, struct lock_thread *t) {
+    (void)t;
+    if (atomic_exchange_explicit(&l->flag, 0, memory_order_release) == 2) {
+        futex(&l->flag, FUTEX_WAKE_PRIVATE, 1);
+    }
+}
+
+
+
+static inline void no_thread_init(union lock *l, struct lock_thread *t) {
+    (void)l;
+    (void)t;
+}
+
+static const struct lock_ops lock_types[] = {
+    { "mutex", mutex_init, no_thread_init, mutex_lock, mutex_unlock },
+    { "trylock", mutex_init, no_thread_init, trylock_lock, mutex_unlock },
+    { "spin", flag_init, no_thread_init, spin_lock, spin_unlock },
+    { "ticket", ticket_init, no_thread_init, ticket_lock, ticket_unlock },
+    { "mcs", mcs_init, no_thread_init, mcs_lock, mcs_unlock },
+    { "clh", clh_init, clh_thread_init, clh_lock, clh_unlock },
+    { "futex", flag_init, no_thread_init, futex_lock, futex_unlock },
+};
+#define NUM_OF_LOCK_TYPES (int)(sizeof(lock_types) / sizeof(lock_types[0]))
+
+#endif
@@ -0,0 +1,299 @@
+/*
+ * pipeline.c
+ */
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include "pipeline.h"
+#include "stats.h"
+
+const char *notify_names[] = { "cond", "eventfd", "futex", "spinpark", "spin" };
+
+
+
+static long futex(atomic_uint *addr, int op, unsigned val) {
+    return syscall(SYS_futex, addr, op, val, NULL, NULL, 0);
+}
+
+
+
+// ============================ COMPLETION ============================
+
+void init_completion(struct completion *x) {
+    atomic_init(&x->done, 0);
+}
+
+
+
+/**
+ * Wake one waiter, or let the next wait_for_completion() pass.
+ */
+void complete(struct completion *x) {
+    unsigned d = atomic_load(&x->done);
+    while (d != UINT_MAX && !atomic_compare_exchange_weak(&x->done, &d, d + 1)) continue;
+    futex(&x->done, FUTEX_WAKE_PRIVATE, 1);
+}
+
+
+
+/**
+ * Wake every waiter, now and in the future.
+ */
+void complete_all(struct completion *x) {
+    atomic_store(&x->done, UINT_MAX);
+    futex(&x->done, FUTEX_WAKE_PRIVATE, INT_MAX);
+}
+
+
+
+/**
+ * Wait until complete() or complete_all() was called, consuming one complete().
+ */
+void wait_for_completion(struct completion *x) {
+    for (;;) {
+        unsigned d = atomic_load(&x->done);
+        if (d == UINT_MAX) return;
+        if (d > 0) {
+            if (atomic_compare_exchange_weak(&x->done, &d, d - 1)) return;
+            continue;
+        }
+        futex(&x->done, FUTEX_WAIT_PRIVATE, 0);
+    }
+}
+
+
+
+// ============================ NOTIFIER ============================
+
+int notifier_init(struct notifier *n, enum notify_kind kind) {
+    memset(n, 0, sizeof(*n));
+    n->kind = kind;
+    n->efd = -1;
+    if (kind == NOTIFY_EVENTFD && (n->efd = eventfd(0, EFD_CLOEXEC | EFD_SEMAPHORE)) == -1) {
+        return -1;
+    }
+    pthread_mutex_init(&n->lock, NULL);
+    pthread_cond_init(&n->cond, NULL);
+    return 0;
+}
+
+
+
+void notifier_destroy(struct notifier *n) {
+    if (n->efd != -1) close(n->efd);
+    pthread_cond_destroy(&n->cond);
+    pthread_mutex_destroy(&n->lock);
+}
+
+
+
+/**
+ * Wait until ready(ctx) is true.
+ *
+ * A sleeper registers in waiters and samples seq before its last check
+ * of ready(), so a notifier_wake() after that check always changes seq
+ * and ends the sleep.
+ */
+void notifier_wait(struct notifier *n, int (*ready)(void *ctx), void *ctx) {
+    int spins = n->kind == NOTIFY_SPIN ? INT_MAX : n->kind == NOTIFY_SPINPARK ? NOTIFY_SPINS : 0;
+    for (int k = 0; k < spins; k++) {
+        if (ready(ctx)) return;
+        cpu_relax();
+    }
+
+    for (;;) {
+        atomic_fetch_add(&n->waiters, 1);
+        unsigned s = atomic_load(&n->seq);
+        if (ready(ctx)) {
+            atomic_fetch_sub(&n->waiters, 1);
+            return;
+        }
+        switch (n->kind) {
+        case NOTIFY_COND:
+            pthread_mutex_lock(&n->lock);
+            while (atomic_load(&n->seq) == s) pthread_cond_wait(&n->cond, &n->lock);
+            pthread_mutex_unlock(&n->lock);
+            break;
+        case NOTIFY_EVENTFD: {
+            // Semaphore mode: every wake lets exactly one read through
+            eventfd_t v;
+            eventfd_read(n->efd, &v);
+            break;
+        }
+        default:
+            futex(&n->seq, FUTEX_WAIT_PRIVATE, s);
+        }
+        atomic_fetch_sub(&n->waiters, 1);
+        if (ready(ctx)) return;
+    }
+}
+
+
+
+/**
+ * Wake a sleeper after making the condition true. Costs no system call
+ * while nobody sleeps.
+ */
+void notifier_wake(struct notifier *n) {
+    if (n->kind == NOTIFY_SPIN) {
+        return;
+    }
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&n->waiters, memory_order_relaxed) == 0) {
+        return;
+    }
+    atomic_fetch_add(&n->seq, 1);
+    switch (n->kind) {
+    case NOTIFY_COND:
+        pthread_mutex_lock(&n->lock);
+        pthread_cond_broadcast(&n->cond);
+        pthread_mutex_unlock(&n->lock);
+        break;
+    case NOTIFY_EVENTFD:
+        eventfd_write(n->efd, 1);
+        break;
+    default:
+        futex(&n->seq, FUTEX_WAKE_PRIVATE, 1);
+    }
+}
+
+
+
+// ============================ QUEUE ============================
+
+/**
+ * Set up a queue.
+ *
+ * @param capacity: Number of items, rounded up to a power of two.
+ * @param mpmc: 0 for one producer and one consumer thread, 1 for many.
+ * @param kind: How threads sleep on a full or empty queue.
+ * @return int: 0 on success, -1 on failure.
+ */
+int queue_init(struct queue *q, unsigned long capacity, int mpmc, enum notify_kind kind) {
+    unsigned long cap = 2;
+    while (cap < capacity) cap <<= 1;
+    memset(q, 0, sizeof(*q));
+    q->mpmc = mpmc;
+    q->mask = cap - 1;
+    if (mpmc) {
+        q->cells = calloc(cap, sizeof(*q->cells));
+        if (q->cells == NULL) return -1;
+        for (unsigned long k = 0; k < cap; k++) atomic_init(&q->cells[k].seq, k);
+    } else {
+        q->ring = calloc(cap, sizeof(*q->ring));
+        if (q->ring == NULL) return -1;
+    }
+    if (notifier_init(&q->not_empty, kind) == -1 || notifier_init(&q->not_full, kind) == -1) {
+        return -1;
+    }
+    return 0;
+}
+
+
+
+void queue_destroy(struct queue *q) {
+    notifier_destroy(&q->not_empty);
+    notifier_destroy(&q->not_full);
+    free(q->ring);
+    free(q->cells);
+}
+
+
+
+static int spsc_try_push(struct queue *q, struct item *it) {
+    unsigned long t = atomic_load_explicit(&q->tail, memory_order_relaxed);
+    if (t - atomic_load_explicit(&q->head, memory_order_acquire) > q->mask) return 0;
+    q->ring[t & q->mask] = *it;
+    atomic_store_explicit(&q->tail, t + 1, memory_order_release);
+    return 1;
+}
+
+static int spsc_try_pop(struct queue *q, struct item *it) {
+    unsigned long h = atomic_load_explicit(&q->head, memory_order_relaxed);
+    if (h == atomic_load_explicit(&q->tail, memory_order_acquire)) return 0;
+    *it = q->ring[h & q->mask];
+    atomic_store_explicit(&q->head, h + 1, memory_order_release);
+    return 1;
+}
+
+/**
+ * Bounded MPMC queue (Vyukov): every cell carries a sequence number that
+ * tells whether it is free for the push or the pop at a position.
+ */
+static int mpmc_try_push(struct queue *q, struct item *it) {
+    unsigned long pos = atomic_load_explicit(&q->tail, memory_order_relaxed);
+    for (;;) {
+        struct mpmc_cell *c = &q->cells[pos & q->mask];
+        long diff = (long)atomic_load_explicit(&c->seq, memory_order_acquire) - (long)pos;
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&q->tail, &pos, pos + 1, memory_order_relaxed, memory_order_relaxed)) {
+                c->item = *it;
+                atomic_store_explicit(&c->seq, pos + 1, memory_order_release);
+                return 1;
+            }
+        } else if (diff < 0) {
+            return 0;
+        } else {
+            pos = atomic_load_explicit(&q->tail, memory_order_relaxed);
+        }
+    }
+}
+
+static int mpmc_try_pop(struct queue *q, struct item *it) {
+    unsigned long pos = atomic_load_explicit(&q->head, memory_order_relaxed);
+    for (;;) {
+        struct mpmc_cell *c = &q->cells[pos & q->mask];
+        long diff = (long)atomic_load_explicit(&c->seq, memory_order_acquire) - (long)(pos + 1);
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&q->head, &pos, pos + 1, memory_order_relaxed, memory_order_relaxed)) {
+                *it = c->item;
+                atomic_store_explicit(&c->seq, pos + q->mask + 1, memory_order_release);
+                return 1;
+            }
+        } else if (diff < 0) {
+            return 0;
+        } else {
+            pos = atomic_load_explicit(&q->head, memory_order_relaxed);
+        }
+    }
+}
+
+static int queue_has_room(void *ctx) {
+    struct queue *q = ctx;
+    return atomic_load(&q->tail) - atomic_load(&q->head) <= q->mask;
+}
+
+static int queue_has_data(void *ctx) {
+    struct queue *q = ctx;
+    return atomic_load(&q->tail) != atomic_load(&q->head);
+}
+
+
+
+/**
+ * Push an item, sleeping while the queue is full.
+ */
+void queue_push(struct queue *q, struct item *it) {
+    it->pushed_ns = now_ns();
+    while (!(q->mpmc ? mpmc_try_push(q, it) : spsc_try_push(q, it))) {
+        notifier_wait(&q->not_full, queue_has_room, q);
+    }
+    notifier_wake(&q->not_empty);
+}
+
+
+
+/**
+ * Pop an item, sleeping while the queue is empty.
+ */
+void queue_pop(struct queue *q, struct item *it) {
+    while (!(q->mpmc ? mpmc_try_pop(q, it) : spsc_try_pop(q, it))) {
+        notifier_wait(&q->not_empty, queue_has_data, q);
+    }
+    notifier_wake(&q->not_full);
+}
@@ -0,0 +1,85 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+/*
+ * pipeline.h
+ *
+ * Building blocks for staged thread pipelines, the userspace version of
+ * the crank -> flywheel chain in completions.c:
+ *
+ * - struct completion: complete(), complete_all(), wait_for_completion()
+ *   with the kernel semantics, on top of a futex
+ * - struct notifier: how a thread sleeps until a queue has room or data
+ *   (condition variable, eventfd, futex, spin-then-park or pure spin)
+ * - struct queue: bounded SPSC ring or MPMC queue of items
+ */
+#include <pthread.h>
+#include <stdatomic.h>
+
+#define PIPE_CACHE_LINE 64
+
+// ============================ COMPLETION ============================
+
+struct completion {
+    atomic_uint done;               // Pending complete() count, UINT_MAX after complete_all()
+};
+
+void init_completion(struct completion *x);
+void complete(struct completion *x);
+void complete_all(struct completion *x);
+void wait_for_completion(struct completion *x);
+
+// ============================ NOTIFIER ============================
+
+enum notify_kind { NOTIFY_COND, NOTIFY_EVENTFD, NOTIFY_FUTEX, NOTIFY_SPINPARK, NOTIFY_SPIN };
+extern const char *notify_names[];
+#define NUM_OF_NOTIFY_KINDS 5
+#define NOTIFY_SPINS 2000           // Spins before a spin-then-park waiter sleeps
+
+struct notifier {
+    enum notify_kind kind;
+    atomic_uint seq __attribute__((aligned(PIPE_CACHE_LINE)));  // Bumped on every wake
+    atomic_int waiters;             // Sleeping (or about to sleep) threads
+    int efd;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+};
+
+int notifier_init(struct notifier *n, enum notify_kind kind);
+void notifier_destroy(struct notifier *n);
+void notifier_wait(struct notifier *n, int (*ready)(void *ctx), void *ctx);
+void notifier_wake(struct notifier *n);
+
+// ============================ QUEUE ============================
+
+// A unit of work flowing through the pipeline.
+struct item {
+    unsigned long long seq;         // ITEM_STOP ends a consumer thread
+    unsigned long long created_ns;  // Set by the source
+    unsigned long long pushed_ns;   // Set on every push, for handoff latency
+};
+#define ITEM_STOP (~0ULL)
+
+struct mpmc_cell {
+    atomic_ulong seq;
+    struct item item;
+};
+
+struct queue {
+    int mpmc;
+    unsigned long mask;
+    // SPSC: head only written by the consumer, tail only by the producer
+    atomic_ulong head __attribute__((aligned(PIPE_CACHE_LINE)));
+    atomic_ulong tail __attribute__((aligned(PIPE_CACHE_LINE)));
+    struct item *ring;
+    struct mpmc_cell *cells;
+    struct notifier not_empty;
+    struct notifier not_full;
+};
+
+int queue_init(struct queue *q, unsigned long capacity, int mpmc, enum notify_kind kind);
+void queue_destroy(struct queue *q);
+void queue_push(struct queue *q, struct item *it);
+void queue_pop(struct queue *q, struct item *it);
+
+#endif
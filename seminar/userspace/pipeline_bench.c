@@ -0,0 +1,243 @@
+/*
+ * pipeline_bench.c
+ *
+ * A staged pipeline in the spirit of completions.c: the threads start
+ * together on a completion, a source stage creates items, middle stages
+ * pass them on (optionally after some work) and a sink stage consumes
+ * them. Neighbouring stages are connected by bounded queues, SPSC when
+ * both sides have one thread and MPMC otherwise, and every signaling
+ * kind of pipeline.h is run in turn.
+ *
+ * Handoff latency is the time an item spent in a queue (push to pop),
+ * end-to-end latency the time from creation in the source to the sink.
+ *
+ * Command to run: "gcc -O2 pipeline_bench.c pipeline.c -o pipeline_bench -pthread; ./pipeline_bench -n 4 -t 1,2"
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "pipeline.h"
+#include "stats.h"
+
+#define MAX_STAGES 16
+#define MAX_STAGE_THREADS 64
+
+struct stage_thread {
+    pthread_t thread;
+    int id;                         // For pinning
+    int stage;
+    unsigned long long items;
+    struct hist handoff_ns;         // Wait of popped items in the input queue
+    struct hist e2e_ns;             // Sink only
+} __attribute__((aligned(64)));
+
+struct stage {
+    int threads;
+    atomic_int live;                // Threads not yet stopped
+    struct queue *in;               // NULL for the source
+    struct queue *out;              // NULL for the sink
+    int next_threads;               // Consumers of out, one ITEM_STOP each
+};
+
+// Options
+unsigned long long item_count = 1000000;
+unsigned long capacity = 256;
+int work_ns = 0;
+int pin = 0;
+
+// Current point
+struct stage stages[MAX_STAGES];
+struct queue queues[MAX_STAGES - 1];
+struct completion start_comp;
+struct completion sink_comp;
+
+
+
+/**
+ * Busy loop standing in for the work of a middle stage.
+ */
+void do_work(void) {
+    if (work_ns == 0) return;
+    unsigned long long end = now_ns() + work_ns;
+    while (now_ns() < end) cpu_relax();
+}
+
+
+
+void *stage_thread(void *arg) {
+    struct stage_thread *t = arg;
+    struct stage *s = &stages[t->stage];
+    if (pin) pin_thread(t->id);
+    wait_for_completion(&start_comp);
+
+    if (s->in == NULL) {
+        struct item it;
+        for (unsigned long long k = 0; k < item_count; k++) {
+            it.seq = k;
+            it.created_ns = now_ns();
+            queue_push(s->out, &it);
+            t->items++;
+        }
+    } else {
+        for (;;) {
+            struct item it;
+            queue_pop(s->in, &it);
+            if (it.seq == ITEM_STOP) break;
+            unsigned long long now = now_ns();
+            hist_add(&t->handoff_ns, now - it.pushed_ns);
+            t->items++;
+            if (s->out == NULL) {
+                hist_add(&t->e2e_ns, now - it.created_ns);
+                continue;
+            }
+            do_work();
+            queue_push(s->out, &it);
+        }
+    }
+
+    // The last thread of a stage to stop passes the stop on, after every
+    // item of its stage is in the queue
+    if (atomic_fetch_sub(&s->live, 1) == 1) {
+        if (s->out != NULL) {
+            struct item stop = { .seq = ITEM_STOP };
+            for (int k = 0; k < s->next_threads; k++) queue_push(s->out, &stop);
+        } else {
+            complete(&sink_comp);
+        }
+    }
+    return NULL;
+}
+
+
+
+/**
+ * Run one point.
+ *
+ * @param kind: Signaling used by every queue.
+ * @param num_stages: Stages including source and sink.
+ * @param middle: Threads in every middle stage.
+ */
+void run_point(enum notify_kind kind, int num_stages, int middle, int csv) {
+    static struct stage_thread threads[MAX_STAGES * MAX_STAGE_THREADS];
+    memset(threads, 0, sizeof(threads));
+    init_completion(&start_comp);
+    init_completion(&sink_comp);
+
+    for (int k = 0; k < num_stages; k++) {
+        stages[k].threads = k == 0 || k == num_stages - 1 ? 1 : middle;
+    }
+    for (int k = 0; k < num_stages; k++) {
+        struct stage *s = &stages[k];
+        atomic_init(&s->live, s->threads);
+        s->in = k == 0 ? NULL : &queues[k - 1];
+        s->out = k == num_stages - 1 ? NULL : &queues[k];
+        s->next_threads = s->out != NULL ? stages[k + 1].threads : 0;
+        if (s->out != NULL && queue_init(s->out, capacity, s->threads > 1 || s->next_threads > 1, kind) == -1) {
+            perror("run_point");
+            exit(1);
+        }
+    }
+
+    int n = 0;
+    for (int k = 0; k < num_stages; k++) {
+        for (int j = 0; j < stages[k].threads; j++, n++) {
+            threads[n].id = n;
+            threads[n].stage = k;
+            if (pthread_create(&threads[n].thread, NULL, stage_thread, &threads[n]) != 0) {
+                fprintf(stderr, "run_point: Error: Cannot start thread %d\n", n);
+                exit(1);
+            }
+        }
+    }
+    unsigned long long start = now_ns();
+    complete_all(&start_comp);
+    wait_for_completion(&sink_comp);
+    double elapsed = (now_ns() - start) / 1e9;
+
+    static struct hist handoff, e2e;
+    memset(&handoff, 0, sizeof(handoff));
+    memset(&e2e, 0, sizeof(e2e));
+    for (int k = 0; k < n; k++) {
+        pthread_join(threads[k].thread, NULL);
+        hist_merge(&handoff, &threads[k].handoff_ns);
+        hist_merge(&e2e, &threads[k].e2e_ns);
+    }
+    for (int k = 0; k < num_stages - 1; k++) {
+        queue_destroy(&queues[k]);
+    }
+
+    printf(csv ? "%s,%d,%d,%lu,%.0f,%llu,%llu,%llu,%llu,%llu\n"
+               : "(%s, %d, %d, %lu, %.0f, %llu, %llu, %llu, %llu, %llu)\n",
+           notify_names[kind], num_stages, middle, capacity, e2e.count / elapsed,
+           hist_percentile(&handoff, 50), hist_percentile(&handoff, 99),
+           hist_percentile(&e2e, 50), hist_percentile(&e2e, 99), hist_percentile(&e2e, 99.9));
+    fflush(stdout);
+}
+
+
+
+/**
+ * Print usage.
+ */
+void usage(const char *prog) {
+    fprintf(stderr,
+        "Usage: %s [-s signals] [-n stages] [-t threads] [-q capacity] [-c items] [-W ns] [-a] [-o text|csv]\n"
+        "  -s signals  Comma list of cond,eventfd,futex,spinpark,spin or all (default all)\n"
+        "  -n stages   Stages including source and sink, 2-%d (default 3)\n"
+        "  -t threads  Comma list of thread counts per middle stage (default 1)\n"
+        "  -q capacity Queue capacity, rounded up to a power of two (default 256)\n"
+        "  -c items    Items sent through the pipeline (default 1000000)\n"
+        "  -W ns       Busy work per item in every middle stage (default 0)\n"
+        "  -a          Pin threads to CPUs round-robin\n"
+        "Output: (signal, stages, middle threads, capacity, items/s,\n"
+        "         handoff p50, p99, end-to-end p50, p99, p99.9 ns)\n",
+        prog, MAX_STAGES);
+}
+
+
+
+int main(int argc, char *argv[]) {
+    const char *signal_list = "all";
+    const char *thread_list = "1";
+    int num_stages = 3;
+    int csv = 0;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "s:n:t:q:c:W:ao:")) != -1) {
+        switch (opt) {
+        case 's': signal_list = optarg; break;
+        case 'n': num_stages = atoi(optarg); break;
+        case 't': thread_list = optarg; break;
+        case 'q': capacity = strtoul(optarg, NULL, 10); break;
+        case 'c': item_count = strtoull(optarg, NULL, 10); break;
+        case 'W': work_ns = atoi(optarg); break;
+        case 'a': pin = 1; break;
+        case 'o': csv = strcmp(optarg, "csv") == 0; break;
+        default: usage(argv[0]); return 1;
+        }
+    }
+    if (num_stages < 2 || num_stages > MAX_STAGES || capacity < 1 || item_count < 1 || work_ns < 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (csv) {
+        printf("signal,stages,middle_threads,capacity,items_per_s,handoff_p50_ns,handoff_p99_ns,e2e_p50_ns,e2e_p99_ns,e2e_p999_ns\n");
+    }
+    for (int k = 0; k < NUM_OF_NOTIFY_KINDS; k++) {
+        if (!in_list(signal_list, notify_names[k])) continue;
+        for (const char *t = thread_list; *t; t += strcspn(t, ",") + (t[strcspn(t, ",")] == ',')) {
+            int middle = atoi(t);
+            if (middle < 1 || middle > MAX_STAGE_THREADS) {
+                fprintf(stderr, "Thread count must be 1-%d\n", MAX_STAGE_THREADS);
+                return 1;
+            }
+            run_point(k, num_stages, middle, csv);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,313 @@
+/*
+ * shared_state.c
+ */
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include "shared_state.h"
+
+#define CACHE_LINE 64
+
+// Config stored as atomics, so the optimistic readers (seqlock, ring)
+// can race with a writer without undefined behaviour.
+struct atomic_config {
+    atomic_ulong version;
+    atomic_ulong words[CONFIG_WORDS];
+};
+
+// RCU reader slot: the epoch a reader started in, 0 when it is outside a read.
+struct reader_slot {
+    atomic_ulong epoch;
+} __attribute__((aligned(CACHE_LINE)));
+
+// A replaced RCU copy waiting until no reader can still hold it.
+struct retired {
+    struct config *config;
+    unsigned long epoch;
+    struct retired *next;
+};
+
+struct ring_slot {
+    atomic_uint seq;                // Odd while a writer fills the slot
+    struct atomic_config data;
+} __attribute__((aligned(CACHE_LINE)));
+
+struct shared_state {
+    pthread_mutex_t writer;         // Serializes writers (and readers too for "mutex")
+    pthread_rwlock_t rwlock;
+    struct config plain;            // mutex, rwlock
+
+    atomic_uint seq __attribute__((aligned(CACHE_LINE)));
+    struct atomic_config seq_data;  // seqlock
+
+    _Atomic(struct config *) current __attribute__((aligned(CACHE_LINE)));
+    atomic_ulong epoch;             // rcu
+    struct retired *retired;
+    struct reader_slot readers[SHARED_MAX_READERS];
+
+    atomic_uint ring_head __attribute__((aligned(CACHE_LINE)));
+    struct ring_slot ring[SHARED_RING_SLOTS];
+};
+
+
+
+/**
+ * Fill a config for a version.
+ */
+void config_make(struct config *c, unsigned long version) {
+    c->version = version;
+    for (int k = 0; k < CONFIG_WORDS; k++) {
+        c->words[k] = version * (k + 1);
+    }
+}
+
+
+
+/**
+ * Check that a copy is not torn.
+ *
+ * @return int: 1 if every word matches the version.
+ */
+int config_valid(const struct config *c) {
+    for (int k = 0; k < CONFIG_WORDS; k++) {
+        if (c->words[k] != c->version * (k + 1)) return 0;
+    }
+    return 1;
+}
+
+
+
+/**
+ * Copy out of an atomic config, word by word.
+ */
+static void load_config(struct atomic_config *src, struct config *dst) {
+    dst->version = atomic_load_explicit(&src->version, memory_order_relaxed);
+    for (int k = 0; k < CONFIG_WORDS; k++) {
+        dst->words[k] = atomic_load_explicit(&src->words[k], memory_order_relaxed);
+    }
+}
+
+
+
+/**
+ * Copy into an atomic config, word by word.
+ */
+static void store_config(struct atomic_config *dst, const struct config *src) {
+    atomic_store_explicit(&dst->version, src->version, memory_order_relaxed);
+    for (int k = 0; k < CONFIG_WORDS; k++) {
+        atomic_store_explicit(&dst->words[k], src->words[k], memory_order_relaxed);
+    }
+}
+
+
+
+/**
+ * Create a shared state holding version 0, usable by every variant.
+ */
+static struct shared_state *shared_create(void) {
+    struct shared_state *s = aligned_alloc(CACHE_LINE, sizeof(*s));
+    if (s == NULL) {
+        return NULL;
+    }
+    memset(s, 0, sizeof(*s));
+    struct config zero;
+    config_make(&zero, 0);
+
+    pthread_mutex_init(&s->writer, NULL);
+    pthread_rwlock_init(&s->rwlock, NULL);
+    s->plain = zero;
+    store_config(&s->seq_data, &zero);
+
+    struct config *first = malloc(sizeof(*first));
+    *first = zero;
+    atomic_init(&s->current, first);
+    atomic_init(&s->epoch, 1);      // 0 marks a reader slot as quiescent
+
+    for (int k = 0; k < SHARED_RING_SLOTS; k++) {
+        store_config(&s->ring[k].data, &zero);
+    }
+    return s;
+}
+
+
+
+static void shared_destroy(struct shared_state *s) {
+    while (s->retired != NULL) {
+        struct retired *r = s->retired;
+        s->retired = r->next;
+        free(r->config);
+        free(r);
+    }
+    free(atomic_load(&s->current));
+    pthread_rwlock_destroy(&s->rwlock);
+    pthread_mutex_destroy(&s->writer);
+    free(s);
+}
+
+
+
+// ============================ MUTEX ============================
+
+static void mutex_read(struct shared_state *s, int reader, struct config *out) {
+    (void)reader;
+    pthread_mutex_lock(&s->writer);
+    *out = s->plain;
+    pthread_mutex_unlock(&s->writer);
+}
+
+static void mutex_write(struct shared_state *s, const struct config *in) {
+    pthread_mutex_lock(&s->writer);
+    s->plain = *in;
+    pthread_mutex_unlock(&s->writer);
+}
+
+
+
+// ============================ RWLOCK ============================
+
+static void rwlock_read(struct shared_state *s, int reader, struct config *out) {
+    (void)reader;
+    pthread_rwlock_rdlock(&s->rwlock);
+    *out = s->plain;
+    pthread_rwlock_unlock(&s->rwlock);
+}
+
+static void rwlock_write(struct shared_state *s, const struct config *in) {
+    pthread_rwlock_wrlock(&s->rwlock);
+    s->plain = *in;
+    pthread_rwlock_unlock(&s->rwlock);
+}
+
+
+
+// ============================ SEQLOCK ============================
+
+/**
+ * Copy under a sequence counter, retrying when a writer was active.
+ */
+static void seq_copy(atomic_uint *seq, struct atomic_config *data, struct config *out) {
+    for (;;) {
+        unsigned s1 = atomic_load_explicit(seq, memory_order_acquire);
+        if (s1 & 1) continue;
+        load_config(data, out);
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(seq, memory_order_relaxed) == s1) return;
+    }
+}
+
+/**
+ * Write under a sequence counter, the caller serializes writers.
+ */
+static void seq_store(atomic_uint *seq, struct atomic_config *data, const struct config *in) {
+    unsigned s = atomic_load_explicit(seq, memory_order_relaxed);
+    atomic_store_explicit(seq, s + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    store_config(data, in);
+    atomic_store_explicit(seq, s + 2, memory_order_release);
+}
+
+static void seqlock_read(struct shared_state *s, int reader, struct config *out) {
+    (void)reader;
+    seq_copy(&s->seq, &s->seq_data, out);
+}
+
+static void seqlock_write(struct shared_state *s, const struct config *in) {
+    pthread_mutex_lock(&s->writer);
+    seq_store(&s->seq, &s->seq_data, in);
+    pthread_mutex_unlock(&s->writer);
+}
+
+
+
+// ============================ RCU ============================
+
+/**
+ * Read through the current pointer.
+ *
+ * The reader announces the epoch it started in, a copy retired in a
+ * later epoch cannot be the one it loaded.
+ */
+static void rcu_read(struct shared_state *s, int reader, struct config *out) {
+    struct reader_slot *slot = &s->readers[reader];
+    atomic_store(&slot->epoch, atomic_load(&s->epoch));
+    struct config *c = atomic_load(&s->current);
+    *out = *c;
+    atomic_store_explicit(&slot->epoch, 0, memory_order_release);
+}
+
+/**
+ * Swap in a new copy and free every retired copy no reader can hold.
+ */
+static void rcu_write(struct shared_state *s, const struct config *in) {
+    struct config *fresh = malloc(sizeof(*fresh));
+    struct retired *r = malloc(sizeof(*r));
+    if (fresh == NULL || r == NULL) {
+        free(fresh);
+        free(r);
+        return;
+    }
+    *fresh = *in;
+
+    pthread_mutex_lock(&s->writer);
+    r->config = atomic_exchange(&s->current, fresh);
+    r->epoch = atomic_fetch_add(&s->epoch, 1) + 1;
+    r->next = s->retired;
+    s->retired = r;
+
+    // Oldest epoch a reader is still in
+    unsigned long oldest = r->epoch;
+    for (int k = 0; k < SHARED_MAX_READERS; k++) {
+        unsigned long e = atomic_load(&s->readers[k].epoch);
+        if (e != 0 && e < oldest) oldest = e;
+    }
+    for (struct retired **p = &s->retired; *p != NULL; ) {
+        if ((*p)->epoch <= oldest) {
+            struct retired *done = *p;
+            *p = done->next;
+            free(done->config);
+            free(done);
+        } else {
+            p = &(*p)->next;
+        }
+    }
+    pthread_mutex_unlock(&s->writer);
+}
+
+
+
+// ============================ RING ============================
+
+/**
+ * Copy the newest published slot. A writer only touches that slot again
+ * after filling SHARED_RING_SLOTS - 1 others, so retries are rare.
+ */
+static void ring_read(struct shared_state *s, int reader, struct config *out) {
+    (void)reader;
+    for (;;) {
+        struct ring_slot *slot = &s->ring[atomic_load_explicit(&s->ring_head, memory_order_acquire)];
+        unsigned s1 = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        if (s1 & 1) continue;
+        load_config(&slot->data, out);
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&slot->seq, memory_order_relaxed) == s1) return;
+    }
+}
+
+static void ring_write(struct shared_state *s, const struct config *in) {
+    pthread_mutex_lock(&s->writer);
+    unsigned next = (atomic_load_explicit(&s->ring_head, memory_order_relaxed) + 1) % SHARED_RING_SLOTS;
+    seq_store(&s->ring[next].seq, &s->ring[next].data, in);
+    atomic_store_explicit(&s->ring_head, next, memory_order_release);
+    pthread_mutex_unlock(&s->writer);
+}
+
+
+
+const struct shared_ops shared_types[] = {
+    { "mutex", shared_create, shared_destroy, mutex_read, mutex_write },
+    { "rwlock", shared_create, shared_destroy, rwlock_read, rwlock_write },
+    { "seqlock", shared_create, shared_destroy, seqlock_read, seqlock_write },
+    { "rcu", shared_create, shared_destroy, rcu_read, rcu_write },
+    { "ring", shared_create, shared_destroy, ring_read, ring_write },
+};
+const int num_of_shared_types = sizeof(shared_types) / sizeof(shared_types[0]);
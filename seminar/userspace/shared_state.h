@@ -0,0 +1,51 @@
+#ifndef SHARED_STATE_H
+#define SHARED_STATE_H
+
+/*
+ * shared_state.h
+ *
+ * Userspace version of the example_mutex_1/2 pattern, where one component
+ * exports state that others share (get_shared_mutex()), with different
+ * ways to keep it consistent:
+ *
+ * - mutex:   one global mutex, as in the modules
+ * - rwlock:  pthread reader-writer lock
+ * - seqlock: readers retry when a write overlapped their copy
+ * - rcu:     readers follow a pointer, writers swap in a new copy and
+ *            free the old one once no reader from an older epoch is left
+ * - ring:    writers publish versions into a ring of slots, readers copy
+ *            the newest one and never wait for a writer
+ *
+ * Writers are serialized among themselves in every variant, readers only
+ * block in mutex and rwlock.
+ */
+#include <stdatomic.h>
+
+#define CONFIG_WORDS 8
+#define SHARED_MAX_READERS 256
+#define SHARED_RING_SLOTS 8
+
+// The shared state: word k always holds version * (k + 1), so a reader
+// can tell a torn copy from a consistent one.
+struct config {
+    unsigned long version;
+    unsigned long words[CONFIG_WORDS];
+};
+
+struct shared_state;
+
+struct shared_ops {
+    const char *name;
+    struct shared_state *(*create)(void);
+    void (*destroy)(struct shared_state *s);
+    void (*read)(struct shared_state *s, int reader, struct config *out);
+    void (*write)(struct shared_state *s, const struct config *in);
+};
+
+extern const struct shared_ops shared_types[];
+extern const int num_of_shared_types;
+
+void config_make(struct config *c, unsigned long version);
+int config_valid(const struct config *c);
+
+#endif
@@ -0,0 +1,192 @@
+/*
+ * shared_state_bench.c
+ *
+ * Read scaling of the shared state variants in shared_state.c. R reader
+ * threads copy the state in a loop while W writer threads replace it,
+ * either now and then (read-mostly) or back to back (write-heavy).
+ *
+ * Command to run: "gcc -O2 shared_state_bench.c shared_state.c -o shared_state_bench -pthread; ./shared_state_bench -r 1,2,4,8"
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "shared_state.h"
+#include "stats.h"
+
+#define MAX_WRITERS 64
+
+enum mix { MIX_READ_MOSTLY, MIX_WRITE_HEAVY };
+const char *mix_names[] = { "read", "write" };
+
+struct worker {
+    pthread_t thread;
+    int id;
+    unsigned long long ops;
+    unsigned long long torn;
+} __attribute__((aligned(64)));
+
+// Options
+int duration_ms = 1000;
+int write_interval_us = 100;    // Pause between writes in the read-mostly mix
+int pin = 0;
+
+// Current point
+const struct shared_ops *ops;
+struct shared_state *state;
+enum mix mix;
+atomic_ulong next_version;
+atomic_int start_flag;
+atomic_int stop_flag;
+
+
+
+void *reader_thread(void *arg) {
+    struct worker *w = arg;
+    struct config c;
+    if (pin) pin_thread(w->id);
+    while (!atomic_load(&start_flag)) cpu_relax();
+    while (!atomic_load_explicit(&stop_flag, memory_order_relaxed)) {
+        ops->read(state, w->id, &c);
+        w->torn += !config_valid(&c);
+        w->ops++;
+    }
+    return NULL;
+}
+
+
+
+void *writer_thread(void *arg) {
+    struct worker *w = arg;
+    struct config c;
+    if (pin) pin_thread(w->id);
+    while (!atomic_load(&start_flag)) cpu_relax();
+    while (!atomic_load_explicit(&stop_flag, memory_order_relaxed)) {
+        config_make(&c, atomic_fetch_add(&next_version, 1));
+        ops->write(state, &c);
+        w->ops++;
+        if (mix == MIX_READ_MOSTLY) usleep(write_interval_us);
+    }
+    return NULL;
+}
+
+
+
+/**
+ * Run one point.
+ *
+ * @return int: 0 on success, -1 if a reader saw a torn copy.
+ */
+int run_point(const struct shared_ops *type, enum mix m, int readers, int writers, int csv) {
+    static struct worker workers[SHARED_MAX_READERS + MAX_WRITERS];
+    memset(workers, 0, sizeof(workers));
+    ops = type;
+    mix = m;
+    state = ops->create();
+    if (state == NULL) {
+        perror("run_point");
+        exit(1);
+    }
+    atomic_store(&next_version, 1);
+    atomic_store(&start_flag, 0);
+    atomic_store(&stop_flag, 0);
+
+    for (int k = 0; k < readers + writers; k++) {
+        workers[k].id = k;
+        if (pthread_create(&workers[k].thread, NULL, k < readers ? reader_thread : writer_thread, &workers[k]) != 0) {
+            fprintf(stderr, "run_point: Error: Cannot start thread %d\n", k);
+            exit(1);
+        }
+    }
+    unsigned long long start = now_ns();
+    atomic_store(&start_flag, 1);
+    usleep(duration_ms * 1000);
+    atomic_store(&stop_flag, 1);
+
+    unsigned long long reads = 0, writes = 0, torn = 0;
+    for (int k = 0; k < readers + writers; k++) {
+        pthread_join(workers[k].thread, NULL);
+        if (k < readers) reads += workers[k].ops;
+        else writes += workers[k].ops;
+        torn += workers[k].torn;
+    }
+    double elapsed = (now_ns() - start) / 1e9;
+    ops->destroy(state);
+
+    printf(csv ? "%s,%s,%d,%d,%.0f,%.0f,%.0f,%llu\n" : "(%s, %s, %d, %d, %.0f, %.0f, %.0f, %llu)\n",
+           type->name, mix_names[m], readers, writers, reads / elapsed, reads / elapsed / readers,
+           writes / elapsed, torn);
+    fflush(stdout);
+    return torn ? -1 : 0;
+}
+
+
+
+/**
+ * Print usage.
+ */
+void usage(const char *prog) {
+    fprintf(stderr,
+        "Usage: %s [-k kinds] [-m mixes] [-r readers] [-w writers] [-i us] [-d ms] [-a] [-o text|csv]\n"
+        "  -k kinds    Comma list of mutex,rwlock,seqlock,rcu,ring or all (default all)\n"
+        "  -m mixes    Comma list of read (read-mostly), write (write-heavy) or all (default all)\n"
+        "  -r readers  Comma list of reader thread counts (default 1,2,4)\n"
+        "  -w writers  Writer threads (default 1)\n"
+        "  -i us       Pause between writes in the read-mostly mix (default 100)\n"
+        "  -d ms       Duration of every point (default 1000)\n"
+        "  -a          Pin threads to CPUs round-robin\n"
+        "Output: (kind, mix, readers, writers, reads/s, reads/s per reader, writes/s, torn reads)\n",
+        prog);
+}
+
+
+
+int main(int argc, char *argv[]) {
+    const char *kind_list = "all";
+    const char *mix_list = "all";
+    const char *reader_list = "1,2,4";
+    int writers = 1;
+    int csv = 0;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "k:m:r:w:i:d:ao:")) != -1) {
+        switch (opt) {
+        case 'k': kind_list = optarg; break;
+        case 'm': mix_list = optarg; break;
+        case 'r': reader_list = optarg; break;
+        case 'w': writers = atoi(optarg); break;
+        case 'i': write_interval_us = atoi(optarg); break;
+        case 'd': duration_ms = atoi(optarg); break;
+        case 'a': pin = 1; break;
+        case 'o': csv = strcmp(optarg, "csv") == 0; break;
+        default: usage(argv[0]); return 1;
+        }
+    }
+    if (writers < 0 || writers > MAX_WRITERS || duration_ms < 1 || write_interval_us < 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (csv) {
+        printf("kind,mix,readers,writers,reads_per_s,reads_per_s_per_reader,writes_per_s,torn\n");
+    }
+    int res = 0;
+    for (int k = 0; k < num_of_shared_types; k++) {
+        if (!in_list(kind_list, shared_types[k].name)) continue;
+        for (int m = MIX_READ_MOSTLY; m <= MIX_WRITE_HEAVY; m++) {
+            if (!in_list(mix_list, mix_names[m])) continue;
+            for (const char *r = reader_list; *r; r += strcspn(r, ",") + (r[strcspn(r, ",")] == ',')) {
+                int readers = atoi(r);
+                if (readers < 1 || readers > SHARED_MAX_READERS) {
+                    fprintf(stderr, "Reader count must be 1-%d\n", SHARED_MAX_READERS);
+                    return 1;
+                }
+                res |= run_point(&shared_types[k], m, readers, writers, csv);
+            }
+        }
+    }
+    return res ? 1 : 0;
+}
@@ -0,0 +1,142 @@
+#ifndef STATS_H
+#define STATS_H
+
+/*
+ * stats.h
+ *
+ * Timing, latency histogram, thread pinning and option list helpers for
+ * the userspace ports of the seminar examples. Needs _GNU_SOURCE.
+ */
+#include <string.h>
+#include <time.h>
+#include <sched.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#define HIST_SUB 8                          // Sub-buckets per power of two
+#define HIST_BUCKETS (62 * HIST_SUB)
+
+// Histogram of integer values, HIST_SUB linear buckets per power of two.
+struct hist {
+    unsigned long long count;
+    unsigned long long max;
+    unsigned long long buckets[HIST_BUCKETS];
+};
+
+
+
+/**
+ * Monotonic time in nanoseconds.
+ */
+static inline unsigned long long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+
+
+/**
+ * Spin-wait hint for busy loops.
+ */
+static inline void cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ __volatile__("yield");
+#endif
+}
+
+
+
+/**
+ * Pin the calling thread to a CPU (round-robin by id).
+ */
+static inline void pin_thread(int id) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(id % sysconf(_SC_NPROCESSORS_ONLN), &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+
+
+/**
+ * Check whether a name is in a comma separated list ("all" matches everything).
+ */
+static inline int in_list(const char *list, const char *name) {
+    if (strcmp(list, "all") == 0) return 1;
+    size_t len = strlen(name);
+    for (const char *p = list; (p = strstr(p, name)) != NULL; p += len) {
+        if ((p == list || p[-1] == ',') && (p[len] == ',' || p[len] == '\0')) return 1;
+    }
+    return 0;
+}
+
+
+
+/**
+ * Bucket of a value (usually nanoseconds).
+ */
+static inline int hist_index(unsigned long long v) {
+    int idx;
+    if (v < HIST_SUB) {
+        idx = v;
+    } else {
+        int e = 63 - __builtin_clzll(v);    // v is in [2^e, 2^(e+1))
+        idx = (e - 2) * HIST_SUB + ((v >> (e - 3)) & (HIST_SUB - 1));
+    }
+    return idx < HIST_BUCKETS ? idx : HIST_BUCKETS - 1;
+}
+
+
+
+/**
+ * Add a value (usually nanoseconds) to a histogram.
+ */
+static inline void hist_add(struct hist *h, unsigned long long v) {
+    h->buckets[hist_index(v)]++;
+    h->count++;
+    if (v > h->max) h->max = v;
+}
+
+
+
+/**
+ * Add the counts of one histogram to another.
+ */
+static inline void hist_merge(struct hist *dst, const struct hist *src) {
+    for (int k = 0; k < HIST_BUCKETS; k++) {
+        dst->buckets[k] += src->buckets[k];
+    }
+    dst->count += src->count;
+    if (src->max > dst->max) dst->max = src->max;
+}
+
+
+
+/**
+ * Percentile of a histogram.
+ *
+ * @param p: The percentile, 0-100.
+ * @return Upper bound of the bucket holding the percentile (capped at the max).
+ */
+static inline unsigned long long hist_percentile(const struct hist *h, double p) {
+    if (h->count == 0) {
+        return 0;
+    }
+    unsigned long long rank = (unsigned long long)(p / 100.0 * h->count + 0.999999);
+    if (rank < 1) rank = 1;
+    unsigned long long seen = 0;
+    for (int k = 0; k < HIST_BUCKETS; k++) {
+        seen += h->buckets[k];
+        if (seen >= rank) {
+            unsigned long long upper = k < HIST_SUB ? (unsigned long long)k + 1
+                : (unsigned long long)(HIST_SUB + k % HIST_SUB + 1) << (k / HIST_SUB - 1);
+            return upper < h->max ? upper : h->max;
+        }
+    }
+    return h->max;
+}
+
+#endif
@@ -0,0 +1,450 @@
+/*
+ * workpool.c
+ */
+#include "workpool.h"
+
+#ifdef __KERNEL__
+#include <linux/module.h>
+#endif
+
+
+
+/*
+ * Signal a batch once for n finished items.
+ */
+static void wp_batch_finished(struct wp_batch *batch, int n)
+{
+    if (batch && n && atomic_sub_and_test(n, &batch->pending))
+        complete(&batch->done);
+}
+
+
+
+/*
+ * Run a list taken from a queue, in submission order. Finished items are
+ * counted per batch and reported when the batch changes or the list ends.
+ */
+static void wp_run(struct wp_worker *w, struct llist_node *list, bool stolen)
+{
+    struct wp_batch *batch = NULL;
+    int finished = 0;
+
+    list = llist_reverse_order(list);
+    while (list) {
+        struct wp_work *work = llist_entry(list, struct wp_work, node);
+        struct wp_batch *b = work->batch;
+
+        // The item may be freed by its function
+        list = list->next;
+        if (b != batch) {
+            wp_batch_finished(batch, finished);
+            batch = b;
+            finished = 0;
+        }
+        work->func(work, w->index);
+        finished++;
+        w->executed++;
+        w->stolen += stolen;
+    }
+    wp_batch_finished(batch, finished);
+}
+
+
+
+/*
+ * Take the whole queue of the next worker that has work.
+ */
+static struct llist_node *wp_steal(struct wp_worker *w)
+{
+    struct wp_pool *pool = w->pool;
+    int k;
+
+    for (k = 1; k < pool->nr_workers; k++) {
+        struct wp_worker *victim = &pool->workers[(w->index + k) % pool->nr_workers];
+        struct llist_node *list;
+
+        if (llist_empty(&victim->queue))
+            continue;
+        list = llist_del_all(&victim->queue);
+        if (list)
+            return list;
+    }
+    return NULL;
+}
+
+
+
+static int wp_worker_fn(void *arg)
+{
+    struct wp_worker *w = arg;
+    struct wp_pool *pool = w->pool;
+
+    while (!atomic_read(&pool->stopping)) {
+        struct llist_node *list = llist_del_all(&w->queue);
+
+        if (list) {
+            wp_run(w, list, false);
+            continue;
+        }
+        list = wp_steal(w);
+        if (list) {
+            wp_run(w, list, true);
+            continue;
+        }
+
+        // Announce idleness before the last look, a submitter either sees
+        // it or its items are seen here
+        atomic_set(&w->idle, 1);
+        atomic_inc(&pool->nr_idle);
+        smp_mb__after_atomic();
+        list = wp_steal(w);
+        if (!list)
+            wp_wait_event(&w->wait, !llist_empty(&w->queue) || atomic_read(&w->kick) ||
+                          atomic_read(&pool->stopping));
+        atomic_dec(&pool->nr_idle);
+        atomic_set(&w->idle, 0);
+        atomic_set(&w->kick, 0);
+        if (list)
+            wp_run(w, list, true);
+    }
+    return 0;
+}
+
+
+
+/*
+ * Wake an idle worker to steal from a busy one.
+ */
+static void wp_kick_idle(struct wp_pool *pool, struct wp_worker *busy)
+{
+    int k;
+
+    if (!atomic_read(&pool->nr_idle))
+        return;
+    for (k = 1; k < pool->nr_workers; k++) {
+        struct wp_worker *w = &pool->workers[(busy->index + k) % pool->nr_workers];
+
+        if (atomic_read(&w->idle) && !atomic_read(&w->kick)) {
+            atomic_set(&w->kick, 1);
+            wp_wake(&w->wait);
+            return;
+        }
+    }
+}
+
+
+
+/*
+ * The online CPUs in increasing order, at most n. In userspace those the
+ * process may run on.
+ *
+ * @return Number of CPUs stored.
+ */
+static int wp_online_cpus(int *cpus, int n)
+{
+    int cpu, k = 0;
+
+#ifdef __KERNEL__
+    for_each_online_cpu(cpu) {
+        if (k == n)
+            break;
+        cpus[k++] = cpu;
+    }
+#else
+    cpu_set_t set;
+
+    if (sched_getaffinity(0, sizeof(set), &set) != 0) {
+        for (cpu = 0; cpu < n; cpu++)
+            cpus[k++] = cpu;
+        return k;
+    }
+    for (cpu = 0; cpu < CPU_SETSIZE && k < n; cpu++) {
+        if (CPU_ISSET(cpu, &set))
+            cpus[k++] = cpu;
+    }
+#endif
+    return k;
+}
+
+
+
+/**
+ * Start a pool, bound round-robin to the online CPUs.
+ *
+ * @param nr_workers: Number of workers, 0 for one per online CPU.
+ * @return The pool, NULL on failure.
+ */
+struct wp_pool *wp_pool_create(int nr_workers)
+{
+    struct wp_pool *pool = wp_calloc(1, sizeof(*pool));
+    int nr_cpus = wp_num_cpus();
+    int *cpus;
+    int cpu, k, next;
+
+    if (!pool)
+        return NULL;
+    cpus = wp_calloc(nr_cpus, sizeof(*cpus));
+    if (cpus)
+        nr_cpus = wp_online_cpus(cpus, nr_cpus);
+    pool->nr_workers = nr_workers > 0 ? nr_workers : nr_cpus;
+    pool->nr_cpu_ids = wp_nr_cpu_ids();
+    pool->workers = wp_calloc(pool->nr_workers, sizeof(*pool->workers));
+    pool->cpu_worker = wp_calloc(pool->nr_cpu_ids, sizeof(*pool->cpu_worker));
+    if (!cpus || nr_cpus < 1 || !pool->workers || !pool->cpu_worker) {
+        wp_free(cpus);
+        wp_free(pool->workers);
+        wp_free(pool->cpu_worker);
+        wp_free(pool);
+        return NULL;
+    }
+    atomic_set(&pool->nr_idle, 0);
+    atomic_set(&pool->stopping, 0);
+
+    // Submitters on a CPU go to the first worker bound to it, CPUs without
+    // a worker (offline at creation or beyond nr_workers) share them in turn
+    for (cpu = 0; cpu < pool->nr_cpu_ids; cpu++)
+        pool->cpu_worker[cpu] = -1;
+    for (k = pool->nr_workers - 1; k >= 0; k--) {
+        pool->workers[k].cpu = cpus[k % nr_cpus];
+        pool->cpu_worker[pool->workers[k].cpu] = k;
+    }
+    for (cpu = 0, next = 0; cpu < pool->nr_cpu_ids; cpu++) {
+        if (pool->cpu_worker[cpu] < 0)
+            pool->cpu_worker[cpu] = next++ % pool->nr_workers;
+    }
+    wp_free(cpus);
+
+    for (k = 0; k < pool->nr_workers; k++) {
+        struct wp_worker *w = &pool->workers[k];
+
+        init_llist_head(&w->queue);
+        wp_wait_init(&w->wait);
+        w->pool = pool;
+        w->index = k;
+        atomic_set(&w->idle, 0);
+        atomic_set(&w->kick, 0);
+    }
+    for (k = 0; k < pool->nr_workers; k++) {
+        struct wp_worker *w = &pool->workers[k];
+
+        if (wp_thread_start(&w->thread, wp_worker_fn, w, w->cpu, "wp_worker/%u") != 0) {
+            pool->nr_workers = k;
+            wp_pool_destroy(pool);
+            return NULL;
+        }
+    }
+    return pool;
+}
+
+
+
+/**
+ * Stop the workers and free the pool. Items still queued are not run,
+ * wait for their batches first.
+ */
+void wp_pool_destroy(struct wp_pool *pool)
+{
+    int k;
+
+    atomic_set(&pool->stopping, 1);
+    for (k = 0; k < pool->nr_workers; k++)
+        wp_wake(&pool->workers[k].wait);
+    for (k = 0; k < pool->nr_workers; k++) {
+        wp_thread_join(pool->workers[k].thread);
+        wp_wait_destroy(&pool->workers[k].wait);
+    }
+    wp_free(pool->workers);
+    wp_free(pool->cpu_worker);
+    wp_free(pool);
+}
+
+
+
+void wp_batch_init(struct wp_batch *batch)
+{
+    atomic_set(&batch->pending, 1);
+    init_completion(&batch->done);
+}
+
+
+
+/**
+ * Wait until every item submitted with the batch ran. A batch can be
+ * submitted in several calls, all before this one.
+ */
+void wp_batch_wait(struct wp_batch *batch)
+{
+    if (!atomic_sub_and_test(1, &batch->pending))
+        wait_for_completion(&batch->done);
+}
+
+
+
+/**
+ * Queue items on a worker with a single atomic operation.
+ *
+ * @param worker: Worker index, -1 for the worker of the current CPU.
+ * @param works: Items to run, in this order.
+ * @param batch: Batch to count the items in, may be NULL.
+ */
+void wp_submit_batch(struct wp_pool *pool, int worker, struct wp_work **works, int n, struct wp_batch *batch)
+{
+    struct wp_worker *w;
+    int k;
+
+    if (n <= 0)
+        return;
+    if (worker < 0) {
+        int cpu = wp_this_cpu();
+
+        worker = cpu < pool->nr_cpu_ids ? pool->cpu_worker[cpu] : cpu;
+    }
+    w = &pool->workers[worker % pool->nr_workers];
+    if (batch)
+        atomic_add(n, &batch->pending);
+
+    // The list is LIFO, chain newest first so wp_run() gets the order back
+    for (k = 0; k < n; k++) {
+        works[k]->batch = batch;
+        works[k]->node.next = k > 0 ? &works[k - 1]->node : NULL;
+    }
+    if (llist_add_batch(&works[n - 1]->node, &works[0]->node, &w->queue)) {
+        if (atomic_read(&w->idle))
+            wp_wake(&w->wait);
+    } else {
+        wp_kick_idle(pool, w);
+    }
+}
+
+
+
+void wp_submit(struct wp_pool *pool, int worker, struct wp_work *work)
+{
+    wp_submit_batch(pool, worker, &work, 1, work->batch);
+}
+
+
+
+// ============================ THREADS ============================
+
+#ifdef __KERNEL__
+
+/**
+ * Start a kthread, bound to a CPU unless cpu is -1.
+ *
+ * @param namefmt: Thread name, %u is replaced by the CPU.
+ * @return int: 0 on success, a negative errno on failure.
+ */
+int wp_thread_start(wp_thread_t *thread, int (*fn)(void *arg), void *arg, int cpu, const char *namefmt)
+{
+    struct task_struct *t;
+
+    if (cpu >= 0)
+        t = kthread_create_on_cpu(fn, arg, cpu, namefmt);
+    else
+        t = kthread_create(fn, arg, "%s", namefmt);
+    if (IS_ERR(t))
+        return PTR_ERR(t);
+    // The thread may return before wp_thread_join(), keep its task_struct
+    get_task_struct(t);
+    wake_up_process(t);
+    *thread = t;
+    return 0;
+}
+
+
+
+void wp_thread_join(wp_thread_t thread)
+{
+    kthread_stop(thread);
+    put_task_struct(thread);
+}
+
+#else
+
+struct wp_start {
+    int (*fn)(void *arg);
+    void *arg;
+    int cpu;
+};
+
+static void *wp_trampoline(void *p)
+{
+    struct wp_start start = *(struct wp_start *)p;
+
+    free(p);
+    if (start.cpu >= 0) {
+        cpu_set_t set;
+
+        CPU_ZERO(&set);
+        CPU_SET(start.cpu, &set);
+        pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    }
+    start.fn(start.arg);
+    return NULL;
+}
+
+
+
+/**
+ * Start a pthread, pinned to a CPU unless cpu is -1.
+ *
+ * @return int: 0 on success, -1 on failure.
+ */
+int wp_thread_start(wp_thread_t *thread, int (*fn)(void *arg), void *arg, int cpu, const char *namefmt)
+{
+    struct wp_start *start = malloc(sizeof(*start));
+
+    (void)namefmt;
+    if (!start)
+        return -1;
+    start->fn = fn;
+    start->arg = arg;
+    start->cpu = cpu;
+    if (pthread_create(thread, NULL, wp_trampoline, start) != 0) {
+        free(start);
+        return -1;
+    }
+    return 0;
+}
+
+
+
+void wp_thread_join(wp_thread_t thread)
+{
+    pthread_join(thread, NULL);
+}
+
+#endif
+
+
+
+#ifdef __KERNEL__
+
+EXPORT_SYMBOL(wp_pool_create);
+EXPORT_SYMBOL(wp_pool_destroy);
+EXPORT_SYMBOL(wp_batch_init);
+EXPORT_SYMBOL(wp_batch_wait);
+EXPORT_SYMBOL(wp_submit_batch);
+EXPORT_SYMBOL(wp_submit);
+EXPORT_SYMBOL(wp_thread_start);
+EXPORT_SYMBOL(wp_thread_join);
+
+static int __init workpool_init(void)
+{
+    pr_info("workpool init\n");
+    return 0;
+}
+
+static void __exit workpool_exit(void)
+{
+    pr_info("workpool exit\n");
+}
+
+module_init(workpool_init);
+module_exit(workpool_exit);
+
+MODULE_DESCRIPTION("Per-CPU worker pool");
+MODULE_LICENSE("GPL");
+
+#endif
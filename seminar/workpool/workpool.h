@@ -0,0 +1,309 @@
+#ifndef WORKPOOL_H
+#define WORKPOOL_H
+
+/*
+ * workpool.h
+ *
+ * Per-CPU worker pool, instead of a kthread per task as in
+ * mutex_example.c and completions.c.
+ *
+ * - One worker thread per online CPU, bound to it (or a given number,
+ *   spread over the online CPUs).
+ * - Every worker has a lock-free submission queue (llist): submitters
+ *   push a whole batch with one cmpxchg, the worker takes everything
+ *   with one xchg and runs it in submission order.
+ * - A worker without work steals the queue of another CPU. Submitting
+ *   to a busy worker kicks an idle one.
+ * - A batch is done when its last item ran, workers count finished
+ *   items per batch and signal the completion once per batch.
+ *
+ * The same source builds as a kernel module (workpool.ko, exporting the
+ * wp_*() API) and as a pthread userspace library; the small compat layer
+ * below maps the kernel primitives for the latter.
+ */
+
+#ifdef __KERNEL__
+
+#include <linux/atomic.h>
+#include <linux/completion.h>
+#include <linux/kthread.h>
+#include <linux/ktime.h>
+#include <linux/llist.h>
+#include <linux/math64.h>
+#include <linux/mm.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+#include <linux/sort.h>
+#include <linux/wait.h>
+
+typedef struct task_struct *wp_thread_t;
+typedef wait_queue_head_t wp_wait_t;
+
+#define wp_log(...) pr_info(__VA_ARGS__)
+#define wp_calloc(n, size) kvcalloc(n, size, GFP_KERNEL)
+#define wp_free(p) kvfree(p)
+#define wp_now_ns() ktime_get_ns()
+#define wp_this_cpu() raw_smp_processor_id()
+#define wp_num_cpus() num_online_cpus()
+#define wp_nr_cpu_ids() nr_cpu_ids
+
+#define wp_sort(base, n, size, cmp) sort(base, n, size, cmp, NULL)
+#define wp_div64(a, b) div64_u64(a, b)
+
+#define wp_wait_init(w) init_waitqueue_head(w)
+#define wp_wait_destroy(w) do { } while (0)
+#define wp_wait_event(w, cond) wait_event_interruptible(*(w), cond)
+#define wp_wake(w) wake_up(w)
+
+#else
+
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+typedef atomic_int atomic_t;
+#define atomic_read(v) atomic_load(v)
+#define atomic_set(v, i) atomic_store(v, i)
+#define atomic_add(i, v) atomic_fetch_add(v, i)
+#define atomic_inc(v) atomic_fetch_add(v, 1)
+#define atomic_dec(v) atomic_fetch_sub(v, 1)
+#define atomic_sub_and_test(i, v) (atomic_fetch_sub(v, i) == (i))
+#define smp_mb__after_atomic() atomic_thread_fence(memory_order_seq_cst)
+
+#define container_of(ptr, type, member) ((type *)((char *)(ptr) - offsetof(type, member)))
+#define llist_entry(ptr, type, member) container_of(ptr, type, member)
+
+// Lock-free list with the semantics of <linux/llist.h>
+struct llist_node {
+    struct llist_node *next;
+};
+
+struct llist_head {
+    _Atomic(struct llist_node *) first;
+};
+
+static inline void init_llist_head(struct llist_head *list)
+{
+    atomic_init(&list->first, NULL);
+}
+
+static inline bool llist_empty(struct llist_head *head)
+{
+    return atomic_load_explicit(&head->first, memory_order_relaxed) == NULL;
+}
+
+/* Add a chain of nodes, returns true if the list was empty. */
+static inline bool llist_add_batch(struct llist_node *new_first, struct llist_node *new_last,
+                                   struct llist_head *head)
+{
+    struct llist_node *first = atomic_load_explicit(&head->first, memory_order_relaxed);
+
+    do {
+        new_last->next = first;
+    } while (!atomic_compare_exchange_weak_explicit(&head->first, &first, new_first,
+                                                     memory_order_seq_cst, memory_order_relaxed));
+    return first == NULL;
+}
+
+static inline bool llist_add(struct llist_node *node, struct llist_head *head)
+{
+    return llist_add_batch(node, node, head);
+}
+
+static inline struct llist_node *llist_del_all(struct llist_head *head)
+{
+    return atomic_exchange_explicit(&head->first, NULL, memory_order_acquire);
+}
+
+static inline struct llist_node *llist_reverse_order(struct llist_node *head)
+{
+    struct llist_node *new_head = NULL;
+
+    while (head) {
+        struct llist_node *next = head->next;
+
+        head->next = new_head;
+        new_head = head;
+        head = next;
+    }
+    return new_head;
+}
+
+// Completion with the kernel semantics
+struct completion {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    unsigned int done;
+};
+
+static inline void init_completion(struct completion *x)
+{
+    pthread_mutex_init(&x->lock, NULL);
+    pthread_cond_init(&x->cond, NULL);
+    x->done = 0;
+}
+
+static inline void complete(struct completion *x)
+{
+    pthread_mutex_lock(&x->lock);
+    x->done++;
+    pthread_cond_signal(&x->cond);
+    pthread_mutex_unlock(&x->lock);
+}
+
+static inline void complete_all(struct completion *x)
+{
+    pthread_mutex_lock(&x->lock);
+    x->done = UINT_MAX / 2;
+    pthread_cond_broadcast(&x->cond);
+    pthread_mutex_unlock(&x->lock);
+}
+
+static inline void wait_for_completion(struct completion *x)
+{
+    pthread_mutex_lock(&x->lock);
+    while (x->done == 0)
+        pthread_cond_wait(&x->cond, &x->lock);
+    x->done--;
+    pthread_mutex_unlock(&x->lock);
+}
+
+typedef pthread_t wp_thread_t;
+
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+} wp_wait_t;
+
+#define wp_log(...) printf(__VA_ARGS__)
+#define wp_free(p) free(p)
+#define wp_sort(base, n, size, cmp) qsort(base, n, size, cmp)
+#define wp_div64(a, b) ((a) / (b))
+#define wp_num_cpus() ((int)sysconf(_SC_NPROCESSORS_ONLN))
+#define wp_nr_cpu_ids() CPU_SETSIZE
+
+/* Zeroed and cache line aligned, like the kernel allocators for struct wp_worker. */
+static inline void *wp_calloc(size_t n, size_t size)
+{
+    size_t bytes = (n * size + 63) & ~(size_t)63;
+    void *p = aligned_alloc(64, bytes ? bytes : 64);
+
+    if (p)
+        memset(p, 0, bytes);
+    return p;
+}
+
+static inline unsigned long long wp_now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static inline int wp_this_cpu(void)
+{
+    int cpu = sched_getcpu();
+
+    return cpu < 0 ? 0 : cpu;
+}
+
+static inline void cpu_relax(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ __volatile__("yield");
+#endif
+}
+
+static inline void wp_wait_init(wp_wait_t *w)
+{
+    pthread_mutex_init(&w->lock, NULL);
+    pthread_cond_init(&w->cond, NULL);
+}
+
+static inline void wp_wait_destroy(wp_wait_t *w)
+{
+    pthread_cond_destroy(&w->cond);
+    pthread_mutex_destroy(&w->lock);
+}
+
+/* The condition is checked under the lock wp_wake() takes, so a wake-up
+ * after the condition became true cannot be lost. */
+#define wp_wait_event(w, condition) do {                    \
+        pthread_mutex_lock(&(w)->lock);                     \
+        while (!(condition))                                \
+            pthread_cond_wait(&(w)->cond, &(w)->lock);      \
+        pthread_mutex_unlock(&(w)->lock);                   \
+    } while (0)
+
+static inline void wp_wake(wp_wait_t *w)
+{
+    pthread_mutex_lock(&w->lock);
+    pthread_cond_broadcast(&w->cond);
+    pthread_mutex_unlock(&w->lock);
+}
+
+#endif /* __KERNEL__ */
+
+// ============================ POOL ============================
+
+struct wp_work;
+typedef void (*wp_func_t)(struct wp_work *work, int worker);
+
+// A batch of work items with one completion.
+struct wp_batch {
+    atomic_t pending;               // Items not yet run, plus 1 until wp_batch_wait()
+    struct completion done;
+};
+
+// A work item, usually embedded in the caller's structure.
+struct wp_work {
+    struct llist_node node;
+    wp_func_t func;
+    struct wp_batch *batch;         // May be NULL
+};
+
+struct wp_worker {
+    struct llist_head queue;
+    struct wp_pool *pool;
+    int index;
+    int cpu;
+    wp_thread_t thread;
+    wp_wait_t wait;
+    atomic_t idle;                  // Sleeping or about to
+    atomic_t kick;                  // Woken to steal
+    unsigned long long executed;
+    unsigned long long stolen;      // Items taken from other queues
+} __attribute__((aligned(64)));
+
+struct wp_pool {
+    int nr_workers;
+    int nr_cpu_ids;
+    int *cpu_worker;                // Worker of each CPU id, CPU ids may be sparse
+    atomic_t nr_idle;
+    atomic_t stopping;
+    struct wp_worker *workers;
+};
+
+struct wp_pool *wp_pool_create(int nr_workers);
+void wp_pool_destroy(struct wp_pool *pool);
+void wp_batch_init(struct wp_batch *batch);
+void wp_batch_wait(struct wp_batch *batch);
+void wp_submit_batch(struct wp_pool *pool, int worker, struct wp_work **works, int n, struct wp_batch *batch);
+void wp_submit(struct wp_pool *pool, int worker, struct wp_work *work);
+
+int wp_thread_start(wp_thread_t *thread, int (*fn)(void *arg), void *arg, int cpu, const char *namefmt);
+void wp_thread_join(wp_thread_t thread);
+
+#endif
@@ -0,0 +1,332 @@
+/*
+ * workpool_bench.c
+ *
+ * Submitted work items per second and scheduling latency (submission to
+ * start of the item) of the worker pool, against a thread per item as in
+ * mutex_example.c and completions.c.
+ *
+ * Submitter threads queue their items in batches on the worker of their
+ * CPU and wait for them with one wp_batch. Every item spins for work_ns.
+ *
+ * Userspace:   "gcc -O2 workpool_bench.c workpool.c -o workpool_bench -pthread; ./workpool_bench -b 1,16,256"
+ * Kernel:      "make; sudo insmod workpool.ko; sudo insmod workpool_bench.ko batches=1,16,256; dmesg"
+ */
+#include "workpool.h"
+
+#ifdef __KERNEL__
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/string.h>
+#else
+#include <stdio.h>
+#include <string.h>
+#endif
+
+#define MAX_SUBMITTERS 64
+
+struct bench_work {
+    struct wp_work work;
+    unsigned long long submit_ns;
+    unsigned long long start_ns;
+};
+
+struct submitter {
+    wp_thread_t thread;
+    struct bench_work *works;
+    struct wp_work **ptrs;
+    int count;
+};
+
+// Options
+static int workers = 0;                 // Pool size, 0 = one worker per online CPU
+static int items = 100000;
+static int submitters = 1;
+static int work_ns = 0;
+static int spawn_items = 1000;         // Items of the thread-per-item run, 0 to skip
+
+// Current run
+static struct wp_pool *pool;
+static struct submitter subs[MAX_SUBMITTERS];
+static struct completion start_comp;
+static int batch_size;
+
+
+
+static void spin(int ns)
+{
+    unsigned long long end = wp_now_ns() + ns;
+
+    while (wp_now_ns() < end)
+        cpu_relax();
+}
+
+
+
+static void bench_func(struct wp_work *work, int worker)
+{
+    struct bench_work *bw = container_of(work, struct bench_work, work);
+
+    (void)worker;
+    bw->start_ns = wp_now_ns();
+    spin(work_ns);
+}
+
+
+
+static int submitter_fn(void *arg)
+{
+    struct submitter *s = arg;
+    struct wp_batch batch;
+    int k, j;
+
+    wait_for_completion(&start_comp);
+    wp_batch_init(&batch);
+    for (k = 0; k < s->count; k += batch_size) {
+        int n = s->count - k < batch_size ? s->count - k : batch_size;
+        unsigned long long now = wp_now_ns();
+
+        for (j = k; j < k + n; j++)
+            s->works[j].submit_ns = now;
+        wp_submit_batch(pool, -1, s->ptrs + k, n, &batch);
+    }
+    wp_batch_wait(&batch);
+    return 0;
+}
+
+
+
+static int cmp_ull(const void *a, const void *b)
+{
+    unsigned long long x = *(const unsigned long long *)a, y = *(const unsigned long long *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+
+
+/*
+ * Print a result line with the latency percentiles of finished items.
+ */
+static void report(const char *mode, int batch, int nsub, struct bench_work *works, int n,
+                   unsigned long long elapsed_ns, unsigned long long stolen)
+{
+    unsigned long long *lat = wp_calloc(n, sizeof(*lat));
+    int k;
+
+    if (!lat)
+        return;
+    for (k = 0; k < n; k++)
+        lat[k] = works[k].start_ns - works[k].submit_ns;
+    wp_sort(lat, n, sizeof(*lat), cmp_ull);
+    wp_log("(%s, %d, %d, %d, %llu, %llu, %llu, %llu, %llu)\n", mode,
+           pool ? pool->nr_workers : 0, nsub, batch,
+           elapsed_ns ? wp_div64(n * 1000000000ULL, elapsed_ns) : 0,
+           lat[n / 2], lat[n - 1 - n / 100], lat[n - 1], stolen);
+    wp_free(lat);
+}
+
+
+
+/*
+ * Run every submitter once with a batch size.
+ */
+static int run_pool(struct bench_work *works, struct wp_work **ptrs, int batch)
+{
+    unsigned long long start, stolen = 0;
+    int k, per = items / submitters;
+
+    batch_size = batch;
+    init_completion(&start_comp);
+    for (k = 0; k < submitters; k++) {
+        struct submitter *s = &subs[k];
+
+        s->works = works + k * per;
+        s->ptrs = ptrs + k * per;
+        s->count = per;
+        if (wp_thread_start(&s->thread, submitter_fn, s, -1, "wp_submitter") != 0) {
+            wp_log("workpool_bench: Error: Cannot start submitter %d\n", k);
+            complete_all(&start_comp);
+            while (k-- > 0)
+                wp_thread_join(subs[k].thread);
+            return -1;
+        }
+    }
+    for (k = 0; k < pool->nr_workers; k++)
+        stolen -= pool->workers[k].stolen;
+    start = wp_now_ns();
+    complete_all(&start_comp);
+    for (k = 0; k < submitters; k++)
+        wp_thread_join(subs[k].thread);
+    start = wp_now_ns() - start;
+    for (k = 0; k < pool->nr_workers; k++)
+        stolen += pool->workers[k].stolen;
+    report("pool", batch, submitters, works, per * submitters, start, stolen);
+    return 0;
+}
+
+
+
+static int spawn_fn(void *arg)
+{
+    bench_func(arg, -1);
+    return 0;
+}
+
+
+
+/*
+ * A thread per item: started one after the other, joined at the end.
+ */
+static int run_spawn(struct bench_work *works)
+{
+    wp_thread_t *threads = wp_calloc(spawn_items, sizeof(*threads));
+    unsigned long long start;
+    int k, n;
+
+    if (!threads)
+        return -1;
+    start = wp_now_ns();
+    for (n = 0; n < spawn_items; n++) {
+        works[n].submit_ns = wp_now_ns();
+        if (wp_thread_start(&threads[n], spawn_fn, &works[n].work, -1, "wp_spawn") != 0)
+            break;
+    }
+    for (k = 0; k < n; k++)
+        wp_thread_join(threads[k]);
+    start = wp_now_ns() - start;
+    wp_free(threads);
+    if (n > 0)
+        report("spawn", 1, 1, works, n, start, 0);
+    return n == spawn_items ? 0 : -1;
+}
+
+
+
+/*
+ * Run the pool for every batch size in a comma separated list, then the
+ * thread-per-item baseline.
+ */
+static int bench(const char *batch_list)
+{
+    struct bench_work *works;
+    struct wp_work **ptrs;
+    const char *b;
+    int k, res = 0;
+    int n = items > spawn_items ? items : spawn_items;
+
+    if (workers < 0 || submitters < 1 || submitters > MAX_SUBMITTERS || items < submitters || work_ns < 0 || spawn_items < 0)
+        return -1;
+    works = wp_calloc(n, sizeof(*works));
+    ptrs = wp_calloc(n, sizeof(*ptrs));
+    pool = wp_pool_create(workers);
+    if (!works || !ptrs || !pool) {
+        wp_log("workpool_bench: Error: Cannot set up the pool\n");
+        res = -1;
+        goto out;
+    }
+    for (k = 0; k < n; k++) {
+        works[k].work.func = bench_func;
+        ptrs[k] = &works[k].work;
+    }
+
+    wp_log("Output: (mode, workers, submitters, batch, items/s, latency p50, p99, max ns, stolen)\n");
+    for (b = batch_list; *b; ) {
+        int batch = 0;
+
+        while (*b >= '0' && *b <= '9')
+            batch = batch * 10 + *b++ - '0';
+        if (*b == ',')
+            b++;
+        else if (*b)
+            batch = 0;
+        if (batch < 1) {
+            res = -1;
+            break;
+        }
+        res |= run_pool(works, ptrs, batch);
+    }
+    if (spawn_items > 0)
+        res |= run_spawn(works);
+
+out:
+    if (pool)
+        wp_pool_destroy(pool);
+    pool = NULL;
+    wp_free(works);
+    wp_free(ptrs);
+    return res;
+}
+
+
+
+#ifdef __KERNEL__
+
+static char *batches = "1,16,256";
+module_param(workers, int, 0444);
+module_param(items, int, 0444);
+module_param(submitters, int, 0444);
+module_param(work_ns, int, 0444);
+module_param(spawn_items, int, 0444);
+module_param(batches, charp, 0444);
+
+static int __init workpool_bench_init(void)
+{
+    pr_info("workpool_bench init\n");
+    return bench(batches) ? -EINVAL : 0;
+}
+
+static void __exit workpool_bench_exit(void)
+{
+    pr_info("workpool_bench exit\n");
+}
+
+module_init(workpool_bench_init);
+module_exit(workpool_bench_exit);
+
+MODULE_DESCRIPTION("Worker pool benchmark");
+MODULE_LICENSE("GPL");
+
+#else
+
+/**
+ * Print usage.
+ */
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+        "Usage: %s [-w workers] [-n items] [-b batches] [-s submitters] [-W ns] [-S items]\n"
+        "  -w workers     Pool size (default 0, one worker per online CPU)\n"
+        "  -n items       Items per pool run (default 100000)\n"
+        "  -b batches     Comma list of items per submission (default 1,16,256)\n"
+        "  -s submitters  Submitter threads (default 1)\n"
+        "  -W ns          Busy work per item (default 0)\n"
+        "  -S items       Items of the thread-per-item run, 0 to skip (default 1000)\n",
+        prog);
+}
+
+
+
+int main(int argc, char *argv[])
+{
+    const char *batch_list = "1,16,256";
+    int opt;
+
+    while ((opt = getopt(argc, argv, "w:n:b:s:W:S:")) != -1) {
+        switch (opt) {
+        case 'w': workers = atoi(optarg); break;
+        case 'n': items = atoi(optarg); break;
+        case 'b': batch_list = optarg; break;
+        case 's': submitters = atoi(optarg); break;
+        case 'W': work_ns = atoi(optarg); break;
+        case 'S': spawn_items = atoi(optarg); break;
+        default: usage(argv[0]); return 1;
+        }
+    }
+    if (bench(batch_list) != 0) {
+        usage(argv[0]);
+        return 1;
+    }
+    return 0;
+}
+
+#endif